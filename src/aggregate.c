@@ -0,0 +1,915 @@
+/**
+ * aggregate.c
+ * Filters and aggregations over the columns of a catalog table.
+ *
+ * Rows are handled 64 at a time, matching a word of the bitmaps that tell
+ * which cells have a value and which rows are wanted. Whole words of rows go
+ * through SSE2 kernels, while the sparse ones only touch the rows that are
+ * set. Large tables are split into chunks of words spread across a thread
+ * pool, each with its own partial results that are merged at the end.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "aggregate.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "error.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+	(defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#	define AGG_SSE2
+#	include <emmintrin.h>
+#endif /* __SSE2__ */
+
+// Number of rows handed out to each task. Must be a multiple of 64.
+#define AGG_CHUNK 65536
+
+// Operation enumeration.
+typedef enum {
+	AGG_EQUALS = 0,
+	AGG_BELOW,
+	AGG_AGGREGATE,
+	AGG_TOP_K
+} agg_op_t;
+
+// Running aggregate of a group.
+typedef struct {
+	size_t count;
+	int64_t isum;
+	int64_t imin;
+	int64_t imax;
+	double fsum;
+	double fmin;
+	double fmax;
+} agg_acc_t;
+
+// Query being run over a table.
+typedef struct {
+	agg_op_t op;
+	pecan_table_t *tbl;
+	pecan_column_t *col;
+	pecan_column_t *group;
+	const uint64_t *in;
+	uint64_t *out;
+
+	uint32_t code;
+	int64_t ilimit;
+	double flimit;
+
+	size_t ngroups;
+	size_t k;
+} agg_query_t;
+
+// Chunk of rows that a task works on.
+typedef struct {
+	agg_query_t *query;
+	size_t first;
+	size_t last;
+
+	agg_acc_t *accs;
+	size_t *top;
+	size_t ntop;
+} agg_job_t;
+
+// Private methods.
+static pecan_err_t agg_run(pecan_pool_t *pool, agg_query_t *query,
+						   agg_job_t **jobs, size_t *njobs);
+static void agg_jobs_free(agg_job_t *jobs, size_t njobs);
+static void agg_task(void *arg);
+static pecan_err_t agg_check(pecan_column_t *col, int numeric);
+static uint64_t agg_mask(agg_query_t *query, size_t word);
+static unsigned int bit_first(uint64_t bits);
+static uint64_t word_equals(const uint32_t *codes, uint32_t code);
+static uint64_t word_cmp(pecan_column_t *col, size_t base, int above,
+						 int64_t ilimit, double flimit);
+static void word_aggregate(pecan_column_t *col, size_t base, agg_acc_t *acc);
+static void acc_init(agg_acc_t *acc);
+static void acc_add(agg_acc_t *acc, pecan_column_t *col, size_t row);
+static void acc_merge(agg_acc_t *acc, agg_acc_t *other, int ints);
+static int top_better(pecan_column_t *col, size_t a, size_t b);
+static void top_push(pecan_column_t *col, size_t *heap, size_t k, size_t *n,
+					 size_t row);
+static void top_sift(pecan_column_t *col, size_t *heap, size_t n, size_t row);
+#ifdef AGG_SSE2
+static __m128i cmpgt_epi64(__m128i a, __m128i b);
+#endif /* AGG_SSE2 */
+
+/**
+ * Picks out the rows of a string column that hold a given value.
+ *
+ * @param  pool Thread pool to spread the work across or NULL to create one
+ *              when the table is large enough.
+ * @param  tbl  Table.
+ * @param  col  String column.
+ * @param  code Dictionary code of the value from pecan_column_code.
+ * @param  in   Bitmap of the rows to consider or NULL for all of them.
+ * @param  out  Bitmap of PECAN_ROWS_WORDS words to receive the matching rows.
+ *              May be the same as the input one.
+ * @return      PECAN_OK if the operation was successful.
+ */
+pecan_err_t pecan_filter_equals(pecan_pool_t *pool, pecan_table_t *tbl,
+								pecan_column_t *col, uint32_t code,
+								const uint64_t *in, uint64_t *out) {
+	agg_query_t query;
+	agg_job_t *jobs;
+	size_t njobs;
+	pecan_err_t err;
+
+	err = agg_check(col, 0);
+	if (err)
+		return err;
+
+	memset(&query, 0, sizeof(agg_query_t));
+	query.op = AGG_EQUALS;
+	query.tbl = tbl;
+	query.col = col;
+	query.in = in;
+	query.out = out;
+	query.code = code;
+
+	err = agg_run(pool, &query, &jobs, &njobs);
+	agg_jobs_free(jobs, njobs);
+	return err;
+}
+
+/**
+ * Picks out the rows of a numeric column whose value is below a limit, such
+ * as the parts that are running low on stock.
+ *
+ * @param  pool  Thread pool to spread the work across or NULL to create one
+ *               when the table is large enough.
+ * @param  tbl   Table.
+ * @param  col   Numeric column.
+ * @param  limit Values must be strictly below this.
+ * @param  in    Bitmap of the rows to consider or NULL for all of them.
+ * @param  out   Bitmap of PECAN_ROWS_WORDS words to receive the matching rows.
+ *               May be the same as the input one.
+ * @return       PECAN_OK if the operation was successful.
+ */
+pecan_err_t pecan_filter_below(pecan_pool_t *pool, pecan_table_t *tbl,
+							   pecan_column_t *col, double limit,
+							   const uint64_t *in, uint64_t *out) {
+	agg_query_t query;
+	agg_job_t *jobs;
+	size_t njobs;
+	pecan_err_t err;
+	double ilimit;
+
+	err = agg_check(col, 1);
+	if (err)
+		return err;
+
+	memset(&query, 0, sizeof(agg_query_t));
+	query.op = AGG_BELOW;
+	query.tbl = tbl;
+	query.col = col;
+	query.in = in;
+	query.out = out;
+	query.flimit = limit;
+
+	// Integers are below a limit when they're below the integer above it.
+	// Keeping it just outside of the range of the column doesn't change the
+	// result and lets the kernels compare by subtracting.
+	ilimit = ceil(limit);
+	if (isnan(limit) || (ilimit < (double)-PECAN_TABLE_MAX_INT)) {
+		query.ilimit = -PECAN_TABLE_MAX_INT;
+	} else if (ilimit > (double)(PECAN_TABLE_MAX_INT + 1)) {
+		query.ilimit = PECAN_TABLE_MAX_INT + 1;
+	} else {
+		query.ilimit = (int64_t)ilimit;
+	}
+
+	err = agg_run(pool, &query, &jobs, &njobs);
+	agg_jobs_free(jobs, njobs);
+	return err;
+}
+
+/**
+ * Aggregates a numeric column, optionally grouped by a string column.
+ *
+ * @param  pool  Thread pool to spread the work across or NULL to create one
+ *               when the table is large enough.
+ * @param  tbl   Table.
+ * @param  value Numeric column to be aggregated.
+ * @param  group String column to group the rows by or NULL for a single group.
+ * @param  match Bitmap of the rows to consider or NULL for all of them.
+ * @param  aggs  Array of PECAN_AGG_GROUPS aggregates, indexed by the
+ *               dictionary code of the group.
+ * @return       PECAN_OK if the operation was successful.
+ */
+pecan_err_t pecan_aggregate(pecan_pool_t *pool, pecan_table_t *tbl,
+							pecan_column_t *value, pecan_column_t *group,
+							const uint64_t *match, pecan_agg_t *aggs) {
+	agg_query_t query;
+	agg_job_t *jobs;
+	size_t njobs;
+	pecan_err_t err;
+	size_t i;
+	size_t j;
+
+	err = agg_check(value, 1);
+	if (err)
+		return err;
+	if (group) {
+		err = agg_check(group, 0);
+		if (err)
+			return err;
+	}
+
+	memset(&query, 0, sizeof(agg_query_t));
+	query.op = AGG_AGGREGATE;
+	query.tbl = tbl;
+	query.col = value;
+	query.group = group;
+	query.in = match;
+	query.ngroups = PECAN_AGG_GROUPS(group);
+
+	err = agg_run(pool, &query, &jobs, &njobs);
+	if (err)
+		goto cleanup;
+
+	// Merge the partial aggregates of every chunk.
+	for (i = 0; i < query.ngroups; i++) {
+		agg_acc_t acc;
+
+		acc_init(&acc);
+		for (j = 0; j < njobs; j++) {
+			acc_merge(&acc, &jobs[j].accs[i],
+					  value->type == PECAN_COLUMN_INT);
+		}
+
+		aggs[i].count = acc.count;
+		if (acc.count == 0) {
+			aggs[i].sum = 0;
+			aggs[i].min = 0;
+			aggs[i].max = 0;
+		} else if (value->type == PECAN_COLUMN_INT) {
+			aggs[i].sum = (double)acc.isum;
+			aggs[i].min = (double)acc.imin;
+			aggs[i].max = (double)acc.imax;
+		} else {
+			aggs[i].sum = acc.fsum;
+			aggs[i].min = acc.fmin;
+			aggs[i].max = acc.fmax;
+		}
+	}
+
+cleanup:
+	agg_jobs_free(jobs, njobs);
+	return err;
+}
+
+/**
+ * Finds the rows with the largest values of a numeric column, such as the
+ * parts we have the most of.
+ *
+ * @param  pool  Thread pool to spread the work across or NULL to create one
+ *               when the table is large enough.
+ * @param  tbl   Table.
+ * @param  value Numeric column to rank the rows by.
+ * @param  match Bitmap of the rows to consider or NULL for all of them.
+ * @param  rows  Array to receive the rows, largest first.
+ * @param  k     Number of rows that fit in the array.
+ * @param  nrows Returns the number of rows in the array.
+ * @return       PECAN_OK if the operation was successful.
+ */
+pecan_err_t pecan_top_k(pecan_pool_t *pool, pecan_table_t *tbl,
+						pecan_column_t *value, const uint64_t *match,
+						size_t *rows, size_t k, size_t *nrows) {
+	agg_query_t query;
+	agg_job_t *jobs;
+	size_t njobs;
+	pecan_err_t err;
+	size_t i;
+	size_t j;
+
+	*nrows = 0;
+	err = agg_check(value, 1);
+	if (err || (k == 0))
+		return err;
+
+	memset(&query, 0, sizeof(agg_query_t));
+	query.op = AGG_TOP_K;
+	query.tbl = tbl;
+	query.col = value;
+	query.in = match;
+	query.k = k;
+
+	err = agg_run(pool, &query, &jobs, &njobs);
+	if (err)
+		goto cleanup;
+
+	// Merge the best rows of every chunk.
+	for (i = 0; i < njobs; i++) {
+		for (j = 0; j < jobs[i].ntop; j++)
+			top_push(value, rows, k, nrows, jobs[i].top[j]);
+	}
+
+	// Sort the heap, largest first, by repeatedly moving its smallest to the
+	// end.
+	for (i = *nrows; i > 1; i--) {
+		size_t row = rows[0];
+
+		top_sift(value, rows, i - 1, rows[i - 1]);
+		rows[i - 1] = row;
+	}
+
+cleanup:
+	agg_jobs_free(jobs, njobs);
+	return err;
+}
+
+/**
+ * Runs a query over every chunk of a table.
+ *
+ * @param  pool  Thread pool to spread the work across or NULL to create one
+ *               when the table is large enough.
+ * @param  query Query to be run.
+ * @param  jobs  Returns the chunks with their partial results. Must be free'd
+ *               with agg_jobs_free even if the operation failed.
+ * @param  njobs Returns the number of chunks.
+ * @return       PECAN_OK if the operation was successful.
+ */
+static pecan_err_t agg_run(pecan_pool_t *pool, agg_query_t *query,
+						   agg_job_t **jobs, size_t *njobs) {
+	pecan_pool_t *own_pool = NULL;
+	pecan_taskgroup_t group;
+	size_t nrows = query->tbl->nrows;
+	size_t i;
+	size_t j;
+
+	// Split the table up.
+	*njobs = (nrows + AGG_CHUNK - 1) / AGG_CHUNK;
+	if (*njobs == 0)
+		*njobs = 1;
+	*jobs = (agg_job_t *)mem_calloc(NULL, *njobs, sizeof(agg_job_t));
+	if (*jobs == NULL)
+		goto nomem;
+	for (i = 0; i < *njobs; i++) {
+		agg_job_t *job = &(*jobs)[i];
+
+		job->query = query;
+		job->first = i * AGG_CHUNK;
+		job->last = ((nrows - job->first) < AGG_CHUNK) ? nrows :
+			job->first + AGG_CHUNK;
+
+		// Space for the partial results.
+		if (query->op == AGG_AGGREGATE) {
+			job->accs = (agg_acc_t *)mem_alloc(NULL, query->ngroups *
+											   sizeof(agg_acc_t));
+			if (job->accs == NULL)
+				goto nomem;
+			for (j = 0; j < query->ngroups; j++)
+				acc_init(&job->accs[j]);
+		} else if (query->op == AGG_TOP_K) {
+			job->top = (size_t *)mem_alloc(NULL, query->k * sizeof(size_t));
+			if (job->top == NULL)
+				goto nomem;
+		}
+	}
+
+	// Small tables aren't worth waking up any threads for.
+	if (*njobs == 1) {
+		agg_task(&(*jobs)[0]);
+		return PECAN_OK;
+	}
+
+	// Get a pool to spread the chunks across.
+	if (pool == NULL) {
+		own_pool = pool_new(0);
+		pool = own_pool;
+		if (pool == NULL) {
+			err_set_msg(EMSG("Couldn't create a thread pool"));
+			return PECAN_ERR_UNKNOWN;
+		}
+	}
+
+	// Run every chunk.
+	pool_group_init(&group);
+	for (i = 0; i < *njobs; i++) {
+		if (pool_submit(pool, &group, agg_task, &(*jobs)[i]) != 0)
+			agg_task(&(*jobs)[i]);
+	}
+	pool_wait(pool, &group);
+
+	pool_free(own_pool);
+	return PECAN_OK;
+
+nomem:
+	err_set_msg(EMSG("Couldn't allocate memory for the query"));
+	return PECAN_ERR_UNKNOWN;
+}
+
+/**
+ * Frees up the chunks of a query.
+ *
+ * @param jobs  Chunks of the query.
+ * @param njobs Number of chunks.
+ */
+static void agg_jobs_free(agg_job_t *jobs, size_t njobs) {
+	size_t i;
+
+	if (jobs == NULL)
+		return;
+
+	for (i = 0; i < njobs; i++) {
+		mem_free(NULL, jobs[i].accs);
+		mem_free(NULL, jobs[i].top);
+	}
+	mem_free(NULL, jobs);
+}
+
+/**
+ * Runs a query over a chunk of a table, a word of rows at a time.
+ *
+ * @param arg Chunk of the table.
+ */
+static void agg_task(void *arg) {
+	agg_job_t *job = (agg_job_t *)arg;
+	agg_query_t *query = job->query;
+	pecan_column_t *col = query->col;
+	size_t nrows = query->tbl->nrows;
+	size_t word;
+
+	for (word = job->first / 64; (word * 64) < job->last; word++) {
+		uint64_t mask = agg_mask(query, word);
+		size_t base = word * 64;
+		int full = (base + 64) <= nrows;
+		uint64_t bits;
+		size_t row;
+
+		switch (query->op) {
+			case AGG_EQUALS:
+				if (mask && full) {
+					mask &= word_equals(col->codes + base, query->code);
+				} else {
+					for (bits = mask; bits; bits &= bits - 1) {
+						row = base + bit_first(bits);
+						if (col->codes[row] != query->code)
+							mask &= ~((uint64_t)1 << (row - base));
+					}
+				}
+
+				query->out[word] = mask;
+				break;
+			case AGG_BELOW:
+				if (mask && full) {
+					mask &= word_cmp(col, base, 0, query->ilimit,
+									 query->flimit);
+				} else {
+					for (bits = mask; bits; bits &= bits - 1) {
+						row = base + bit_first(bits);
+						if ((col->type == PECAN_COLUMN_INT) ?
+								(col->ints[row] >= query->ilimit) :
+								!(col->floats[row] < query->flimit))
+							mask &= ~((uint64_t)1 << (row - base));
+					}
+				}
+
+				query->out[word] = mask;
+				break;
+			case AGG_AGGREGATE:
+				// Whole words of a single group go through the fast path.
+				if ((query->group == NULL) && (mask == ~(uint64_t)0)) {
+					word_aggregate(col, base, &job->accs[0]);
+					break;
+				}
+
+				for (; mask; mask &= mask - 1) {
+					size_t index = 0;
+
+					row = base + bit_first(mask);
+					if (query->group) {
+						index = query->group->codes[row];
+						if (index == PECAN_TABLE_NULL_CODE)
+							index = query->ngroups - 1;
+					}
+
+					acc_add(&job->accs[index], col, row);
+				}
+				break;
+			case AGG_TOP_K:
+				// Once the heap is full only the rows above its smallest one
+				// can make it in.
+				if (mask && full && (job->ntop == query->k)) {
+					row = job->top[0];
+					mask &= word_cmp(col, base, 1,
+						(col->type == PECAN_COLUMN_INT) ? col->ints[row] : 0,
+						(col->type == PECAN_COLUMN_FLOAT) ?
+						col->floats[row] : 0);
+				}
+
+				for (; mask; mask &= mask - 1) {
+					top_push(col, job->top, query->k, &job->ntop,
+							 base + bit_first(mask));
+				}
+				break;
+		}
+	}
+}
+
+/**
+ * Checks if a column can be used in a query.
+ *
+ * @param  col     Column to be checked.
+ * @param  numeric Non-zero if it must be numeric, otherwise it must hold
+ *                 strings.
+ * @return         PECAN_OK if the column can be used.
+ */
+static pecan_err_t agg_check(pecan_column_t *col, int numeric) {
+	if (col == NULL) {
+		err_set_msg(EMSG("Column doesn't exist in the table"));
+		return PECAN_ERR_UNKNOWN;
+	}
+
+	if (numeric && (col->type == PECAN_COLUMN_STRING)) {
+		err_format_msg(EMSG("Column '%s' isn't numeric"), col->name);
+		return PECAN_ERR_UNKNOWN;
+	} else if (!numeric && (col->type != PECAN_COLUMN_STRING)) {
+		err_format_msg(EMSG("Column '%s' doesn't hold strings"), col->name);
+		return PECAN_ERR_UNKNOWN;
+	}
+
+	return PECAN_OK;
+}
+
+/**
+ * Gets the rows of a word that have a value and were asked for.
+ *
+ * @param  query Query being run.
+ * @param  word  Index of the word.
+ * @return       Bitmap of the rows in the word.
+ */
+static uint64_t agg_mask(agg_query_t *query, size_t word) {
+	uint64_t mask = query->col->valid[word];
+
+	if (query->in)
+		mask &= query->in[word];
+
+	// Don't trust whatever is past the last row of a caller's bitmap.
+	if (word == (query->tbl->nrows / 64))
+		mask &= ((uint64_t)1 << (query->tbl->nrows & 63)) - 1;
+
+	return mask;
+}
+
+/**
+ * Gets the position of the lowest bit that's set.
+ *
+ * @param  bits Word with at least one bit set.
+ * @return      Position of the bit.
+ */
+static unsigned int bit_first(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+	return (unsigned int)__builtin_ctzll(bits);
+#else
+	unsigned int pos = 0;
+
+	while (!(bits & 1)) {
+		bits >>= 1;
+		pos++;
+	}
+
+	return pos;
+#endif /* __GNUC__ */
+}
+
+/**
+ * Compares a whole word of dictionary codes against a code.
+ *
+ * @param  codes Codes of the 64 rows of the word.
+ * @param  code  Code to compare against.
+ * @return       Bitmap of the rows that have the code.
+ */
+static uint64_t word_equals(const uint32_t *codes, uint32_t code) {
+	uint64_t bits = 0;
+	unsigned int i;
+
+#ifdef AGG_SSE2
+	const __m128i needle = _mm_set1_epi32((int)code);
+
+	for (i = 0; i < 64; i += 4) {
+		__m128i eq = _mm_cmpeq_epi32(
+			_mm_loadu_si128((const __m128i *)(codes + i)), needle);
+		bits |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(eq)) << i;
+	}
+#else
+	for (i = 0; i < 64; i++)
+		bits |= (uint64_t)(codes[i] == code) << i;
+#endif /* AGG_SSE2 */
+
+	return bits;
+}
+
+/**
+ * Compares a whole word of numbers against a limit.
+ *
+ * @param  col    Numeric column.
+ * @param  base   First row of the word.
+ * @param  above  Non-zero to look for the values above the limit instead of
+ *                below it.
+ * @param  ilimit Limit for integer columns.
+ * @param  flimit Limit for floating-point columns.
+ * @return        Bitmap of the rows that are past the limit.
+ */
+static uint64_t word_cmp(pecan_column_t *col, size_t base, int above,
+						 int64_t ilimit, double flimit) {
+	uint64_t bits = 0;
+	unsigned int i;
+
+	if (col->type == PECAN_COLUMN_INT) {
+		const int64_t *v = col->ints + base;
+#ifdef AGG_SSE2
+		const __m128i limit = _mm_set1_epi64x(ilimit);
+
+		for (i = 0; i < 64; i += 2) {
+			__m128i x = _mm_loadu_si128((const __m128i *)(v + i));
+			__m128i gt = (above) ? cmpgt_epi64(x, limit) :
+				cmpgt_epi64(limit, x);
+			bits |= (uint64_t)_mm_movemask_pd(_mm_castsi128_pd(gt)) << i;
+		}
+#else
+		for (i = 0; i < 64; i++) {
+			bits |= (uint64_t)((above) ? (v[i] > ilimit) :
+				(v[i] < ilimit)) << i;
+		}
+#endif /* AGG_SSE2 */
+	} else {
+		const double *v = col->floats + base;
+#ifdef AGG_SSE2
+		const __m128d limit = _mm_set1_pd(flimit);
+
+		for (i = 0; i < 64; i += 2) {
+			__m128d x = _mm_loadu_pd(v + i);
+			__m128d gt = (above) ? _mm_cmpgt_pd(x, limit) :
+				_mm_cmplt_pd(x, limit);
+			bits |= (uint64_t)_mm_movemask_pd(gt) << i;
+		}
+#else
+		for (i = 0; i < 64; i++) {
+			bits |= (uint64_t)((above) ? (v[i] > flimit) :
+				(v[i] < flimit)) << i;
+		}
+#endif /* AGG_SSE2 */
+	}
+
+	return bits;
+}
+
+/**
+ * Aggregates a whole word of numbers that all have a value.
+ *
+ * @param col  Numeric column.
+ * @param base First row of the word.
+ * @param acc  Aggregate to add the word to.
+ */
+static void word_aggregate(pecan_column_t *col, size_t base, agg_acc_t *acc) {
+	unsigned int i;
+
+	acc->count += 64;
+	if (col->type == PECAN_COLUMN_INT) {
+		const int64_t *v = col->ints + base;
+#ifdef AGG_SSE2
+		__m128i sum = _mm_setzero_si128();
+		__m128i min = _mm_loadu_si128((const __m128i *)v);
+		__m128i max = min;
+		int64_t lanes[2];
+
+		for (i = 0; i < 64; i += 2) {
+			__m128i x = _mm_loadu_si128((const __m128i *)(v + i));
+			__m128i gt;
+
+			sum = _mm_add_epi64(sum, x);
+			gt = cmpgt_epi64(min, x);
+			min = _mm_or_si128(_mm_and_si128(gt, x), _mm_andnot_si128(gt, min));
+			gt = cmpgt_epi64(x, max);
+			max = _mm_or_si128(_mm_and_si128(gt, x), _mm_andnot_si128(gt, max));
+		}
+
+		_mm_storeu_si128((__m128i *)lanes, sum);
+		acc->isum += lanes[0] + lanes[1];
+		_mm_storeu_si128((__m128i *)lanes, min);
+		if (lanes[0] < acc->imin)
+			acc->imin = lanes[0];
+		if (lanes[1] < acc->imin)
+			acc->imin = lanes[1];
+		_mm_storeu_si128((__m128i *)lanes, max);
+		if (lanes[0] > acc->imax)
+			acc->imax = lanes[0];
+		if (lanes[1] > acc->imax)
+			acc->imax = lanes[1];
+#else
+		for (i = 0; i < 64; i++) {
+			acc->isum += v[i];
+			if (v[i] < acc->imin)
+				acc->imin = v[i];
+			if (v[i] > acc->imax)
+				acc->imax = v[i];
+		}
+#endif /* AGG_SSE2 */
+	} else {
+		const double *v = col->floats + base;
+#ifdef AGG_SSE2
+		__m128d sum = _mm_setzero_pd();
+		__m128d min = _mm_loadu_pd(v);
+		__m128d max = min;
+		double lanes[2];
+
+		for (i = 0; i < 64; i += 2) {
+			__m128d x = _mm_loadu_pd(v + i);
+
+			sum = _mm_add_pd(sum, x);
+			min = _mm_min_pd(min, x);
+			max = _mm_max_pd(max, x);
+		}
+
+		_mm_storeu_pd(lanes, sum);
+		acc->fsum += lanes[0] + lanes[1];
+		_mm_storeu_pd(lanes, min);
+		if (lanes[0] < acc->fmin)
+			acc->fmin = lanes[0];
+		if (lanes[1] < acc->fmin)
+			acc->fmin = lanes[1];
+		_mm_storeu_pd(lanes, max);
+		if (lanes[0] > acc->fmax)
+			acc->fmax = lanes[0];
+		if (lanes[1] > acc->fmax)
+			acc->fmax = lanes[1];
+#else
+		for (i = 0; i < 64; i++) {
+			acc->fsum += v[i];
+			if (v[i] < acc->fmin)
+				acc->fmin = v[i];
+			if (v[i] > acc->fmax)
+				acc->fmax = v[i];
+		}
+#endif /* AGG_SSE2 */
+	}
+}
+
+/**
+ * Initializes an empty aggregate.
+ *
+ * @param acc Aggregate to be initialized.
+ */
+static void acc_init(agg_acc_t *acc) {
+	acc->count = 0;
+	acc->isum = 0;
+	acc->imin = INT64_MAX;
+	acc->imax = INT64_MIN;
+	acc->fsum = 0;
+	acc->fmin = HUGE_VAL;
+	acc->fmax = -HUGE_VAL;
+}
+
+/**
+ * Adds a single row to an aggregate.
+ *
+ * @param acc Aggregate.
+ * @param col Numeric column.
+ * @param row Row to be added.
+ */
+static void acc_add(agg_acc_t *acc, pecan_column_t *col, size_t row) {
+	acc->count++;
+	if (col->type == PECAN_COLUMN_INT) {
+		int64_t v = col->ints[row];
+
+		acc->isum += v;
+		if (v < acc->imin)
+			acc->imin = v;
+		if (v > acc->imax)
+			acc->imax = v;
+	} else {
+		double v = col->floats[row];
+
+		acc->fsum += v;
+		if (v < acc->fmin)
+			acc->fmin = v;
+		if (v > acc->fmax)
+			acc->fmax = v;
+	}
+}
+
+/**
+ * Merges an aggregate into another.
+ *
+ * @param acc   Aggregate to merge into.
+ * @param other Aggregate to be merged.
+ * @param ints  Non-zero if the aggregates are of an integer column.
+ */
+static void acc_merge(agg_acc_t *acc, agg_acc_t *other, int ints) {
+	if (other->count == 0)
+		return;
+
+	acc->count += other->count;
+	if (ints) {
+		acc->isum += other->isum;
+		if (other->imin < acc->imin)
+			acc->imin = other->imin;
+		if (other->imax > acc->imax)
+			acc->imax = other->imax;
+	} else {
+		acc->fsum += other->fsum;
+		if (other->fmin < acc->fmin)
+			acc->fmin = other->fmin;
+		if (other->fmax > acc->fmax)
+			acc->fmax = other->fmax;
+	}
+}
+
+/**
+ * Checks if a row ranks above another one.
+ *
+ * @param  col Numeric column.
+ * @param  a   First row.
+ * @param  b   Second row.
+ * @return     Non-zero if the first row has a larger value or the same value
+ *             and comes first.
+ */
+static int top_better(pecan_column_t *col, size_t a, size_t b) {
+	if (col->type == PECAN_COLUMN_INT) {
+		if (col->ints[a] != col->ints[b])
+			return col->ints[a] > col->ints[b];
+	} else if (col->floats[a] != col->floats[b]) {
+		return col->floats[a] > col->floats[b];
+	}
+
+	return a < b;
+}
+
+/**
+ * Offers a row to a min-heap of the best rows so far. With a full heap it
+ * replaces the smallest row if the new one is better.
+ *
+ * @param col  Numeric column.
+ * @param heap Heap of rows.
+ * @param k    Capacity of the heap.
+ * @param n    Number of rows in the heap.
+ * @param row  Row to be offered.
+ */
+static void top_push(pecan_column_t *col, size_t *heap, size_t k, size_t *n,
+					 size_t row) {
+	size_t i;
+
+	// Sift it up while there's room.
+	if (*n < k) {
+		i = (*n)++;
+		while ((i > 0) && top_better(col, heap[(i - 1) / 2], row)) {
+			heap[i] = heap[(i - 1) / 2];
+			i = (i - 1) / 2;
+		}
+		heap[i] = row;
+		return;
+	}
+
+	// Replace the smallest one.
+	if ((k > 0) && top_better(col, row, heap[0]))
+		top_sift(col, heap, k, row);
+}
+
+/**
+ * Replaces the smallest row of a min-heap and sifts the new one down into
+ * place.
+ *
+ * @param col  Numeric column.
+ * @param heap Heap of rows.
+ * @param n    Number of rows in the heap.
+ * @param row  Row to take the place of the smallest one.
+ */
+static void top_sift(pecan_column_t *col, size_t *heap, size_t n, size_t row) {
+	size_t i = 0;
+
+	for (;;) {
+		size_t child = (i * 2) + 1;
+
+		if (child >= n)
+			break;
+		if (((child + 1) < n) && top_better(col, heap[child], heap[child + 1]))
+			child++;
+		if (!top_better(col, row, heap[child]))
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = row;
+}
+
+#ifdef AGG_SSE2
+/**
+ * Compares signed 64-bit integers, which SSE2 has no instruction for. Integer
+ * columns never go past PECAN_TABLE_MAX_INT, so the difference between two of
+ * their values can't overflow and its sign tells which one is greater.
+ *
+ * @param  a First pair of integers.
+ * @param  b Second pair of integers.
+ * @return   All ones in the lanes where the first integer is greater.
+ */
+static __m128i cmpgt_epi64(__m128i a, __m128i b) {
+	__m128i sign = _mm_srai_epi32(_mm_sub_epi64(b, a), 31);
+
+	return _mm_shuffle_epi32(sign, _MM_SHUFFLE(3, 3, 1, 1));
+}
+#endif /* AGG_SSE2 */
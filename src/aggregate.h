@@ -0,0 +1,64 @@
+/**
+ * aggregate.h
+ * Filters and aggregations over the columns of a catalog table.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _AGGREGATE_H
+#define _AGGREGATE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "pool.h"
+#include "table.h"
+
+// Number of words in a bitmap of the rows of a table.
+#define PECAN_ROWS_WORDS(tbl) (((tbl)->nrows / 64) + 1)
+
+// Number of groups an aggregation by a column gives out. The last one holds
+// the rows without a group.
+#define PECAN_AGG_GROUPS(col) (((col) != NULL) ? (col)->ndict + 1 : 1)
+
+// Aggregate of a numeric column. Groups without any rows are all zeroes.
+typedef struct {
+	size_t count;
+	double sum;
+	double min;
+	double max;
+} pecan_agg_t;
+
+// Filters
+PECAN_EXPORTS pecan_err_t pecan_filter_equals(pecan_pool_t *pool,
+											  pecan_table_t *tbl,
+											  pecan_column_t *col,
+											  uint32_t code,
+											  const uint64_t *in,
+											  uint64_t *out);
+PECAN_EXPORTS pecan_err_t pecan_filter_below(pecan_pool_t *pool,
+											 pecan_table_t *tbl,
+											 pecan_column_t *col, double limit,
+											 const uint64_t *in,
+											 uint64_t *out);
+
+// Aggregations
+PECAN_EXPORTS pecan_err_t pecan_aggregate(pecan_pool_t *pool,
+										  pecan_table_t *tbl,
+										  pecan_column_t *value,
+										  pecan_column_t *group,
+										  const uint64_t *match,
+										  pecan_agg_t *aggs);
+PECAN_EXPORTS pecan_err_t pecan_top_k(pecan_pool_t *pool, pecan_table_t *tbl,
+									  pecan_column_t *value,
+									  const uint64_t *match, size_t *rows,
+									  size_t k, size_t *nrows);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _AGGREGATE_H */
@@ -0,0 +1,212 @@
+/**
+ * alloc.c
+ * Pluggable memory allocation used throughout the library.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "alloc.h"
+
+#include <string.h>
+
+// Statistics counters are updated atomically where we are able to.
+#ifdef __GNUC__
+#	define STAT_ADD(field, n) \
+	__atomic_fetch_add(&(field), (n), __ATOMIC_RELAXED)
+#	define STAT_GET(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+#	define STAT_SET(field, n) __atomic_store_n(&(field), (n), __ATOMIC_RELAXED)
+#else
+#	define STAT_ADD(field, n) ((field) += (n))
+#	define STAT_GET(field) (field)
+#	define STAT_SET(field, n) ((field) = (n))
+#endif  /* __GNUC__ */
+
+// Private methods.
+static void *std_malloc(size_t size, void *ctx);
+static void *std_realloc(void *ptr, size_t size, void *ctx);
+static void std_free(void *ptr, void *ctx);
+
+// Private variables.
+static const pecan_allocator_t std_allocator = {
+	std_malloc, std_realloc, std_free, NULL
+};
+static pecan_allocator_t global_allocator = {
+	std_malloc, std_realloc, std_free, NULL
+};
+static pecan_alloc_stats_t alloc_stats = { 0, 0, 0, 0 };
+
+/**
+ * Sets the global allocator used by the library. This should be done before
+ * anything gets allocated, since memory must always be free'd by the same
+ * allocator that allocated it.
+ *
+ * @param alloc Allocator to be used or NULL to go back to the standard one.
+ */
+void mem_set_allocator(const pecan_allocator_t *alloc) {
+	global_allocator = (alloc) ? *alloc : std_allocator;
+}
+
+/**
+ * Gets the global allocator used by the library.
+ *
+ * @return Global allocator.
+ */
+const pecan_allocator_t *mem_get_allocator(void) {
+	return &global_allocator;
+}
+
+/**
+ * Allocates a block of memory.
+ *
+ * @param  alloc Allocator to use or NULL to use the global one.
+ * @param  size  Number of bytes to allocate.
+ * @return       Allocated memory or NULL if we couldn't allocate it.
+ */
+void *mem_alloc(const pecan_allocator_t *alloc, size_t size) {
+	if (alloc == NULL)
+		alloc = &global_allocator;
+
+	STAT_ADD(alloc_stats.allocs, 1);
+	STAT_ADD(alloc_stats.bytes, size);
+	return alloc->malloc(size, alloc->ctx);
+}
+
+/**
+ * Allocates a zeroed out block of memory for an array.
+ *
+ * @param  alloc Allocator to use or NULL to use the global one.
+ * @param  count Number of elements in the array.
+ * @param  size  Size of each element.
+ * @return       Allocated memory or NULL if we couldn't allocate it.
+ */
+void *mem_calloc(const pecan_allocator_t *alloc, size_t count, size_t size) {
+	void *ptr;
+
+	// Check for overflows.
+	if ((size != 0) && (count > ((size_t)-1 / size)))
+		return NULL;
+
+	// Allocate and zero out the memory.
+	ptr = mem_alloc(alloc, count * size);
+	if (ptr != NULL)
+		memset(ptr, 0, count * size);
+
+	return ptr;
+}
+
+/**
+ * Resizes a block of memory.
+ *
+ * @param  alloc Allocator to use or NULL to use the global one.
+ * @param  ptr   Memory to be resized or NULL to allocate a new block.
+ * @param  size  New size of the block in bytes.
+ * @return       Resized memory or NULL if we couldn't resize it, in which
+ *               case the original block is left untouched.
+ */
+void *mem_realloc(const pecan_allocator_t *alloc, void *ptr, size_t size) {
+	if (alloc == NULL)
+		alloc = &global_allocator;
+
+	STAT_ADD(alloc_stats.reallocs, 1);
+	STAT_ADD(alloc_stats.bytes, size);
+	return alloc->realloc(ptr, size, alloc->ctx);
+}
+
+/**
+ * Copies a string of known length, which doesn't need to be NULL terminated.
+ *
+ * @param  alloc Allocator to use or NULL to use the global one.
+ * @param  str   String to be copied.
+ * @param  len   Number of characters to be copied.
+ * @return       NULL terminated copy of the string or NULL if we couldn't
+ *               allocate it.
+ */
+char *mem_strndup(const pecan_allocator_t *alloc, const char *str,
+				  size_t len) {
+	char *buf;
+
+	// Allocate the space for the string.
+	buf = (char *)mem_alloc(alloc, (len + 1) * sizeof(char));
+	if (buf == NULL)
+		return NULL;
+
+	// Copy the string over.
+	memcpy(buf, str, len * sizeof(char));
+	buf[len] = '\0';
+
+	return buf;
+}
+
+/**
+ * Frees a block of memory.
+ *
+ * @param alloc Allocator that allocated the memory or NULL for the global one.
+ * @param ptr   Memory to be free'd. Nothing happens if this is NULL.
+ */
+void mem_free(const pecan_allocator_t *alloc, void *ptr) {
+	if (ptr == NULL)
+		return;
+	if (alloc == NULL)
+		alloc = &global_allocator;
+
+	STAT_ADD(alloc_stats.frees, 1);
+	alloc->free(ptr, alloc->ctx);
+}
+
+/**
+ * Gets the allocation statistics of the library.
+ *
+ * @param stats Structure to be populated with the statistics.
+ */
+void mem_get_stats(pecan_alloc_stats_t *stats) {
+	stats->allocs = STAT_GET(alloc_stats.allocs);
+	stats->reallocs = STAT_GET(alloc_stats.reallocs);
+	stats->frees = STAT_GET(alloc_stats.frees);
+	stats->bytes = STAT_GET(alloc_stats.bytes);
+}
+
+/**
+ * Resets the allocation statistics of the library.
+ */
+void mem_reset_stats(void) {
+	STAT_SET(alloc_stats.allocs, 0);
+	STAT_SET(alloc_stats.reallocs, 0);
+	STAT_SET(alloc_stats.frees, 0);
+	STAT_SET(alloc_stats.bytes, 0);
+}
+
+/**
+ * Standard library malloc wrapper.
+ *
+ * @param  size Number of bytes to allocate.
+ * @param  ctx  Unused.
+ * @return      Allocated memory.
+ */
+static void *std_malloc(size_t size, void *ctx) {
+	(void)ctx;
+	return malloc(size);
+}
+
+/**
+ * Standard library realloc wrapper.
+ *
+ * @param  ptr  Memory to be resized.
+ * @param  size New size of the block in bytes.
+ * @param  ctx  Unused.
+ * @return      Resized memory.
+ */
+static void *std_realloc(void *ptr, size_t size, void *ctx) {
+	(void)ctx;
+	return realloc(ptr, size);
+}
+
+/**
+ * Standard library free wrapper.
+ *
+ * @param ptr Memory to be free'd.
+ * @param ctx Unused.
+ */
+static void std_free(void *ptr, void *ctx) {
+	(void)ctx;
+	free(ptr);
+}
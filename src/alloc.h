@@ -0,0 +1,58 @@
+/**
+ * alloc.h
+ * Pluggable memory allocation used throughout the library.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _ALLOC_H
+#define _ALLOC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdlib.h>
+
+// Memory allocator structure definition.
+typedef struct {
+	void *(*malloc)(size_t size, void *ctx);
+	void *(*realloc)(void *ptr, size_t size, void *ctx);
+	void (*free)(void *ptr, void *ctx);
+	void *ctx;
+} pecan_allocator_t;
+
+// Memory allocation statistics structure definition.
+typedef struct {
+	size_t allocs;
+	size_t reallocs;
+	size_t frees;
+	size_t bytes;
+} pecan_alloc_stats_t;
+
+// Make the vectors use our allocator.
+#define cvector_clib_malloc(size)       mem_alloc(NULL, (size))
+#define cvector_clib_calloc(count, size) mem_calloc(NULL, (count), (size))
+#define cvector_clib_realloc(ptr, size) mem_realloc(NULL, (ptr), (size))
+#define cvector_clib_free(ptr)          mem_free(NULL, (ptr))
+
+// Configuration
+void mem_set_allocator(const pecan_allocator_t *alloc);
+const pecan_allocator_t *mem_get_allocator(void);
+
+// Allocation
+void *mem_alloc(const pecan_allocator_t *alloc, size_t size);
+void *mem_calloc(const pecan_allocator_t *alloc, size_t count, size_t size);
+void *mem_realloc(const pecan_allocator_t *alloc, void *ptr, size_t size);
+char *mem_strndup(const pecan_allocator_t *alloc, const char *str, size_t len);
+void mem_free(const pecan_allocator_t *alloc, void *ptr);
+
+// Statistics
+void mem_get_stats(pecan_alloc_stats_t *stats);
+void mem_reset_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ALLOC_H */
@@ -0,0 +1,175 @@
+/**
+ * arena.c
+ * Reference counted memory arena for lots of tiny short-lived allocations.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "arena.h"
+
+#include <string.h>
+
+// Default size of the arena chunks.
+#define ARENA_CHUNK_SIZE 4096
+
+// Alignment of the allocations.
+#define ARENA_ALIGN sizeof(void *)
+#define ARENA_ALIGN_UP(n) (((n) + (ARENA_ALIGN - 1)) & ~(ARENA_ALIGN - 1))
+
+// Gets the data area of a chunk.
+#define CHUNK_DATA(chunk) \
+	((char *)(chunk) + ARENA_ALIGN_UP(sizeof(pecan_arena_chunk_t)))
+
+/**
+ * Creates a new empty arena with a single reference.
+ * WARNING: This function allocates the arena, so you're responsible for
+ *          releasing it with arena_release.
+ *
+ * @param  alloc Allocator for the arena or NULL to use the global one.
+ * @return       Newly created arena or NULL if we couldn't allocate it.
+ */
+pecan_arena_t *arena_new(const pecan_allocator_t *alloc) {
+	pecan_arena_t *arena;
+
+	// Allocate the arena structure.
+	arena = (pecan_arena_t *)mem_alloc(alloc, sizeof(pecan_arena_t));
+	if (arena == NULL)
+		return NULL;
+
+	// Chunks are only allocated when they are first needed.
+	arena->head = NULL;
+	arena->current = NULL;
+	arena->refs = 1;
+	arena->alloc = alloc;
+
+	return arena;
+}
+
+/**
+ * Grabs a new reference to an arena.
+ *
+ * @param  arena Arena to be referenced.
+ * @return       The same arena.
+ */
+pecan_arena_t *arena_ref(pecan_arena_t *arena) {
+	arena->refs++;
+	return arena;
+}
+
+/**
+ * Allocates some memory from the arena. This memory is only reclaimed when the
+ * arena gets reset or released.
+ *
+ * @param  arena Arena to allocate the memory from.
+ * @param  size  Number of bytes to allocate.
+ * @return       Pointer to the allocated memory or NULL if we ran out of it.
+ */
+void *arena_alloc(pecan_arena_t *arena, size_t size) {
+	pecan_arena_chunk_t *chunk;
+	void *ptr;
+
+	// Try to fit the allocation into one of the chunks we already have.
+	size = ARENA_ALIGN_UP(size);
+	chunk = arena->current;
+	while ((chunk != NULL) && ((chunk->size - chunk->used) < size))
+		chunk = chunk->next;
+
+	// Allocate a new chunk right after the current one if nothing fits.
+	if (chunk == NULL) {
+		size_t csize = ARENA_CHUNK_SIZE;
+		if (arena->current && (csize < arena->current->size * 2))
+			csize = arena->current->size * 2;
+		if (csize < size)
+			csize = size;
+
+		chunk = (pecan_arena_chunk_t *)mem_alloc(arena->alloc,
+			ARENA_ALIGN_UP(sizeof(pecan_arena_chunk_t)) + csize);
+		if (chunk == NULL)
+			return NULL;
+		chunk->size = csize;
+		chunk->used = 0;
+
+		// Link it into the chain.
+		if (arena->current) {
+			chunk->next = arena->current->next;
+			arena->current->next = chunk;
+		} else {
+			chunk->next = NULL;
+			arena->head = chunk;
+		}
+	}
+
+	// Carve out the allocation.
+	ptr = CHUNK_DATA(chunk) + chunk->used;
+	chunk->used += size;
+	arena->current = chunk;
+
+	return ptr;
+}
+
+/**
+ * Copies a string of known length, which doesn't need to be NULL terminated,
+ * into the arena.
+ *
+ * @param  arena Arena to allocate the string from.
+ * @param  str   String to be copied.
+ * @param  len   Number of characters to be copied.
+ * @return       NULL terminated copy of the string or NULL if we ran out of
+ *               memory.
+ */
+char *arena_strndup(pecan_arena_t *arena, const char *str, size_t len) {
+	char *buf;
+
+	// Allocate the space for the string.
+	buf = (char *)arena_alloc(arena, (len + 1) * sizeof(char));
+	if (buf == NULL)
+		return NULL;
+
+	// Copy the string over.
+	memcpy(buf, str, len * sizeof(char));
+	buf[len] = '\0';
+
+	return buf;
+}
+
+/**
+ * Reclaims everything that was allocated from the arena while keeping its
+ * chunks around to be reused.
+ * WARNING: Every pointer that was allocated from the arena will be invalid.
+ *
+ * @param arena Arena to be reset.
+ */
+void arena_reset(pecan_arena_t *arena) {
+	pecan_arena_chunk_t *chunk;
+
+	for (chunk = arena->head; chunk != NULL; chunk = chunk->next)
+		chunk->used = 0;
+	arena->current = arena->head;
+}
+
+/**
+ * Drops a reference to an arena, freeing it if it was the last one.
+ *
+ * @param arena Arena to be released.
+ */
+void arena_release(pecan_arena_t *arena) {
+	pecan_arena_chunk_t *chunk;
+
+	// Check if someone else is still holding on to it.
+	if (arena == NULL)
+		return;
+	arena->refs--;
+	if (arena->refs > 0)
+		return;
+
+	// Free up all of the chunks.
+	chunk = arena->head;
+	while (chunk != NULL) {
+		pecan_arena_chunk_t *next = chunk->next;
+
+		mem_free(arena->alloc, chunk);
+		chunk = next;
+	}
+
+	mem_free(arena->alloc, arena);
+}
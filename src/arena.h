@@ -0,0 +1,51 @@
+/**
+ * arena.h
+ * Reference counted memory arena for lots of tiny short-lived allocations.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdlib.h>
+
+#include "alloc.h"
+
+// Arena memory chunk structure definition.
+typedef struct pecan_arena_chunk_s {
+	struct pecan_arena_chunk_s *next;
+	size_t size;
+	size_t used;
+} pecan_arena_chunk_t;
+
+// Arena structure definition.
+typedef struct {
+	pecan_arena_chunk_t *head;
+	pecan_arena_chunk_t *current;
+	size_t refs;
+
+	const pecan_allocator_t *alloc;
+} pecan_arena_t;
+
+// Initialization
+pecan_arena_t *arena_new(const pecan_allocator_t *alloc);
+pecan_arena_t *arena_ref(pecan_arena_t *arena);
+
+// Allocation
+void *arena_alloc(pecan_arena_t *arena, size_t size);
+char *arena_strndup(pecan_arena_t *arena, const char *str, size_t len);
+
+// Cleanup
+void arena_reset(pecan_arena_t *arena);
+void arena_release(pecan_arena_t *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ARENA_H */
@@ -0,0 +1,702 @@
+/**
+ * atlas.c
+ * Persistent atlas holding a thumbnail of the image of every archive in a bin.
+ *
+ * An atlas is meant to be mapped into memory and used as is, so that showing
+ * the thumbnails of a parts bin never has to open its archives. Every
+ * thumbnail lives in a cell of the same size and is stored as top-down rows of
+ * B, G, R, A pixels, aligned to the top-left corner of its cell. All integers
+ * are stored in little-endian and every offset is relative to the start of
+ * the file:
+ *
+ *   Header     magic[4], version (u16), flags (u16), cell width (u16), cell
+ *              height (u16), thumbnails (u32), buckets (u32), reserved (u32),
+ *              strings offset (u64), strings length (u64), buckets offset
+ *              (u64), directory offset (u64), pixels offset (u64)
+ *   Strings    NUL terminated archive paths relative to the parts bin.
+ *   Buckets    buckets * u32 thumbnail number plus one, zero being empty.
+ *   Directory  thumbnails * {name offset (u32), name length (u32), mtime
+ *              (i64), size (u64), image hash (u64), mtime nanoseconds (u32),
+ *              width (u16), height (u16), reserved (u64)} sorted by name.
+ *   Pixels     thumbnails * cells, starting on a page boundary.
+ *
+ * The modification time and size are the ones of the file that holds the
+ * image, which is the archive itself for packed archives. Thumbnails whose
+ * file didn't change are carried over when the atlas is rebuilt, and the ones
+ * whose image hash didn't change are carried over without being decoded.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "atlas.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "blob.h"
+#include "byteorder.h"
+#include "error.h"
+#include "fileutils.h"
+
+// Number of archives handled by each build task.
+#define ATLAS_CHUNK 32
+
+// State shared by every build task.
+typedef struct {
+	unsigned char *map;
+	uint64_t dir_off;
+	uint64_t pixels_off;
+	uint32_t width;
+	uint32_t height;
+
+	char **paths;
+	size_t root_len;
+	pecan_atlas_t *old;
+} atlas_build_t;
+
+// Build task for a chunk of archives.
+typedef struct {
+	atlas_build_t *build;
+	size_t first;
+	size_t count;
+	size_t decoded;
+} atlas_job_t;
+
+// Private methods.
+static pecan_err_t atlas_scan(const char *dir, char ***paths);
+static int atlas_path_cmp(const void *a, const void *b);
+static const char *atlas_name(atlas_build_t *build, const char *path);
+static uint64_t round_page(uint64_t n);
+static void atlas_task(void *arg);
+static int atlas_thumb(atlas_build_t *build, size_t index);
+static int atlas_reuse(atlas_build_t *build, unsigned char *rec,
+					   unsigned char *cell, const char *name, uint64_t hash,
+					   int by_hash);
+
+/**
+ * Opens an atlas by mapping it into memory. Only the header is checked, the
+ * rest of the atlas is only touched when it's used.
+ *
+ * @param  atlas Atlas structure to be populated.
+ * @param  fname Path to the atlas file.
+ * @return       PECAN_OK if the operation was successful.
+ *               PECAN_ERR_PATH_NOT_FOUND if the file couldn't be opened.
+ *               PECAN_ERR_FILE_IO if the file couldn't be mapped.
+ *               PECAN_ERR_PARSE if the file isn't a valid atlas.
+ */
+pecan_err_t pecan_atlas_open(pecan_atlas_t *atlas, const char *fname) {
+	const unsigned char *h;
+	struct stat sb;
+	uint64_t strings_off;
+	uint64_t buckets_off;
+	uint64_t dir_off;
+	uint64_t pixels_off;
+	uint64_t cell;
+	void *map;
+	int fd;
+
+	memset(atlas, 0, sizeof(pecan_atlas_t));
+
+	// Open the file.
+	fd = open(fname, O_RDONLY);
+	if (fd == -1) {
+		err_format_msg(EMSG("Couldn't open atlas '%s'"), fname);
+		return PECAN_ERR_PATH_NOT_FOUND;
+	}
+	if ((fstat(fd, &sb) != 0) || (sb.st_size < ATLAS_HEADER_SIZE)) {
+		close(fd);
+		err_format_msg(EMSG("'%s' is too small to be an atlas"), fname);
+		return PECAN_ERR_PARSE;
+	}
+
+	// Map it into memory. The mapping outlives the descriptor.
+	map = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		err_format_msg(EMSG("Couldn't map atlas '%s'"), fname);
+		return PECAN_ERR_FILE_IO;
+	}
+	atlas->map = (const unsigned char *)map;
+	atlas->len = (size_t)sb.st_size;
+
+	// Check the header.
+	h = atlas->map;
+	if ((memcmp(h, ATLAS_MAGIC, 4) != 0) ||
+			(le_read16(h + 4) != ATLAS_VERSION))
+		goto invalid;
+	atlas->cell_width = le_read16(h + 8);
+	atlas->cell_height = le_read16(h + 10);
+	atlas->count = le_read32(h + 12);
+	atlas->nbuckets = le_read32(h + 16);
+	strings_off = le_read64(h + 24);
+	atlas->strings_len = le_read64(h + 32);
+	buckets_off = le_read64(h + 40);
+	dir_off = le_read64(h + 48);
+	pixels_off = le_read64(h + 56);
+	cell = (uint64_t)atlas->cell_width * atlas->cell_height *
+		PECAN_BMP_PIXEL_SIZE;
+
+	// Make sure every table is inside the file.
+	if ((atlas->cell_width == 0) || (atlas->cell_height == 0) ||
+			(atlas->nbuckets & (atlas->nbuckets - 1)) ||
+			((atlas->count > 0) && (atlas->nbuckets <= atlas->count)) ||
+			(strings_off > atlas->len) ||
+			(atlas->strings_len > (atlas->len - strings_off)) ||
+			(buckets_off > atlas->len) ||
+			(atlas->nbuckets > ((atlas->len - buckets_off) / 4)) ||
+			(dir_off > atlas->len) ||
+			(atlas->count > ((atlas->len - dir_off) / ATLAS_DIR_SIZE)) ||
+			(pixels_off > atlas->len) ||
+			(atlas->count > ((atlas->len - pixels_off) / cell)))
+		goto invalid;
+
+	atlas->strings = (const char *)atlas->map + strings_off;
+	atlas->buckets = atlas->map + buckets_off;
+	atlas->dir = atlas->map + dir_off;
+	atlas->pixels = atlas->map + pixels_off;
+
+	return PECAN_OK;
+
+invalid:
+	pecan_atlas_close(atlas);
+	err_format_msg(EMSG("'%s' isn't a valid atlas"), fname);
+	return PECAN_ERR_PARSE;
+}
+
+/**
+ * Gets the number of thumbnails in an atlas.
+ *
+ * @param  atlas Atlas structure.
+ * @return       Number of thumbnails.
+ */
+size_t pecan_atlas_len(pecan_atlas_t *atlas) {
+	return atlas->count;
+}
+
+/**
+ * Gets a thumbnail from an atlas. Its name and pixels point straight into the
+ * atlas and are only valid while the atlas is open. Archives without a usable
+ * image have an empty thumbnail.
+ *
+ * @param  atlas Atlas structure.
+ * @param  index Index of the thumbnail in name order.
+ * @param  thumb Structure to receive the thumbnail.
+ * @return       PECAN_OK if the operation was successful.
+ *               PECAN_ERR_PATH_NOT_FOUND if the index is out of bounds.
+ *               PECAN_ERR_PARSE if the thumbnail's record is corrupted.
+ */
+pecan_err_t pecan_atlas_get(pecan_atlas_t *atlas, size_t index,
+							pecan_atlas_thumb_t *thumb) {
+	const unsigned char *rec;
+	uint32_t name_off;
+
+	// Check if we have it.
+	if (index >= atlas->count) {
+		err_format_msg(EMSG("Thumbnail %zu is outside of the atlas"), index);
+		return PECAN_ERR_PATH_NOT_FOUND;
+	}
+
+	// Decode the record.
+	rec = atlas->dir + (index * ATLAS_DIR_SIZE);
+	name_off = le_read32(rec);
+	thumb->name_len = le_read32(rec + 4);
+	thumb->mtime = (int64_t)le_read64(rec + 8);
+	thumb->size = le_read64(rec + 16);
+	thumb->hash = le_read64(rec + 24);
+	thumb->mtime_nsec = le_read32(rec + 32);
+	thumb->width = le_read16(rec + 36);
+	thumb->height = le_read16(rec + 38);
+
+	// Make sure it doesn't point outside of the atlas.
+	if (((uint64_t)name_off + thumb->name_len) >= atlas->strings_len ||
+			(atlas->strings[name_off + thumb->name_len] != '\0') ||
+			(thumb->width > atlas->cell_width) ||
+			(thumb->height > atlas->cell_height)) {
+		err_format_msg(EMSG("Record of thumbnail %zu is corrupted"), index);
+		return PECAN_ERR_PARSE;
+	}
+
+	// Point to the pixels.
+	thumb->name = atlas->strings + name_off;
+	thumb->stride = (size_t)atlas->cell_width * PECAN_BMP_PIXEL_SIZE;
+	thumb->pixels = atlas->pixels +
+		(index * thumb->stride * atlas->cell_height);
+
+	return PECAN_OK;
+}
+
+/**
+ * Finds a thumbnail in an atlas by the path of its archive relative to the
+ * parts bin the atlas was built from.
+ *
+ * @param  atlas Atlas structure.
+ * @param  name  Path of the archive.
+ * @param  index Pointer to receive the index of the thumbnail.
+ * @return       Non-zero if the thumbnail was found.
+ */
+int pecan_atlas_find(pecan_atlas_t *atlas, const char *name, size_t *index) {
+	const unsigned char *rec;
+	uint32_t mask;
+	uint32_t slot;
+	uint32_t num;
+	uint32_t i;
+	size_t len;
+
+	// Check if we have anything to look for.
+	if (atlas->nbuckets == 0)
+		return 0;
+
+	// Probe the buckets until we find it or an empty one, making sure a
+	// corrupted atlas without any empty buckets doesn't keep us going forever.
+	len = strlen(name);
+	mask = atlas->nbuckets - 1;
+	slot = (uint32_t)blob_hash(name, len) & mask;
+	for (i = 0; i < atlas->nbuckets; i++) {
+		num = le_read32(atlas->buckets + (slot * 4));
+		if (num == 0)
+			break;
+
+		if (num <= atlas->count) {
+			rec = atlas->dir + ((num - 1) * ATLAS_DIR_SIZE);
+			if ((le_read32(rec + 4) == len) &&
+					(((uint64_t)le_read32(rec) + len) < atlas->strings_len) &&
+					(memcmp(atlas->strings + le_read32(rec), name, len) == 0)) {
+				*index = num - 1;
+				return 1;
+			}
+		}
+
+		slot = (slot + 1) & mask;
+	}
+
+	return 0;
+}
+
+/**
+ * Builds the atlas of a parts bin. If the atlas already exists the thumbnails
+ * of archives that didn't change are carried over, so keeping it up to date
+ * only costs decoding the images that changed. The new atlas is written next
+ * to the old one and replaces it at the end, so readers that have the old one
+ * open aren't disturbed.
+ *
+ * @param  pool    Thread pool to decode images in or NULL to create one.
+ * @param  root    Root of the parts bin.
+ * @param  fname   Path to the atlas file.
+ * @param  width   Width of the thumbnail cells.
+ * @param  height  Height of the thumbnail cells.
+ * @param  decoded Returns the number of images that had to be decoded.
+ * @return         PECAN_OK if the operation was successful.
+ *                 PECAN_ERR_FILE_IO if the atlas couldn't be written.
+ */
+pecan_err_t pecan_atlas_build(pecan_pool_t *pool, const char *root,
+							  const char *fname, uint32_t width,
+							  uint32_t height, size_t *decoded) {
+	cvector_vector_type(char *) paths = NULL;
+	pecan_pool_t *own_pool = NULL;
+	pecan_taskgroup_t group;
+	pecan_atlas_t old;
+	atlas_build_t build;
+	atlas_job_t *jobs = NULL;
+	size_t njobs;
+	unsigned char *h;
+	uint64_t strings_len;
+	uint64_t buckets_off;
+	uint64_t total;
+	uint32_t nbuckets;
+	uint32_t name_off;
+	char *tmp = NULL;
+	void *map = MAP_FAILED;
+	int fd = -1;
+	size_t count;
+	size_t i;
+	pecan_err_t err;
+
+	memset(&build, 0, sizeof(atlas_build_t));
+	memset(&old, 0, sizeof(pecan_atlas_t));
+	*decoded = 0;
+
+	// Check the size of the cells.
+	if ((width == 0) || (height == 0) || (width > 0xFFFF) ||
+			(height > 0xFFFF)) {
+		err_format_msg(EMSG("Invalid thumbnail size %ux%u"), width, height);
+		return PECAN_ERR_UNKNOWN;
+	}
+
+	// Find every archive in the bin.
+	err = atlas_scan(root, &paths);
+	if (err)
+		goto cleanup;
+	count = cvector_size(paths);
+	if (count > 0)
+		qsort(paths, count, sizeof(char *), atlas_path_cmp);
+
+	// Carry over what we can from the previous atlas.
+	if ((pecan_atlas_open(&old, fname) == PECAN_OK) &&
+			((old.cell_width != width) || (old.cell_height != height)))
+		pecan_atlas_close(&old);
+	build.old = (old.map) ? &old : NULL;
+	build.width = width;
+	build.height = height;
+	build.paths = paths;
+	build.root_len = strlen(root);
+
+	// Lay the atlas out.
+	strings_len = 0;
+	for (i = 0; i < count; i++)
+		strings_len += strlen(atlas_name(&build, paths[i])) + 1;
+	nbuckets = (count > 0) ? 1 : 0;
+	while (nbuckets && (nbuckets < (count * 2)))
+		nbuckets <<= 1;
+	buckets_off = (ATLAS_HEADER_SIZE + strings_len + 7) & ~(uint64_t)7;
+	build.dir_off = buckets_off + ((uint64_t)nbuckets * 4);
+	build.pixels_off = round_page(build.dir_off + (count * ATLAS_DIR_SIZE));
+	total = build.pixels_off + ((uint64_t)count * width * height *
+		PECAN_BMP_PIXEL_SIZE);
+
+	// Create the new atlas and map it so that tasks can write cells directly.
+	tmp = extcat(fname, "tmp");
+	if (tmp == NULL)
+		goto nomem;
+	fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if ((fd == -1) || (ftruncate(fd, (off_t)total) != 0))
+		goto ioerr;
+	map = mmap(NULL, (size_t)total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		goto ioerr;
+	build.map = (unsigned char *)map;
+
+	// Header.
+	h = build.map;
+	memcpy(h, ATLAS_MAGIC, 4);
+	le_write16(h + 4, ATLAS_VERSION);
+	le_write16(h + 8, (uint16_t)width);
+	le_write16(h + 10, (uint16_t)height);
+	le_write32(h + 12, (uint32_t)count);
+	le_write32(h + 16, nbuckets);
+	le_write64(h + 24, ATLAS_HEADER_SIZE);
+	le_write64(h + 32, strings_len);
+	le_write64(h + 40, buckets_off);
+	le_write64(h + 48, build.dir_off);
+	le_write64(h + 56, build.pixels_off);
+
+	// Names and buckets.
+	name_off = 0;
+	for (i = 0; i < count; i++) {
+		const char *name = atlas_name(&build, paths[i]);
+		unsigned char *rec = build.map + build.dir_off + (i * ATLAS_DIR_SIZE);
+		size_t len = strlen(name);
+		uint32_t slot;
+
+		memcpy(build.map + ATLAS_HEADER_SIZE + name_off, name, len + 1);
+		le_write32(rec, name_off);
+		le_write32(rec + 4, (uint32_t)len);
+		name_off += (uint32_t)len + 1;
+
+		slot = (uint32_t)blob_hash(name, len) & (nbuckets - 1);
+		while (le_read32(build.map + buckets_off + (slot * 4)) != 0)
+			slot = (slot + 1) & (nbuckets - 1);
+		le_write32(build.map + buckets_off + (slot * 4), (uint32_t)i + 1);
+	}
+
+	// Get a pool to decode the images in.
+	if (pool == NULL) {
+		own_pool = pool_new(0);
+		pool = own_pool;
+		if (pool == NULL) {
+			err_set_msg(EMSG("Couldn't create a thread pool"));
+			err = PECAN_ERR_UNKNOWN;
+			goto cleanup;
+		}
+	}
+
+	// Thumbnails, a chunk of archives at a time.
+	njobs = (count + ATLAS_CHUNK - 1) / ATLAS_CHUNK;
+	jobs = (atlas_job_t *)mem_calloc(NULL, njobs + 1, sizeof(atlas_job_t));
+	if (jobs == NULL)
+		goto nomem;
+	pool_group_init(&group);
+	for (i = 0; i < njobs; i++) {
+		jobs[i].build = &build;
+		jobs[i].first = i * ATLAS_CHUNK;
+		jobs[i].count = ((count - jobs[i].first) < ATLAS_CHUNK) ?
+			count - jobs[i].first : ATLAS_CHUNK;
+		if (pool_submit(pool, &group, atlas_task, &jobs[i]) != 0)
+			atlas_task(&jobs[i]);
+	}
+	pool_wait(pool, &group);
+	for (i = 0; i < njobs; i++)
+		*decoded += jobs[i].decoded;
+
+	// Replace the old atlas.
+	munmap(map, (size_t)total);
+	map = MAP_FAILED;
+	if (close(fd) != 0) {
+		fd = -1;
+		unlink(tmp);
+		goto ioerr;
+	}
+	fd = -1;
+	if (rename(tmp, fname) != 0) {
+		unlink(tmp);
+		goto ioerr;
+	}
+
+cleanup:
+	if (map != MAP_FAILED)
+		munmap(map, (size_t)total);
+	if (fd != -1) {
+		close(fd);
+		unlink(tmp);
+	}
+	pecan_atlas_close(&old);
+	pool_free(own_pool);
+	mem_free(NULL, jobs);
+	mem_free(NULL, tmp);
+	for (i = 0; i < cvector_size(paths); i++)
+		mem_free(NULL, paths[i]);
+	cvector_free(paths);
+
+	return err;
+
+ioerr:
+	err_format_msg(EMSG("Couldn't write atlas '%s'"), fname);
+	err = PECAN_ERR_FILE_IO;
+	goto cleanup;
+
+nomem:
+	err_set_msg(EMSG("Couldn't allocate memory to build the atlas"));
+	err = PECAN_ERR_UNKNOWN;
+	goto cleanup;
+}
+
+/**
+ * Closes an atlas.
+ *
+ * @param atlas Atlas to be closed.
+ */
+void pecan_atlas_close(pecan_atlas_t *atlas) {
+	if (atlas->map)
+		munmap((void *)atlas->map, atlas->len);
+
+	memset(atlas, 0, sizeof(pecan_atlas_t));
+}
+
+/**
+ * Scans a directory recursively for component archives.
+ *
+ * @param  dir   Directory to be scanned.
+ * @param  paths Vector of paths to add the archives to.
+ * @return       PECAN_OK if the operation was successful.
+ */
+static pecan_err_t atlas_scan(const char *dir, char ***paths) {
+	struct dirent *ent;
+	pecan_err_t err = PECAN_OK;
+	DIR *dh;
+
+	// Open the directory.
+	dh = opendir(dir);
+	if (dh == NULL) {
+		err_format_msg(EMSG("Couldn't open directory '%s'"), dir);
+		return PECAN_ERR_FILE_IO;
+	}
+
+	// Go through its contents.
+	while ((err == PECAN_OK) && ((ent = readdir(dh)) != NULL)) {
+		char *path;
+		char *manifest;
+
+		// Skip hidden files and the special directories.
+		if (ent->d_name[0] == '.')
+			continue;
+		pathcat(2, &path, dir, ent->d_name);
+
+		if (is_dir(path)) {
+			// Unpacked archives are directories with a manifest in them.
+			pathcat(2, &manifest, path, PECAN_MANIFEST_FILE);
+			if (file_exists(manifest)) {
+				cvector_push_back(*paths, path);
+				path = NULL;
+			} else {
+				err = atlas_scan(path, paths);
+			}
+			mem_free(NULL, manifest);
+		} else if (file_ext_match(path, "tar")) {
+			// Packed archive.
+			cvector_push_back(*paths, path);
+			path = NULL;
+		}
+
+		mem_free(NULL, path);
+	}
+
+	closedir(dh);
+	return err;
+}
+
+/**
+ * Compares two archive paths for sorting.
+ */
+static int atlas_path_cmp(const void *a, const void *b) {
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/**
+ * Gets the path of an archive relative to the root of the parts bin.
+ *
+ * @param  build Build state.
+ * @param  path  Path of the archive as it was scanned.
+ * @return       Relative path inside the scanned path.
+ */
+static const char *atlas_name(atlas_build_t *build, const char *path) {
+	path += build->root_len;
+	while (*path == '/')
+		path++;
+
+	return path;
+}
+
+/**
+ * Rounds a number up to the next page boundary.
+ */
+static uint64_t round_page(uint64_t n) {
+	return (n + ATLAS_PAGE_SIZE - 1) & ~(uint64_t)(ATLAS_PAGE_SIZE - 1);
+}
+
+/**
+ * Builds the thumbnails of a chunk of archives.
+ *
+ * @param arg Build job.
+ */
+static void atlas_task(void *arg) {
+	atlas_job_t *job = (atlas_job_t *)arg;
+	size_t i;
+
+	for (i = job->first; i < (job->first + job->count); i++)
+		job->decoded += atlas_thumb(job->build, i);
+}
+
+/**
+ * Builds the thumbnail of a single archive, carrying it over from the previous
+ * atlas whenever possible.
+ *
+ * @param  build Build state.
+ * @param  index Index of the archive.
+ * @return       Non-zero if the image had to be decoded.
+ */
+static int atlas_thumb(atlas_build_t *build, size_t index) {
+	const char *path = build->paths[index];
+	const char *name = atlas_name(build, path);
+	unsigned char *rec;
+	unsigned char *cell;
+	pecan_archive_t part;
+	pecan_bmp_t bmp;
+	struct stat sb;
+	uint32_t width;
+	uint32_t height;
+	uint64_t hash;
+	char *fpath;
+	int ret;
+
+	rec = build->map + build->dir_off + (index * ATLAS_DIR_SIZE);
+	cell = build->map + build->pixels_off + (index * (size_t)build->width *
+		build->height * PECAN_BMP_PIXEL_SIZE);
+
+	// Get the modification time of the file that holds the image.
+	fpath = NULL;
+	if (is_dir(path))
+		pathcat(2, &fpath, path, PECAN_IMAGE_FILE);
+	if (stat((fpath) ? fpath : path, &sb) != 0)
+		memset(&sb, 0, sizeof(struct stat));
+	mem_free(NULL, fpath);
+	le_write64(rec + 8, (uint64_t)sb.st_mtime);
+	le_write64(rec + 16, (uint64_t)sb.st_size);
+#ifdef __linux__
+	le_write32(rec + 32, (uint32_t)sb.st_mtim.tv_nsec);
+#endif /* __linux__ */
+
+	// Carry it over if the file didn't change at all.
+	if (atlas_reuse(build, rec, cell, name, 0, 0))
+		return 0;
+
+	// Read the image without the rest of the archive.
+	ret = 0;
+	pecan_init(&part);
+	if ((pecan_read_member(&part, path, PECAN_IMAGE_FILE) != PECAN_OK) ||
+			(part.image.len == 0))
+		goto cleanup;
+
+	// Carry it over if the image itself didn't change.
+	hash = blob_hash(part.image.data, part.image.len);
+	le_write64(rec + 24, hash);
+	if (atlas_reuse(build, rec, cell, name, hash, 1))
+		goto cleanup;
+
+	// Scale it down into its cell.
+	ret = 1;
+	if (pecan_bmp_open(&bmp, part.image.data, part.image.len) != PECAN_OK)
+		goto cleanup;
+	pecan_bmp_fit(&bmp, build->width, build->height, &width, &height);
+	if (pecan_bmp_thumbnail(&bmp, cell, width, height,
+			(size_t)build->width * PECAN_BMP_PIXEL_SIZE, PECAN_BMP_BOX) !=
+			PECAN_OK)
+		goto cleanup;
+	le_write16(rec + 36, (uint16_t)width);
+	le_write16(rec + 38, (uint16_t)height);
+
+cleanup:
+	pecan_free(&part);
+	return ret;
+}
+
+/**
+ * Copies the thumbnail of an archive from the previous atlas if it's still
+ * valid.
+ *
+ * @param  build   Build state.
+ * @param  rec     Directory record of the new thumbnail.
+ * @param  cell    Cell of the new thumbnail.
+ * @param  name    Path of the archive relative to the parts bin.
+ * @param  hash    Hash of the image.
+ * @param  by_hash Compare the image hash instead of the file's modification
+ *                 time and size.
+ * @return         Non-zero if the thumbnail was carried over.
+ */
+static int atlas_reuse(atlas_build_t *build, unsigned char *rec,
+					   unsigned char *cell, const char *name, uint64_t hash,
+					   int by_hash) {
+	pecan_atlas_thumb_t thumb;
+	size_t index;
+	uint32_t y;
+
+	// Find the previous thumbnail.
+	if ((build->old == NULL) || !pecan_atlas_find(build->old, name, &index) ||
+			(pecan_atlas_get(build->old, index, &thumb) != PECAN_OK))
+		return 0;
+
+	// Check if it's still valid.
+	if (by_hash) {
+		if (thumb.hash != hash)
+			return 0;
+	} else if ((thumb.mtime != (int64_t)le_read64(rec + 8)) ||
+			   (thumb.size != le_read64(rec + 16)) ||
+			   (thumb.mtime_nsec != le_read32(rec + 32))) {
+		return 0;
+	}
+
+	// Copy it over.
+	le_write64(rec + 24, thumb.hash);
+	le_write16(rec + 36, (uint16_t)thumb.width);
+	le_write16(rec + 38, (uint16_t)thumb.height);
+	for (y = 0; y < thumb.height; y++) {
+		memcpy(cell + (y * thumb.stride), thumb.pixels + (y * thumb.stride),
+			   thumb.width * PECAN_BMP_PIXEL_SIZE);
+	}
+
+	return 1;
+}
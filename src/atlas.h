@@ -0,0 +1,87 @@
+/**
+ * atlas.h
+ * Persistent atlas holding a thumbnail of the image of every archive in a bin.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _ATLAS_H
+#define _ATLAS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "bmp.h"
+#include "pecan.h"
+#include "pool.h"
+
+// Atlas format definitions.
+#define ATLAS_MAGIC        "PATL"
+#define ATLAS_VERSION      1
+#define ATLAS_PAGE_SIZE    4096
+#define ATLAS_HEADER_SIZE  64
+#define ATLAS_DIR_SIZE     48
+
+// Default size of the thumbnails.
+#define PECAN_ATLAS_DEFAULT_SIZE 64
+
+// Thumbnail inside an atlas. Everything points straight into the mapped atlas.
+typedef struct {
+	const char *name;
+	size_t name_len;
+
+	int64_t mtime;
+	uint32_t mtime_nsec;
+	uint64_t size;
+	uint64_t hash;
+
+	uint32_t width;
+	uint32_t height;
+	size_t stride;
+	const unsigned char *pixels;
+} pecan_atlas_thumb_t;
+
+// Atlas structure definition.
+typedef struct {
+	const unsigned char *map;
+	size_t len;
+
+	uint32_t count;
+	uint32_t cell_width;
+	uint32_t cell_height;
+	const char *strings;
+	uint64_t strings_len;
+	const unsigned char *buckets;
+	uint32_t nbuckets;
+	const unsigned char *dir;
+	const unsigned char *pixels;
+} pecan_atlas_t;
+
+// Initialization
+PECAN_EXPORTS pecan_err_t pecan_atlas_open(pecan_atlas_t *atlas,
+										   const char *fname);
+
+// Lookup
+PECAN_EXPORTS size_t pecan_atlas_len(pecan_atlas_t *atlas);
+PECAN_EXPORTS pecan_err_t pecan_atlas_get(pecan_atlas_t *atlas, size_t index,
+										  pecan_atlas_thumb_t *thumb);
+PECAN_EXPORTS int pecan_atlas_find(pecan_atlas_t *atlas, const char *name,
+								   size_t *index);
+
+// Building
+PECAN_EXPORTS pecan_err_t pecan_atlas_build(pecan_pool_t *pool,
+											const char *root,
+											const char *fname, uint32_t width,
+											uint32_t height, size_t *decoded);
+
+// Cleanup
+PECAN_EXPORTS void pecan_atlas_close(pecan_atlas_t *atlas);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ATLAS_H */
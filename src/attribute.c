@@ -11,6 +11,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+// Private methods.
+static void attr_drop_name(pecan_attr_t *attr);
+static void attr_drop_value(pecan_attr_t *attr);
+
 /**
  * Initializes an component attribute structure.
  *
@@ -19,6 +23,7 @@
 void attr_init(pecan_attr_t *attr) {
 	attr->name = NULL;
 	attr->value = NULL;
+	attr->flags = 0;
 }
 
 /**
@@ -28,12 +33,25 @@ void attr_init(pecan_attr_t *attr) {
  * @param name New name of the attribute.
  */
 void attr_set_name(pecan_attr_t *attr, const char *name) {
+	attr_set_name_n(attr, name, strlen(name));
+}
+
+/**
+ * Sets the name of the attribute from a string of known length, which doesn't
+ * need to be NULL terminated.
+ *
+ * @param attr Attribute to be changed.
+ * @param name New name of the attribute.
+ * @param len  Number of characters to copy from the name string.
+ */
+void attr_set_name_n(pecan_attr_t *attr, const char *name, size_t len) {
 	// Make sure we have enough space to store our attribute.
-	free(attr->name);
-	attr->name = (char *)malloc((strlen(name) + 1) * sizeof(char));
+	attr_drop_name(attr);
+	attr->name = (char *)mem_alloc(NULL, (len + 1) * sizeof(char));
 
 	// Actually set the attribute.
-	strcpy(attr->name, name);
+	memcpy(attr->name, name, len * sizeof(char));
+	attr->name[len] = '\0';
 }
 
 /**
@@ -44,35 +62,64 @@ void attr_set_name(pecan_attr_t *attr, const char *name) {
  * @param end   Pointer to the start of the new name of the attribute.
  */
 void attr_set_name_tk(pecan_attr_t *attr, const char *start, const char *end) {
-	char *buftmp;
-	const char *tmp;
+	attr_set_name_n(attr, start, end - start);
+}
 
-	// Make sure we have enough space to store our attribute.
-	free(attr->name);
-	attr->name = (char *)malloc((end - start + 1) * sizeof(char));
-
-	// Copy the token to the attribute.
-	buftmp = attr->name;
-	tmp = start;
-	while (tmp != end) {
-		*buftmp++ = *tmp++;
-	}
-	*buftmp = '\0';
+/**
+ * Sets the name of the attribute by taking ownership of an already allocated
+ * string, avoiding a copy.
+ * WARNING: The string will be free'd by the attribute, so it must have been
+ *          allocated with mem_alloc (plain malloc unless a global allocator
+ *          was set) and must not be used by the caller afterwards.
+ *
+ * @param attr Attribute to be changed.
+ * @param name Allocated string with the new name of the attribute.
+ */
+void attr_take_name(pecan_attr_t *attr, char *name) {
+	attr_drop_name(attr);
+	attr->name = name;
 }
 
 /**
- * Sets the name of the attribute.
+ * Sets the name of the attribute to a string that's owned by someone else,
+ * usually an arena, avoiding a copy. The attribute will never free it.
+ * WARNING: The string must outlive the attribute.
+ *
+ * @param attr Attribute to be changed.
+ * @param name String with the new name of the attribute.
+ */
+void attr_borrow_name(pecan_attr_t *attr, char *name) {
+	attr_drop_name(attr);
+	attr->name = name;
+	attr->flags |= ATTR_NAME_BORROWED;
+}
+
+/**
+ * Sets the value of the attribute.
  *
  * @param attr  Attribute to be changed.
  * @param value New value of the attribute.
  */
 void attr_set_value(pecan_attr_t *attr, const char *value) {
+	attr_set_value_n(attr, value, strlen(value));
+}
+
+/**
+ * Sets the value of the attribute from a string of known length, which doesn't
+ * need to be NULL terminated.
+ *
+ * @param attr  Attribute to be changed.
+ * @param value New value of the attribute.
+ * @param len   Number of characters to copy from the value string.
+ */
+void attr_set_value_n(pecan_attr_t *attr, const char *value, size_t len) {
 	// Make sure we have enough space to store our attribute.
-	free(attr->value);
-	attr->value = (char *)malloc((strlen(value) + 1) * sizeof(char));
+	attr_drop_value(attr);
+	attr->value = (char *)mem_alloc(NULL, (len + 1) * sizeof(char));
 
 	// Actually set the attribute.
-	strcpy(attr->value, value);
+	memcpy(attr->value, value, len * sizeof(char));
+	attr->value[len] = '\0';
 }
 
 /**
@@ -83,94 +130,78 @@ void attr_set_value(pecan_attr_t *attr, const char *value) {
  * @param end   Pointer to the start of the new value of the attribute.
  */
 void attr_set_value_tk(pecan_attr_t *attr, const char *start, const char *end) {
-	char *buftmp;
-	const char *tmp;
-
-	// Make sure we have enough space to store our attribute.
-	free(attr->value);
-	attr->value = (char *)malloc((end - start + 1) * sizeof(char));
-
-	// Copy the token to the attribute.
-	buftmp = attr->value;
-	tmp = start;
-	while (tmp != end) {
-		*buftmp++ = *tmp++;
-	}
-	*buftmp = '\0';
+	attr_set_value_n(attr, start, end - start);
 }
 
 /**
- * Gets an attribute in the proper format to be written to an attributes file
- * already with a newline at the end.
- * WARNING: This function allocates its return string, so you're responsible
- *          for freeing it.
+ * Sets the value of the attribute by taking ownership of an already allocated
+ * string, avoiding a copy.
+ * WARNING: The string will be free'd by the attribute, so it must have been
+ *          allocated with mem_alloc (plain malloc unless a global allocator
+ *          was set) and must not be used by the caller afterwards.
  *
- * @param  attr Attribute to be formatted.
- * @param  buf  Pointer to the formatted string. (WARNING: Allocated internally)
- * @return      Size of the formatted attribute string or 0 if an error occured.
+ * @param attr  Attribute to be changed.
+ * @param value Allocated string with the new value of the attribute.
  */
-size_t attr_get_file_format(pecan_attr_t attr, char **buf) {
-	// Calculate the length of the final string.
-	size_t len = 2 + strlen(attr.name) + strlen(attr.value);
+void attr_take_value(pecan_attr_t *attr, char *value) {
+	attr_drop_value(attr);
+	attr->value = value;
+}
 
-	// Allocate some space and copy the string over.
-	*buf = (char *)realloc(*buf, (len + 1) * sizeof(char));
-	if (*buf == NULL)
-		return 0;
-	sprintf(*buf, "%s\t%s\n", attr.name, attr.value);
+/**
+ * Sets the value of the attribute to a string that's owned by someone else,
+ * usually an arena, avoiding a copy. The attribute will never free it.
+ * WARNING: The string must outlive the attribute.
+ *
+ * @param attr  Attribute to be changed.
+ * @param value String with the new value of the attribute.
+ */
+void attr_borrow_value(pecan_attr_t *attr, char *value) {
+	attr_drop_value(attr);
+	attr->value = value;
+	attr->flags |= ATTR_VALUE_BORROWED;
+}
 
-	return len;
+/**
+ * Copies an attribute into a new, independent, attribute.
+ *
+ * @param dest Initialized attribute to receive the copy.
+ * @param src  Attribute to be copied.
+ */
+void attr_copy(pecan_attr_t *dest, pecan_attr_t src) {
+	if (src.name)
+		attr_set_name(dest, src.name);
+	if (src.value)
+		attr_set_value(dest, src.value);
 }
 
 /**
- * Gets all of the attributes in an array and gives back the contents to write
- * it back to an attributes file.
- * WARNING: This function allocates its return string, so you're responsible
+ * Creates a deep copy of an attributes array.
+ * WARNING: This function allocates its return array, so you're responsible
  *          for freeing it.
  *
- * @param  attribs Attributes array to be written to a file.
- * @param  buf     Pointer to the file contents. (WARNING: Allocated internally)
- * @return         Size of the file content string or 0 if an error occured.
+ * @param  attribs Attributes array to be copied.
+ * @return         Copy of the array or NULL if the original was empty.
  */
-size_t attr_get_file(pecan_attr_arr_t attribs, char **buf) {
+pecan_attr_arr_t attr_arr_copy(pecan_attr_arr_t attribs) {
+	pecan_attr_arr_t copy = NULL;
 	pecan_attr_t *it;
-	char *tmpbuf;
-	size_t len;
 
-	// Reset things up.
-	*buf = NULL;
-	len = 1;
+	// Make sure we allocate just once.
+	if (cvector_size(attribs) == 0)
+		return NULL;
+	cvector_reserve(copy, cvector_size(attribs));
 
-	// Iterate over the attributes populating the contents buffer.
+	// Copy each attribute over.
 	for (it = cvector_begin(attribs); it != cvector_end(attribs); ++it) {
-		char *abuf;
-		size_t alen;
-
-		// Get a new attribute line for the file.
-		abuf = NULL;
-		alen = attr_get_file_format(*it, &abuf);
-
-		// Allocate enough space to hold our content.
-		len += alen;
-		*buf = (char *)realloc(*buf, len * sizeof(char));
-		tmpbuf = (*buf) + len - alen - 1;
-
-		// Concatenate the new attribute to the existing content.
-		while (*abuf != '\0') {
-			*tmpbuf = *abuf;
+		pecan_attr_t attr;
 
-			tmpbuf++;
-			abuf++;
-		}
-
-		// Clean up our mess.
-		abuf -= alen;
-		free(abuf);
+		attr_init(&attr);
+		attr_copy(&attr, *it);
+		cvector_push_back(copy, attr);
 	}
 
-	// NULL terminate the string and return.
-	*tmpbuf = '\0';
-	return len;
+	return copy;
 }
 
 /**
@@ -179,8 +210,32 @@ size_t attr_get_file(pecan_attr_arr_t attribs, char **buf) {
  * @param attr Attribute to have its contents free'd.
  */
 void attr_free(pecan_attr_t attr) {
-	free(attr.name);
-	attr.name = NULL;
-	free(attr.value);
-	attr.value = NULL;
+	attr_drop_name(&attr);
+	attr_drop_value(&attr);
+}
+
+/**
+ * Lets go of the name of the attribute, freeing it if we own it.
+ *
+ * @param attr Attribute to have its name dropped.
+ */
+static void attr_drop_name(pecan_attr_t *attr) {
+	if (!(attr->flags & ATTR_NAME_BORROWED))
+		mem_free(NULL, attr->name);
+
+	attr->name = NULL;
+	attr->flags &= ~ATTR_NAME_BORROWED;
+}
+
+/**
+ * Lets go of the value of the attribute, freeing it if we own it.
+ *
+ * @param attr Attribute to have its value dropped.
+ */
+static void attr_drop_value(pecan_attr_t *attr) {
+	if (!(attr->flags & ATTR_VALUE_BORROWED))
+		mem_free(NULL, attr->value);
+
+	attr->value = NULL;
+	attr->flags &= ~ATTR_VALUE_BORROWED;
 }
@@ -12,12 +12,18 @@
 extern "C" {
 #endif
 
+#include "alloc.h"
 #include <cvector.h>
 
+// Attribute string ownership flags.
+#define ATTR_NAME_BORROWED  0x01
+#define ATTR_VALUE_BORROWED 0x02
+
 // Key-Value pair attribute structure definition.
 typedef struct {
 	char *name;
 	char *value;
+	unsigned int flags;
 } pecan_attr_t;
 
 // Attribute array type definition.
@@ -28,13 +34,19 @@ void attr_init(pecan_attr_t *attr);
 
 // Setters
 void attr_set_name(pecan_attr_t *attr, const char *name);
+void attr_set_name_n(pecan_attr_t *attr, const char *name, size_t len);
 void attr_set_name_tk(pecan_attr_t *attr, const char *start, const char *end);
+void attr_take_name(pecan_attr_t *attr, char *name);
+void attr_borrow_name(pecan_attr_t *attr, char *name);
 void attr_set_value(pecan_attr_t *attr, const char *value);
+void attr_set_value_n(pecan_attr_t *attr, const char *value, size_t len);
 void attr_set_value_tk(pecan_attr_t *attr, const char *start, const char *end);
+void attr_take_value(pecan_attr_t *attr, char *value);
+void attr_borrow_value(pecan_attr_t *attr, char *value);
 
-// Formatting
-size_t attr_get_file_format(pecan_attr_t attr, char **buf);
-size_t attr_get_file(pecan_attr_arr_t attribs, char **buf);
+// Copying
+void attr_copy(pecan_attr_t *dest, pecan_attr_t src);
+pecan_attr_arr_t attr_arr_copy(pecan_attr_arr_t attribs);
 
 // Cleanup
 void attr_free(pecan_attr_t attr);
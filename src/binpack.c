@@ -0,0 +1,1134 @@
+/**
+ * binpack.c
+ * Single file container holding every component archive of a parts bin.
+ *
+ * A pack is meant to be mapped into memory and used as is, without parsing.
+ * All integers are stored in little-endian and every offset is relative to
+ * the start of the file:
+ *
+ *   Header     magic[4], version (u16), flags (u16), page size (u32),
+ *              parts (u32), strings offset (u64), strings length (u64),
+ *              attributes offset (u64), attributes (u64), directory offset
+ *              (u64), file length (u64)
+ *   Strings    NUL terminated strings shared by every part.
+ *   Attributes attributes * {name (u32), value (u32)} string offsets.
+ *   Directory  parts * {name (u32), manifest first (u32), manifest length
+ *              (u32), parameters first (u32), parameters length (u32),
+ *              reserved (u32), image offset (u64), image length (u64),
+ *              datasheet offset (u64), datasheet length (u64), reserved (u64)}
+ *              sorted by part name.
+ *   Blobs      Images and datasheets, each starting on a page boundary.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "binpack.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "byteorder.h"
+#include "error.h"
+#include "fileutils.h"
+
+// Initial number of slots in the hash tables used while writing.
+#define BINPACK_INITIAL_SLOTS 1024
+
+// Size of the pieces that blobs are split into to be written by the pool.
+#define BINPACK_WRITE_CHUNK (1024 * 1024)
+
+// Growable byte buffer.
+typedef struct {
+	unsigned char *data;
+	size_t len;
+	size_t cap;
+} bytebuf_t;
+
+// Deduplicated string table.
+typedef struct {
+	bytebuf_t buf;
+	uint32_t *slots;
+	size_t nslots;
+	size_t count;
+} strtab_t;
+
+// Offsets of blobs that were already placed in the pack.
+typedef struct {
+	const void **keys;
+	uint64_t *offsets;
+	size_t nslots;
+	size_t count;
+} blobmap_t;
+
+// Part being written to the pack.
+typedef struct {
+	const char *name;
+	pecan_archive_t *part;
+
+	uint32_t name_off;
+	uint32_t manifest_first;
+	uint32_t manifest_len;
+	uint32_t params_first;
+	uint32_t params_len;
+	uint64_t image_off;
+	uint64_t datasheet_off;
+	int image_new;
+	int datasheet_new;
+} pack_item_t;
+
+// Piece of a blob to be written to the pack by a task.
+typedef struct {
+	int fd;
+	const unsigned char *data;
+	size_t len;
+	uint64_t off;
+	int *bad;
+} pack_chunk_t;
+
+// Private methods.
+static const char *pack_string(pecan_binpack_t *pack, uint32_t off);
+static uint64_t round_page(uint64_t n);
+static int pack_item_cmp(const void *a, const void *b);
+static const char *pack_item_name(pecan_catalog_t *cat, const char *path);
+static int pack_item_attrs(pack_item_t *item, pecan_attr_type_t type,
+						   strtab_t *st, bytebuf_t *attrs);
+static uint64_t pack_item_blob(blobmap_t *map, pecan_blob_t *blob,
+							   uint64_t *cursor, int *placed);
+static int pack_write_pad(FILE *fh, uint64_t *pos, uint64_t to);
+static size_t pack_blob_chunks(pack_chunk_t *chunks, int fd,
+							   pecan_blob_t *blob, uint64_t off, int *bad);
+static void pack_chunk_task(void *arg);
+static unsigned char *bytebuf_grow(bytebuf_t *buf, size_t len);
+static int strtab_add(strtab_t *st, const char *str, uint32_t *off);
+static int strtab_rehash(strtab_t *st);
+static int blobmap_get(blobmap_t *map, const void *key, uint64_t *off);
+static int blobmap_put(blobmap_t *map, const void *key, uint64_t off);
+
+/**
+ * Opens a bin pack by mapping it into memory. Only the header is checked, the
+ * rest of the pack is only touched when it's used.
+ *
+ * @param  pack  Bin pack structure to be populated.
+ * @param  fname Path to the bin pack file.
+ * @return       PECAN_OK if the operation was successful.
+ *               PECAN_ERR_PATH_NOT_FOUND if the file couldn't be opened.
+ *               PECAN_ERR_FILE_IO if the file couldn't be mapped.
+ *               PECAN_ERR_PARSE if the file isn't a valid bin pack.
+ */
+pecan_err_t pecan_binpack_open(pecan_binpack_t *pack, const char *fname) {
+	const unsigned char *h;
+	struct stat sb;
+	uint64_t strings_off;
+	uint64_t attrs_off;
+	uint64_t dir_off;
+	void *map;
+	int fd;
+
+	pack->map = NULL;
+	pack->len = 0;
+
+	// Open the file.
+	fd = open(fname, O_RDONLY);
+	if (fd == -1) {
+		err_format_msg(EMSG("Couldn't open bin pack '%s'"), fname);
+		return PECAN_ERR_PATH_NOT_FOUND;
+	}
+	if ((fstat(fd, &sb) != 0) || (sb.st_size < BINPACK_HEADER_SIZE)) {
+		close(fd);
+		err_format_msg(EMSG("'%s' is too small to be a bin pack"), fname);
+		return PECAN_ERR_PARSE;
+	}
+
+	// Map it into memory. The mapping outlives the descriptor.
+	map = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		err_format_msg(EMSG("Couldn't map bin pack '%s'"), fname);
+		return PECAN_ERR_FILE_IO;
+	}
+	pack->map = (const unsigned char *)map;
+	pack->len = (size_t)sb.st_size;
+
+	// Check the header.
+	h = pack->map;
+	if ((memcmp(h, BINPACK_MAGIC, 4) != 0) ||
+			(le_read16(h + 4) != BINPACK_VERSION))
+		goto invalid;
+	pack->nparts = le_read32(h + 12);
+	strings_off = le_read64(h + 16);
+	pack->strings_len = le_read64(h + 24);
+	attrs_off = le_read64(h + 32);
+	pack->nattrs = le_read64(h + 40);
+	dir_off = le_read64(h + 48);
+	if (le_read64(h + 56) != pack->len)
+		goto invalid;
+
+	// Make sure every table is inside the file.
+	if ((strings_off > pack->len) ||
+			(pack->strings_len > (pack->len - strings_off)) ||
+			(attrs_off > pack->len) ||
+			(pack->nattrs > ((pack->len - attrs_off) / BINPACK_ATTR_SIZE)) ||
+			(dir_off > pack->len) ||
+			(pack->nparts > ((pack->len - dir_off) / BINPACK_DIR_SIZE)))
+		goto invalid;
+
+	// Strings must be terminated so that they can be used directly.
+	pack->strings = (const char *)pack->map + strings_off;
+	if ((pack->strings_len > 0) &&
+			(pack->strings[pack->strings_len - 1] != '\0'))
+		goto invalid;
+	pack->attrs = pack->map + attrs_off;
+	pack->dir = pack->map + dir_off;
+
+	return PECAN_OK;
+
+invalid:
+	pecan_binpack_close(pack);
+	err_format_msg(EMSG("'%s' isn't a valid bin pack"), fname);
+	return PECAN_ERR_PARSE;
+}
+
+/**
+ * Gets the number of parts in a bin pack.
+ *
+ * @param  pack Bin pack structure.
+ * @return      Number of parts.
+ */
+size_t pecan_binpack_len(pecan_binpack_t *pack) {
+	return pack->nparts;
+}
+
+/**
+ * Gets a part from a bin pack. Its strings and blobs point straight into the
+ * pack and are only valid while the pack is open.
+ *
+ * @param  pack  Bin pack structure.
+ * @param  index Index of the part in name order.
+ * @param  part  Structure to receive the part.
+ * @return       PECAN_OK if the operation was successful.
+ *               PECAN_ERR_PATH_NOT_FOUND if the index is out of bounds.
+ *               PECAN_ERR_PARSE if the part's record is corrupted.
+ */
+pecan_err_t pecan_binpack_get(pecan_binpack_t *pack, size_t index,
+							  pecan_binpack_part_t *part) {
+	const unsigned char *rec;
+	uint64_t image_off;
+	uint64_t image_len;
+	uint64_t datasheet_off;
+	uint64_t datasheet_len;
+
+	// Check if we have it.
+	if (index >= pack->nparts) {
+		err_format_msg(EMSG("Part %zu is outside of the bin pack"), index);
+		return PECAN_ERR_PATH_NOT_FOUND;
+	}
+
+	// Decode the record.
+	rec = pack->dir + (index * BINPACK_DIR_SIZE);
+	part->name = pack_string(pack, le_read32(rec));
+	part->manifest_first = le_read32(rec + 4);
+	part->manifest_len = le_read32(rec + 8);
+	part->params_first = le_read32(rec + 12);
+	part->params_len = le_read32(rec + 16);
+	image_off = le_read64(rec + 24);
+	image_len = le_read64(rec + 32);
+	datasheet_off = le_read64(rec + 40);
+	datasheet_len = le_read64(rec + 48);
+
+	// Make sure it doesn't point outside of the pack.
+	if ((part->name == NULL) ||
+			(((uint64_t)part->manifest_first + part->manifest_len) >
+			 pack->nattrs) ||
+			(((uint64_t)part->params_first + part->params_len) >
+			 pack->nattrs) ||
+			(image_off > pack->len) || (image_len > (pack->len - image_off)) ||
+			(datasheet_off > pack->len) ||
+			(datasheet_len > (pack->len - datasheet_off))) {
+		err_format_msg(EMSG("Record of part %zu is corrupted"), index);
+		return PECAN_ERR_PARSE;
+	}
+
+	// Point to the blobs.
+	part->image = (image_len) ? pack->map + image_off : NULL;
+	part->image_len = (size_t)image_len;
+	part->datasheet = (datasheet_len) ? pack->map + datasheet_off : NULL;
+	part->datasheet_len = (size_t)datasheet_len;
+
+	return PECAN_OK;
+}
+
+/**
+ * Finds a part in a bin pack by its name, which is its path relative to the
+ * parts bin it was packed from.
+ *
+ * @param  pack  Bin pack structure.
+ * @param  name  Name of the part.
+ * @param  index Pointer to receive the index of the part.
+ * @return       Non-zero if the part was found.
+ */
+int pecan_binpack_find(pecan_binpack_t *pack, const char *name,
+					   size_t *index) {
+	size_t lo;
+	size_t hi;
+
+	// Binary search through the directory.
+	lo = 0;
+	hi = pack->nparts;
+	while (lo < hi) {
+		size_t mid = lo + ((hi - lo) / 2);
+		const char *str;
+		int cmp;
+
+		str = pack_string(pack, le_read32(pack->dir + (mid * BINPACK_DIR_SIZE)));
+		if (str == NULL)
+			return 0;
+
+		cmp = strcmp(str, name);
+		if (cmp == 0) {
+			*index = mid;
+			return 1;
+		} else if (cmp < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Gets the number of attributes of a part.
+ *
+ * @param  part Part from the bin pack.
+ * @param  type Type of attribute.
+ * @return      Number of attributes.
+ */
+size_t pecan_binpack_attr_len(pecan_binpack_part_t *part,
+							  pecan_attr_type_t type) {
+	return (type == PECAN_PARAMETERS) ? part->params_len : part->manifest_len;
+}
+
+/**
+ * Gets an attribute of a part by its index.
+ *
+ * @param  pack  Bin pack structure.
+ * @param  part  Part from the bin pack.
+ * @param  type  Type of attribute.
+ * @param  index Index of the attribute.
+ * @param  name  Pointer to receive the attribute name.
+ * @param  value Pointer to receive the attribute value.
+ * @return       Non-zero if the attribute exists.
+ */
+int pecan_binpack_attr_idx(pecan_binpack_t *pack, pecan_binpack_part_t *part,
+						   pecan_attr_type_t type, size_t index,
+						   const char **name, const char **value) {
+	const unsigned char *rec;
+	uint32_t first;
+
+	// Check if we have it.
+	if (index >= pecan_binpack_attr_len(part, type))
+		return 0;
+	first = (type == PECAN_PARAMETERS) ? part->params_first :
+		part->manifest_first;
+
+	// Get its strings.
+	rec = pack->attrs + ((first + index) * BINPACK_ATTR_SIZE);
+	*name = pack_string(pack, le_read32(rec));
+	*value = pack_string(pack, le_read32(rec + 4));
+
+	return (*name != NULL) && (*value != NULL);
+}
+
+/**
+ * Gets the value of an attribute of a part by its name.
+ *
+ * @param  pack Bin pack structure.
+ * @param  part Part from the bin pack.
+ * @param  type Type of attribute.
+ * @param  name Name of the attribute.
+ * @return      Value of the attribute or NULL if it wasn't found.
+ */
+const char *pecan_binpack_get_attr(pecan_binpack_t *pack,
+								   pecan_binpack_part_t *part,
+								   pecan_attr_type_t type, const char *name) {
+	const char *aname;
+	const char *avalue;
+	size_t i;
+
+	for (i = 0; i < pecan_binpack_attr_len(part, type); i++) {
+		if (pecan_binpack_attr_idx(pack, part, type, i, &aname, &avalue) &&
+				(strcmp(aname, name) == 0))
+			return avalue;
+	}
+
+	return NULL;
+}
+
+/**
+ * Reads a part from a bin pack into an archive structure.
+ *
+ * @param  pack  Bin pack structure.
+ * @param  index Index of the part.
+ * @param  part  Empty component archive to be populated.
+ * @return       PECAN_OK if the operation was successful.
+ *               PECAN_ERR_PATH_NOT_FOUND if the index is out of bounds.
+ *               PECAN_ERR_PARSE if the part's record is corrupted.
+ *               PECAN_ERR_UNKNOWN if we weren't able to allocate memory.
+ */
+pecan_err_t pecan_binpack_read(pecan_binpack_t *pack, size_t index,
+							   pecan_archive_t *part) {
+	pecan_binpack_part_t bp;
+	const char *name;
+	const char *value;
+	pecan_err_t err;
+	size_t i;
+	int type;
+
+	// Get the part.
+	err = pecan_binpack_get(pack, index, &bp);
+	if (err)
+		return err;
+	part->fname = mem_strndup(NULL, bp.name, strlen(bp.name));
+	if (part->fname == NULL)
+		goto nomem;
+
+	// Copy the attributes.
+	for (type = PECAN_MANIFEST; type <= PECAN_PARAMETERS; type++) {
+		for (i = 0; i < pecan_binpack_attr_len(&bp, (pecan_attr_type_t)type);
+				i++) {
+			char *aname;
+			char *avalue;
+
+			if (!pecan_binpack_attr_idx(pack, &bp, (pecan_attr_type_t)type, i,
+					&name, &value)) {
+				err_format_msg(EMSG("Attributes of part '%s' are corrupted"),
+							   bp.name);
+				return PECAN_ERR_PARSE;
+			}
+
+			// Copy the strings ourselves so that we can check for failures.
+			aname = mem_strndup(NULL, name, strlen(name));
+			avalue = mem_strndup(NULL, value, strlen(value));
+			if ((aname == NULL) || (avalue == NULL)) {
+				mem_free(NULL, aname);
+				mem_free(NULL, avalue);
+				goto nomem;
+			}
+			pecan_add_attr_take(part, (pecan_attr_type_t)type, aname, avalue);
+		}
+	}
+
+	// Copy the blobs.
+	if (((bp.image_len > 0) &&
+			(blob_copy(&part->image, bp.image, bp.image_len) == 0)) ||
+			((bp.datasheet_len > 0) &&
+			(blob_copy(&part->datasheet, bp.datasheet, bp.datasheet_len) == 0))) {
+		err_format_msg(EMSG("Couldn't allocate the blobs of part '%s'"),
+					   bp.name);
+		return PECAN_ERR_UNKNOWN;
+	}
+	if (part->store) {
+		blobstore_intern(part->store, &part->image);
+		blobstore_intern(part->store, &part->datasheet);
+	}
+
+	return PECAN_OK;
+
+nomem:
+	err_format_msg(EMSG("Couldn't allocate the attributes of part '%s'"),
+				   bp.name);
+	return PECAN_ERR_UNKNOWN;
+}
+
+/**
+ * Writes every archive of a loaded catalog to a new bin pack. Blobs that were
+ * deduplicated by the catalog are only stored once. Since every blob already
+ * has its place in the file they are written in pieces by the catalog's pool.
+ *
+ * @param  cat   Loaded catalog.
+ * @param  fname Path to the bin pack file to be written.
+ * @return       PECAN_OK if the operation was successful.
+ *               PECAN_ERR_FILE_IO if there were errors while writing.
+ *               PECAN_ERR_UNKNOWN if we weren't able to allocate memory.
+ */
+pecan_err_t pecan_binpack_write(pecan_catalog_t *cat, const char *fname) {
+	unsigned char rec[BINPACK_HEADER_SIZE];
+	pack_item_t *items = NULL;
+	size_t nitems;
+	pack_chunk_t *chunks = NULL;
+	size_t nchunks;
+	pecan_taskgroup_t group;
+	pecan_pool_t *pool;
+	int bad;
+	strtab_t st;
+	bytebuf_t attrs;
+	blobmap_t map;
+	uint64_t attrs_off;
+	uint64_t dir_off;
+	uint64_t cursor;
+	uint64_t pos;
+	size_t i;
+	FILE *fh = NULL;
+	pecan_err_t err = PECAN_OK;
+
+	memset(&st, 0, sizeof(st));
+	memset(&attrs, 0, sizeof(attrs));
+	memset(&map, 0, sizeof(map));
+
+	// Gather the archives that were loaded in name order.
+	items = (pack_item_t *)mem_calloc(NULL, pecan_catalog_len(cat) + 1,
+		sizeof(pack_item_t));
+	if (items == NULL)
+		goto nomem;
+	nitems = 0;
+	for (i = 0; i < pecan_catalog_len(cat); i++) {
+		pecan_catalog_entry_t *entry = pecan_catalog_get(cat, i);
+
+		if (entry->err)
+			continue;
+		items[nitems].name = pack_item_name(cat, entry->path);
+		items[nitems].part = &entry->part;
+		nitems++;
+	}
+	qsort(items, nitems, sizeof(pack_item_t), pack_item_cmp);
+
+	// Build the string table and attribute records.
+	for (i = 0; i < nitems; i++) {
+		if (!strtab_add(&st, items[i].name, &items[i].name_off) ||
+				!pack_item_attrs(&items[i], PECAN_MANIFEST, &st, &attrs) ||
+				!pack_item_attrs(&items[i], PECAN_PARAMETERS, &st, &attrs))
+			goto nomem;
+	}
+
+	// Lay the tables out and place the blobs after them.
+	attrs_off = (BINPACK_HEADER_SIZE + st.buf.len + 7) & ~(uint64_t)7;
+	dir_off = attrs_off + attrs.len;
+	cursor = round_page(dir_off + (nitems * BINPACK_DIR_SIZE));
+	for (i = 0; i < nitems; i++) {
+		items[i].image_off = pack_item_blob(&map, &items[i].part->image,
+			&cursor, &items[i].image_new);
+		items[i].datasheet_off = pack_item_blob(&map,
+			&items[i].part->datasheet, &cursor, &items[i].datasheet_new);
+		if ((items[i].image_off == 0 && items[i].part->image.len) ||
+				(items[i].datasheet_off == 0 && items[i].part->datasheet.len))
+			goto nomem;
+	}
+
+	// Open the pack for writing.
+	fh = fopen(fname, "wb");
+	if (fh == NULL) {
+		err_format_msg(EMSG("Couldn't open '%s' for writing"), fname);
+		err = PECAN_ERR_FILE_IO;
+		goto cleanup;
+	}
+
+	// Header.
+	memset(rec, 0, sizeof(rec));
+	memcpy(rec, BINPACK_MAGIC, 4);
+	le_write16(rec + 4, BINPACK_VERSION);
+	le_write32(rec + 8, BINPACK_PAGE_SIZE);
+	le_write32(rec + 12, (uint32_t)nitems);
+	le_write64(rec + 16, BINPACK_HEADER_SIZE);
+	le_write64(rec + 24, st.buf.len);
+	le_write64(rec + 32, attrs_off);
+	le_write64(rec + 40, attrs.len / BINPACK_ATTR_SIZE);
+	le_write64(rec + 48, dir_off);
+	le_write64(rec + 56, cursor);
+	pos = fwrite(rec, 1, BINPACK_HEADER_SIZE, fh);
+
+	// Strings and attributes.
+	pos += fwrite(st.buf.data, 1, st.buf.len, fh);
+	if (!pack_write_pad(fh, &pos, attrs_off))
+		goto ioerr;
+	pos += fwrite(attrs.data, 1, attrs.len, fh);
+
+	// Directory.
+	for (i = 0; i < nitems; i++) {
+		memset(rec, 0, sizeof(rec));
+		le_write32(rec, items[i].name_off);
+		le_write32(rec + 4, items[i].manifest_first);
+		le_write32(rec + 8, items[i].manifest_len);
+		le_write32(rec + 12, items[i].params_first);
+		le_write32(rec + 16, items[i].params_len);
+		le_write64(rec + 24, items[i].image_off);
+		le_write64(rec + 32, items[i].part->image.len);
+		le_write64(rec + 40, items[i].datasheet_off);
+		le_write64(rec + 48, items[i].part->datasheet.len);
+		pos += fwrite(rec, 1, BINPACK_DIR_SIZE, fh);
+	}
+
+	// Give the file its final length, leaving the blob pages zeroed.
+	if ((pos != dir_off + (nitems * BINPACK_DIR_SIZE)) || (fflush(fh) != 0) ||
+			(ftruncate(fileno(fh), (off_t)cursor) != 0))
+		goto ioerr;
+
+	// Split the blobs that were placed into pieces.
+	bad = 0;
+	nchunks = 0;
+	for (i = 0; i < nitems; i++) {
+		if (items[i].image_new)
+			nchunks += pack_blob_chunks(NULL, 0, &items[i].part->image, 0, NULL);
+		if (items[i].datasheet_new)
+			nchunks += pack_blob_chunks(NULL, 0, &items[i].part->datasheet, 0,
+										NULL);
+	}
+	chunks = (pack_chunk_t *)mem_alloc(NULL,
+		((nchunks) ? nchunks : 1) * sizeof(pack_chunk_t));
+	if (chunks == NULL)
+		goto nomem;
+	nchunks = 0;
+	for (i = 0; i < nitems; i++) {
+		if (items[i].image_new) {
+			nchunks += pack_blob_chunks(chunks + nchunks, fileno(fh),
+				&items[i].part->image, items[i].image_off, &bad);
+		}
+		if (items[i].datasheet_new) {
+			nchunks += pack_blob_chunks(chunks + nchunks, fileno(fh),
+				&items[i].part->datasheet, items[i].datasheet_off, &bad);
+		}
+	}
+
+	// Write each piece as its own task, or right here if we have no pool.
+	pool = pecan_catalog_pool(cat);
+	pool_group_init(&group);
+	for (i = 0; i < nchunks; i++) {
+		if ((pool == NULL) ||
+				(pool_submit(pool, &group, pack_chunk_task, &chunks[i]) != 0))
+			pack_chunk_task(&chunks[i]);
+	}
+	if (pool)
+		pool_wait(pool, &group);
+	if (bad)
+		goto ioerr;
+
+cleanup:
+	if (fh)
+		fclose(fh);
+	mem_free(NULL, items);
+	mem_free(NULL, chunks);
+	mem_free(NULL, st.buf.data);
+	mem_free(NULL, st.slots);
+	mem_free(NULL, attrs.data);
+	mem_free(NULL, map.keys);
+	mem_free(NULL, map.offsets);
+
+	return err;
+
+ioerr:
+	err_format_msg(EMSG("Couldn't write bin pack '%s'"), fname);
+	err = PECAN_ERR_FILE_IO;
+	goto cleanup;
+
+nomem:
+	err_set_msg(EMSG("Couldn't allocate memory to build the bin pack"));
+	err = PECAN_ERR_UNKNOWN;
+	goto cleanup;
+}
+
+/**
+ * Unpacks every part of a bin pack into packed archives inside a directory,
+ * recreating the layout of the parts bin it was packed from.
+ *
+ * @param  pack Bin pack structure.
+ * @param  dir  Directory to write the archives to. Created if needed.
+ * @return      PECAN_OK if the operation was successful.
+ *              PECAN_ERR_PATH_NOT_FOUND if a directory couldn't be created.
+ *              PECAN_ERR_FILE_IO if there were errors while writing.
+ *              PECAN_ERR_PARSE if the pack is corrupted.
+ */
+pecan_err_t pecan_binpack_unpack(pecan_binpack_t *pack, const char *dir) {
+	pecan_archive_t part;
+	char *fpath = NULL;
+	size_t i;
+	pecan_err_t err = PECAN_OK;
+
+	pecan_init(&part);
+	for (i = 0; i < pack->nparts; i++) {
+		char *sep;
+
+		// Read the part.
+		pecan_reset(&part);
+		err = pecan_binpack_read(pack, i, &part);
+		if (err)
+			break;
+
+		// Make sure we aren't tricked into writing somewhere else.
+		if (!path_is_contained(part.fname)) {
+			err_format_msg(EMSG("Bin pack part '%s' has an unsafe name"),
+						   part.fname);
+			err = PECAN_ERR_PARSE;
+			break;
+		}
+
+		// Figure out where it goes, making sure it ends up as a packed archive.
+		pathcat(2, &fpath, dir, part.fname);
+		if (!file_ext_match(fpath, "tar")) {
+			char *tmp = extcat(fpath, "tar");
+
+			mem_free(NULL, fpath);
+			fpath = tmp;
+		}
+
+		// Create its parent directories.
+		sep = strrchr(fpath, '/');
+		if (sep) {
+			*sep = '\0';
+			if (!make_path(fpath)) {
+				err_format_msg(EMSG("Couldn't create directory '%s'"), fpath);
+				err = PECAN_ERR_PATH_NOT_FOUND;
+				break;
+			}
+			*sep = '/';
+		}
+
+		// Write it.
+		err = pecan_write(&part, fpath);
+		if (err)
+			break;
+		mem_free(NULL, fpath);
+		fpath = NULL;
+	}
+
+	pecan_release(&part);
+	mem_free(NULL, fpath);
+
+	return err;
+}
+
+/**
+ * Closes a bin pack. Anything taken from it becomes invalid.
+ *
+ * @param pack Bin pack to be closed.
+ */
+void pecan_binpack_close(pecan_binpack_t *pack) {
+	if (pack->map)
+		munmap((void *)pack->map, pack->len);
+
+	pack->map = NULL;
+	pack->len = 0;
+	pack->nparts = 0;
+	pack->strings = NULL;
+	pack->strings_len = 0;
+	pack->attrs = NULL;
+	pack->nattrs = 0;
+	pack->dir = NULL;
+}
+
+/**
+ * Gets a string from the pack's string table.
+ *
+ * @param  pack Bin pack structure.
+ * @param  off  Offset of the string in the table.
+ * @return      String or NULL if the offset is outside of the table.
+ */
+static const char *pack_string(pecan_binpack_t *pack, uint32_t off) {
+	if (off >= pack->strings_len)
+		return NULL;
+
+	return pack->strings + off;
+}
+
+/**
+ * Rounds an offset up to the next page boundary.
+ *
+ * @param  n Offset in bytes.
+ * @return   Rounded up offset.
+ */
+static uint64_t round_page(uint64_t n) {
+	return (n + (BINPACK_PAGE_SIZE - 1)) & ~(uint64_t)(BINPACK_PAGE_SIZE - 1);
+}
+
+/**
+ * Compares two pack items by name.
+ *
+ * @param  a First pack item.
+ * @param  b Second pack item.
+ * @return   Same as strcmp.
+ */
+static int pack_item_cmp(const void *a, const void *b) {
+	return strcmp(((const pack_item_t *)a)->name,
+				  ((const pack_item_t *)b)->name);
+}
+
+/**
+ * Gets the name of an archive inside a pack, which is its path relative to the
+ * root of the parts bin.
+ *
+ * @param  cat  Catalog the archive came from.
+ * @param  path Path to the archive.
+ * @return      Name of the archive pointing inside the path.
+ */
+static const char *pack_item_name(pecan_catalog_t *cat, const char *path) {
+	size_t len;
+
+	// Strip the root of the bin.
+	if (cat->root) {
+		len = strlen(cat->root);
+		if (strncmp(path, cat->root, len) == 0) {
+			path += len;
+			while (*path == '/')
+				path++;
+		}
+	}
+
+	return path;
+}
+
+/**
+ * Adds the attributes of an archive to the pack's tables.
+ *
+ * @param  item  Pack item of the archive.
+ * @param  type  Type of attribute.
+ * @param  st    String table.
+ * @param  attrs Attribute records.
+ * @return       Non-zero if the operation was successful.
+ */
+static int pack_item_attrs(pack_item_t *item, pecan_attr_type_t type,
+						   strtab_t *st, bytebuf_t *attrs) {
+	uint32_t first;
+	size_t len;
+	size_t i;
+
+	// Add each attribute.
+	first = (uint32_t)(attrs->len / BINPACK_ATTR_SIZE);
+	len = pecan_get_attr_len(item->part, type);
+	for (i = 0; i < len; i++) {
+		pecan_attr_t *attr = pecan_get_attr_idx(item->part, type, i);
+		unsigned char *rec;
+		uint32_t name;
+		uint32_t value;
+
+		if (!strtab_add(st, attr->name, &name) ||
+				!strtab_add(st, attr->value, &value))
+			return 0;
+		rec = bytebuf_grow(attrs, BINPACK_ATTR_SIZE);
+		if (rec == NULL)
+			return 0;
+		le_write32(rec, name);
+		le_write32(rec + 4, value);
+	}
+
+	// Keep track of where they are.
+	if (type == PECAN_PARAMETERS) {
+		item->params_first = first;
+		item->params_len = (uint32_t)len;
+	} else {
+		item->manifest_first = first;
+		item->manifest_len = (uint32_t)len;
+	}
+
+	return 1;
+}
+
+/**
+ * Places a blob in the pack, reusing the place of identical contents shared
+ * with a blob that was already placed.
+ *
+ * @param  map    Blobs that were already placed.
+ * @param  blob   Blob to be placed.
+ * @param  cursor Offset of the next free page. Updated if the blob was placed.
+ * @param  placed Set to non-zero if the blob has to be written at its offset.
+ * @return        Offset of the blob, 0 if it's empty or on allocation failure.
+ */
+static uint64_t pack_item_blob(blobmap_t *map, pecan_blob_t *blob,
+							   uint64_t *cursor, int *placed) {
+	uint64_t off;
+
+	// Nothing to place?
+	*placed = 0;
+	if (blob->len == 0)
+		return 0;
+
+	// Shared contents only need to be stored once.
+	if (blob->shared && blobmap_get(map, blob->shared, &off))
+		return off;
+
+	// Give it the next free pages.
+	off = *cursor;
+	if (blob->shared && !blobmap_put(map, blob->shared, off))
+		return 0;
+	*cursor = round_page(off + blob->len);
+	*placed = 1;
+
+	return off;
+}
+
+/**
+ * Pads the file with zeros up to an offset.
+ *
+ * @param  fh  File being written.
+ * @param  pos Current position in the file. Updated with the new position.
+ * @param  to  Offset to pad up to.
+ * @return     Non-zero if the operation was successful.
+ */
+static int pack_write_pad(FILE *fh, uint64_t *pos, uint64_t to) {
+	static const unsigned char zeros[BINPACK_PAGE_SIZE];
+
+	// Something has gone really wrong if we went past it.
+	if (*pos > to)
+		return 0;
+
+	while (*pos < to) {
+		size_t len = ((to - *pos) > sizeof(zeros)) ? sizeof(zeros) :
+			(size_t)(to - *pos);
+
+		if (fwrite(zeros, 1, len, fh) != len)
+			return 0;
+		*pos += len;
+	}
+
+	return !ferror(fh);
+}
+
+/**
+ * Splits a blob that was placed in the pack into pieces to be written.
+ *
+ * @param  chunks Array to store the pieces or NULL to only count them.
+ * @param  fd     File descriptor of the pack.
+ * @param  blob   Blob to be written.
+ * @param  off    Offset of the blob in the pack.
+ * @param  bad    Flag to be set if writing any of the pieces fails.
+ * @return        Number of pieces the blob was split into.
+ */
+static size_t pack_blob_chunks(pack_chunk_t *chunks, int fd,
+							   pecan_blob_t *blob, uint64_t off, int *bad) {
+	size_t n;
+	size_t i;
+
+	n = (blob->len + BINPACK_WRITE_CHUNK - 1) / BINPACK_WRITE_CHUNK;
+	if (chunks == NULL)
+		return n;
+
+	for (i = 0; i < n; i++) {
+		size_t pos = i * BINPACK_WRITE_CHUNK;
+
+		chunks[i].fd = fd;
+		chunks[i].data = (const unsigned char *)blob->data + pos;
+		chunks[i].len = ((blob->len - pos) < BINPACK_WRITE_CHUNK) ?
+			(blob->len - pos) : BINPACK_WRITE_CHUNK;
+		chunks[i].off = off + pos;
+		chunks[i].bad = bad;
+	}
+
+	return n;
+}
+
+/**
+ * Task that writes a piece of a blob at its place in the pack.
+ *
+ * @param arg Piece to be written.
+ */
+static void pack_chunk_task(void *arg) {
+	pack_chunk_t *chunk = (pack_chunk_t *)arg;
+	size_t done = 0;
+
+	while (done < chunk->len) {
+		ssize_t n = pwrite(chunk->fd, chunk->data + done, chunk->len - done,
+						   (off_t)(chunk->off + done));
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			__atomic_store_n(chunk->bad, 1, __ATOMIC_RELAXED);
+			return;
+		}
+
+		done += (size_t)n;
+	}
+}
+
+/**
+ * Grows a byte buffer.
+ *
+ * @param  buf Byte buffer.
+ * @param  len Number of bytes to append.
+ * @return     Pointer to the appended bytes or NULL if we ran out of memory.
+ */
+static unsigned char *bytebuf_grow(bytebuf_t *buf, size_t len) {
+	unsigned char *p;
+
+	// Make room.
+	if ((buf->len + len) > buf->cap) {
+		size_t cap = (buf->cap) ? buf->cap * 2 : BINPACK_PAGE_SIZE;
+		unsigned char *data;
+
+		while (cap < (buf->len + len))
+			cap *= 2;
+		data = (unsigned char *)mem_realloc(NULL, buf->data, cap);
+		if (data == NULL)
+			return NULL;
+		buf->data = data;
+		buf->cap = cap;
+	}
+
+	p = buf->data + buf->len;
+	buf->len += len;
+	return p;
+}
+
+/**
+ * Adds a string to the string table unless it's already there.
+ *
+ * @param  st  String table.
+ * @param  str String to be added.
+ * @param  off Pointer to receive the offset of the string in the table.
+ * @return     Non-zero if the operation was successful.
+ */
+static int strtab_add(strtab_t *st, const char *str, uint32_t *off) {
+	unsigned char *p;
+	size_t len;
+	size_t mask;
+	size_t slot;
+
+	// Make sure we have enough slots for a new string.
+	if ((st->count + 1) > (st->nslots / 4 * 3)) {
+		if (!strtab_rehash(st))
+			return 0;
+	}
+
+	// Check if we already have it.
+	len = strlen(str);
+	mask = st->nslots - 1;
+	slot = (size_t)(blob_hash(str, len) & mask);
+	while (st->slots[slot] != 0) {
+		uint32_t o = st->slots[slot] - 1;
+
+		if (strcmp((const char *)st->buf.data + o, str) == 0) {
+			*off = o;
+			return 1;
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	// Append it.
+	if ((st->buf.len + len + 1) > UINT32_MAX)
+		return 0;
+	*off = (uint32_t)st->buf.len;
+	p = bytebuf_grow(&st->buf, len + 1);
+	if (p == NULL)
+		return 0;
+	memcpy(p, str, len + 1);
+	st->slots[slot] = *off + 1;
+	st->count++;
+
+	return 1;
+}
+
+/**
+ * Doubles the number of slots in the string table.
+ *
+ * @param  st String table.
+ * @return    Non-zero if the operation was successful.
+ */
+static int strtab_rehash(strtab_t *st) {
+	uint32_t *slots;
+	size_t nslots;
+	size_t mask;
+	size_t i;
+
+	// Allocate the new slots.
+	nslots = (st->nslots) ? st->nslots * 2 : BINPACK_INITIAL_SLOTS;
+	slots = (uint32_t *)mem_calloc(NULL, nslots, sizeof(uint32_t));
+	if (slots == NULL)
+		return 0;
+
+	// Put every string in its new slot.
+	mask = nslots - 1;
+	for (i = 0; i < st->nslots; i++) {
+		const char *str;
+		size_t slot;
+
+		if (st->slots[i] == 0)
+			continue;
+		str = (const char *)st->buf.data + (st->slots[i] - 1);
+		slot = (size_t)(blob_hash(str, strlen(str)) & mask);
+		while (slots[slot] != 0)
+			slot = (slot + 1) & mask;
+		slots[slot] = st->slots[i];
+	}
+
+	mem_free(NULL, st->slots);
+	st->slots = slots;
+	st->nslots = nslots;
+	return 1;
+}
+
+/**
+ * Gets the offset of a blob that was already placed.
+ *
+ * @param  map Blob map.
+ * @param  key Shared contents of the blob.
+ * @param  off Pointer to receive the offset.
+ * @return     Non-zero if the blob was already placed.
+ */
+static int blobmap_get(blobmap_t *map, const void *key, uint64_t *off) {
+	size_t slot;
+
+	if (map->nslots == 0)
+		return 0;
+
+	slot = (size_t)(blob_hash(&key, sizeof(key)) & (map->nslots - 1));
+	while (map->keys[slot] != NULL) {
+		if (map->keys[slot] == key) {
+			*off = map->offsets[slot];
+			return 1;
+		}
+		slot = (slot + 1) & (map->nslots - 1);
+	}
+
+	return 0;
+}
+
+/**
+ * Remembers the offset of a blob that was just placed.
+ *
+ * @param  map Blob map.
+ * @param  key Shared contents of the blob.
+ * @param  off Offset of the blob.
+ * @return     Non-zero if the operation was successful.
+ */
+static int blobmap_put(blobmap_t *map, const void *key, uint64_t off) {
+	size_t slot;
+
+	// Grow the table if needed.
+	if ((map->count + 1) > (map->nslots / 4 * 3)) {
+		blobmap_t grown;
+		size_t i;
+
+		grown.nslots = (map->nslots) ? map->nslots * 2 : BINPACK_INITIAL_SLOTS;
+		grown.count = 0;
+		grown.keys = (const void **)mem_calloc(NULL, grown.nslots,
+			sizeof(void *));
+		grown.offsets = (uint64_t *)mem_calloc(NULL, grown.nslots,
+			sizeof(uint64_t));
+		if ((grown.keys == NULL) || (grown.offsets == NULL)) {
+			mem_free(NULL, grown.keys);
+			mem_free(NULL, grown.offsets);
+			return 0;
+		}
+
+		for (i = 0; i < map->nslots; i++) {
+			if (map->keys[i])
+				blobmap_put(&grown, map->keys[i], map->offsets[i]);
+		}
+		mem_free(NULL, map->keys);
+		mem_free(NULL, map->offsets);
+		*map = grown;
+	}
+
+	// Insert it.
+	slot = (size_t)(blob_hash(&key, sizeof(key)) & (map->nslots - 1));
+	while (map->keys[slot] != NULL)
+		slot = (slot + 1) & (map->nslots - 1);
+	map->keys[slot] = key;
+	map->offsets[slot] = off;
+	map->count++;
+
+	return 1;
+}
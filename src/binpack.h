@@ -0,0 +1,96 @@
+/**
+ * binpack.h
+ * Single file container holding every component archive of a parts bin.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _BINPACK_H
+#define _BINPACK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "catalog.h"
+
+// Pack format definitions.
+#define BINPACK_MAGIC        "PBIN"
+#define BINPACK_VERSION      1
+#define BINPACK_PAGE_SIZE    4096
+#define BINPACK_HEADER_SIZE  64
+#define BINPACK_ATTR_SIZE    8
+#define BINPACK_DIR_SIZE     64
+
+// Part inside a pack. Everything points straight into the mapped pack.
+typedef struct {
+	const char *name;
+
+	uint32_t manifest_first;
+	uint32_t manifest_len;
+	uint32_t params_first;
+	uint32_t params_len;
+
+	const void *image;
+	size_t image_len;
+	const void *datasheet;
+	size_t datasheet_len;
+} pecan_binpack_part_t;
+
+// Bin pack structure definition.
+typedef struct {
+	const unsigned char *map;
+	size_t len;
+
+	uint32_t nparts;
+	const char *strings;
+	uint64_t strings_len;
+	const unsigned char *attrs;
+	uint64_t nattrs;
+	const unsigned char *dir;
+} pecan_binpack_t;
+
+// Initialization
+PECAN_EXPORTS pecan_err_t pecan_binpack_open(pecan_binpack_t *pack,
+											 const char *fname);
+
+// Lookup
+PECAN_EXPORTS size_t pecan_binpack_len(pecan_binpack_t *pack);
+PECAN_EXPORTS pecan_err_t pecan_binpack_get(pecan_binpack_t *pack,
+											size_t index,
+											pecan_binpack_part_t *part);
+PECAN_EXPORTS int pecan_binpack_find(pecan_binpack_t *pack, const char *name,
+									 size_t *index);
+
+// Attributes
+PECAN_EXPORTS size_t pecan_binpack_attr_len(pecan_binpack_part_t *part,
+											pecan_attr_type_t type);
+PECAN_EXPORTS int pecan_binpack_attr_idx(pecan_binpack_t *pack,
+										 pecan_binpack_part_t *part,
+										 pecan_attr_type_t type, size_t index,
+										 const char **name,
+										 const char **value);
+PECAN_EXPORTS const char *pecan_binpack_get_attr(pecan_binpack_t *pack,
+												 pecan_binpack_part_t *part,
+												 pecan_attr_type_t type,
+												 const char *name);
+
+// Conversion
+PECAN_EXPORTS pecan_err_t pecan_binpack_read(pecan_binpack_t *pack,
+											 size_t index,
+											 pecan_archive_t *part);
+PECAN_EXPORTS pecan_err_t pecan_binpack_write(pecan_catalog_t *cat,
+											  const char *fname);
+PECAN_EXPORTS pecan_err_t pecan_binpack_unpack(pecan_binpack_t *pack,
+											   const char *dir);
+
+// Cleanup
+PECAN_EXPORTS void pecan_binpack_close(pecan_binpack_t *pack);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BINPACK_H */
@@ -8,6 +8,23 @@
 #include "blob.h"
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
+
+#include "blobstore.h"
+
+// Hashing constants.
+#define HASH_PRIME1 0x9E3779B185EBCA87ULL
+#define HASH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define HASH_PRIME3 0x165667B19E3779F9ULL
+#define HASH_PRIME4 0x85EBCA77C2B2AE63ULL
+#define HASH_PRIME5 0x27D4EB2F165667C5ULL
+#define HASH_ROTL(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+// Private methods.
+static int blob_reserve(pecan_blob_t *blob, size_t size);
+static uint64_t hash_read64(const unsigned char *p);
+static uint64_t hash_round(uint64_t acc, uint64_t input);
+static uint64_t hash_merge(uint64_t acc, uint64_t val);
 
 /**
  * Initializes a blob object.
@@ -16,7 +33,73 @@
  */
 void blob_init(pecan_blob_t *blob) {
 	blob->len = 0;
+	blob->cap = 0;
 	blob->data = NULL;
+	blob->shared = NULL;
+	blob->alloc = NULL;
+}
+
+/**
+ * Computes a fast non-cryptographic 64-bit hash of some contents. This is meant
+ * to identify duplicate blobs, so always compare the lengths as well.
+ *
+ * @param  data Contents to be hashed.
+ * @param  len  Length of the contents in bytes.
+ * @return      Hash of the contents.
+ */
+uint64_t blob_hash(const void *data, size_t len) {
+	const unsigned char *p = (const unsigned char *)data;
+	const unsigned char *end = p + len;
+	uint64_t h;
+
+	// Go through the bulk of the data in 32 byte stripes.
+	if (len >= 32) {
+		const unsigned char *limit = end - 32;
+		uint64_t v1 = HASH_PRIME1 + HASH_PRIME2;
+		uint64_t v2 = HASH_PRIME2;
+		uint64_t v3 = 0;
+		uint64_t v4 = 0 - HASH_PRIME1;
+
+		do {
+			v1 = hash_round(v1, hash_read64(p));
+			v2 = hash_round(v2, hash_read64(p + 8));
+			v3 = hash_round(v3, hash_read64(p + 16));
+			v4 = hash_round(v4, hash_read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+
+		// Merge the lanes together.
+		h = HASH_ROTL(v1, 1) + HASH_ROTL(v2, 7) + HASH_ROTL(v3, 12) +
+			HASH_ROTL(v4, 18);
+		h = hash_merge(h, v1);
+		h = hash_merge(h, v2);
+		h = hash_merge(h, v3);
+		h = hash_merge(h, v4);
+	} else {
+		h = HASH_PRIME5;
+	}
+	h += (uint64_t)len;
+
+	// Consume the remaining words and bytes.
+	while ((p + 8) <= end) {
+		h ^= hash_round(0, hash_read64(p));
+		h = HASH_ROTL(h, 27) * HASH_PRIME1 + HASH_PRIME4;
+		p += 8;
+	}
+	while (p < end) {
+		h ^= (*p) * HASH_PRIME5;
+		h = HASH_ROTL(h, 11) * HASH_PRIME1;
+		p++;
+	}
+
+	// Avalanche the final value.
+	h ^= h >> 33;
+	h *= HASH_PRIME2;
+	h ^= h >> 29;
+	h *= HASH_PRIME3;
+	h ^= h >> 32;
+
+	return h;
 }
 
 /**
@@ -30,6 +113,10 @@ size_t blob_slurp(pecan_blob_t *blob, const char *fpath) {
 	FILE *fh;
 	size_t nbytes = 0;
 
+	// Make sure we aren't going to write over shared contents.
+	if (blob->shared)
+		blob_release(blob);
+
 	// Open the file.
 	fh = fopen(fpath, "rb");
 	if (fh == NULL)
@@ -41,10 +128,11 @@ size_t blob_slurp(pecan_blob_t *blob, const char *fpath) {
 	rewind(fh);
 
 	// Allocate the space to read the file into.
-	blob->data = realloc(blob->data, nbytes);
-	if (blob->data == NULL)
+	if (!blob_reserve(blob, nbytes)) {
+		fclose(fh);
 		return 0L;
-	
+	}
+
 	// Read the file into the blob.
 	blob->len = fread(blob->data, 1, nbytes, fh);
 	if (blob->len != nbytes)
@@ -55,6 +143,28 @@ size_t blob_slurp(pecan_blob_t *blob, const char *fpath) {
 	return blob->len;
 }
 
+/**
+ * Copies some contents from memory into a blob.
+ *
+ * @param  blob Blob to get the contents into.
+ * @param  data Contents to be copied.
+ * @param  len  Length of the contents.
+ * @return      Number of bytes copied or 0 if an error occurred.
+ */
+size_t blob_copy(pecan_blob_t *blob, const void *data, size_t len) {
+	// Make sure we aren't going to write over shared contents.
+	if (blob->shared)
+		blob_release(blob);
+
+	// Allocate the space to hold the contents.
+	if (!blob_reserve(blob, len))
+		return 0L;
+
+	memcpy(blob->data, data, len);
+	blob->len = len;
+	return len;
+}
+
 /**
  * Slurps a blob from a tar file that has already been seek'd to the file that
  * we want to slurp.
@@ -65,9 +175,12 @@ size_t blob_slurp(pecan_blob_t *blob, const char *fpath) {
  * @return        MicroTAR error code.
  */
 int blob_tar_read(pecan_blob_t *blob, mtar_t *tar, mtar_header_t header) {
+	// Make sure we aren't going to write over shared contents.
+	if (blob->shared)
+		blob_release(blob);
+
 	// Allocate the space to read the file into.
-	blob->data = realloc(blob->data, header.size);
-	if (blob->data == NULL)
+	if (!blob_reserve(blob, header.size))
 		return MTAR_EFAILURE;
 
 	// Read the file into the blob.
@@ -75,13 +188,204 @@ int blob_tar_read(pecan_blob_t *blob, mtar_t *tar, mtar_header_t header) {
 	return mtar_read_data(tar, blob->data, header.size);
 }
 
+/**
+ * Empties a blob while holding on to its buffer so that it can be reused by
+ * the next read without allocating.
+ *
+ * @param blob Blob object to be reset.
+ */
+void blob_reset(pecan_blob_t *blob) {
+	// Shared contents can't be reused.
+	if (blob->shared) {
+		blob_release(blob);
+		return;
+	}
+
+	blob->len = 0;
+}
+
+/**
+ * Makes a blob reference some shared contents, getting rid of any contents it
+ * previously held.
+ *
+ * @param blob   Blob object to reference the shared contents.
+ * @param shared Shared contents to be referenced.
+ */
+void blob_share(pecan_blob_t *blob, pecan_blob_shared_t *shared) {
+	pecan_blobstore_t *store = shared->store;
+
+	// Grab a reference first in case we are already pointing to it.
+	if (store) {
+		blobstore_lock(store);
+		shared->refs++;
+		blobstore_unlock(store);
+	} else {
+		shared->refs++;
+	}
+	blob_free(blob);
+
+	// Point to the shared contents.
+	blob->shared = shared;
+	blob->data = shared->data;
+	blob->len = shared->len;
+}
+
+/**
+ * Makes a blob share the same contents as another one without copying them.
+ * If the source blob isn't shared yet its contents will be turned into shared
+ * contents first.
+ *
+ * @param dest Blob object to reference the contents.
+ * @param src  Blob object with the contents to be shared.
+ */
+void blob_clone(pecan_blob_t *dest, pecan_blob_t *src) {
+	// Nothing to share?
+	if (src->len == 0) {
+		blob_free(dest);
+		return;
+	}
+
+	// Turn the private contents of the source into shared ones.
+	if (src->shared == NULL) {
+		pecan_blob_shared_t *shared;
+
+		shared = (pecan_blob_shared_t *)mem_alloc(NULL,
+			sizeof(pecan_blob_shared_t));
+		if (shared == NULL)
+			return;
+		shared->hash = 0;
+		shared->len = src->len;
+		shared->data = src->data;
+		shared->refs = 1;
+		shared->alloc = src->alloc;
+		shared->store = NULL;
+		shared->next = NULL;
+
+		src->shared = shared;
+		src->cap = 0;
+	}
+
+	// Reference the shared contents.
+	blob_share(dest, src->shared);
+}
+
+/**
+ * Drops the reference a blob holds to its shared contents, freeing them if it
+ * was the last one. The blob will be left empty.
+ *
+ * @param blob Blob object to have its shared contents released.
+ */
+void blob_release(pecan_blob_t *blob) {
+	pecan_blob_shared_t *shared = blob->shared;
+	pecan_blobstore_t *store;
+	size_t refs;
+
+	// Do we even have anything shared?
+	if (shared == NULL)
+		return;
+
+	// Let go of our reference, taking it out of the store if it was the last.
+	store = shared->store;
+	if (store) {
+		blobstore_lock(store);
+		refs = --shared->refs;
+		if (refs == 0)
+			blobstore_remove(store, shared);
+		blobstore_unlock(store);
+	} else {
+		refs = --shared->refs;
+	}
+
+	// Are we the last ones holding on to these contents?
+	if (refs == 0) {
+		mem_free(shared->alloc, shared->data);
+		mem_free(NULL, shared);
+	}
+
+	// Empty out the blob.
+	blob->shared = NULL;
+	blob->data = NULL;
+	blob->len = 0;
+	blob->cap = 0;
+}
+
 /**
  * Cleans up the mess left behind by a blob object.
  *
  * @param blob Blob object to be freed.
  */
 void blob_free(pecan_blob_t *blob) {
-	free(blob->data);
+	// Shared contents are reference counted.
+	if (blob->shared) {
+		blob_release(blob);
+		return;
+	}
+
+	mem_free(blob->alloc, blob->data);
 	blob->data = NULL;
 	blob->len = 0;
+	blob->cap = 0;
+}
+
+/**
+ * Makes sure the blob's own buffer is able to hold a number of bytes, reusing
+ * it whenever it's already large enough.
+ *
+ * @param  blob Blob object to have its buffer sized.
+ * @param  size Number of bytes that the buffer must be able to hold.
+ * @return      Non-zero if the operation was successful.
+ */
+static int blob_reserve(pecan_blob_t *blob, size_t size) {
+	void *data;
+
+	// Do we already have enough space?
+	if ((blob->data != NULL) && (blob->cap >= size))
+		return 1;
+
+	// Grow the buffer.
+	data = mem_realloc(blob->alloc, blob->data, (size) ? size : 1);
+	if (data == NULL)
+		return 0;
+	blob->data = data;
+	blob->cap = (size) ? size : 1;
+
+	return 1;
+}
+
+/**
+ * Reads a 64-bit little endian word from an unaligned pointer.
+ *
+ * @param  p Pointer to the word.
+ * @return   Word that was read.
+ */
+static uint64_t hash_read64(const unsigned char *p) {
+	return (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) |
+		((uint64_t)p[3] << 24) | ((uint64_t)p[4] << 32) |
+		((uint64_t)p[5] << 40) | ((uint64_t)p[6] << 48) |
+		((uint64_t)p[7] << 56);
+}
+
+/**
+ * Mixes a word of input into a hash lane.
+ *
+ * @param  acc   Hash lane accumulator.
+ * @param  input Word to be mixed in.
+ * @return       New value of the lane.
+ */
+static uint64_t hash_round(uint64_t acc, uint64_t input) {
+	acc += input * HASH_PRIME2;
+	acc = HASH_ROTL(acc, 31);
+	return acc * HASH_PRIME1;
+}
+
+/**
+ * Merges a hash lane into the final hash value.
+ *
+ * @param  acc Final hash accumulator.
+ * @param  val Value of the lane to be merged.
+ * @return     New value of the accumulator.
+ */
+static uint64_t hash_merge(uint64_t acc, uint64_t val) {
+	acc ^= hash_round(0, val);
+	return acc * HASH_PRIME1 + HASH_PRIME4;
 }
@@ -13,22 +13,54 @@ extern "C" {
 #endif
 
 #include <microtar.h>
+#include <stdint.h>
 #include <stdlib.h>
 
+#include "alloc.h"
+
+// Forward declaration of the blob store.
+struct pecan_blobstore_s;
+
+// Reference counted blob contents shared between multiple blobs.
+typedef struct pecan_blob_shared_s {
+	uint64_t hash;
+	size_t len;
+	void *data;
+	size_t refs;
+
+	const pecan_allocator_t *alloc;
+	struct pecan_blobstore_s *store;
+	struct pecan_blob_shared_s *next;
+} pecan_blob_shared_t;
+
 // Blob type definition.
 typedef struct {
 	size_t len;
+	size_t cap;
 	void *data;
+	pecan_blob_shared_t *shared;
+
+	const pecan_allocator_t *alloc;
 } pecan_blob_t;
 
 // Initialization
 void blob_init(pecan_blob_t *blob);
 
+// Hashing
+uint64_t blob_hash(const void *data, size_t len);
+
 // Reading
 size_t blob_slurp(pecan_blob_t *blob, const char *fpath);
+size_t blob_copy(pecan_blob_t *blob, const void *data, size_t len);
 int blob_tar_read(pecan_blob_t *blob, mtar_t *tar, mtar_header_t header);
 
+// Sharing
+void blob_clone(pecan_blob_t *dest, pecan_blob_t *src);
+void blob_share(pecan_blob_t *blob, pecan_blob_shared_t *shared);
+void blob_release(pecan_blob_t *blob);
+
 // Cleanup
+void blob_reset(pecan_blob_t *blob);
 void blob_free(pecan_blob_t *blob);
 
 #ifdef __cplusplus
@@ -0,0 +1,242 @@
+/**
+ * blobstore.c
+ * Content-addressed store that deduplicates blobs shared between archives.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "blobstore.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Initial number of buckets in the hash table.
+#define BLOBSTORE_INITIAL_BUCKETS 64
+
+// Private methods.
+static void blobstore_grow(pecan_blobstore_t *store);
+
+/**
+ * Initializes an empty blob store. The store can be safely shared between
+ * archives that are being read by multiple threads at the same time.
+ *
+ * @param store Blob store to be initialized.
+ */
+void blobstore_init(pecan_blobstore_t *store) {
+	store->buckets = NULL;
+	store->nbuckets = 0;
+	store->count = 0;
+	store->bytes = 0;
+	store->saved = 0;
+	mutex_init(&store->lock);
+}
+
+/**
+ * Interns the contents of a blob into the store. If identical contents are
+ * already in the store the blob will reference them and its own copy will be
+ * free'd, otherwise the store takes ownership of the blob's contents without
+ * copying them.
+ *
+ * @param store Blob store to hold the contents.
+ * @param blob  Blob to be deduplicated.
+ */
+void blobstore_intern(pecan_blobstore_t *store, pecan_blob_t *blob) {
+	// Empty blobs and ones that are already shared aren't worth the effort.
+	if ((blob->len == 0) || (blob->shared != NULL))
+		return;
+
+	blobstore_intern_hash(store, blob, blob_hash(blob->data, blob->len));
+}
+
+/**
+ * Interns the contents of a blob into the store when the hash of its contents
+ * is already known, such as when it comes from an archive index. A wrong hash
+ * won't ever cause different contents to be merged, only a missed duplicate.
+ *
+ * @param store Blob store to hold the contents.
+ * @param blob  Blob to be deduplicated.
+ * @param hash  Hash of the blob's contents as computed by blob_hash.
+ */
+void blobstore_intern_hash(pecan_blobstore_t *store, pecan_blob_t *blob,
+						   uint64_t hash) {
+	pecan_blob_shared_t *shared;
+	size_t idx;
+
+	// Empty blobs and ones that are already shared aren't worth the effort.
+	if ((blob->len == 0) || (blob->shared != NULL))
+		return;
+
+	// Check if we already have the same contents stored.
+	blobstore_lock(store);
+	if (store->nbuckets > 0) {
+		for (shared = store->buckets[hash & (store->nbuckets - 1)];
+				shared != NULL; shared = shared->next) {
+			// Make sure this isn't just a hash collision.
+			if ((shared->hash == hash) && (shared->len == blob->len) &&
+					(memcmp(shared->data, blob->data, blob->len) == 0)) {
+				store->saved += blob->len;
+				shared->refs++;
+				blobstore_unlock(store);
+
+				// Ditch our own copy of the contents.
+				blob_free(blob);
+				blob->shared = shared;
+				blob->data = shared->data;
+				blob->len = shared->len;
+				return;
+			}
+		}
+	}
+
+	// Make sure we have enough buckets for a new entry.
+	if ((store->count + 1) > (store->nbuckets / 4 * 3)) {
+		blobstore_grow(store);
+		if (store->nbuckets == 0) {
+			blobstore_unlock(store);
+			return;
+		}
+	}
+
+	// Create a new entry that takes over the blob's contents.
+	shared = (pecan_blob_shared_t *)mem_alloc(NULL,
+		sizeof(pecan_blob_shared_t));
+	if (shared == NULL) {
+		blobstore_unlock(store);
+		return;
+	}
+	shared->hash = hash;
+	shared->len = blob->len;
+	shared->data = blob->data;
+	shared->refs = 1;
+	shared->alloc = blob->alloc;
+	shared->store = store;
+
+	// Insert the entry into its bucket.
+	idx = (size_t)(hash & (store->nbuckets - 1));
+	shared->next = store->buckets[idx];
+	store->buckets[idx] = shared;
+	store->count++;
+	store->bytes += shared->len;
+	blobstore_unlock(store);
+
+	// Make the blob reference the new entry.
+	blob->shared = shared;
+	blob->cap = 0;
+}
+
+/**
+ * Removes an entry from the store without freeing it. This is called when the
+ * last blob referencing the entry lets go of it, with the store locked.
+ *
+ * @param store  Blob store holding the entry.
+ * @param shared Entry to be removed.
+ */
+void blobstore_remove(pecan_blobstore_t *store, pecan_blob_shared_t *shared) {
+	pecan_blob_shared_t **it;
+
+	// Find the entry in its bucket chain and unlink it.
+	it = &store->buckets[shared->hash & (store->nbuckets - 1)];
+	while (*it != NULL) {
+		if (*it == shared) {
+			*it = shared->next;
+			store->count--;
+			store->bytes -= shared->len;
+			break;
+		}
+
+		it = &(*it)->next;
+	}
+
+	// Detach the entry from the store.
+	shared->store = NULL;
+	shared->next = NULL;
+}
+
+/**
+ * Frees up the store. Contents still referenced by blobs are detached and will
+ * be free'd when their last blob lets go of them.
+ *
+ * @param store Blob store to be free'd.
+ */
+void blobstore_free(pecan_blobstore_t *store) {
+	size_t i;
+
+	// Detach every entry that's still around.
+	for (i = 0; i < store->nbuckets; i++) {
+		pecan_blob_shared_t *it = store->buckets[i];
+
+		while (it != NULL) {
+			pecan_blob_shared_t *next = it->next;
+
+			it->store = NULL;
+			it->next = NULL;
+			it = next;
+		}
+	}
+
+	// Free the table and reset the store.
+	mem_free(NULL, store->buckets);
+	store->buckets = NULL;
+	store->nbuckets = 0;
+	store->count = 0;
+	store->bytes = 0;
+	store->saved = 0;
+	mutex_destroy(&store->lock);
+}
+
+/**
+ * Locks the store so that its entries and their reference counts can be
+ * safely changed.
+ *
+ * @param store Blob store to be locked.
+ */
+void blobstore_lock(pecan_blobstore_t *store) {
+	mutex_lock(&store->lock);
+}
+
+/**
+ * Unlocks the store.
+ *
+ * @param store Blob store to be unlocked.
+ */
+void blobstore_unlock(pecan_blobstore_t *store) {
+	mutex_unlock(&store->lock);
+}
+
+/**
+ * Doubles the number of buckets in the store's hash table.
+ *
+ * @param store Blob store to be grown.
+ */
+static void blobstore_grow(pecan_blobstore_t *store) {
+	pecan_blob_shared_t **buckets;
+	size_t nbuckets;
+	size_t i;
+
+	// Allocate the new table.
+	nbuckets = (store->nbuckets) ? store->nbuckets * 2 :
+		BLOBSTORE_INITIAL_BUCKETS;
+	buckets = (pecan_blob_shared_t **)mem_calloc(NULL, nbuckets,
+		sizeof(pecan_blob_shared_t *));
+	if (buckets == NULL)
+		return;
+
+	// Rehash every entry into the new table.
+	for (i = 0; i < store->nbuckets; i++) {
+		pecan_blob_shared_t *it = store->buckets[i];
+
+		while (it != NULL) {
+			pecan_blob_shared_t *next = it->next;
+			size_t idx = (size_t)(it->hash & (nbuckets - 1));
+
+			it->next = buckets[idx];
+			buckets[idx] = it;
+			it = next;
+		}
+	}
+
+	// Swap the tables.
+	mem_free(NULL, store->buckets);
+	store->buckets = buckets;
+	store->nbuckets = nbuckets;
+}
@@ -0,0 +1,52 @@
+/**
+ * blobstore.h
+ * Content-addressed store that deduplicates blobs shared between archives.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _BLOBSTORE_H
+#define _BLOBSTORE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdlib.h>
+
+#include "blob.h"
+#include "thread.h"
+
+// Blob store type definition.
+typedef struct pecan_blobstore_s {
+	pecan_blob_shared_t **buckets;
+	size_t nbuckets;
+	size_t count;
+
+	size_t bytes;
+	size_t saved;
+
+	pecan_mutex_t lock;
+} pecan_blobstore_t;
+
+// Initialization
+void blobstore_init(pecan_blobstore_t *store);
+
+// Deduplication
+void blobstore_intern(pecan_blobstore_t *store, pecan_blob_t *blob);
+void blobstore_intern_hash(pecan_blobstore_t *store, pecan_blob_t *blob,
+						   uint64_t hash);
+void blobstore_remove(pecan_blobstore_t *store, pecan_blob_shared_t *shared);
+
+// Locking
+void blobstore_lock(pecan_blobstore_t *store);
+void blobstore_unlock(pecan_blobstore_t *store);
+
+// Cleanup
+void blobstore_free(pecan_blobstore_t *store);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BLOBSTORE_H */
@@ -0,0 +1,742 @@
+/**
+ * bmp.c
+ * Allocation-free decoder and thumbnailer of component bitmap images.
+ *
+ * Images are decoded straight from the memory of their blob into buffers
+ * provided by the caller, always as top-down rows of B, G, R, A pixels, which
+ * is also the layout of a 32-bit DIB section. Uncompressed 1, 4, 8, 16, 24 and
+ * 32-bit images are supported.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "bmp.h"
+
+#include <string.h>
+
+#include "byteorder.h"
+#include "error.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+	(defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#	define BMP_SSE2
+#	include <emmintrin.h>
+#endif /* __SSE2__ */
+
+// Size of the file header that precedes the information header.
+#define BMP_FILE_HEADER_SIZE  14
+
+// Compression methods.
+#define BMP_BI_RGB             0
+#define BMP_BI_RLE8            1
+#define BMP_BI_RLE4            2
+#define BMP_BI_BITFIELDS       3
+#define BMP_BI_JPEG            4
+#define BMP_BI_PNG             5
+#define BMP_BI_ALPHABITFIELDS  6
+
+// Layouts of the pixels that have their own fast paths.
+#define BMP_FMT_PALETTE  0
+#define BMP_FMT_MASKED   1
+#define BMP_FMT_BGR24    2
+#define BMP_FMT_BGRX32   3
+#define BMP_FMT_BGRA32   4
+
+// Number of thumbnail columns that are scaled at once.
+#define BMP_THUMB_CHUNK  64
+
+// Largest number of 4 pixel steps we can sum before 16-bit lanes overflow.
+#define BMP_SSE2_SPAN    128
+
+// Private methods.
+static pecan_err_t bmp_masks(pecan_bmp_t *bmp);
+static const unsigned char *bmp_row(const pecan_bmp_t *bmp, uint32_t y);
+static uint32_t bmp_channel(const pecan_bmp_t *bmp, uint32_t val, int c);
+static uint32_t bmp_pixel(const pecan_bmp_t *bmp, const unsigned char *row,
+						  uint32_t x);
+static void bmp_box_cols(const pecan_bmp_t *bmp, unsigned char *dst,
+						 size_t stride, uint32_t cx, uint32_t n,
+						 uint32_t width, uint32_t height);
+static void bmp_bilinear_cols(const pecan_bmp_t *bmp, unsigned char *dst,
+							  size_t stride, uint32_t cx, uint32_t n,
+							  uint32_t width, uint32_t height);
+static void bmp_span(const pecan_bmp_t *bmp, const unsigned char *row,
+					 uint32_t x0, uint32_t x1, uint64_t sum[4]);
+static void bmp_sample(uint32_t d, uint32_t dsize, uint32_t ssize,
+					   uint32_t *i0, uint32_t *i1, uint32_t *frac);
+static uint32_t px_lerp(uint32_t a, uint32_t b, uint32_t frac);
+static void px_store(unsigned char *dst, uint32_t px);
+
+/**
+ * Parses the headers of a bitmap file in memory. Nothing is copied, so the
+ * memory must outlive the image object.
+ *
+ * @param  bmp  Image object to be populated.
+ * @param  data Contents of the bitmap file, usually an image blob.
+ * @param  len  Length of the contents.
+ * @return      PECAN_OK if the image can be decoded.
+ *              PECAN_ERR_PARSE if the file is malformed.
+ *              PECAN_ERR_NOT_IMPLEMENTED if the image is compressed or uses an
+ *              unsupported bit depth.
+ */
+pecan_err_t pecan_bmp_open(pecan_bmp_t *bmp, const void *data, size_t len) {
+	const unsigned char *buf = (const unsigned char *)data;
+	const unsigned char *hdr;
+	uint32_t offset, hdrsize, compression, nmasks, ncolors;
+	int32_t width, height;
+	static const int order[4] = { 2, 1, 0, 3 };
+	size_t palette;
+	int i;
+
+	// Check the file header.
+	memset(bmp, 0, sizeof(pecan_bmp_t));
+	if ((len < BMP_FILE_HEADER_SIZE + 12) || (buf[0] != 'B') ||
+			(buf[1] != 'M')) {
+		err_set_msg(EMSG("Image is not a bitmap"));
+		return PECAN_ERR_PARSE;
+	}
+	offset = le_read32(buf + 10);
+	hdr = buf + BMP_FILE_HEADER_SIZE;
+	hdrsize = le_read32(hdr);
+	compression = BMP_BI_RGB;
+	ncolors = 0;
+	nmasks = 0;
+
+	// Read the information header.
+	if (hdrsize == 12) {
+		// Ancient OS/2 header with 3 byte palette entries.
+		width = le_read16(hdr + 4);
+		height = le_read16(hdr + 6);
+		bmp->bpp = le_read16(hdr + 10);
+		bmp->entry_size = 3;
+	} else if ((hdrsize >= 40) && (hdrsize <= len - BMP_FILE_HEADER_SIZE)) {
+		width = (int32_t)le_read32(hdr + 4);
+		height = (int32_t)le_read32(hdr + 8);
+		bmp->bpp = le_read16(hdr + 14);
+		compression = le_read32(hdr + 16);
+		ncolors = le_read32(hdr + 32);
+		bmp->entry_size = 4;
+	} else {
+		err_format_msg(EMSG("Unsupported bitmap header size %u"), hdrsize);
+		return PECAN_ERR_PARSE;
+	}
+	palette = BMP_FILE_HEADER_SIZE + hdrsize;
+
+	// Check the compression method.
+	switch (compression) {
+	case BMP_BI_RGB:
+		break;
+	case BMP_BI_BITFIELDS:
+	case BMP_BI_ALPHABITFIELDS:
+		// Masks either live in the header or right after it.
+		nmasks = ((compression == BMP_BI_ALPHABITFIELDS) || (hdrsize >= 56)) ?
+			4 : 3;
+		if (hdrsize == 40)
+			palette += nmasks * 4;
+		if (len < BMP_FILE_HEADER_SIZE + 40 + (nmasks * 4)) {
+			err_set_msg(EMSG("Bitmap color masks are truncated"));
+			return PECAN_ERR_PARSE;
+		}
+		break;
+	case BMP_BI_RLE8:
+	case BMP_BI_RLE4:
+	case BMP_BI_JPEG:
+	case BMP_BI_PNG:
+		err_set_msg(EMSG("Compressed bitmaps are not supported"));
+		return PECAN_ERR_NOT_IMPLEMENTED;
+	default:
+		err_format_msg(EMSG("Unknown bitmap compression method %u"),
+					   compression);
+		return PECAN_ERR_PARSE;
+	}
+
+	// Check the dimensions, a negative height being a top-down image.
+	if ((width <= 0) || (width > PECAN_BMP_MAX_DIM) || (height == 0) ||
+			(height < -PECAN_BMP_MAX_DIM) || (height > PECAN_BMP_MAX_DIM)) {
+		err_format_msg(EMSG("Invalid bitmap dimensions %dx%d"), width, height);
+		return PECAN_ERR_PARSE;
+	}
+	bmp->width = (uint32_t)width;
+	bmp->top_down = height < 0;
+	bmp->height = (uint32_t)(bmp->top_down ? -height : height);
+
+	// Work out how the pixels are laid out.
+	switch (bmp->bpp) {
+	case 1:
+	case 4:
+	case 8:
+		if (nmasks > 0) {
+			err_set_msg(EMSG("Palette bitmaps can't have color masks"));
+			return PECAN_ERR_PARSE;
+		}
+
+		// Locate the palette.
+		if ((ncolors == 0) || (ncolors > (1U << bmp->bpp)))
+			ncolors = 1U << bmp->bpp;
+		if ((palette > len) ||
+				((len - palette) / bmp->entry_size < ncolors)) {
+			err_set_msg(EMSG("Bitmap palette is truncated"));
+			return PECAN_ERR_PARSE;
+		}
+		bmp->palette = buf + palette;
+		bmp->ncolors = ncolors;
+		bmp->format = BMP_FMT_PALETTE;
+		break;
+	case 24:
+		if (nmasks > 0) {
+			err_set_msg(EMSG("24-bit bitmaps can't have color masks"));
+			return PECAN_ERR_PARSE;
+		}
+		bmp->format = BMP_FMT_BGR24;
+		break;
+	case 16:
+	case 32:
+		if (nmasks > 0) {
+			// Masks are stored as red, green, blue and alpha.
+			for (i = 0; i < (int)nmasks; i++)
+				bmp->masks[order[i]] = le_read32(hdr + 40 + (i * 4));
+		} else if (bmp->bpp == 16) {
+			bmp->masks[0] = 0x001F;
+			bmp->masks[1] = 0x03E0;
+			bmp->masks[2] = 0x7C00;
+		} else {
+			bmp->masks[0] = 0x000000FF;
+			bmp->masks[1] = 0x0000FF00;
+			bmp->masks[2] = 0x00FF0000;
+		}
+		if (bmp_masks(bmp) != PECAN_OK)
+			return PECAN_ERR_PARSE;
+		break;
+	default:
+		err_format_msg(EMSG("Unsupported bitmap bit depth %u"), bmp->bpp);
+		return PECAN_ERR_NOT_IMPLEMENTED;
+	}
+
+	// Make sure every row is in memory.
+	bmp->stride = (((size_t)bmp->width * bmp->bpp + 31) / 32) * 4;
+	if ((offset > len) || ((len - offset) / bmp->stride < bmp->height)) {
+		err_set_msg(EMSG("Bitmap pixel data is truncated"));
+		return PECAN_ERR_PARSE;
+	}
+	bmp->pixels = buf + offset;
+
+	return PECAN_OK;
+}
+
+/**
+ * Decodes an image at its original size.
+ *
+ * @param  bmp    Opened image object.
+ * @param  dst    Buffer with room for height rows of width pixels.
+ * @param  stride Distance in bytes between the rows of the buffer.
+ * @return        PECAN_OK if the operation was successful.
+ */
+pecan_err_t pecan_bmp_decode(const pecan_bmp_t *bmp, void *dst, size_t stride) {
+	unsigned char *out;
+	const unsigned char *row;
+	uint32_t x;
+	uint32_t y;
+
+	// Check if the rows fit in the buffer.
+	if (stride < (size_t)bmp->width * PECAN_BMP_PIXEL_SIZE) {
+		err_set_msg(EMSG("Bitmap buffer stride is too small"));
+		return PECAN_ERR_UNKNOWN;
+	}
+
+	// Convert row by row.
+	for (y = 0; y < bmp->height; y++) {
+		row = bmp_row(bmp, y);
+		out = (unsigned char *)dst + ((size_t)y * stride);
+
+		switch (bmp->format) {
+		case BMP_FMT_BGRA32:
+			// Already in our pixel format.
+			memcpy(out, row, (size_t)bmp->width * PECAN_BMP_PIXEL_SIZE);
+			break;
+		case BMP_FMT_BGRX32:
+			// Only need to make the pixels opaque.
+			x = 0;
+#ifdef BMP_SSE2
+			for (; x + 4 <= bmp->width; x += 4) {
+				__m128i px = _mm_loadu_si128((const __m128i *)(row + (x * 4)));
+				px = _mm_or_si128(px, _mm_set1_epi32((int)0xFF000000));
+				_mm_storeu_si128((__m128i *)(out + (x * 4)), px);
+			}
+#endif /* BMP_SSE2 */
+			for (; x < bmp->width; x++)
+				px_store(out + (x * 4), bmp_pixel(bmp, row, x));
+			break;
+		default:
+			for (x = 0; x < bmp->width; x++)
+				px_store(out + (x * 4), bmp_pixel(bmp, row, x));
+			break;
+		}
+	}
+
+	return PECAN_OK;
+}
+
+/**
+ * Scales an image down into a thumbnail straight from its pixel data. The box
+ * filter averages every source pixel that falls under a thumbnail pixel and is
+ * the one to use for large reductions, while the bilinear filter only samples
+ * the 4 nearest pixels and is cheaper when the sizes are close.
+ *
+ * @param  bmp    Opened image object.
+ * @param  dst    Buffer with room for height rows of width pixels.
+ * @param  width  Width of the thumbnail.
+ * @param  height Height of the thumbnail.
+ * @param  stride Distance in bytes between the rows of the buffer.
+ * @param  filter Scaling filter to be used.
+ * @return        PECAN_OK if the operation was successful.
+ */
+pecan_err_t pecan_bmp_thumbnail(const pecan_bmp_t *bmp, void *dst,
+								uint32_t width, uint32_t height, size_t stride,
+								pecan_bmp_filter_t filter) {
+	uint32_t cx, n;
+
+	// Check the size of the thumbnail.
+	if ((width == 0) || (height == 0) || (width > PECAN_BMP_MAX_DIM) ||
+			(height > PECAN_BMP_MAX_DIM)) {
+		err_format_msg(EMSG("Invalid thumbnail size %ux%u"), width, height);
+		return PECAN_ERR_UNKNOWN;
+	}
+	if (stride < (size_t)width * PECAN_BMP_PIXEL_SIZE) {
+		err_set_msg(EMSG("Thumbnail buffer stride is too small"));
+		return PECAN_ERR_UNKNOWN;
+	}
+
+	// Go through the thumbnail in chunks of columns.
+	for (cx = 0; cx < width; cx += n) {
+		n = width - cx;
+		if (n > BMP_THUMB_CHUNK)
+			n = BMP_THUMB_CHUNK;
+
+		if (filter == PECAN_BMP_BILINEAR) {
+			bmp_bilinear_cols(bmp, (unsigned char *)dst, stride, cx, n, width,
+							  height);
+		} else {
+			bmp_box_cols(bmp, (unsigned char *)dst, stride, cx, n, width,
+						 height);
+		}
+	}
+
+	return PECAN_OK;
+}
+
+/**
+ * Calculates the largest size that fits an image inside a bounding box while
+ * keeping its aspect ratio. Images are never scaled up.
+ *
+ * @param bmp        Opened image object.
+ * @param max_width  Width of the bounding box.
+ * @param max_height Height of the bounding box.
+ * @param width      Returns the width of the fitted image.
+ * @param height     Returns the height of the fitted image.
+ */
+void pecan_bmp_fit(const pecan_bmp_t *bmp, uint32_t max_width,
+				   uint32_t max_height, uint32_t *width, uint32_t *height) {
+	uint64_t w = bmp->width;
+	uint64_t h = bmp->height;
+
+	// Shrink by the side that overflows the most.
+	if (w > max_width) {
+		h = (h * max_width) / w;
+		w = max_width;
+	}
+	if (h > max_height) {
+		w = (w * max_height) / h;
+		h = max_height;
+	}
+
+	*width = (w > 0) ? (uint32_t)w : 1;
+	*height = (h > 0) ? (uint32_t)h : 1;
+}
+
+/**
+ * Validates the color masks of an image and works out how to extract each
+ * channel.
+ *
+ * @param  bmp Image object with its masks populated.
+ * @return     PECAN_OK if the masks are valid.
+ */
+static pecan_err_t bmp_masks(pecan_bmp_t *bmp) {
+	uint32_t mask;
+	int c;
+
+	for (c = 0; c < 4; c++) {
+		mask = bmp->masks[c];
+		if (bmp->bpp == 16)
+			mask &= 0xFFFF;
+		bmp->masks[c] = mask;
+		if (mask == 0)
+			continue;
+
+		// Masks must be a single run of bits.
+		while (!((mask >> bmp->shifts[c]) & 1))
+			bmp->shifts[c]++;
+		mask >>= bmp->shifts[c];
+		if (mask & (mask + 1)) {
+			err_set_msg(EMSG("Bitmap color masks are not contiguous"));
+			return PECAN_ERR_PARSE;
+		}
+		while (mask) {
+			bmp->bits[c]++;
+			mask >>= 1;
+		}
+	}
+	bmp->alpha = bmp->masks[3] != 0;
+
+	// Most 32-bit images are just bytes in the order we want.
+	bmp->format = BMP_FMT_MASKED;
+	if ((bmp->bpp == 32) && (bmp->masks[0] == 0x000000FF) &&
+			(bmp->masks[1] == 0x0000FF00) && (bmp->masks[2] == 0x00FF0000)) {
+		if (bmp->masks[3] == 0xFF000000) {
+			bmp->format = BMP_FMT_BGRA32;
+		} else if (bmp->masks[3] == 0) {
+			bmp->format = BMP_FMT_BGRX32;
+		}
+	}
+
+	return PECAN_OK;
+}
+
+/**
+ * Gets a row of pixels counting from the top of the image.
+ *
+ * @param  bmp Opened image object.
+ * @param  y   Row number from the top.
+ * @return     Start of the stored row.
+ */
+static inline const unsigned char *bmp_row(const pecan_bmp_t *bmp,
+										   uint32_t y) {
+	if (!bmp->top_down)
+		y = bmp->height - 1 - y;
+
+	return bmp->pixels + ((size_t)y * bmp->stride);
+}
+
+/**
+ * Extracts a color channel from a masked pixel and scales it to 8 bits.
+ *
+ * @param  bmp Opened image object.
+ * @param  val Stored pixel value.
+ * @param  c   Channel number in our pixel order.
+ * @return     Channel value between 0 and 255.
+ */
+static inline uint32_t bmp_channel(const pecan_bmp_t *bmp, uint32_t val,
+								   int c) {
+	uint32_t max;
+
+	val = (val & bmp->masks[c]) >> bmp->shifts[c];
+	if (bmp->bits[c] >= 8)
+		return val >> (bmp->bits[c] - 8);
+	if (bmp->bits[c] == 0)
+		return 0;
+
+	max = (1U << bmp->bits[c]) - 1;
+	return ((val * 255) + (max / 2)) / max;
+}
+
+/**
+ * Gets a single pixel from a row of the image.
+ *
+ * @param  bmp Opened image object.
+ * @param  row Start of the stored row.
+ * @param  x   Column of the pixel.
+ * @return     Pixel packed as B | G << 8 | R << 16 | A << 24.
+ */
+static inline uint32_t bmp_pixel(const pecan_bmp_t *bmp,
+								 const unsigned char *row, uint32_t x) {
+	const unsigned char *entry;
+	uint32_t val;
+
+	switch (bmp->format) {
+	case BMP_FMT_BGRA32:
+		return le_read32(row + (x * 4));
+	case BMP_FMT_BGRX32:
+		return le_read32(row + (x * 4)) | 0xFF000000;
+	case BMP_FMT_BGR24:
+		row += x * 3;
+		return (uint32_t)row[0] | ((uint32_t)row[1] << 8) |
+			((uint32_t)row[2] << 16) | 0xFF000000;
+	case BMP_FMT_MASKED:
+		val = (bmp->bpp == 16) ? le_read16(row + (x * 2)) :
+			le_read32(row + (x * 4));
+		return bmp_channel(bmp, val, 0) | (bmp_channel(bmp, val, 1) << 8) |
+			(bmp_channel(bmp, val, 2) << 16) |
+			((bmp->alpha ? bmp_channel(bmp, val, 3) : 0xFF) << 24);
+	}
+
+	// Palette index, with the leftmost pixel in the most significant bits.
+	switch (bmp->bpp) {
+	case 1:
+		val = (row[x >> 3] >> (7 - (x & 7))) & 0x01;
+		break;
+	case 4:
+		val = (row[x >> 1] >> ((x & 1) ? 0 : 4)) & 0x0F;
+		break;
+	default:
+		val = row[x];
+		break;
+	}
+
+	// Out of range indexes are black, just like Windows does it.
+	if (val >= bmp->ncolors)
+		return 0xFF000000;
+	entry = bmp->palette + (val * bmp->entry_size);
+
+	return (uint32_t)entry[0] | ((uint32_t)entry[1] << 8) |
+		((uint32_t)entry[2] << 16) | 0xFF000000;
+}
+
+/**
+ * Scales a chunk of columns of the thumbnail with the box filter. Each source
+ * row is walked in order and only once per chunk.
+ *
+ * @param bmp    Opened image object.
+ * @param dst    Thumbnail buffer.
+ * @param stride Distance in bytes between the rows of the buffer.
+ * @param cx     First column of the chunk.
+ * @param n      Number of columns in the chunk.
+ * @param width  Width of the thumbnail.
+ * @param height Height of the thumbnail.
+ */
+static void bmp_box_cols(const pecan_bmp_t *bmp, unsigned char *dst,
+						 size_t stride, uint32_t cx, uint32_t n,
+						 uint32_t width, uint32_t height) {
+	uint64_t sums[BMP_THUMB_CHUNK][4];
+	uint32_t x0[BMP_THUMB_CHUNK];
+	uint32_t x1[BMP_THUMB_CHUNK];
+	unsigned char *out;
+	uint32_t y0, y1, y;
+	uint32_t dy, i;
+	uint64_t count;
+	int c;
+
+	// Columns of the source that fall under each thumbnail column.
+	for (i = 0; i < n; i++) {
+		x0[i] = (uint32_t)(((uint64_t)(cx + i) * bmp->width) / width);
+		x1[i] = (uint32_t)(((uint64_t)(cx + i + 1) * bmp->width) / width);
+		if (x1[i] <= x0[i])
+			x1[i] = x0[i] + 1;
+	}
+
+	for (dy = 0; dy < height; dy++) {
+		// Rows of the source that fall under this row of the thumbnail.
+		y0 = (uint32_t)(((uint64_t)dy * bmp->height) / height);
+		y1 = (uint32_t)(((uint64_t)(dy + 1) * bmp->height) / height);
+		if (y1 <= y0)
+			y1 = y0 + 1;
+
+		// Sum up the boxes a source row at a time.
+		memset(sums, 0, sizeof(sums));
+		for (y = y0; y < y1; y++) {
+			const unsigned char *row = bmp_row(bmp, y);
+			for (i = 0; i < n; i++)
+				bmp_span(bmp, row, x0[i], x1[i], sums[i]);
+		}
+
+		// Average them out.
+		out = dst + ((size_t)dy * stride) + (cx * 4);
+		for (i = 0; i < n; i++) {
+			count = (uint64_t)(x1[i] - x0[i]) * (y1 - y0);
+			for (c = 0; c < 4; c++) {
+				out[(i * 4) + c] =
+					(unsigned char)((sums[i][c] + (count / 2)) / count);
+			}
+		}
+	}
+}
+
+/**
+ * Scales a chunk of columns of the thumbnail with the bilinear filter.
+ *
+ * @param bmp    Opened image object.
+ * @param dst    Thumbnail buffer.
+ * @param stride Distance in bytes between the rows of the buffer.
+ * @param cx     First column of the chunk.
+ * @param n      Number of columns in the chunk.
+ * @param width  Width of the thumbnail.
+ * @param height Height of the thumbnail.
+ */
+static void bmp_bilinear_cols(const pecan_bmp_t *bmp, unsigned char *dst,
+							  size_t stride, uint32_t cx, uint32_t n,
+							  uint32_t width, uint32_t height) {
+	uint32_t x0[BMP_THUMB_CHUNK];
+	uint32_t x1[BMP_THUMB_CHUNK];
+	uint32_t fx[BMP_THUMB_CHUNK];
+	const unsigned char *r0;
+	const unsigned char *r1;
+	unsigned char *out;
+	uint32_t y0, y1, fy;
+	uint32_t dy, i;
+
+	// Source columns are the same for every row.
+	for (i = 0; i < n; i++)
+		bmp_sample(cx + i, width, bmp->width, &x0[i], &x1[i], &fx[i]);
+
+	// Interpolate between the 4 nearest source pixels.
+	for (dy = 0; dy < height; dy++) {
+		bmp_sample(dy, height, bmp->height, &y0, &y1, &fy);
+		r0 = bmp_row(bmp, y0);
+		r1 = bmp_row(bmp, y1);
+		out = dst + ((size_t)dy * stride) + (cx * 4);
+
+		for (i = 0; i < n; i++) {
+			px_store(out + (i * 4), px_lerp(
+				px_lerp(bmp_pixel(bmp, r0, x0[i]), bmp_pixel(bmp, r0, x1[i]),
+						fx[i]),
+				px_lerp(bmp_pixel(bmp, r1, x0[i]), bmp_pixel(bmp, r1, x1[i]),
+						fx[i]),
+				fy));
+		}
+	}
+}
+
+/**
+ * Sums each channel of a horizontal span of pixels.
+ *
+ * @param bmp Opened image object.
+ * @param row Start of the stored row.
+ * @param x0  First column of the span.
+ * @param x1  Column right after the end of the span.
+ * @param sum Sum of each channel in our pixel order.
+ */
+static void bmp_span(const pecan_bmp_t *bmp, const unsigned char *row,
+					 uint32_t x0, uint32_t x1, uint64_t sum[4]) {
+	const unsigned char *p;
+	uint64_t alpha = sum[3];
+	uint32_t n = x1 - x0;
+	uint32_t x;
+
+	switch (bmp->format) {
+	case BMP_FMT_BGRA32:
+	case BMP_FMT_BGRX32:
+		p = row + (x0 * 4);
+#ifdef BMP_SSE2
+		if (n >= 4) {
+			const __m128i zero = _mm_setzero_si128();
+			__m128i acc = zero;
+			uint32_t lanes[4];
+			uint32_t steps;
+
+			// Widen pixels to 16-bit lanes and only go to 32 bits when full.
+			while (n >= 4) {
+				__m128i part = zero;
+
+				steps = n / 4;
+				if (steps > BMP_SSE2_SPAN)
+					steps = BMP_SSE2_SPAN;
+				n -= steps * 4;
+				while (steps--) {
+					__m128i px = _mm_loadu_si128((const __m128i *)p);
+					part = _mm_add_epi16(part, _mm_unpacklo_epi8(px, zero));
+					part = _mm_add_epi16(part, _mm_unpackhi_epi8(px, zero));
+					p += 16;
+				}
+				acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(part, zero));
+				acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(part, zero));
+			}
+
+			_mm_storeu_si128((__m128i *)lanes, acc);
+			sum[0] += lanes[0];
+			sum[1] += lanes[1];
+			sum[2] += lanes[2];
+			sum[3] += lanes[3];
+		}
+#endif /* BMP_SSE2 */
+		for (; n > 0; n--) {
+			sum[0] += p[0];
+			sum[1] += p[1];
+			sum[2] += p[2];
+			sum[3] += p[3];
+			p += 4;
+		}
+
+		// Padding bytes aren't alpha.
+		if (bmp->format == BMP_FMT_BGRX32)
+			sum[3] = alpha + (0xFF * (x1 - x0));
+		break;
+	case BMP_FMT_BGR24:
+		p = row + (x0 * 3);
+		for (; n > 0; n--) {
+			sum[0] += p[0];
+			sum[1] += p[1];
+			sum[2] += p[2];
+			p += 3;
+		}
+		sum[3] += 0xFF * (x1 - x0);
+		break;
+	default:
+		for (x = x0; x < x1; x++) {
+			uint32_t px = bmp_pixel(bmp, row, x);
+			sum[0] += px & 0xFF;
+			sum[1] += (px >> 8) & 0xFF;
+			sum[2] += (px >> 16) & 0xFF;
+			sum[3] += px >> 24;
+		}
+		break;
+	}
+}
+
+/**
+ * Maps a thumbnail pixel to the source pixels around its center.
+ *
+ * @param d     Position in the thumbnail.
+ * @param dsize Size of the thumbnail along this axis.
+ * @param ssize Size of the source along this axis.
+ * @param i0    Returns the source pixel before the center.
+ * @param i1    Returns the source pixel after the center.
+ * @param frac  Returns the weight of the pixel after the center out of 256.
+ */
+static inline void bmp_sample(uint32_t d, uint32_t dsize, uint32_t ssize,
+							  uint32_t *i0, uint32_t *i1, uint32_t *frac) {
+	int64_t pos;
+
+	// Center of the pixel in 8-bit fixed point.
+	pos = ((((int64_t)d * 2) + 1) * ssize * 256) / ((int64_t)dsize * 2) - 128;
+	if (pos < 0)
+		pos = 0;
+
+	*i0 = (uint32_t)(pos >> 8);
+	*frac = (uint32_t)(pos & 0xFF);
+	if (*i0 >= ssize - 1) {
+		*i0 = ssize - 1;
+		*frac = 0;
+	}
+	*i1 = (*i0 < ssize - 1) ? *i0 + 1 : *i0;
+}
+
+/**
+ * Interpolates between two pixels 2 channels at a time inside a single word.
+ *
+ * @param  a    First pixel.
+ * @param  b    Second pixel.
+ * @param  frac Weight of the second pixel out of 256.
+ * @return      Interpolated pixel.
+ */
+static inline uint32_t px_lerp(uint32_t a, uint32_t b, uint32_t frac) {
+	uint32_t rb;
+	uint32_t ag;
+
+	rb = (((a & 0x00FF00FF) * (256 - frac)) +
+		((b & 0x00FF00FF) * frac)) >> 8;
+	ag = ((((a >> 8) & 0x00FF00FF) * (256 - frac)) +
+		(((b >> 8) & 0x00FF00FF) * frac)) >> 8;
+
+	return (rb & 0x00FF00FF) | ((ag & 0x00FF00FF) << 8);
+}
+
+/**
+ * Stores a packed pixel as B, G, R, A bytes.
+ *
+ * @param dst Destination of the pixel.
+ * @param px  Pixel packed as B | G << 8 | R << 16 | A << 24.
+ */
+static inline void px_store(unsigned char *dst, uint32_t px) {
+	dst[0] = (unsigned char)(px & 0xFF);
+	dst[1] = (unsigned char)((px >> 8) & 0xFF);
+	dst[2] = (unsigned char)((px >> 16) & 0xFF);
+	dst[3] = (unsigned char)(px >> 24);
+}
@@ -0,0 +1,74 @@
+/**
+ * bmp.h
+ * Allocation-free decoder and thumbnailer of component bitmap images.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _BMP_H
+#define _BMP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pecan.h"
+
+// Size of a decoded pixel, which is always stored as B, G, R, A bytes.
+#define PECAN_BMP_PIXEL_SIZE  4
+
+// Largest width or height of an image that we are willing to decode.
+#define PECAN_BMP_MAX_DIM     32768
+
+// Filters used to scale images down into thumbnails.
+typedef enum {
+	PECAN_BMP_BOX = 0,
+	PECAN_BMP_BILINEAR
+} pecan_bmp_filter_t;
+
+// Parsed bitmap image that references the memory it was opened from.
+typedef struct {
+	uint32_t width;
+	uint32_t height;
+	uint16_t bpp;
+	int alpha;
+
+	const unsigned char *pixels;
+	size_t stride;
+	int top_down;
+
+	int format;
+	uint32_t masks[4];
+	uint8_t shifts[4];
+	uint8_t bits[4];
+
+	const unsigned char *palette;
+	uint32_t ncolors;
+	uint8_t entry_size;
+} pecan_bmp_t;
+
+// Initialization
+PECAN_EXPORTS pecan_err_t pecan_bmp_open(pecan_bmp_t *bmp, const void *data,
+										 size_t len);
+
+// Decoding
+PECAN_EXPORTS pecan_err_t pecan_bmp_decode(const pecan_bmp_t *bmp, void *dst,
+										   size_t stride);
+PECAN_EXPORTS pecan_err_t pecan_bmp_thumbnail(const pecan_bmp_t *bmp,
+											  void *dst, uint32_t width,
+											  uint32_t height, size_t stride,
+											  pecan_bmp_filter_t filter);
+
+// Sizing
+PECAN_EXPORTS void pecan_bmp_fit(const pecan_bmp_t *bmp, uint32_t max_width,
+								 uint32_t max_height, uint32_t *width,
+								 uint32_t *height);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BMP_H */
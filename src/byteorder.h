@@ -0,0 +1,55 @@
+/**
+ * byteorder.h
+ * Little-endian encoding of the integers stored in our binary file formats.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _BYTEORDER_H
+#define _BYTEORDER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * Reads little-endian integers from unaligned pointers.
+ */
+static inline uint16_t le_read16(const unsigned char *p) {
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t le_read32(const unsigned char *p) {
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+		((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t le_read64(const unsigned char *p) {
+	return (uint64_t)le_read32(p) | ((uint64_t)le_read32(p + 4) << 32);
+}
+
+/**
+ * Writes little-endian integers to unaligned pointers.
+ */
+static inline void le_write16(unsigned char *p, uint16_t val) {
+	p[0] = (unsigned char)(val & 0xFF);
+	p[1] = (unsigned char)(val >> 8);
+}
+
+static inline void le_write32(unsigned char *p, uint32_t val) {
+	le_write16(p, (uint16_t)(val & 0xFFFF));
+	le_write16(p + 2, (uint16_t)(val >> 16));
+}
+
+static inline void le_write64(unsigned char *p, uint64_t val) {
+	le_write32(p, (uint32_t)(val & 0xFFFFFFFF));
+	le_write32(p + 4, (uint32_t)(val >> 32));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BYTEORDER_H */
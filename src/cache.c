@@ -0,0 +1,575 @@
+/**
+ * cache.c
+ * Memory budgeted cache of the heavy parts of component archives.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+
+// Initial number of buckets in the hash table.
+#define CACHE_INITIAL_BUCKETS 64
+
+// Private methods.
+static uint64_t cache_hash(const char *path, pecan_cache_kind_t kind);
+static pecan_cache_entry_t *cache_find(pecan_cache_t *cache, const char *path,
+									   pecan_cache_kind_t kind, uint64_t hash);
+static void cache_grow(pecan_cache_t *cache);
+static void cache_touch(pecan_cache_t *cache, pecan_cache_entry_t *entry);
+static void cache_unlink(pecan_cache_t *cache, pecan_cache_entry_t *entry);
+static pecan_cache_entry_t *cache_evict(pecan_cache_t *cache);
+static pecan_cache_entry_t *entry_load(const char *path,
+									   pecan_cache_kind_t kind);
+static void entry_free_list(pecan_cache_entry_t *entry);
+
+/**
+ * Initializes an empty cache. The cache can be safely shared between multiple
+ * threads.
+ *
+ * @param cache  Cache to be initialized.
+ * @param budget Maximum number of bytes to be held by entries that aren't in
+ *               use.
+ */
+void pecan_cache_init(pecan_cache_t *cache, size_t budget) {
+	cache->buckets = NULL;
+	cache->nbuckets = 0;
+	cache->count = 0;
+	cache->head = NULL;
+	cache->tail = NULL;
+	cache->budget = budget;
+	cache->bytes = 0;
+	cache->hits = 0;
+	cache->misses = 0;
+	cache->evictions = 0;
+	mutex_init(&cache->lock);
+}
+
+/**
+ * Changes the memory budget of the cache, evicting entries right away if it
+ * got smaller.
+ *
+ * @param cache  Cache structure.
+ * @param budget Maximum number of bytes to be held by entries that aren't in
+ *               use.
+ */
+void pecan_cache_set_budget(pecan_cache_t *cache, size_t budget) {
+	pecan_cache_entry_t *evicted;
+
+	mutex_lock(&cache->lock);
+	cache->budget = budget;
+	evicted = cache_evict(cache);
+	mutex_unlock(&cache->lock);
+
+	entry_free_list(evicted);
+}
+
+/**
+ * Gets a member of an archive from the cache, reading it from disk if it isn't
+ * cached. The member can be found in the entry's archive structure, which must
+ * be treated as read-only, and stays valid until the entry is given back with
+ * pecan_cache_put.
+ *
+ * @param  cache Cache structure.
+ * @param  path  Path to the component archive (file or folder).
+ * @param  kind  Member of the archive to get.
+ * @return       Cache entry or NULL if an error occurred.
+ */
+pecan_cache_entry_t *pecan_cache_get(pecan_cache_t *cache, const char *path,
+									 pecan_cache_kind_t kind) {
+	pecan_cache_entry_t *entry;
+	pecan_cache_entry_t *loaded;
+	pecan_cache_entry_t *evicted;
+	uint64_t hash;
+
+	// Check if we already have it.
+	hash = cache_hash(path, kind);
+	mutex_lock(&cache->lock);
+	entry = cache_find(cache, path, kind, hash);
+	if (entry) {
+		entry->pins++;
+		cache->hits++;
+		cache_touch(cache, entry);
+		mutex_unlock(&cache->lock);
+
+		return entry;
+	}
+	cache->misses++;
+	mutex_unlock(&cache->lock);
+
+	// Read it from disk without holding up everyone else.
+	loaded = entry_load(path, kind);
+	if (loaded == NULL)
+		return NULL;
+	loaded->hash = hash;
+
+	// Someone else may have read it in the meantime.
+	mutex_lock(&cache->lock);
+	entry = cache_find(cache, path, kind, hash);
+	if (entry) {
+		entry->pins++;
+		cache_touch(cache, entry);
+		mutex_unlock(&cache->lock);
+
+		entry_free_list(loaded);
+		return entry;
+	}
+
+	// Make sure we have enough buckets for a new entry.
+	if ((cache->count + 1) > (cache->nbuckets / 4 * 3)) {
+		cache_grow(cache);
+		if (cache->nbuckets == 0) {
+			mutex_unlock(&cache->lock);
+			entry_free_list(loaded);
+
+			err_set_msg(EMSG("Couldn't allocate the cache table"));
+			return NULL;
+		}
+	}
+
+	// Insert the new entry as the most recently used one.
+	entry = loaded;
+	entry->pins = 1;
+	entry->chain = cache->buckets[hash & (cache->nbuckets - 1)];
+	cache->buckets[hash & (cache->nbuckets - 1)] = entry;
+	entry->next = cache->head;
+	if (cache->head)
+		cache->head->prev = entry;
+	cache->head = entry;
+	if (cache->tail == NULL)
+		cache->tail = entry;
+	cache->count++;
+	cache->bytes += entry->size;
+
+	// Keep ourselves within budget.
+	evicted = cache_evict(cache);
+	mutex_unlock(&cache->lock);
+
+	entry_free_list(evicted);
+	return entry;
+}
+
+/**
+ * Gives back an entry taken with pecan_cache_get. The entry must not be used
+ * after this.
+ *
+ * @param cache Cache structure.
+ * @param entry Entry to be given back.
+ */
+void pecan_cache_put(pecan_cache_t *cache, pecan_cache_entry_t *entry) {
+	pecan_cache_entry_t *evicted;
+	int last;
+
+	mutex_lock(&cache->lock);
+	last = (--entry->pins == 0);
+
+	// Entries invalidated while in use are ours to free once the last pin goes.
+	if (entry->stale) {
+		mutex_unlock(&cache->lock);
+
+		if (last) {
+			entry->next = NULL;
+			entry_free_list(entry);
+		}
+		return;
+	}
+
+	// Entries that were held above budget can now go.
+	evicted = cache_evict(cache);
+	mutex_unlock(&cache->lock);
+
+	entry_free_list(evicted);
+}
+
+/**
+ * Gets the blob held by an image or datasheet entry.
+ *
+ * @param  entry Cache entry.
+ * @return       Blob held by the entry or NULL if it holds parameters.
+ */
+pecan_blob_t *pecan_cache_blob(pecan_cache_entry_t *entry) {
+	switch (entry->kind) {
+		case PECAN_CACHE_IMAGE:
+			return &entry->part.image;
+		case PECAN_CACHE_DATASHEET:
+			return &entry->part.datasheet;
+		default:
+			return NULL;
+	}
+}
+
+/**
+ * Drops every cached member of an archive, usually because it changed on disk.
+ * Entries that are still in use are free'd once they are given back.
+ *
+ * @param cache Cache structure.
+ * @param path  Path to the component archive.
+ */
+void pecan_cache_invalidate(pecan_cache_t *cache, const char *path) {
+	pecan_cache_entry_t *dropped = NULL;
+	pecan_cache_entry_t *entry;
+	int kind;
+
+	mutex_lock(&cache->lock);
+	for (kind = PECAN_CACHE_IMAGE; kind <= PECAN_CACHE_PARAMS; kind++) {
+		entry = cache_find(cache, path, (pecan_cache_kind_t)kind,
+			cache_hash(path, (pecan_cache_kind_t)kind));
+		if (entry == NULL)
+			continue;
+
+		// Take it out of the cache.
+		cache_unlink(cache, entry);
+		if (entry->pins > 0) {
+			entry->stale = 1;
+		} else {
+			entry->next = dropped;
+			dropped = entry;
+		}
+	}
+	mutex_unlock(&cache->lock);
+
+	entry_free_list(dropped);
+}
+
+/**
+ * Gets a snapshot of the cache statistics.
+ *
+ * @param cache Cache structure.
+ * @param stats Structure to receive the statistics.
+ */
+void pecan_cache_get_stats(pecan_cache_t *cache, pecan_cache_stats_t *stats) {
+	mutex_lock(&cache->lock);
+	stats->hits = cache->hits;
+	stats->misses = cache->misses;
+	stats->evictions = cache->evictions;
+	stats->entries = cache->count;
+	stats->bytes = cache->bytes;
+	mutex_unlock(&cache->lock);
+}
+
+/**
+ * Resets the hit, miss and eviction counters of the cache.
+ *
+ * @param cache Cache structure.
+ */
+void pecan_cache_reset_stats(pecan_cache_t *cache) {
+	mutex_lock(&cache->lock);
+	cache->hits = 0;
+	cache->misses = 0;
+	cache->evictions = 0;
+	mutex_unlock(&cache->lock);
+}
+
+/**
+ * Drops every entry that isn't in use.
+ *
+ * @param cache Cache structure.
+ */
+void pecan_cache_clear(pecan_cache_t *cache) {
+	size_t budget;
+
+	mutex_lock(&cache->lock);
+	budget = cache->budget;
+	mutex_unlock(&cache->lock);
+
+	pecan_cache_set_budget(cache, 0);
+	pecan_cache_set_budget(cache, budget);
+}
+
+/**
+ * Frees up the cache.
+ * WARNING: Every entry must have been given back before this is called.
+ *
+ * @param cache Cache to be free'd.
+ */
+void pecan_cache_free(pecan_cache_t *cache) {
+	pecan_cache_entry_t *entry;
+
+	// Free every entry.
+	entry = cache->head;
+	while (entry != NULL) {
+		pecan_cache_entry_t *next = entry->next;
+
+		entry->next = NULL;
+		entry_free_list(entry);
+		entry = next;
+	}
+
+	// Free the table and reset the cache.
+	mem_free(NULL, cache->buckets);
+	cache->buckets = NULL;
+	cache->nbuckets = 0;
+	cache->count = 0;
+	cache->head = NULL;
+	cache->tail = NULL;
+	cache->bytes = 0;
+	mutex_destroy(&cache->lock);
+}
+
+/**
+ * Computes the hash of a cache key.
+ *
+ * @param  path Path to the component archive.
+ * @param  kind Member of the archive.
+ * @return      Hash of the key.
+ */
+static uint64_t cache_hash(const char *path, pecan_cache_kind_t kind) {
+	return blob_hash(path, strlen(path)) ^
+		((uint64_t)(kind + 1) * 0x9E3779B97F4A7C15ULL);
+}
+
+/**
+ * Finds an entry in the cache.
+ * WARNING: Must be called with the cache locked.
+ *
+ * @param  cache Cache structure.
+ * @param  path  Path to the component archive.
+ * @param  kind  Member of the archive.
+ * @param  hash  Hash of the key.
+ * @return       Entry or NULL if it isn't cached.
+ */
+static pecan_cache_entry_t *cache_find(pecan_cache_t *cache, const char *path,
+									   pecan_cache_kind_t kind, uint64_t hash) {
+	pecan_cache_entry_t *it;
+
+	// Check if we have anything in the cache.
+	if (cache->nbuckets == 0)
+		return NULL;
+
+	// Go through the bucket chain.
+	for (it = cache->buckets[hash & (cache->nbuckets - 1)]; it != NULL;
+			it = it->chain) {
+		if ((it->hash == hash) && (it->kind == kind) &&
+				(strcmp(it->path, path) == 0))
+			return it;
+	}
+
+	return NULL;
+}
+
+/**
+ * Doubles the number of buckets in the cache's hash table.
+ * WARNING: Must be called with the cache locked.
+ *
+ * @param cache Cache to be grown.
+ */
+static void cache_grow(pecan_cache_t *cache) {
+	pecan_cache_entry_t **buckets;
+	pecan_cache_entry_t *it;
+	size_t nbuckets;
+
+	// Allocate the new table.
+	nbuckets = (cache->nbuckets) ? cache->nbuckets * 2 : CACHE_INITIAL_BUCKETS;
+	buckets = (pecan_cache_entry_t **)mem_calloc(NULL, nbuckets,
+		sizeof(pecan_cache_entry_t *));
+	if (buckets == NULL)
+		return;
+
+	// Rehash every entry into the new table.
+	for (it = cache->head; it != NULL; it = it->next) {
+		size_t idx = (size_t)(it->hash & (nbuckets - 1));
+
+		it->chain = buckets[idx];
+		buckets[idx] = it;
+	}
+
+	// Swap the tables.
+	mem_free(NULL, cache->buckets);
+	cache->buckets = buckets;
+	cache->nbuckets = nbuckets;
+}
+
+/**
+ * Moves an entry to the front of the recently used list.
+ * WARNING: Must be called with the cache locked.
+ *
+ * @param cache Cache structure.
+ * @param entry Entry that was just used.
+ */
+static void cache_touch(pecan_cache_t *cache, pecan_cache_entry_t *entry) {
+	// Already at the front?
+	if (cache->head == entry)
+		return;
+
+	// Take it out of its place.
+	entry->prev->next = entry->next;
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	} else {
+		cache->tail = entry->prev;
+	}
+
+	// Put it at the front.
+	entry->prev = NULL;
+	entry->next = cache->head;
+	cache->head->prev = entry;
+	cache->head = entry;
+}
+
+/**
+ * Takes an entry out of the hash table and the recently used list.
+ * WARNING: Must be called with the cache locked.
+ *
+ * @param cache Cache structure.
+ * @param entry Entry to be taken out.
+ */
+static void cache_unlink(pecan_cache_t *cache, pecan_cache_entry_t *entry) {
+	pecan_cache_entry_t **it;
+
+	// Unlink it from its bucket chain.
+	it = &cache->buckets[entry->hash & (cache->nbuckets - 1)];
+	while (*it != NULL) {
+		if (*it == entry) {
+			*it = entry->chain;
+			break;
+		}
+
+		it = &(*it)->chain;
+	}
+
+	// Unlink it from the recently used list.
+	if (entry->prev) {
+		entry->prev->next = entry->next;
+	} else {
+		cache->head = entry->next;
+	}
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	} else {
+		cache->tail = entry->prev;
+	}
+
+	entry->prev = NULL;
+	entry->next = NULL;
+	entry->chain = NULL;
+	cache->count--;
+	cache->bytes -= entry->size;
+}
+
+/**
+ * Evicts the least recently used entries that aren't in use until the cache
+ * is back within its budget.
+ * WARNING: Must be called with the cache locked.
+ *
+ * @param  cache Cache structure.
+ * @return       List of evicted entries, linked by next, to be free'd once the
+ *               cache is unlocked.
+ */
+static pecan_cache_entry_t *cache_evict(pecan_cache_t *cache) {
+	pecan_cache_entry_t *evicted = NULL;
+	pecan_cache_entry_t *it;
+
+	it = cache->tail;
+	while ((cache->bytes > cache->budget) && (it != NULL)) {
+		pecan_cache_entry_t *prev = it->prev;
+
+		// Entries in use must stay around.
+		if (it->pins == 0) {
+			cache_unlink(cache, it);
+			it->next = evicted;
+			evicted = it;
+			cache->evictions++;
+		}
+
+		it = prev;
+	}
+
+	return evicted;
+}
+
+/**
+ * Reads a member of an archive into a new cache entry.
+ *
+ * @param  path Path to the component archive.
+ * @param  kind Member of the archive to be read.
+ * @return      Newly allocated entry or NULL if an error occurred.
+ */
+static pecan_cache_entry_t *entry_load(const char *path,
+									   pecan_cache_kind_t kind) {
+	pecan_cache_entry_t *entry;
+	const char *member;
+	pecan_err_t err;
+	size_t idx;
+
+	// Figure out which member we are dealing with.
+	switch (kind) {
+		case PECAN_CACHE_IMAGE:
+			member = PECAN_IMAGE_FILE;
+			break;
+		case PECAN_CACHE_DATASHEET:
+			member = PECAN_DATASHEET_FILE;
+			break;
+		default:
+			member = PECAN_PARAM_FILE;
+			break;
+	}
+
+	// Allocate the entry.
+	entry = (pecan_cache_entry_t *)mem_alloc(NULL, sizeof(pecan_cache_entry_t));
+	if (entry == NULL) {
+		err_set_msg(EMSG("Couldn't allocate a cache entry"));
+		return NULL;
+	}
+	entry->kind = kind;
+	entry->hash = 0;
+	entry->pins = 0;
+	entry->stale = 0;
+	entry->prev = NULL;
+	entry->next = NULL;
+	entry->chain = NULL;
+	pecan_init(&entry->part);
+	entry->path = mem_strndup(NULL, path, strlen(path));
+	if (entry->path == NULL) {
+		err_set_msg(EMSG("Couldn't allocate a cache entry"));
+		entry_free_list(entry);
+		return NULL;
+	}
+
+	// Read the member.
+	err = pecan_read_member(&entry->part, path, member);
+	if (err) {
+		entry_free_list(entry);
+		return NULL;
+	}
+
+	// Get rid of the read buffers since they won't be needed again.
+	mem_free(entry->part.alloc, entry->part.buf);
+	entry->part.buf = NULL;
+	entry->part.buf_len = 0;
+	tarindex_free(&entry->part.index);
+
+	// Account for the memory held by the entry.
+	entry->size = sizeof(pecan_cache_entry_t) + strlen(path) + 1;
+	if (kind == PECAN_CACHE_PARAMS) {
+		for (idx = 0; idx < cvector_size(entry->part.params); idx++) {
+			pecan_attr_t *attr = &entry->part.params[idx];
+
+			entry->size += sizeof(pecan_attr_t) + strlen(attr->name) +
+				strlen(attr->value) + 2;
+		}
+	} else {
+		entry->size += pecan_cache_blob(entry)->len;
+	}
+
+	return entry;
+}
+
+/**
+ * Frees a list of entries linked by next.
+ *
+ * @param entry First entry of the list or NULL.
+ */
+static void entry_free_list(pecan_cache_entry_t *entry) {
+	while (entry != NULL) {
+		pecan_cache_entry_t *next = entry->next;
+
+		pecan_release(&entry->part);
+		mem_free(NULL, entry->path);
+		mem_free(NULL, entry);
+		entry = next;
+	}
+}
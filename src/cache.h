@@ -0,0 +1,100 @@
+/**
+ * cache.h
+ * Memory budgeted cache of the heavy parts of component archives.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "pecan.h"
+#include "thread.h"
+
+// Kinds of archive members that can be cached.
+typedef enum {
+	PECAN_CACHE_IMAGE = 0,
+	PECAN_CACHE_DATASHEET,
+	PECAN_CACHE_PARAMS
+} pecan_cache_kind_t;
+
+// Cached member of an archive. Its archive only holds the cached member.
+typedef struct pecan_cache_entry_s {
+	char *path;
+	pecan_cache_kind_t kind;
+	uint64_t hash;
+	size_t size;
+	pecan_archive_t part;
+
+	size_t pins;
+	int stale;
+
+	struct pecan_cache_entry_s *prev;
+	struct pecan_cache_entry_s *next;
+	struct pecan_cache_entry_s *chain;
+} pecan_cache_entry_t;
+
+// Cache statistics.
+typedef struct {
+	size_t hits;
+	size_t misses;
+	size_t evictions;
+
+	size_t entries;
+	size_t bytes;
+} pecan_cache_stats_t;
+
+// Cache structure definition.
+typedef struct {
+	pecan_cache_entry_t **buckets;
+	size_t nbuckets;
+	size_t count;
+
+	pecan_cache_entry_t *head;
+	pecan_cache_entry_t *tail;
+	size_t budget;
+	size_t bytes;
+
+	size_t hits;
+	size_t misses;
+	size_t evictions;
+
+	pecan_mutex_t lock;
+} pecan_cache_t;
+
+// Initialization
+PECAN_EXPORTS void pecan_cache_init(pecan_cache_t *cache, size_t budget);
+PECAN_EXPORTS void pecan_cache_set_budget(pecan_cache_t *cache, size_t budget);
+
+// Lookup
+PECAN_EXPORTS pecan_cache_entry_t *pecan_cache_get(pecan_cache_t *cache,
+												   const char *path,
+												   pecan_cache_kind_t kind);
+PECAN_EXPORTS void pecan_cache_put(pecan_cache_t *cache,
+								   pecan_cache_entry_t *entry);
+PECAN_EXPORTS pecan_blob_t *pecan_cache_blob(pecan_cache_entry_t *entry);
+
+// Invalidation
+PECAN_EXPORTS void pecan_cache_invalidate(pecan_cache_t *cache,
+										  const char *path);
+
+// Statistics
+PECAN_EXPORTS void pecan_cache_get_stats(pecan_cache_t *cache,
+										 pecan_cache_stats_t *stats);
+PECAN_EXPORTS void pecan_cache_reset_stats(pecan_cache_t *cache);
+
+// Cleanup
+PECAN_EXPORTS void pecan_cache_clear(pecan_cache_t *cache);
+PECAN_EXPORTS void pecan_cache_free(pecan_cache_t *cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CACHE_H */
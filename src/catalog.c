@@ -0,0 +1,629 @@
+/**
+ * catalog.c
+ * Collection of all of the component archives inside a parts bin.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "catalog.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cvector_utils.h>
+
+#include "error.h"
+#include "fileutils.h"
+
+// Blobs larger than this get verified in multiple chunks.
+#define VERIFY_CHUNK_SIZE (1024 * 1024)
+
+// Verification job for a single archive.
+typedef struct {
+	pecan_catalog_t *cat;
+	pecan_catalog_entry_t *entry;
+	int bad;
+} verify_job_t;
+
+// Verification job for a chunk of a blob.
+typedef struct {
+	const unsigned char *a;
+	const unsigned char *b;
+	size_t len;
+	int *bad;
+} verify_chunk_t;
+
+// Private methods.
+static pecan_err_t catalog_scan(pecan_catalog_t *cat, const char *dir);
+static pecan_err_t catalog_add(pecan_catalog_t *cat, const char *path);
+static int catalog_entry_cmp(const void *a, const void *b);
+static void entry_free(pecan_catalog_entry_t *entry);
+static void entry_set_error(pecan_catalog_entry_t *entry, pecan_err_t err);
+static void load_task(void *arg);
+static void verify_task(void *arg);
+static void verify_chunk_task(void *arg);
+static int verify_attrs(pecan_archive_t *a, pecan_archive_t *b,
+						pecan_attr_type_t type);
+static void verify_blob(pecan_pool_t *pool, pecan_blob_t *a, pecan_blob_t *b,
+						int *bad);
+
+/**
+ * Initializes an empty catalog.
+ *
+ * @param  cat Catalog to be initialized.
+ * @return     PECAN_OK if the operation was successful.
+ */
+pecan_err_t pecan_catalog_init(pecan_catalog_t *cat) {
+	cat->root = NULL;
+	cat->entries = NULL;
+	cat->pool = NULL;
+	cat->own_pool = 0;
+	cat->nthreads = 0;
+
+	// Initialize what needs to be initialized.
+	err_init();
+	blobstore_init(&cat->store);
+
+	return PECAN_OK;
+}
+
+/**
+ * Makes the catalog use a thread pool provided by the embedder instead of
+ * creating its own.
+ *
+ * @param cat  Catalog structure.
+ * @param pool Thread pool to be used or NULL to go back to our own. It must
+ *             outlive the catalog.
+ */
+void pecan_catalog_set_pool(pecan_catalog_t *cat, pecan_pool_t *pool) {
+	// Get rid of the pool we created.
+	if (cat->own_pool)
+		pool_free(cat->pool);
+
+	cat->pool = pool;
+	cat->own_pool = 0;
+}
+
+/**
+ * Sets the number of worker threads of the pool created by the catalog.
+ *
+ * @param cat      Catalog structure.
+ * @param nthreads Number of threads or 0 to use one per online CPU.
+ */
+void pecan_catalog_set_threads(pecan_catalog_t *cat, size_t nthreads) {
+	cat->nthreads = nthreads;
+
+	// Our own pool will be recreated with the new size when needed.
+	if (cat->own_pool && (pool_size(cat->pool) != pool_threads(nthreads))) {
+		pool_free(cat->pool);
+		cat->pool = NULL;
+		cat->own_pool = 0;
+	}
+}
+
+/**
+ * Gets the thread pool used by the catalog, creating it if needed.
+ *
+ * @param  cat Catalog structure.
+ * @return     Thread pool or NULL if we couldn't create one.
+ */
+pecan_pool_t *pecan_catalog_pool(pecan_catalog_t *cat) {
+	if (cat->pool == NULL) {
+		cat->pool = pool_new(cat->nthreads);
+		cat->own_pool = (cat->pool != NULL);
+	}
+
+	return cat->pool;
+}
+
+/**
+ * Loads every component archive (packed or unpacked) found inside a parts bin
+ * directory and its subdirectories. Each archive is read as a separate task by
+ * the thread pool and their blobs are deduplicated against the catalog's blob
+ * store.
+ *
+ * @param  cat  Catalog to be populated. Anything it held will be free'd.
+ * @param  path Path to the parts bin directory.
+ * @return      PECAN_OK if the operation was successful.
+ *              PECAN_ERR_PATH_NOT_FOUND if the directory wasn't found.
+ *              Error of the first archive that couldn't be read otherwise, the
+ *              archives that were read successfully are still available.
+ */
+pecan_err_t pecan_catalog_load(pecan_catalog_t *cat, const char *path) {
+	pecan_catalog_entry_t **it;
+	pecan_taskgroup_t group;
+	pecan_pool_t *pool;
+	pecan_catalog_entry_t *failed;
+	size_t nfailed;
+	pecan_err_t err;
+
+	// Check if we even have a directory there.
+	if (!is_dir(path)) {
+		err_format_msg(EMSG("Specified parts bin '%s' not found"), path);
+		return PECAN_ERR_PATH_NOT_FOUND;
+	}
+
+	// Start from a clean slate.
+	pecan_catalog_clear(cat);
+	cat->root = mem_strndup(NULL, path, strlen(path));
+
+	// Find all of the archives in the bin and keep them in a stable order.
+	err = catalog_scan(cat, path);
+	if (err)
+		return err;
+	if (cvector_size(cat->entries) > 1) {
+		qsort(cat->entries, cvector_size(cat->entries),
+			  sizeof(pecan_catalog_entry_t *), catalog_entry_cmp);
+	}
+
+	// Get our pool ready.
+	pool = pecan_catalog_pool(cat);
+	if (pool == NULL) {
+		err_set_msg(EMSG("Couldn't create the catalog thread pool"));
+		return PECAN_ERR_UNKNOWN;
+	}
+
+	// Read each archive as its own task.
+	pool_group_init(&group);
+	for (it = cvector_begin(cat->entries); it != cvector_end(cat->entries);
+			++it) {
+		if (pool_submit(pool, &group, load_task, *it) != 0)
+			load_task(*it);
+	}
+	pool_wait(pool, &group);
+
+	// Report back on any archives that failed to load.
+	failed = NULL;
+	nfailed = 0;
+	for (it = cvector_begin(cat->entries); it != cvector_end(cat->entries);
+			++it) {
+		if ((*it)->err) {
+			if (failed == NULL)
+				failed = *it;
+			nfailed++;
+		}
+	}
+	if (failed) {
+		err_format_msg(EMSG("Failed to load %zu of %zu archives (%s: %s)"),
+			nfailed, cvector_size(cat->entries), failed->path,
+			(failed->err_msg) ? failed->err_msg : "unknown error");
+		return failed->err;
+	}
+
+	return PECAN_OK;
+}
+
+/**
+ * Verifies that the archives in the catalog still match their files on disk.
+ * Each archive is a separate task and large blobs are compared in chunks by
+ * subtasks, so a few huge datasheets don't hold everything else back.
+ *
+ * @param  cat  Catalog to be verified.
+ * @param  nbad Optional pointer to store the number of mismatching archives.
+ * @return      PECAN_OK if every archive matches its file.
+ *              PECAN_ERR_FILE_IO if any of them didn't match or couldn't be
+ *              read. Their entries will have their error set.
+ */
+pecan_err_t pecan_catalog_verify(pecan_catalog_t *cat, size_t *nbad) {
+	verify_job_t *jobs;
+	pecan_taskgroup_t group;
+	pecan_pool_t *pool;
+	size_t len;
+	size_t bad;
+	size_t i;
+
+	// Get our pool ready.
+	pool = pecan_catalog_pool(cat);
+	if (pool == NULL) {
+		err_set_msg(EMSG("Couldn't create the catalog thread pool"));
+		return PECAN_ERR_UNKNOWN;
+	}
+
+	// Allocate our jobs.
+	len = cvector_size(cat->entries);
+	jobs = (verify_job_t *)mem_calloc(NULL, (len) ? len : 1,
+									  sizeof(verify_job_t));
+	if (jobs == NULL) {
+		err_set_msg(EMSG("Couldn't allocate the verification jobs"));
+		return PECAN_ERR_UNKNOWN;
+	}
+
+	// Verify each archive that was loaded as its own task.
+	pool_group_init(&group);
+	for (i = 0; i < len; i++) {
+		jobs[i].cat = cat;
+		jobs[i].entry = cat->entries[i];
+		if (jobs[i].entry->err)
+			continue;
+
+		if (pool_submit(pool, &group, verify_task, &jobs[i]) != 0)
+			verify_task(&jobs[i]);
+	}
+	pool_wait(pool, &group);
+
+	// Count the archives that didn't match.
+	bad = 0;
+	for (i = 0; i < len; i++) {
+		if (jobs[i].bad)
+			bad++;
+	}
+	mem_free(NULL, jobs);
+
+	// Report back.
+	if (nbad)
+		*nbad = bad;
+	if (bad) {
+		err_format_msg(EMSG("%zu archives don't match their files"), bad);
+		return PECAN_ERR_FILE_IO;
+	}
+
+	return PECAN_OK;
+}
+
+/**
+ * Gets the number of archives in the catalog.
+ *
+ * @param  cat Catalog structure.
+ * @return     Number of archives.
+ */
+size_t pecan_catalog_len(pecan_catalog_t *cat) {
+	return cvector_size(cat->entries);
+}
+
+/**
+ * Gets an archive entry from the catalog by its index.
+ *
+ * @param  cat   Catalog structure.
+ * @param  index Index of the entry.
+ * @return       The requested entry or NULL if the index is out-of-range.
+ */
+pecan_catalog_entry_t *pecan_catalog_get(pecan_catalog_t *cat, size_t index) {
+	if (index >= cvector_size(cat->entries))
+		return NULL;
+
+	return cat->entries[index];
+}
+
+/**
+ * Finds an archive entry in the catalog by its path.
+ *
+ * @param  cat  Catalog structure.
+ * @param  path Path of the archive as it was found when loading the catalog.
+ * @return      The requested entry or NULL if it wasn't found.
+ */
+pecan_catalog_entry_t *pecan_catalog_find(pecan_catalog_t *cat,
+										  const char *path) {
+	pecan_catalog_entry_t key;
+	pecan_catalog_entry_t *pkey;
+	pecan_catalog_entry_t **found;
+
+	// Entries are sorted by path, so do a binary search.
+	if (cat->entries == NULL)
+		return NULL;
+	key.path = (char *)path;
+	pkey = &key;
+	found = (pecan_catalog_entry_t **)bsearch(&pkey, cat->entries,
+		cvector_size(cat->entries), sizeof(pecan_catalog_entry_t *),
+		catalog_entry_cmp);
+
+	return (found) ? *found : NULL;
+}
+
+/**
+ * Removes every archive from the catalog while holding on to its pool and blob
+ * store, so blobs that are still shared by copies of its archives stay valid.
+ *
+ * @param cat Catalog to be cleared.
+ */
+void pecan_catalog_clear(pecan_catalog_t *cat) {
+	cvector_free_each_and_free(cat->entries, entry_free);
+	cat->entries = NULL;
+	mem_free(NULL, cat->root);
+	cat->root = NULL;
+}
+
+/**
+ * Frees up any resources allocated by the catalog.
+ *
+ * @param cat Catalog to be free'd.
+ */
+void pecan_catalog_free(pecan_catalog_t *cat) {
+	pecan_catalog_release(cat);
+
+	// Clean up our error message stuff.
+	err_free();
+}
+
+/**
+ * Frees up any resources allocated by the catalog without touching the error
+ * message, so it can be used while cleaning up after an error.
+ *
+ * @param cat Catalog to be free'd.
+ */
+void pecan_catalog_release(pecan_catalog_t *cat) {
+	// Free up the archives.
+	pecan_catalog_clear(cat);
+
+	// Free up our pool and blob store.
+	if (cat->own_pool)
+		pool_free(cat->pool);
+	cat->pool = NULL;
+	cat->own_pool = 0;
+	blobstore_free(&cat->store);
+}
+
+/**
+ * Scans a directory recursively for component archives.
+ *
+ * @param  cat Catalog to add the archives to.
+ * @param  dir Directory to be scanned.
+ * @return     PECAN_OK if the operation was successful.
+ */
+static pecan_err_t catalog_scan(pecan_catalog_t *cat, const char *dir) {
+	struct dirent *ent;
+	pecan_err_t err = PECAN_OK;
+	DIR *dh;
+
+	// Open the directory.
+	dh = opendir(dir);
+	if (dh == NULL) {
+		err_format_msg(EMSG("Couldn't open directory '%s'"), dir);
+		return PECAN_ERR_FILE_IO;
+	}
+
+	// Go through its contents.
+	while ((err == PECAN_OK) && ((ent = readdir(dh)) != NULL)) {
+		char *path;
+		char *manifest;
+
+		// Skip hidden files and the special directories.
+		if (ent->d_name[0] == '.')
+			continue;
+		pathcat(2, &path, dir, ent->d_name);
+
+		if (is_dir(path)) {
+			// Unpacked archives are directories with a manifest in them.
+			pathcat(2, &manifest, path, PECAN_MANIFEST_FILE);
+			if (file_exists(manifest)) {
+				err = catalog_add(cat, path);
+			} else {
+				err = catalog_scan(cat, path);
+			}
+			mem_free(NULL, manifest);
+		} else if (file_ext_match(path, "tar")) {
+			// Packed archive.
+			err = catalog_add(cat, path);
+		}
+
+		mem_free(NULL, path);
+	}
+
+	closedir(dh);
+	return err;
+}
+
+/**
+ * Adds a new empty entry to the catalog.
+ *
+ * @param  cat  Catalog structure.
+ * @param  path Path to the archive.
+ * @return      PECAN_OK if the operation was successful.
+ */
+static pecan_err_t catalog_add(pecan_catalog_t *cat, const char *path) {
+	pecan_catalog_entry_t *entry;
+
+	// Allocate the entry.
+	entry = (pecan_catalog_entry_t *)mem_alloc(NULL,
+		sizeof(pecan_catalog_entry_t));
+	if (entry == NULL)
+		goto nomem;
+	entry->path = mem_strndup(NULL, path, strlen(path));
+	if (entry->path == NULL) {
+		mem_free(NULL, entry);
+		goto nomem;
+	}
+	entry->err = PECAN_OK;
+	entry->err_msg = NULL;
+
+	// Get the archive ready to be read.
+	pecan_init(&entry->part);
+	pecan_set_blobstore(&entry->part, &cat->store);
+
+	cvector_push_back(cat->entries, entry);
+	return PECAN_OK;
+
+nomem:
+	err_set_msg(EMSG("Couldn't allocate memory for a catalog entry"));
+	return PECAN_ERR_UNKNOWN;
+}
+
+/**
+ * Compares two catalog entries by their paths.
+ *
+ * @param  a Pointer to the first entry pointer.
+ * @param  b Pointer to the second entry pointer.
+ * @return   Same as strcmp.
+ */
+static int catalog_entry_cmp(const void *a, const void *b) {
+	const pecan_catalog_entry_t *ea = *(const pecan_catalog_entry_t **)a;
+	const pecan_catalog_entry_t *eb = *(const pecan_catalog_entry_t **)b;
+
+	return strcmp(ea->path, eb->path);
+}
+
+/**
+ * Frees up a catalog entry.
+ *
+ * @param entry Entry to be free'd.
+ */
+static void entry_free(pecan_catalog_entry_t *entry) {
+	pecan_release(&entry->part);
+	mem_free(NULL, entry->path);
+	mem_free(NULL, entry->err_msg);
+	mem_free(NULL, entry);
+}
+
+/**
+ * Flags an entry with an error, keeping a copy of the current thread's error
+ * message.
+ *
+ * @param entry Entry to be flagged.
+ * @param err   Error code.
+ */
+static void entry_set_error(pecan_catalog_entry_t *entry, pecan_err_t err) {
+	const char *msg = err_get_msg();
+
+	entry->err = err;
+	mem_free(NULL, entry->err_msg);
+	entry->err_msg = (msg) ? mem_strndup(NULL, msg, strlen(msg)) : NULL;
+}
+
+/**
+ * Task that reads a single archive of the catalog.
+ *
+ * @param arg Catalog entry to be read.
+ */
+static void load_task(void *arg) {
+	pecan_catalog_entry_t *entry = (pecan_catalog_entry_t *)arg;
+	pecan_err_t err;
+
+	err = pecan_read(&entry->part, entry->path);
+	if (err)
+		entry_set_error(entry, err);
+}
+
+/**
+ * Task that verifies a single archive of the catalog against its file.
+ *
+ * @param arg Verification job.
+ */
+static void verify_task(void *arg) {
+	verify_job_t *job = (verify_job_t *)arg;
+	pecan_archive_t *part = &job->entry->part;
+	pecan_archive_t disk;
+
+	// Read the archive from disk again.
+	pecan_init(&disk);
+	if (pecan_read(&disk, job->entry->path)) {
+		job->bad = 1;
+		goto cleanup;
+	}
+
+	// Compare the attributes.
+	if (!verify_attrs(part, &disk, PECAN_MANIFEST) ||
+			!verify_attrs(part, &disk, PECAN_PARAMETERS)) {
+		err_set_msg(EMSG("Archive attributes don't match the ones on disk"));
+		job->bad = 1;
+		goto cleanup;
+	}
+
+	// Compare the blobs.
+	verify_blob(job->cat->pool, &part->image, &disk.image, &job->bad);
+	verify_blob(job->cat->pool, &part->datasheet, &disk.datasheet, &job->bad);
+	if (job->bad)
+		err_set_msg(EMSG("Archive blobs don't match the ones on disk"));
+
+cleanup:
+	// Flag the entry while we still have the error message in this thread.
+	if (job->bad)
+		entry_set_error(job->entry, PECAN_ERR_FILE_IO);
+	pecan_free(&disk);
+}
+
+/**
+ * Task that compares a chunk of a blob.
+ *
+ * @param arg Chunk verification job.
+ */
+static void verify_chunk_task(void *arg) {
+	verify_chunk_t *chunk = (verify_chunk_t *)arg;
+
+	if (memcmp(chunk->a, chunk->b, chunk->len) != 0)
+		__atomic_store_n(chunk->bad, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Checks if the attributes of two archives are the same.
+ *
+ * @param  a    First archive.
+ * @param  b    Second archive.
+ * @param  type Type of attribute.
+ * @return      Non-zero if they are the same.
+ */
+static int verify_attrs(pecan_archive_t *a, pecan_archive_t *b,
+						pecan_attr_type_t type) {
+	size_t len = pecan_get_attr_len(a, type);
+	size_t i;
+
+	if (len != pecan_get_attr_len(b, type))
+		return 0;
+
+	for (i = 0; i < len; i++) {
+		pecan_attr_t *aa = pecan_get_attr_idx(a, type, i);
+		pecan_attr_t *ab = pecan_get_attr_idx(b, type, i);
+
+		if ((strcmp(aa->name, ab->name) != 0) ||
+				(strcmp(aa->value, ab->value) != 0)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * Compares two blobs, splitting the work into subtasks for large blobs.
+ *
+ * @param pool Thread pool.
+ * @param a    First blob.
+ * @param b    Second blob.
+ * @param bad  Flag to be set if they differ.
+ */
+static void verify_blob(pecan_pool_t *pool, pecan_blob_t *a, pecan_blob_t *b,
+						int *bad) {
+	verify_chunk_t *chunks;
+	pecan_taskgroup_t group;
+	size_t nchunks;
+	size_t i;
+
+	// Sizes must match of course.
+	if (a->len != b->len) {
+		*bad = 1;
+		return;
+	}
+
+	// Small blobs aren't worth a task.
+	if (a->len <= VERIFY_CHUNK_SIZE) {
+		if ((a->len > 0) && (memcmp(a->data, b->data, a->len) != 0))
+			*bad = 1;
+		return;
+	}
+
+	// Allocate the chunk jobs.
+	nchunks = (a->len + VERIFY_CHUNK_SIZE - 1) / VERIFY_CHUNK_SIZE;
+	chunks = (verify_chunk_t *)mem_alloc(NULL,
+		nchunks * sizeof(verify_chunk_t));
+	if (chunks == NULL) {
+		if (memcmp(a->data, b->data, a->len) != 0)
+			*bad = 1;
+		return;
+	}
+
+	// Compare each chunk as a subtask and help out while we wait for them.
+	pool_group_init(&group);
+	for (i = 0; i < nchunks; i++) {
+		size_t off = i * VERIFY_CHUNK_SIZE;
+
+		chunks[i].a = (const unsigned char *)a->data + off;
+		chunks[i].b = (const unsigned char *)b->data + off;
+		chunks[i].len = ((a->len - off) < VERIFY_CHUNK_SIZE) ?
+			(a->len - off) : VERIFY_CHUNK_SIZE;
+		chunks[i].bad = bad;
+		if (pool_submit(pool, &group, verify_chunk_task, &chunks[i]) != 0)
+			verify_chunk_task(&chunks[i]);
+	}
+	pool_wait(pool, &group);
+
+	mem_free(NULL, chunks);
+}
@@ -0,0 +1,68 @@
+/**
+ * catalog.h
+ * Collection of all of the component archives inside a parts bin.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _CATALOG_H
+#define _CATALOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pecan.h"
+#include "pool.h"
+
+// Catalog entry structure definition.
+typedef struct {
+	char *path;
+	pecan_archive_t part;
+
+	pecan_err_t err;
+	char *err_msg;
+} pecan_catalog_entry_t;
+
+// Catalog structure definition.
+typedef struct {
+	char *root;
+	cvector_vector_type(pecan_catalog_entry_t *) entries;
+	pecan_blobstore_t store;
+
+	pecan_pool_t *pool;
+	int own_pool;
+	size_t nthreads;
+} pecan_catalog_t;
+
+// Initialization
+PECAN_EXPORTS pecan_err_t pecan_catalog_init(pecan_catalog_t *cat);
+PECAN_EXPORTS void pecan_catalog_set_pool(pecan_catalog_t *cat,
+										  pecan_pool_t *pool);
+PECAN_EXPORTS void pecan_catalog_set_threads(pecan_catalog_t *cat,
+											 size_t nthreads);
+PECAN_EXPORTS pecan_pool_t *pecan_catalog_pool(pecan_catalog_t *cat);
+
+// Operations
+PECAN_EXPORTS pecan_err_t pecan_catalog_load(pecan_catalog_t *cat,
+											 const char *path);
+PECAN_EXPORTS pecan_err_t pecan_catalog_verify(pecan_catalog_t *cat,
+											   size_t *nbad);
+
+// Lookup
+PECAN_EXPORTS size_t pecan_catalog_len(pecan_catalog_t *cat);
+PECAN_EXPORTS pecan_catalog_entry_t *pecan_catalog_get(pecan_catalog_t *cat,
+													   size_t index);
+PECAN_EXPORTS pecan_catalog_entry_t *pecan_catalog_find(pecan_catalog_t *cat,
+														const char *path);
+
+// Cleanup
+PECAN_EXPORTS void pecan_catalog_clear(pecan_catalog_t *cat);
+PECAN_EXPORTS void pecan_catalog_free(pecan_catalog_t *cat);
+void pecan_catalog_release(pecan_catalog_t *cat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CATALOG_H */
@@ -0,0 +1,474 @@
+/**
+ * complete.c
+ * Prefix autocompletion of the values of an attribute across a catalog.
+ *
+ * The distinct values are kept sorted without regard to case, so that all of
+ * the completions of a prefix sit in a single range that's found by binary
+ * searching a sparse index of every few values and then scanning a single
+ * block. The best completions of a range are picked out of a sparse table
+ * holding the best value of every span of blocks, so that a short prefix
+ * that matches most of the catalog costs as little as a long one.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "complete.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "error.h"
+
+// Value of an archive being gathered up.
+typedef struct {
+	const char *value;
+	uint64_t weight;
+} complete_value_t;
+
+// Range of values that still has completions to give out.
+typedef struct {
+	size_t lo;
+	size_t hi;
+	size_t best;
+} complete_range_t;
+
+// Private methods.
+static int fold_ncmp(const char *a, const char *b, size_t n);
+static int complete_value_cmp(const void *a, const void *b);
+static char *complete_fold(pecan_arena_t *arena, const char *str);
+static size_t complete_bound(pecan_complete_t *comp, const char *prefix,
+							 size_t len, int upper);
+static int complete_better(pecan_complete_t *comp, size_t a, size_t b);
+static size_t complete_best(pecan_complete_t *comp, size_t lo, size_t hi);
+static void ranges_push(pecan_complete_t *comp, complete_range_t *heap,
+						size_t *n, size_t lo, size_t hi);
+static complete_range_t ranges_pop(pecan_complete_t *comp,
+								   complete_range_t *heap, size_t *n);
+
+/**
+ * Initializes an empty completion index.
+ *
+ * @param comp Completion index to be initialized.
+ */
+void pecan_complete_init(pecan_complete_t *comp) {
+	memset(comp, 0, sizeof(pecan_complete_t));
+}
+
+/**
+ * Builds the completion index of an attribute across a loaded catalog. Values
+ * that only differ in case are merged together and ranked by the sum of the
+ * stock quantity of every archive that has them.
+ *
+ * @param  comp Empty completion index.
+ * @param  cat  Loaded catalog to be indexed. The index doesn't reference it.
+ * @param  type Type of the attribute.
+ * @param  name Name of the attribute.
+ * @return      PECAN_OK if the operation was successful.
+ */
+pecan_err_t pecan_complete_build(pecan_complete_t *comp, pecan_catalog_t *cat,
+								 pecan_attr_type_t type, const char *name) {
+	complete_value_t *values;
+	pecan_complete_entry_t *entry;
+	size_t nvalues;
+	size_t nblocks;
+	size_t level;
+	size_t doc;
+	size_t i;
+
+	// Set everything up.
+	pecan_complete_free(comp);
+	values = (complete_value_t *)mem_alloc(NULL, (pecan_catalog_len(cat) + 1) *
+										   sizeof(complete_value_t));
+	comp->arena = arena_new(NULL);
+	if ((values == NULL) || (comp->arena == NULL))
+		goto nomem;
+
+	// Gather the value of every archive.
+	nvalues = 0;
+	for (doc = 0; doc < pecan_catalog_len(cat); doc++) {
+		pecan_catalog_entry_t *centry = pecan_catalog_get(cat, doc);
+		pecan_attr_t *attr;
+
+		if (centry->err)
+			continue;
+		attr = pecan_get_attr(&centry->part, type, name);
+		if ((attr == NULL) || (attr->value == NULL) || (*attr->value == '\0'))
+			continue;
+
+		values[nvalues].value = attr->value;
+		values[nvalues].weight = 0;
+		attr = pecan_get_attr(&centry->part, PECAN_MANIFEST,
+							  PECAN_COMPLETE_RANK);
+		if (attr && attr->value)
+			values[nvalues].weight = strtoull(attr->value, NULL, 10);
+		nvalues++;
+	}
+
+	// Merge the repeated ones.
+	if (nvalues > 0)
+		qsort(values, nvalues, sizeof(complete_value_t), complete_value_cmp);
+	comp->entries = (pecan_complete_entry_t *)mem_alloc(NULL, (nvalues + 1) *
+		sizeof(pecan_complete_entry_t));
+	if (comp->entries == NULL)
+		goto nomem;
+	entry = NULL;
+	for (i = 0; i < nvalues; i++) {
+		if ((entry == NULL) ||
+				(fold_ncmp(entry->value, values[i].value, SIZE_MAX) != 0)) {
+			entry = &comp->entries[comp->nentries++];
+			entry->value = arena_strndup(comp->arena, values[i].value,
+										 strlen(values[i].value));
+			entry->key = complete_fold(comp->arena, values[i].value);
+			entry->weight = 0;
+			entry->count = 0;
+			if ((entry->value == NULL) || (entry->key == NULL))
+				goto nomem;
+		}
+
+		entry->weight += values[i].weight;
+		entry->count++;
+	}
+
+	// Build the sparse index.
+	nblocks = (comp->nentries + PECAN_COMPLETE_BLOCK - 1) /
+		PECAN_COMPLETE_BLOCK;
+	comp->samples = (const char **)mem_alloc(NULL, (nblocks + 1) *
+											 sizeof(const char *));
+	if (comp->samples == NULL)
+		goto nomem;
+	for (i = 0; i < nblocks; i++)
+		comp->samples[i] = comp->entries[i * PECAN_COMPLETE_BLOCK].key;
+	comp->nsamples = nblocks;
+
+	// Build the sparse table of the best value in every span of blocks. Each
+	// level doubles the span of the one below it.
+	comp->levels = 1;
+	while (((size_t)1 << comp->levels) <= nblocks)
+		comp->levels++;
+	comp->best = (uint32_t *)mem_alloc(NULL, (comp->levels * nblocks + 1) *
+									   sizeof(uint32_t));
+	if (comp->best == NULL)
+		goto nomem;
+	for (i = 0; i < nblocks; i++) {
+		size_t hi = (i + 1) * PECAN_COMPLETE_BLOCK;
+		size_t j;
+
+		comp->best[i] = (uint32_t)(i * PECAN_COMPLETE_BLOCK);
+		for (j = comp->best[i] + 1; (j < hi) && (j < comp->nentries); j++) {
+			if (complete_better(comp, j, comp->best[i]))
+				comp->best[i] = (uint32_t)j;
+		}
+	}
+	for (level = 1; level < comp->levels; level++) {
+		uint32_t *prev = comp->best + ((level - 1) * nblocks);
+		uint32_t *cur = comp->best + (level * nblocks);
+		size_t half = (size_t)1 << (level - 1);
+
+		for (i = 0; (i + (half * 2)) <= nblocks; i++) {
+			cur[i] = complete_better(comp, prev[i + half], prev[i]) ?
+				prev[i + half] : prev[i];
+		}
+	}
+
+	mem_free(NULL, values);
+	return PECAN_OK;
+
+nomem:
+	mem_free(NULL, values);
+	pecan_complete_free(comp);
+	err_set_msg(EMSG("Couldn't allocate memory to build the completion "
+					 "index"));
+	return PECAN_ERR_UNKNOWN;
+}
+
+/**
+ * Gets the best completions of a prefix, ignoring case.
+ *
+ * @param  comp   Completion index.
+ * @param  prefix What's been typed so far. An empty one completes anything.
+ * @param  hits   Array to receive the best completions, best first. They
+ *                point straight into the index.
+ * @param  k      Number of completions that fit in the array.
+ * @param  nhits  Returns the number of completions in the array.
+ * @return        PECAN_OK if the operation was successful.
+ */
+pecan_err_t pecan_complete_query(pecan_complete_t *comp, const char *prefix,
+								 pecan_complete_entry_t **hits, size_t k,
+								 size_t *nhits) {
+	complete_range_t *heap;
+	complete_range_t range;
+	size_t nranges;
+	size_t len;
+	size_t lo;
+	size_t hi;
+
+	// Find the range of values that start with the prefix.
+	*nhits = 0;
+	len = strlen(prefix);
+	lo = complete_bound(comp, prefix, len, 0);
+	hi = complete_bound(comp, prefix, len, 1);
+	if ((k == 0) || (lo >= hi))
+		return PECAN_OK;
+
+	// Keep splitting the range around its best value.
+	heap = (complete_range_t *)mem_alloc(NULL, ((2 * k) + 1) *
+										 sizeof(complete_range_t));
+	if (heap == NULL) {
+		err_set_msg(EMSG("Couldn't allocate memory for the completions"));
+		return PECAN_ERR_UNKNOWN;
+	}
+	nranges = 0;
+	ranges_push(comp, heap, &nranges, lo, hi);
+	while ((*nhits < k) && (nranges > 0)) {
+		range = ranges_pop(comp, heap, &nranges);
+		hits[(*nhits)++] = &comp->entries[range.best];
+
+		ranges_push(comp, heap, &nranges, range.lo, range.best);
+		ranges_push(comp, heap, &nranges, range.best + 1, range.hi);
+	}
+
+	mem_free(NULL, heap);
+	return PECAN_OK;
+}
+
+/**
+ * Frees up everything held by a completion index.
+ *
+ * @param comp Completion index to be free'd.
+ */
+void pecan_complete_free(pecan_complete_t *comp) {
+	mem_free(NULL, comp->entries);
+	mem_free(NULL, comp->samples);
+	mem_free(NULL, comp->best);
+	if (comp->arena)
+		arena_release(comp->arena);
+
+	memset(comp, 0, sizeof(pecan_complete_t));
+}
+
+/**
+ * Compares two strings ignoring case, up to a number of characters.
+ *
+ * @param  a First string.
+ * @param  b Second string.
+ * @param  n Maximum number of characters to compare.
+ * @return   Same as strncmp.
+ */
+static int fold_ncmp(const char *a, const char *b, size_t n) {
+	for (; n > 0; n--, a++, b++) {
+		unsigned char ca = (unsigned char)*a;
+		unsigned char cb = (unsigned char)*b;
+
+		if ((ca >= 'A') && (ca <= 'Z'))
+			ca |= 0x20;
+		if ((cb >= 'A') && (cb <= 'Z'))
+			cb |= 0x20;
+		if ((ca != cb) || (ca == '\0'))
+			return (int)ca - (int)cb;
+	}
+
+	return 0;
+}
+
+/**
+ * Compares two values for sorting them without regard to case.
+ */
+static int complete_value_cmp(const void *a, const void *b) {
+	return fold_ncmp(((const complete_value_t *)a)->value,
+					 ((const complete_value_t *)b)->value, SIZE_MAX);
+}
+
+/**
+ * Copies a string into an arena folded to lowercase.
+ *
+ * @param  arena Arena to hold the copy.
+ * @param  str   String to be copied.
+ * @return       Folded copy or NULL if we ran out of memory.
+ */
+static char *complete_fold(pecan_arena_t *arena, const char *str) {
+	char *key;
+	char *p;
+
+	key = arena_strndup(arena, str, strlen(str));
+	if (key == NULL)
+		return NULL;
+	for (p = key; *p != '\0'; p++) {
+		if ((*p >= 'A') && (*p <= 'Z'))
+			*p |= 0x20;
+	}
+
+	return key;
+}
+
+/**
+ * Finds one of the ends of the range of values that start with a prefix.
+ *
+ * @param  comp   Completion index.
+ * @param  prefix Prefix being completed.
+ * @param  len    Length of the prefix.
+ * @param  upper  Non-zero to find the end of the range instead of its start.
+ * @return        Index of the first value in the range or past its end.
+ */
+static size_t complete_bound(pecan_complete_t *comp, const char *prefix,
+							 size_t len, int upper) {
+	size_t lo = 0;
+	size_t hi = comp->nsamples;
+	size_t i;
+	size_t end;
+	int cmp;
+
+	// Find the last block that starts before the bound.
+	while (lo < hi) {
+		size_t mid = lo + ((hi - lo) / 2);
+
+		cmp = fold_ncmp(comp->samples[mid], prefix, len);
+		if ((cmp < 0) || (upper && (cmp == 0))) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if (lo == 0)
+		return 0;
+
+	// Scan through it.
+	i = (lo - 1) * PECAN_COMPLETE_BLOCK;
+	end = lo * PECAN_COMPLETE_BLOCK;
+	if (end > comp->nentries)
+		end = comp->nentries;
+	for (; i < end; i++) {
+		cmp = fold_ncmp(comp->entries[i].key, prefix, len);
+		if ((cmp > 0) || (!upper && (cmp == 0)))
+			break;
+	}
+
+	return i;
+}
+
+/**
+ * Checks if a value ranks better than another one.
+ *
+ * @param  comp Completion index.
+ * @param  a    Index of the first value.
+ * @param  b    Index of the second value.
+ * @return      Non-zero if the first value is better.
+ */
+static int complete_better(pecan_complete_t *comp, size_t a, size_t b) {
+	if (comp->entries[a].weight != comp->entries[b].weight)
+		return comp->entries[a].weight > comp->entries[b].weight;
+
+	return a < b;
+}
+
+/**
+ * Finds the best value in a range.
+ *
+ * @param  comp Completion index.
+ * @param  lo   First value of the range.
+ * @param  hi   Value past the end of the range.
+ * @return      Index of the best value.
+ */
+static size_t complete_best(pecan_complete_t *comp, size_t lo, size_t hi) {
+	size_t first = lo / PECAN_COMPLETE_BLOCK;
+	size_t last = (hi - 1) / PECAN_COMPLETE_BLOCK;
+	size_t best = lo;
+	size_t i;
+
+	// Scan through the partial blocks at each end.
+	for (i = lo + 1; (i < hi) && (i < ((first + 1) * PECAN_COMPLETE_BLOCK));
+			i++) {
+		if (complete_better(comp, i, best))
+			best = i;
+	}
+	if (last > first) {
+		for (i = last * PECAN_COMPLETE_BLOCK; i < hi; i++) {
+			if (complete_better(comp, i, best))
+				best = i;
+		}
+	}
+
+	// Look up the whole blocks in between with two overlapping spans.
+	if ((last - first) > 1) {
+		size_t nblocks = comp->nsamples;
+		size_t span = last - first - 1;
+		size_t level = 0;
+		size_t a;
+		size_t b;
+
+		while (((size_t)2 << level) <= span)
+			level++;
+		a = comp->best[(level * nblocks) + first + 1];
+		b = comp->best[(level * nblocks) + last - ((size_t)1 << level)];
+		if (complete_better(comp, a, best))
+			best = a;
+		if (complete_better(comp, b, best))
+			best = b;
+	}
+
+	return best;
+}
+
+/**
+ * Pushes a range of values into the max-heap of ranges left to split.
+ *
+ * @param comp Completion index.
+ * @param heap Heap of ranges.
+ * @param n    Number of ranges in the heap.
+ * @param lo   First value of the range.
+ * @param hi   Value past the end of the range.
+ */
+static void ranges_push(pecan_complete_t *comp, complete_range_t *heap,
+						size_t *n, size_t lo, size_t hi) {
+	complete_range_t range;
+	size_t i;
+
+	if (lo >= hi)
+		return;
+
+	range.lo = lo;
+	range.hi = hi;
+	range.best = complete_best(comp, lo, hi);
+
+	// Sift it up.
+	i = (*n)++;
+	while ((i > 0) && complete_better(comp, range.best,
+									  heap[(i - 1) / 2].best)) {
+		heap[i] = heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	heap[i] = range;
+}
+
+/**
+ * Pops the range with the best value out of the max-heap of ranges.
+ *
+ * @param  comp Completion index.
+ * @param  heap Heap of ranges.
+ * @param  n    Number of ranges in the heap.
+ * @return      Range with the best value.
+ */
+static complete_range_t ranges_pop(pecan_complete_t *comp,
+								   complete_range_t *heap, size_t *n) {
+	complete_range_t top = heap[0];
+	complete_range_t last = heap[--(*n)];
+	size_t i = 0;
+
+	// Sift the last one down from the top.
+	for (;;) {
+		size_t child = (i * 2) + 1;
+
+		if (child >= *n)
+			break;
+		if (((child + 1) < *n) &&
+				complete_better(comp, heap[child + 1].best, heap[child].best))
+			child++;
+		if (!complete_better(comp, heap[child].best, last.best))
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = last;
+
+	return top;
+}
@@ -0,0 +1,67 @@
+/**
+ * complete.h
+ * Prefix autocompletion of the values of an attribute across a catalog.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _COMPLETE_H
+#define _COMPLETE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "catalog.h"
+
+// Manifest attribute that ranks the completions.
+#define PECAN_COMPLETE_RANK  "quantity"
+
+// Number of values between each entry of the sparse index.
+#define PECAN_COMPLETE_BLOCK  16
+
+// Distinct value of the attribute.
+typedef struct {
+	const char *value;
+	const char *key;
+	uint64_t weight;
+	uint32_t count;
+} pecan_complete_entry_t;
+
+// Completion index structure definition.
+typedef struct {
+	pecan_complete_entry_t *entries;
+	size_t nentries;
+
+	const char **samples;
+	size_t nsamples;
+
+	uint32_t *best;
+	size_t levels;
+
+	pecan_arena_t *arena;
+} pecan_complete_t;
+
+// Initialization
+PECAN_EXPORTS void pecan_complete_init(pecan_complete_t *comp);
+PECAN_EXPORTS pecan_err_t pecan_complete_build(pecan_complete_t *comp,
+											   pecan_catalog_t *cat,
+											   pecan_attr_type_t type,
+											   const char *name);
+
+// Querying
+PECAN_EXPORTS pecan_err_t pecan_complete_query(pecan_complete_t *comp,
+											   const char *prefix,
+											   pecan_complete_entry_t **hits,
+											   size_t k, size_t *nhits);
+
+// Cleanup
+PECAN_EXPORTS void pecan_complete_free(pecan_complete_t *comp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _COMPLETE_H */
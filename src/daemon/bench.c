@@ -0,0 +1,375 @@
+/**
+ * pecand-bench
+ * Load generator that measures the latency of the pecand daemon.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../alloc.h"
+#include "protocol.h"
+
+// Command line options structure.
+typedef struct {
+	char *socket_path;
+	char *attr_name;
+	size_t nconns;
+	size_t nrequests;
+	bool fetch_blobs;
+} opts_t;
+
+// Worker thread context.
+typedef struct {
+	size_t id;
+	uint64_t *latencies;
+	size_t nsamples;
+	size_t nerrors;
+} worker_t;
+
+// Global variables.
+static char *prompt = NULL;
+static opts_t opts;
+static char **paths = NULL;
+static size_t npaths = 0;
+
+// Private methods.
+void usage(void);
+static int fetch_paths(void);
+static void *worker_main(void *arg);
+static uint64_t now_ns(void);
+static int cmp_u64(const void *a, const void *b);
+static uint64_t percentile(const uint64_t *sorted, size_t len, double pct);
+
+/**
+ * Program's main entry point.
+ *
+ * @param  argc Number of command line arguments passed to us.
+ * @param  argv Command line arguments.
+ * @return      0 on success.
+ */
+int main(int argc, char **argv) {
+	worker_t *workers;
+	pthread_t *threads;
+	uint64_t *all;
+	uint64_t start;
+	uint64_t elapsed;
+	size_t nsamples;
+	size_t nerrors;
+	size_t total;
+	size_t i;
+	int ret = 0;
+	int c;
+
+	// Set options defaults.
+	prompt = argv[0];
+	opterr = 0;
+	opts.socket_path = PROTO_SOCKET_PATH;
+	opts.attr_name = "quantity";
+	opts.nconns = 4;
+	opts.nrequests = 10000;
+	opts.fetch_blobs = false;
+
+	// Go through the command line options.
+	while ((c = getopt(argc, argv, "hbs:c:n:a:")) != -1) {
+		switch (c) {
+			case 'h':
+				// Help the user with usage.
+				usage();
+				return 0;
+			case 'b':
+				// Fetch datasheets instead of attributes.
+				opts.fetch_blobs = true;
+				break;
+			case 's':
+				// Set the socket path.
+				opts.socket_path = optarg;
+				break;
+			case 'c':
+				// Set the number of concurrent connections.
+				opts.nconns = (size_t)strtoul(optarg, NULL, 10);
+				break;
+			case 'n':
+				// Set the number of requests per connection.
+				opts.nrequests = (size_t)strtoul(optarg, NULL, 10);
+				break;
+			case 'a':
+				// Set the attribute to query.
+				opts.attr_name = optarg;
+				break;
+			case '?':
+				// Unknown option or bad argument.
+				if (strchr("scna", optopt) != NULL) {
+					fprintf(stderr, "Option -%c requires an argument.\n",
+						optopt);
+				} else if (isprint(optopt)) {
+					fprintf(stderr, "%s: invalid option -- '%c'\n", prompt,
+						optopt);
+				} else {
+					fprintf(stderr, "%s: invalid option character -- '\\x%x'\n",
+						prompt, optopt);
+				}
+
+				usage();
+				return 1;
+			default:
+				// Die miserably.
+				abort();
+		}
+	}
+	if ((opts.nconns == 0) || (opts.nrequests == 0)) {
+		usage();
+		return 1;
+	}
+
+	// Get the archives that we'll be asking about.
+	if (fetch_paths())
+		return 1;
+
+	// Allocate everything up front so it doesn't get in the way.
+	workers = (worker_t *)mem_calloc(NULL, opts.nconns, sizeof(worker_t));
+	threads = (pthread_t *)mem_calloc(NULL, opts.nconns, sizeof(pthread_t));
+	all = (uint64_t *)mem_alloc(NULL,
+		opts.nconns * opts.nrequests * sizeof(uint64_t));
+	if ((workers == NULL) || (threads == NULL) || (all == NULL)) {
+		fprintf(stderr, "%s: out of memory\n", prompt);
+		return 1;
+	}
+
+	// Hammer the daemon.
+	start = now_ns();
+	for (i = 0; i < opts.nconns; i++) {
+		workers[i].id = i;
+		workers[i].latencies = all + (i * opts.nrequests);
+		pthread_create(&threads[i], NULL, worker_main, &workers[i]);
+	}
+	nerrors = 0;
+	for (i = 0; i < opts.nconns; i++) {
+		pthread_join(threads[i], NULL);
+		nerrors += workers[i].nerrors;
+	}
+	elapsed = now_ns() - start;
+
+	// Gather the latencies of the requests that actually succeeded.
+	nsamples = 0;
+	for (i = 0; i < opts.nconns; i++) {
+		memmove(all + nsamples, workers[i].latencies,
+			workers[i].nsamples * sizeof(uint64_t));
+		nsamples += workers[i].nsamples;
+	}
+
+	// Report back.
+	total = opts.nconns * opts.nrequests;
+	printf("%zu requests over %zu connections in %.3f s (%.0f req/s), "
+		"%zu errors\n", total, opts.nconns, elapsed / 1e9,
+		total / (elapsed / 1e9), nerrors);
+	if (nsamples > 0) {
+		qsort(all, nsamples, sizeof(uint64_t), cmp_u64);
+		printf("latency (us): p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  "
+			"max %.1f\n", percentile(all, nsamples, 50) / 1e3,
+			percentile(all, nsamples, 90) / 1e3,
+			percentile(all, nsamples, 99) / 1e3,
+			percentile(all, nsamples, 99.9) / 1e3,
+			all[nsamples - 1] / 1e3);
+	}
+	if (nerrors)
+		ret = 1;
+
+	// Clean up.
+	mem_free(NULL, all);
+	mem_free(NULL, threads);
+	mem_free(NULL, workers);
+	for (i = 0; i < npaths; i++)
+		mem_free(NULL, paths[i]);
+	mem_free(NULL, paths);
+
+	return ret;
+}
+
+/**
+ * Gets the list of archives from the daemon.
+ *
+ * @return 0 if the operation was successful.
+ */
+static int fetch_paths(void) {
+	proto_buf_t resp;
+	proto_cur_t cur;
+	uint32_t count;
+	int status;
+	int fd;
+	uint32_t i;
+
+	// Connect to the daemon.
+	fd = proto_connect(opts.socket_path);
+	if (fd < 0) {
+		fprintf(stderr, "%s: couldn't connect to '%s'\n", prompt,
+			opts.socket_path);
+		return -1;
+	}
+
+	// Ask for the list.
+	proto_buf_init(&resp);
+	if (proto_call(fd, PROTO_OP_LIST, 0, NULL, &resp, &status) || status) {
+		fprintf(stderr, "%s: couldn't list the archives\n", prompt);
+		goto fail;
+	}
+
+	// Parse it.
+	proto_cur_init(&cur, resp.data, resp.len);
+	if (proto_get_u32(&cur, &count) || (count == 0)) {
+		fprintf(stderr, "%s: the daemon has no archives\n", prompt);
+		goto fail;
+	}
+	paths = (char **)mem_calloc(NULL, count, sizeof(char *));
+	if (paths == NULL)
+		goto nomem;
+	for (i = 0; i < count; i++) {
+		const char *str;
+		uint16_t len;
+
+		if (proto_get_str(&cur, &str, &len))
+			goto fail;
+		paths[i] = mem_strndup(NULL, str, len);
+		if (paths[i] == NULL)
+			goto nomem;
+		npaths++;
+	}
+
+	proto_buf_free(&resp);
+	close(fd);
+	return 0;
+
+nomem:
+	fprintf(stderr, "%s: out of memory\n", prompt);
+
+fail:
+	proto_buf_free(&resp);
+	close(fd);
+	return -1;
+}
+
+/**
+ * Worker thread that issues requests over its own connection.
+ *
+ * @param  arg Worker context.
+ * @return     Always NULL.
+ */
+static void *worker_main(void *arg) {
+	worker_t *worker = (worker_t *)arg;
+	proto_buf_t req;
+	proto_buf_t resp;
+	unsigned int seed;
+	int status;
+	int fd;
+	size_t i;
+
+	// Connect to the daemon.
+	fd = proto_connect(opts.socket_path);
+	if (fd < 0) {
+		worker->nerrors = opts.nrequests;
+		return NULL;
+	}
+	proto_buf_init(&req);
+	proto_buf_init(&resp);
+	seed = (unsigned int)(worker->id + 1);
+
+	for (i = 0; i < opts.nrequests; i++) {
+		const char *path = paths[rand_r(&seed) % npaths];
+		uint64_t elapsed;
+		uint64_t start;
+		int err;
+
+		// Build up the request.
+		proto_buf_reset(&req);
+		proto_put_str(&req, path);
+		if (!opts.fetch_blobs)
+			proto_put_str(&req, opts.attr_name);
+
+		// Time the round trip.
+		start = now_ns();
+		if (opts.fetch_blobs) {
+			err = proto_call(fd, PROTO_OP_GET_BLOB, PROTO_BLOB_DATASHEET, &req,
+				&resp, &status);
+		} else {
+			err = proto_call(fd, PROTO_OP_GET_ATTR, 0, &req, &resp, &status);
+		}
+		elapsed = now_ns() - start;
+
+		// Only successful requests count towards the latencies.
+		if (err) {
+			worker->nerrors += opts.nrequests - i;
+			break;
+		} else if (status) {
+			worker->nerrors++;
+		} else {
+			worker->latencies[worker->nsamples++] = elapsed;
+		}
+	}
+
+	proto_buf_free(&req);
+	proto_buf_free(&resp);
+	close(fd);
+
+	return NULL;
+}
+
+/**
+ * Gets a monotonic timestamp.
+ *
+ * @return Timestamp in nanoseconds.
+ */
+static uint64_t now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Compares two latencies for sorting.
+ *
+ * @param  a First latency.
+ * @param  b Second latency.
+ * @return   Same as strcmp.
+ */
+static int cmp_u64(const void *a, const void *b) {
+	uint64_t va = *(const uint64_t *)a;
+	uint64_t vb = *(const uint64_t *)b;
+
+	return (va > vb) - (va < vb);
+}
+
+/**
+ * Gets a percentile out of sorted latencies.
+ *
+ * @param  sorted Sorted latencies.
+ * @param  len    Number of latencies.
+ * @param  pct    Percentile to get.
+ * @return        Latency at the percentile.
+ */
+static uint64_t percentile(const uint64_t *sorted, size_t len, double pct) {
+	size_t idx = (size_t)((pct / 100.0) * (double)(len - 1) + 0.5);
+
+	return sorted[(idx < len) ? idx : (len - 1)];
+}
+
+/**
+ * Displays a helpful usage message.
+ */
+void usage(void) {
+	fprintf(stderr, "usage: %s %s\n\n", prompt,
+		"[-h] [-b] [-s socket] [-c conns] [-n requests] [-a attr]");
+	fprintf(stderr, "   -h           Prints out this very helpful message.\n");
+	fprintf(stderr, "   -b           Fetches datasheets instead of attributes.\n");
+	fprintf(stderr, "   -s socket    Path of the daemon's socket.\n");
+	fprintf(stderr, "   -c conns     Number of concurrent connections.\n");
+	fprintf(stderr, "   -n requests  Number of requests per connection.\n");
+	fprintf(stderr, "   -a attr      Name of the attribute to query.\n");
+}
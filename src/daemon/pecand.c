@@ -0,0 +1,601 @@
+/**
+ * pecand
+ * Daemon that keeps a parts bin in memory and answers queries about it over a
+ * Unix domain socket.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../error.h"
+#include "../livecat.h"
+#ifdef __linux__
+#	include "../watch.h"
+#endif  /* __linux__ */
+#include "protocol.h"
+
+// Command line options structure.
+typedef struct {
+	char *socket_path;
+	char *bin_path;
+	size_t nthreads;
+#ifdef __linux__
+	bool watch;
+#endif  /* __linux__ */
+} opts_t;
+
+// Client connection.
+typedef struct client_s {
+	int fd;
+	pthread_t thread;
+	struct client_s *next;
+} client_t;
+
+// Global variables.
+static char *prompt = NULL;
+static pecan_livecat_t lc;
+static volatile sig_atomic_t running = 1;
+static client_t *clients = NULL;
+static size_t nclients = 0;
+static pthread_mutex_t clients_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t clients_cond = PTHREAD_COND_INITIALIZER;
+
+// Private methods.
+void usage(void);
+static int listen_socket(const char *path);
+static void serve(int sock);
+static void *client_main(void *arg);
+static int handle_request(pecan_reader_t *reader, int fd,
+						  const proto_header_t *req, const char *payload,
+						  proto_buf_t *resp);
+static int send_response(int fd, int status, const void *data, size_t len);
+static pecan_archive_t *find_archive(pecan_snapshot_t *snap, proto_cur_t *cur);
+static void stop_handler(int signum);
+#ifdef __linux__
+static void *watch_main(void *arg);
+#endif  /* __linux__ */
+
+/**
+ * Program's main entry point.
+ *
+ * @param  argc Number of command line arguments passed to us.
+ * @param  argv Command line arguments.
+ * @return      0 on success.
+ */
+int main(int argc, char **argv) {
+	struct sigaction sa;
+	pecan_err_t err;
+	size_t narchives;
+	opts_t opts;
+	int sock;
+	int c;
+#ifdef __linux__
+	pecan_watch_t watch;
+	pthread_t watcher;
+	bool watching = false;
+#endif  /* __linux__ */
+
+	// Set options defaults.
+	prompt = argv[0];
+	opterr = 0;
+	opts.socket_path = PROTO_SOCKET_PATH;
+	opts.nthreads = 0;
+#ifdef __linux__
+	opts.watch = false;
+#endif  /* __linux__ */
+
+	// Go through the command line options.
+	while ((c = getopt(argc, argv, "hws:t:")) != -1) {
+		switch (c) {
+			case 'h':
+				// Help the user with usage.
+				usage();
+				return 0;
+#ifdef __linux__
+			case 'w':
+				// Keep the catalog in sync with the parts bin.
+				opts.watch = true;
+				break;
+#endif  /* __linux__ */
+			case 's':
+				// Set the socket path.
+				opts.socket_path = optarg;
+				break;
+			case 't':
+				// Set the number of loading threads.
+				opts.nthreads = (size_t)strtoul(optarg, NULL, 10);
+				break;
+			case '?':
+				// Unknown option or bad argument.
+				if ((optopt == 's') || (optopt == 't')) {
+					fprintf(stderr, "Option -%c requires an argument.\n",
+						optopt);
+				} else if (isprint(optopt)) {
+					fprintf(stderr, "%s: invalid option -- '%c'\n", prompt,
+						optopt);
+				} else {
+					fprintf(stderr, "%s: invalid option character -- '\\x%x'\n",
+						prompt, optopt);
+				}
+
+				usage();
+				return 1;
+			default:
+				// Die miserably.
+				abort();
+		}
+	}
+
+	// Check if we have a parts bin.
+	if ((argc - optind) != 1) {
+		fprintf(stderr, "A parts bin must always be supplied.\n");
+		usage();
+		return 1;
+	}
+	opts.bin_path = argv[optind];
+
+	// Load the parts bin.
+	err = pecan_livecat_init(&lc);
+	if (err) {
+		pecan_print_error();
+		return err;
+	}
+	pecan_catalog_set_threads(&lc.cat, opts.nthreads);
+	err = pecan_livecat_load(&lc, opts.bin_path);
+	if (err == PECAN_ERR_PATH_NOT_FOUND) {
+		pecan_print_error();
+		pecan_livecat_free(&lc);
+		return err;
+	} else if (err) {
+		// Serve whatever we were able to load.
+		pecan_print_error();
+	}
+	narchives = pecan_snapshot_len(lc.current);
+
+	// Get ourselves ready to shut down cleanly.
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = stop_handler;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+#ifdef __linux__
+	// Start watching the parts bin for changes.
+	if (opts.watch) {
+		err = pecan_watch_init(&watch, &lc, opts.bin_path);
+		if (err) {
+			pecan_print_error();
+			pecan_watch_free(&watch);
+		} else if (pthread_create(&watcher, NULL, watch_main, &watch) == 0) {
+			watching = true;
+		}
+	}
+#endif  /* __linux__ */
+
+	// Start listening.
+	sock = listen_socket(opts.socket_path);
+	if (sock < 0) {
+		fprintf(stderr, "%s: couldn't listen on '%s': %s\n", prompt,
+			opts.socket_path, strerror(errno));
+		running = 0;
+	} else {
+		fprintf(stderr, "%s: serving %zu archives on %s\n", prompt,
+			narchives, opts.socket_path);
+		serve(sock);
+		close(sock);
+		unlink(opts.socket_path);
+	}
+
+#ifdef __linux__
+	// Stop watching.
+	if (watching) {
+		pthread_join(watcher, NULL);
+		pecan_watch_free(&watch);
+	}
+#endif  /* __linux__ */
+
+	pecan_livecat_free(&lc);
+	return (sock < 0) ? 1 : 0;
+}
+
+/**
+ * Creates the listening Unix domain socket.
+ *
+ * @param  path Path of the socket.
+ * @return      Socket descriptor or -1 if something went wrong.
+ */
+static int listen_socket(const char *path) {
+	struct sockaddr_un addr;
+	int sock;
+
+	// Build up the address.
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	// Get rid of a stale socket from a previous run.
+	unlink(path);
+
+	// Create the socket and start listening.
+	sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock < 0)
+		return -1;
+	if ((bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) ||
+			(listen(sock, 128) != 0)) {
+		close(sock);
+		return -1;
+	}
+
+	return sock;
+}
+
+/**
+ * Accepts clients until we are told to stop, then waits for every client to
+ * go away.
+ *
+ * @param sock Listening socket.
+ */
+static void serve(int sock) {
+	struct pollfd pfd;
+	client_t *client;
+
+	pfd.fd = sock;
+	pfd.events = POLLIN;
+	while (running) {
+		int fd;
+
+		// Wake up every once in a while to check if we should stop.
+		if (poll(&pfd, 1, 250) <= 0)
+			continue;
+		fd = accept(sock, NULL, NULL);
+		if (fd < 0)
+			continue;
+
+		// Create a thread for the client.
+		client = (client_t *)mem_alloc(NULL, sizeof(client_t));
+		if (client == NULL) {
+			close(fd);
+			continue;
+		}
+		client->fd = fd;
+
+		pthread_mutex_lock(&clients_lock);
+		if (pthread_create(&client->thread, NULL, client_main, client) != 0) {
+			pthread_mutex_unlock(&clients_lock);
+			close(fd);
+			mem_free(NULL, client);
+			continue;
+		}
+		pthread_detach(client->thread);
+		client->next = clients;
+		clients = client;
+		nclients++;
+		pthread_mutex_unlock(&clients_lock);
+	}
+
+	// Kick every client out and wait for them to leave.
+	pthread_mutex_lock(&clients_lock);
+	for (client = clients; client != NULL; client = client->next)
+		shutdown(client->fd, SHUT_RDWR);
+	while (nclients > 0)
+		pthread_cond_wait(&clients_cond, &clients_lock);
+	pthread_mutex_unlock(&clients_lock);
+}
+
+/**
+ * Client connection thread. Answers requests until the client goes away.
+ *
+ * @param  arg Client structure.
+ * @return     Always NULL.
+ */
+static void *client_main(void *arg) {
+	client_t *client = (client_t *)arg;
+	client_t **it;
+	pecan_reader_t *reader;
+	proto_header_t req;
+	proto_buf_t resp;
+	char *payload;
+
+	// Get ourselves ready.
+	proto_buf_init(&resp);
+	reader = pecan_livecat_reader_new(&lc);
+	payload = (char *)mem_alloc(NULL, PROTO_MAX_REQUEST);
+	if ((reader == NULL) || (payload == NULL))
+		goto cleanup;
+
+	// Answer requests.
+	while (proto_read_full(client->fd, &req, sizeof(req)) == 0) {
+		if (req.len > PROTO_MAX_REQUEST)
+			break;
+		if ((req.len > 0) && proto_read_full(client->fd, payload, req.len))
+			break;
+
+		if (handle_request(reader, client->fd, &req, payload, &resp))
+			break;
+	}
+
+cleanup:
+	proto_buf_free(&resp);
+	mem_free(NULL, payload);
+	pecan_livecat_reader_free(reader);
+	close(client->fd);
+
+	// Remove ourselves from the client list.
+	pthread_mutex_lock(&clients_lock);
+	for (it = &clients; *it != NULL; it = &(*it)->next) {
+		if (*it == client) {
+			*it = client->next;
+			break;
+		}
+	}
+	mem_free(NULL, client);
+	nclients--;
+	pthread_cond_broadcast(&clients_cond);
+	pthread_mutex_unlock(&clients_lock);
+
+	// Don't leave the error messages of this thread behind.
+	err_free();
+
+	return NULL;
+}
+
+/**
+ * Answers a single request.
+ *
+ * @param  reader  Live catalog reader of the client.
+ * @param  fd      Client socket.
+ * @param  req     Request header.
+ * @param  payload Request payload.
+ * @param  resp    Scratch buffer to build the response in.
+ * @return         0 if the connection should be kept open.
+ */
+static int handle_request(pecan_reader_t *reader, int fd,
+						  const proto_header_t *req, const char *payload,
+						  proto_buf_t *resp) {
+	pecan_snapshot_t *snap;
+	pecan_archive_t *part;
+	pecan_attr_t *attr;
+	pecan_blob_t *src;
+	pecan_blob_t blob;
+	proto_cur_t cur;
+	const char *name;
+	uint16_t nlen;
+	int status = PECAN_OK;
+	int failed = 0;
+	int ret;
+	size_t i;
+
+	proto_buf_reset(resp);
+	proto_cur_init(&cur, payload, req->len);
+
+	// Everything is answered from a single consistent snapshot.
+	snap = pecan_livecat_enter(reader);
+
+	switch (req->op) {
+		case PROTO_OP_PING:
+			failed |= proto_put(resp, payload, req->len);
+			break;
+		case PROTO_OP_STAT:
+			failed |= proto_put_u64(resp, pecan_snapshot_version(snap));
+			failed |= proto_put_u32(resp, (uint32_t)pecan_snapshot_len(snap));
+			break;
+		case PROTO_OP_LIST:
+			failed |= proto_put_u32(resp, (uint32_t)pecan_snapshot_len(snap));
+			for (i = 0; i < pecan_snapshot_len(snap); i++)
+				failed |= proto_put_str(resp, pecan_snapshot_get(snap, i)->path);
+			break;
+		case PROTO_OP_GET_ATTR:
+			part = find_archive(snap, &cur);
+			if ((part == NULL) || proto_get_str(&cur, &name, &nlen)) {
+				status = PECAN_ERR_PATH_NOT_FOUND;
+				break;
+			}
+
+			// Manifest takes precedence over the parameters.
+			attr = pecan_get_attr_n(part, PECAN_MANIFEST, name, nlen);
+			if (attr == NULL)
+				attr = pecan_get_attr_n(part, PECAN_PARAMETERS, name, nlen);
+			if (attr == NULL) {
+				status = PECAN_ERR_PATH_NOT_FOUND;
+				break;
+			}
+			failed |= proto_put_str(resp, attr->value);
+			break;
+		case PROTO_OP_GET_ATTRS:
+			part = find_archive(snap, &cur);
+			if ((part == NULL) || (req->arg > PECAN_PARAMETERS)) {
+				status = PECAN_ERR_PATH_NOT_FOUND;
+				break;
+			}
+
+			failed |= proto_put_u32(resp, (uint32_t)pecan_get_attr_len(part,
+				(pecan_attr_type_t)req->arg));
+			for (i = 0; i < pecan_get_attr_len(part,
+					(pecan_attr_type_t)req->arg); i++) {
+				attr = pecan_get_attr_idx(part, (pecan_attr_type_t)req->arg, i);
+				failed |= proto_put_str(resp, attr->name);
+				failed |= proto_put_str(resp, attr->value);
+			}
+			break;
+		case PROTO_OP_GET_BLOB:
+			part = find_archive(snap, &cur);
+			if (part == NULL) {
+				status = PECAN_ERR_PATH_NOT_FOUND;
+				break;
+			}
+
+			src = (req->arg == PROTO_BLOB_IMAGE) ? &part->image :
+				&part->datasheet;
+
+			// The length in the header can't describe anything larger.
+			if (src->len > UINT32_MAX) {
+				status = PECAN_ERR_NOT_IMPLEMENTED;
+				break;
+			}
+
+			// Hold a reference to the contents instead of the whole snapshot,
+			// so a slow client doesn't keep old snapshots from being freed.
+			blob_init(&blob);
+			if (src->shared) {
+				blob_share(&blob, src->shared);
+			} else if ((src->len > 0) &&
+					(blob_copy(&blob, src->data, src->len) == 0)) {
+				status = PECAN_ERR_UNKNOWN;
+				break;
+			}
+			pecan_livecat_leave(reader);
+
+			// Send it now that we are out of the snapshot.
+			ret = send_response(fd, PECAN_OK, blob.data, blob.len);
+			blob_free(&blob);
+			return ret;
+		default:
+			status = PECAN_ERR_NOT_IMPLEMENTED;
+			break;
+	}
+
+	pecan_livecat_leave(reader);
+
+	// Responses that couldn't be built are errors too.
+	if (failed && (status == PECAN_OK))
+		status = PECAN_ERR_UNKNOWN;
+
+	// Errors don't carry a payload.
+	if (status != PECAN_OK)
+		resp->len = 0;
+
+	return send_response(fd, status, resp->data, resp->len);
+}
+
+/**
+ * Sends a response to the client.
+ *
+ * @param  fd     Client socket.
+ * @param  status Status of the response.
+ * @param  data   Response payload.
+ * @param  len    Length of the payload.
+ * @return        0 if the operation was successful.
+ */
+static int send_response(int fd, int status, const void *data, size_t len) {
+	proto_header_t hdr;
+	struct iovec iov[2];
+	size_t total;
+	size_t sent = 0;
+
+	// Build up the header.
+	hdr.len = (uint32_t)len;
+	hdr.op = 0;
+	hdr.arg = 0;
+	hdr.status = (int16_t)status;
+
+	// Send the header and the payload in one go.
+	iov[0].iov_base = &hdr;
+	iov[0].iov_len = sizeof(hdr);
+	iov[1].iov_base = (void *)data;
+	iov[1].iov_len = len;
+	total = sizeof(hdr) + len;
+	while (sent < total) {
+		ssize_t ret = writev(fd, iov, 2);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		// Move past what was sent.
+		sent += (size_t)ret;
+		if ((size_t)ret >= iov[0].iov_len) {
+			ret -= (ssize_t)iov[0].iov_len;
+			iov[0].iov_len = 0;
+			iov[1].iov_base = (char *)iov[1].iov_base + ret;
+			iov[1].iov_len -= (size_t)ret;
+		} else {
+			iov[0].iov_base = (char *)iov[0].iov_base + ret;
+			iov[0].iov_len -= (size_t)ret;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Finds the archive whose path is the next string in a request.
+ *
+ * @param  snap Catalog snapshot.
+ * @param  cur  Request cursor.
+ * @return      Archive or NULL if it wasn't found.
+ */
+static pecan_archive_t *find_archive(pecan_snapshot_t *snap, proto_cur_t *cur) {
+	char path[4096];
+	const char *str;
+	uint16_t len;
+
+	if (proto_get_str(cur, &str, &len) || (len >= sizeof(path)))
+		return NULL;
+	memcpy(path, str, len);
+	path[len] = '\0';
+
+	return pecan_snapshot_find(snap, path);
+}
+
+/**
+ * Signal handler that tells us to shut down.
+ *
+ * @param signum Signal number.
+ */
+static void stop_handler(int signum) {
+	(void)signum;
+	running = 0;
+}
+
+#ifdef __linux__
+/**
+ * Watcher thread that keeps the catalog in sync with the parts bin.
+ *
+ * @param  arg Watch structure.
+ * @return     Always NULL.
+ */
+static void *watch_main(void *arg) {
+	pecan_watch_t *watch = (pecan_watch_t *)arg;
+	size_t nchanged;
+
+	while (running) {
+		if (pecan_watch_process(watch, 250, &nchanged))
+			pecan_print_error();
+	}
+
+	err_free();
+	return NULL;
+}
+#endif  /* __linux__ */
+
+/**
+ * Displays a helpful usage message.
+ */
+void usage(void) {
+	fprintf(stderr, "usage: %s %s\n\n", prompt,
+		"[-h] [-w] [-s socket] [-t threads] bindir");
+	fprintf(stderr, "   -h          Prints out this very helpful message.\n");
+#ifdef __linux__
+	fprintf(stderr, "   -w          Picks up changes to the parts bin.\n");
+#endif  /* __linux__ */
+	fprintf(stderr, "   -s socket   Path of the socket to listen on.\n");
+	fprintf(stderr, "   -t threads  Number of threads used for loading.\n");
+}
@@ -0,0 +1,321 @@
+/**
+ * protocol.c
+ * Compact binary protocol spoken by the pecand daemon and its clients.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "protocol.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../alloc.h"
+
+/**
+ * Initializes an empty message buffer.
+ *
+ * @param buf Buffer to be initialized.
+ */
+void proto_buf_init(proto_buf_t *buf) {
+	buf->data = NULL;
+	buf->len = 0;
+	buf->cap = 0;
+}
+
+/**
+ * Empties a message buffer while keeping its storage around.
+ *
+ * @param buf Buffer to be reset.
+ */
+void proto_buf_reset(proto_buf_t *buf) {
+	buf->len = 0;
+}
+
+/**
+ * Appends raw bytes to a message buffer.
+ *
+ * @param  buf  Message buffer.
+ * @param  data Bytes to be appended.
+ * @param  len  Number of bytes.
+ * @return      0 if the operation was successful.
+ */
+int proto_put(proto_buf_t *buf, const void *data, size_t len) {
+	// Grow the buffer if needed.
+	if ((buf->len + len) > buf->cap) {
+		size_t cap = (buf->cap) ? buf->cap : 256;
+		char *tmp;
+
+		while (cap < (buf->len + len))
+			cap *= 2;
+		tmp = (char *)mem_realloc(NULL, buf->data, cap);
+		if (tmp == NULL)
+			return -1;
+
+		buf->data = tmp;
+		buf->cap = cap;
+	}
+
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+
+	return 0;
+}
+
+/**
+ * Appends a 32-bit integer to a message buffer.
+ *
+ * @param  buf   Message buffer.
+ * @param  value Value to be appended.
+ * @return       0 if the operation was successful.
+ */
+int proto_put_u32(proto_buf_t *buf, uint32_t value) {
+	return proto_put(buf, &value, sizeof(value));
+}
+
+/**
+ * Appends a 64-bit integer to a message buffer.
+ *
+ * @param  buf   Message buffer.
+ * @param  value Value to be appended.
+ * @return       0 if the operation was successful.
+ */
+int proto_put_u64(proto_buf_t *buf, uint64_t value) {
+	return proto_put(buf, &value, sizeof(value));
+}
+
+/**
+ * Appends a string to a message buffer.
+ *
+ * @param  buf Message buffer.
+ * @param  str String to be appended. Must be shorter than 64 KiB.
+ * @return     0 if the operation was successful.
+ */
+int proto_put_str(proto_buf_t *buf, const char *str) {
+	size_t len = strlen(str);
+	uint16_t slen;
+
+	if (len > UINT16_MAX)
+		return -1;
+	slen = (uint16_t)len;
+
+	if (proto_put(buf, &slen, sizeof(slen)))
+		return -1;
+	return proto_put(buf, str, len);
+}
+
+/**
+ * Frees up a message buffer.
+ *
+ * @param buf Buffer to be free'd.
+ */
+void proto_buf_free(proto_buf_t *buf) {
+	mem_free(NULL, buf->data);
+	proto_buf_init(buf);
+}
+
+/**
+ * Initializes a cursor to parse a message.
+ *
+ * @param cur  Cursor to be initialized.
+ * @param data Message payload.
+ * @param len  Length of the payload.
+ */
+void proto_cur_init(proto_cur_t *cur, const void *data, size_t len) {
+	cur->pos = (const char *)data;
+	cur->left = len;
+}
+
+/**
+ * Gets a 32-bit integer from a message.
+ *
+ * @param  cur   Message cursor.
+ * @param  value Pointer to store the value.
+ * @return       0 if the operation was successful.
+ */
+int proto_get_u32(proto_cur_t *cur, uint32_t *value) {
+	if (cur->left < sizeof(*value))
+		return -1;
+
+	memcpy(value, cur->pos, sizeof(*value));
+	cur->pos += sizeof(*value);
+	cur->left -= sizeof(*value);
+
+	return 0;
+}
+
+/**
+ * Gets a 64-bit integer from a message.
+ *
+ * @param  cur   Message cursor.
+ * @param  value Pointer to store the value.
+ * @return       0 if the operation was successful.
+ */
+int proto_get_u64(proto_cur_t *cur, uint64_t *value) {
+	if (cur->left < sizeof(*value))
+		return -1;
+
+	memcpy(value, cur->pos, sizeof(*value));
+	cur->pos += sizeof(*value);
+	cur->left -= sizeof(*value);
+
+	return 0;
+}
+
+/**
+ * Gets a string from a message. The string points into the message and isn't
+ * NULL terminated.
+ *
+ * @param  cur Message cursor.
+ * @param  str Pointer to store the start of the string.
+ * @param  len Pointer to store the length of the string.
+ * @return     0 if the operation was successful.
+ */
+int proto_get_str(proto_cur_t *cur, const char **str, uint16_t *len) {
+	if (cur->left < sizeof(*len))
+		return -1;
+	memcpy(len, cur->pos, sizeof(*len));
+	if ((cur->left - sizeof(*len)) < *len)
+		return -1;
+
+	*str = cur->pos + sizeof(*len);
+	cur->pos += sizeof(*len) + *len;
+	cur->left -= sizeof(*len) + *len;
+
+	return 0;
+}
+
+/**
+ * Reads exactly a number of bytes from a socket.
+ *
+ * @param  fd   Socket descriptor.
+ * @param  data Buffer to read into.
+ * @param  len  Number of bytes to read.
+ * @return      0 if the operation was successful, 1 if the other end closed
+ *              the connection before anything was read, -1 on errors.
+ */
+int proto_read_full(int fd, void *data, size_t len) {
+	char *pos = (char *)data;
+	size_t left = len;
+
+	while (left > 0) {
+		ssize_t ret = read(fd, pos, left);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		} else if (ret == 0) {
+			return (left == len) ? 1 : -1;
+		}
+
+		pos += ret;
+		left -= (size_t)ret;
+	}
+
+	return 0;
+}
+
+/**
+ * Writes exactly a number of bytes to a socket.
+ *
+ * @param  fd   Socket descriptor.
+ * @param  data Buffer to write from.
+ * @param  len  Number of bytes to write.
+ * @return      0 if the operation was successful.
+ */
+int proto_write_full(int fd, const void *data, size_t len) {
+	const char *pos = (const char *)data;
+
+	while (len > 0) {
+		ssize_t ret = write(fd, pos, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		pos += ret;
+		len -= (size_t)ret;
+	}
+
+	return 0;
+}
+
+/**
+ * Connects to the daemon.
+ *
+ * @param  path Path to the daemon's socket.
+ * @return      Socket descriptor or -1 if we couldn't connect.
+ */
+int proto_connect(const char *path) {
+	struct sockaddr_un addr;
+	int fd;
+
+	// Build up the address.
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	// Connect.
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/**
+ * Sends a request to the daemon and waits for its response.
+ *
+ * @param  fd     Socket descriptor.
+ * @param  op     Operation to be performed.
+ * @param  arg    Argument of the operation.
+ * @param  req    Request payload or NULL if there isn't one.
+ * @param  resp   Buffer to store the response payload.
+ * @param  status Pointer to store the status of the response.
+ * @return        0 if the operation was successful.
+ */
+int proto_call(int fd, uint8_t op, uint8_t arg, const proto_buf_t *req,
+			   proto_buf_t *resp, int *status) {
+	proto_header_t hdr;
+
+	// Send the request.
+	hdr.len = (req) ? (uint32_t)req->len : 0;
+	hdr.op = op;
+	hdr.arg = arg;
+	hdr.status = 0;
+	if (proto_write_full(fd, &hdr, sizeof(hdr)))
+		return -1;
+	if (req && (req->len > 0) && proto_write_full(fd, req->data, req->len))
+		return -1;
+
+	// Get the response header.
+	if (proto_read_full(fd, &hdr, sizeof(hdr)))
+		return -1;
+	*status = hdr.status;
+
+	// Get the response payload.
+	proto_buf_reset(resp);
+	if (hdr.len > resp->cap) {
+		char *tmp = (char *)mem_realloc(NULL, resp->data, hdr.len);
+		if (tmp == NULL)
+			return -1;
+
+		resp->data = tmp;
+		resp->cap = hdr.len;
+	}
+	if ((hdr.len > 0) && proto_read_full(fd, resp->data, hdr.len))
+		return -1;
+	resp->len = hdr.len;
+
+	return 0;
+}
@@ -0,0 +1,92 @@
+/**
+ * protocol.h
+ * Compact binary protocol spoken by the pecand daemon and its clients.
+ *
+ * Every message is an 8 byte header followed by its payload. Integers are in
+ * host byte order since the protocol only ever travels over a Unix domain
+ * socket. Strings are a 16-bit length followed by that many bytes without a
+ * NULL terminator.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _DAEMON_PROTOCOL_H
+#define _DAEMON_PROTOCOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// Default path of the daemon's socket.
+#define PROTO_SOCKET_PATH "/tmp/pecand.sock"
+
+// Largest request payload that the daemon accepts.
+#define PROTO_MAX_REQUEST (64 * 1024)
+
+// Operations.
+typedef enum {
+	PROTO_OP_PING = 0,  // Echoes the payload back.
+	PROTO_OP_STAT,      // -> u64 version, u32 number of archives.
+	PROTO_OP_LIST,      // -> u32 count, str path...
+	PROTO_OP_GET_ATTR,  // str path, str name -> str value.
+	PROTO_OP_GET_ATTRS, // str path -> u32 count, str name, str value...
+	PROTO_OP_GET_BLOB   // str path -> raw blob contents (under 4 GiB).
+} proto_op_t;
+
+// Blobs that can be fetched (request header arg).
+typedef enum {
+	PROTO_BLOB_IMAGE = 0,
+	PROTO_BLOB_DATASHEET
+} proto_blob_t;
+
+// Message header. The status of a response is a pecan_err_t.
+typedef struct {
+	uint32_t len;
+	uint8_t op;
+	uint8_t arg;
+	int16_t status;
+} proto_header_t;
+
+// Growable buffer used to build messages.
+typedef struct {
+	char *data;
+	size_t len;
+	size_t cap;
+} proto_buf_t;
+
+// Cursor used to parse messages.
+typedef struct {
+	const char *pos;
+	size_t left;
+} proto_cur_t;
+
+// Building
+void proto_buf_init(proto_buf_t *buf);
+void proto_buf_reset(proto_buf_t *buf);
+int proto_put(proto_buf_t *buf, const void *data, size_t len);
+int proto_put_u32(proto_buf_t *buf, uint32_t value);
+int proto_put_u64(proto_buf_t *buf, uint64_t value);
+int proto_put_str(proto_buf_t *buf, const char *str);
+void proto_buf_free(proto_buf_t *buf);
+
+// Parsing
+void proto_cur_init(proto_cur_t *cur, const void *data, size_t len);
+int proto_get_u32(proto_cur_t *cur, uint32_t *value);
+int proto_get_u64(proto_cur_t *cur, uint64_t *value);
+int proto_get_str(proto_cur_t *cur, const char **str, uint16_t *len);
+
+// Transport
+int proto_read_full(int fd, void *data, size_t len);
+int proto_write_full(int fd, const void *data, size_t len);
+int proto_connect(const char *path);
+int proto_call(int fd, uint8_t op, uint8_t arg, const proto_buf_t *req,
+			   proto_buf_t *resp, int *status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _DAEMON_PROTOCOL_H */
@@ -10,8 +10,11 @@
 #include <stdio.h>
 #include <string.h>
 
-// Private variables.
-char *pecan_err_msg_buf = NULL;
+#include "alloc.h"
+#include "thread.h"
+
+// Private variables. Each thread gets its own error message.
+THREAD_LOCAL char *pecan_err_msg_buf = NULL;
 
 /**
  * Initializes the error message buffer.
@@ -27,8 +30,8 @@ void err_init(void) {
  */
 void err_set_msg(const char *msg) {
 	// Make sure we have enough space to store our error message.
-	pecan_err_msg_buf = (char *)realloc(pecan_err_msg_buf,
-										(strlen(msg) + 1) * sizeof(char));
+	pecan_err_msg_buf = (char *)mem_realloc(NULL, pecan_err_msg_buf,
+		(strlen(msg) + 1) * sizeof(char));
 
 	// Copy the error message.
 	strcpy(pecan_err_msg_buf, msg);
@@ -49,8 +52,8 @@ void err_format_msg(const char *format, ...) {
 	va_start(args, format);
 	len = vsnprintf(NULL, 0, format, args);
 	va_end(args);
-	pecan_err_msg_buf = (char *)realloc(pecan_err_msg_buf,
-										(len + 1) * sizeof(char));
+	pecan_err_msg_buf = (char *)mem_realloc(NULL, pecan_err_msg_buf,
+		(len + 1) * sizeof(char));
 
 	// Copy our formatted message.
 	va_start(args, format);
@@ -63,10 +66,35 @@ void err_format_msg(const char *format, ...) {
  */
 void err_free(void) {
 	// Free our error string.
-	free(pecan_err_msg_buf);
+	mem_free(NULL, pecan_err_msg_buf);
 	pecan_err_msg_buf = NULL;
 }
 
+/**
+ * Saves a copy of the current error message, since freeing archives clears it.
+ *
+ * @return Copy of the error message or NULL if there isn't one.
+ */
+char *err_save(void) {
+	if (pecan_err_msg_buf == NULL)
+		return NULL;
+
+	return mem_strndup(NULL, pecan_err_msg_buf, strlen(pecan_err_msg_buf));
+}
+
+/**
+ * Restores an error message saved by err_save and frees the copy.
+ *
+ * @param saved Saved error message or NULL.
+ */
+void err_restore(char *saved) {
+	if (saved == NULL)
+		return;
+
+	err_set_msg(saved);
+	mem_free(NULL, saved);
+}
+
 /**
  * Gets the last error message thrown by the library.
  *
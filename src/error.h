@@ -29,6 +29,10 @@ void err_set_msg(const char *msg);
 void err_format_msg(const char *format, ...);
 void err_free(void);
 
+// Saving
+char *err_save(void);
+void err_restore(char *saved);
+
 // Inspections
 const char *err_get_msg(void);
 void err_print_msg(void);
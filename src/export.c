@@ -0,0 +1,734 @@
+/**
+ * export.c
+ * Streaming exporter of the attributes of a catalog to tabular formats.
+ *
+ * Archives are split into chunks that get formatted in parallel by the
+ * catalog's thread pool, each into its own buffer, while the calling thread
+ * writes the finished buffers out in catalog order. Only a small window of
+ * chunks is in flight at any time, so memory usage doesn't grow with the size
+ * of the parts bin.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "export.h"
+
+#include <cvector_utils.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "error.h"
+#include "fileutils.h"
+
+// Number of archives formatted by each task.
+#define EXPORT_CHUNK_PARTS 256
+
+// Number of chunks allowed to be in flight for each worker thread.
+#define EXPORT_WINDOW 4
+
+// Initial size of the chunk buffers.
+#define EXPORT_BUF_SIZE 65536
+
+// Column index used when a name isn't mapped to any column.
+#define EXPORT_NO_COLUMN ((size_t)-1)
+
+// Kinds of columns.
+typedef enum {
+	EXPORT_COL_PATH = 0,
+	EXPORT_COL_MANIFEST,
+	EXPORT_COL_PARAM
+} export_col_kind_t;
+
+// Column of the export.
+typedef struct {
+	export_col_kind_t kind;
+	const char *name;
+	size_t slot;
+} export_col_t;
+
+// Map of attribute names to the slots of their values in a row.
+typedef struct {
+	const char **names;
+	size_t *slots;
+	size_t count;
+	size_t cap;
+} export_map_t;
+
+// Growable output buffer.
+typedef struct {
+	char *data;
+	size_t len;
+	size_t cap;
+	int failed;
+} export_buf_t;
+
+// Everything that's shared by the export tasks.
+typedef struct {
+	pecan_catalog_t *cat;
+	pecan_export_fmt_t fmt;
+	int projected;
+	size_t root_len;
+
+	cvector_vector_type(export_col_t) cols;
+	size_t path_slot;
+	export_map_t maps[2];
+} export_ctx_t;
+
+// Chunk of archives formatted by a single task.
+typedef struct {
+	export_ctx_t *ctx;
+	size_t first;
+	size_t last;
+	export_buf_t buf;
+	pecan_taskgroup_t group;
+} export_chunk_t;
+
+// Private methods.
+static int export_add_col(export_ctx_t *ctx, export_col_kind_t kind,
+						  const char *name, int unique);
+static void export_task(void *arg);
+static void export_header(export_ctx_t *ctx, export_buf_t *buf);
+static void export_row(export_ctx_t *ctx, pecan_catalog_entry_t *entry,
+					   const char **row, export_buf_t *buf);
+static void export_nested(export_ctx_t *ctx, pecan_catalog_entry_t *entry,
+						  export_buf_t *buf);
+static const char *export_path(export_ctx_t *ctx,
+							   pecan_catalog_entry_t *entry);
+static void export_col_name(export_col_t *col, export_buf_t *buf);
+static void put_csv(export_buf_t *buf, const char *str);
+static void put_json(export_buf_t *buf, const char *prefix, const char *str);
+static void put_json_attrs(export_buf_t *buf, pecan_attr_arr_t attribs);
+static void buf_put(export_buf_t *buf, const char *data, size_t len);
+static void buf_putc(export_buf_t *buf, char c);
+static size_t map_find(export_map_t *map, const char *name);
+static size_t map_add(export_map_t *map, const char *name, size_t slot);
+static void map_free(export_map_t *map);
+
+/**
+ * Exports the attributes of every archive in a catalog that was loaded
+ * successfully, one archive per line, in catalog order.
+ *
+ * @param  cat      Loaded catalog to be exported.
+ * @param  fd       File descriptor to write the export to.
+ * @param  fmt      Format of the export.
+ * @param  columns  Columns to be exported, in order. PECAN_EXPORT_PATH_COLUMN
+ *                  is the path of the archive, names starting with
+ *                  PECAN_EXPORT_PARAM_PREFIX are parameters and everything
+ *                  else are manifest attributes. NULL to export everything,
+ *                  in which case CSV gets every attribute found in the catalog
+ *                  as a column and JSON Lines gets the manifest and parameters
+ *                  as objects of their own.
+ * @param  ncolumns Number of columns.
+ * @return          PECAN_OK if the operation was successful.
+ *                  PECAN_ERR_FILE_IO if writing the export failed.
+ */
+pecan_err_t pecan_catalog_export(pecan_catalog_t *cat, int fd,
+								 pecan_export_fmt_t fmt, const char **columns,
+								 size_t ncolumns) {
+	export_ctx_t ctx;
+	export_chunk_t *chunks = NULL;
+	export_buf_t header;
+	pecan_pool_t *pool;
+	pecan_catalog_entry_t **it;
+	size_t nchunks;
+	size_t window;
+	size_t next;
+	size_t i;
+	pecan_err_t err = PECAN_OK;
+
+	// Set up the context.
+	memset(&ctx, 0, sizeof(ctx));
+	memset(&header, 0, sizeof(header));
+	ctx.cat = cat;
+	ctx.fmt = fmt;
+	ctx.projected = (columns != NULL) && (ncolumns > 0);
+	ctx.root_len = (cat->root) ? strlen(cat->root) : 0;
+	ctx.path_slot = EXPORT_NO_COLUMN;
+
+	// Figure out which columns we are going to have.
+	if (ctx.projected) {
+		for (i = 0; i < ncolumns; i++) {
+			size_t plen = strlen(PECAN_EXPORT_PARAM_PREFIX);
+
+			if (strcmp(columns[i], PECAN_EXPORT_PATH_COLUMN) == 0) {
+				if (!export_add_col(&ctx, EXPORT_COL_PATH, columns[i], 0))
+					goto nomem;
+			} else if (strncmp(columns[i], PECAN_EXPORT_PARAM_PREFIX,
+							   plen) == 0) {
+				if (!export_add_col(&ctx, EXPORT_COL_PARAM, columns[i] + plen,
+									0))
+					goto nomem;
+			} else {
+				if (!export_add_col(&ctx, EXPORT_COL_MANIFEST, columns[i], 0))
+					goto nomem;
+			}
+		}
+	} else if (fmt == PECAN_EXPORT_CSV) {
+		// Every attribute in the catalog, manifest before parameters.
+		if (!export_add_col(&ctx, EXPORT_COL_PATH, PECAN_EXPORT_PATH_COLUMN, 1))
+			goto nomem;
+		for (it = cvector_begin(cat->entries); it != cvector_end(cat->entries);
+				++it) {
+			pecan_attr_t *attr;
+
+			if ((*it)->err)
+				continue;
+			for (attr = cvector_begin((*it)->part.attribs);
+					attr != cvector_end((*it)->part.attribs); ++attr) {
+				if (!export_add_col(&ctx, EXPORT_COL_MANIFEST, attr->name, 1))
+					goto nomem;
+			}
+		}
+		for (it = cvector_begin(cat->entries); it != cvector_end(cat->entries);
+				++it) {
+			pecan_attr_t *attr;
+
+			if ((*it)->err)
+				continue;
+			for (attr = cvector_begin((*it)->part.params);
+					attr != cvector_end((*it)->part.params); ++attr) {
+				if (!export_add_col(&ctx, EXPORT_COL_PARAM, attr->name, 1))
+					goto nomem;
+			}
+		}
+	}
+
+	// Get our pool ready.
+	pool = pecan_catalog_pool(cat);
+	if (pool == NULL) {
+		err_set_msg(EMSG("Couldn't create the catalog thread pool"));
+		err = PECAN_ERR_UNKNOWN;
+		goto cleanup;
+	}
+
+	// Write the header.
+	if (fmt == PECAN_EXPORT_CSV) {
+		export_header(&ctx, &header);
+		if (header.failed)
+			goto nomem;
+		if (!fd_write(fd, header.data, header.len)) {
+			err_set_msg(EMSG("Couldn't write the export"));
+			err = PECAN_ERR_FILE_IO;
+			goto cleanup;
+		}
+	}
+
+	// Split the catalog into chunks.
+	nchunks = (cvector_size(cat->entries) + EXPORT_CHUNK_PARTS - 1) /
+		EXPORT_CHUNK_PARTS;
+	chunks = (export_chunk_t *)mem_calloc(NULL, (nchunks) ? nchunks : 1,
+										  sizeof(export_chunk_t));
+	if (chunks == NULL)
+		goto nomem;
+	for (i = 0; i < nchunks; i++) {
+		chunks[i].ctx = &ctx;
+		chunks[i].first = i * EXPORT_CHUNK_PARTS;
+		chunks[i].last = chunks[i].first + EXPORT_CHUNK_PARTS;
+		if (chunks[i].last > cvector_size(cat->entries))
+			chunks[i].last = cvector_size(cat->entries);
+	}
+
+	// Format the chunks in parallel and write them out in order.
+	window = EXPORT_WINDOW * ((pool_size(pool)) ? pool_size(pool) : 1);
+	next = 0;
+	for (i = 0; i < nchunks; i++) {
+		// Keep the pool busy with the chunks ahead of us.
+		while ((err == PECAN_OK) && (next < nchunks) && (next < (i + window))) {
+			export_chunk_t *chunk = &chunks[next++];
+
+			pool_group_init(&chunk->group);
+			if (pool_submit(pool, &chunk->group, export_task, chunk) != 0)
+				export_task(chunk);
+		}
+
+		// Wait for our chunk and get it out of the door.
+		pool_wait(pool, &chunks[i].group);
+		if ((err == PECAN_OK) && (i < next)) {
+			if (chunks[i].buf.failed) {
+				err_set_msg(EMSG("Couldn't allocate the export buffer"));
+				err = PECAN_ERR_UNKNOWN;
+			} else if (!fd_write(fd, chunks[i].buf.data, chunks[i].buf.len)) {
+				err_set_msg(EMSG("Couldn't write the export"));
+				err = PECAN_ERR_FILE_IO;
+			}
+		}
+		mem_free(NULL, chunks[i].buf.data);
+	}
+
+	goto cleanup;
+
+nomem:
+	err_set_msg(EMSG("Couldn't allocate the export columns"));
+	err = PECAN_ERR_UNKNOWN;
+
+cleanup:
+	mem_free(NULL, chunks);
+	mem_free(NULL, header.data);
+	cvector_free(ctx.cols);
+	map_free(&ctx.maps[PECAN_MANIFEST]);
+	map_free(&ctx.maps[PECAN_PARAMETERS]);
+
+	return err;
+}
+
+/**
+ * Adds a column to the export.
+ *
+ * @param  ctx    Export context.
+ * @param  kind   Kind of column.
+ * @param  name   Name of the attribute. Must outlive the export.
+ * @param  unique Should the column be skipped if it's already there?
+ * @return        Non-zero if the operation was successful.
+ */
+static int export_add_col(export_ctx_t *ctx, export_col_kind_t kind,
+						  const char *name, int unique) {
+	export_col_t col;
+	size_t slot;
+
+	// Find out where its value will be kept in a row.
+	col.kind = kind;
+	col.name = (name) ? name : "";
+	col.slot = cvector_size(ctx->cols);
+	if (kind == EXPORT_COL_PATH) {
+		if (ctx->path_slot != EXPORT_NO_COLUMN) {
+			if (unique)
+				return 1;
+			col.slot = ctx->path_slot;
+		}
+		ctx->path_slot = col.slot;
+	} else {
+		pecan_attr_type_t type = (kind == EXPORT_COL_PARAM) ?
+			PECAN_PARAMETERS : PECAN_MANIFEST;
+
+		slot = map_add(&ctx->maps[type], col.name, col.slot);
+		if (slot == EXPORT_NO_COLUMN)
+			return 0;
+		if (slot != col.slot) {
+			if (unique)
+				return 1;
+			col.slot = slot;
+		}
+	}
+
+	cvector_push_back(ctx->cols, col);
+	return 1;
+}
+
+/**
+ * Task that formats a chunk of the catalog into the chunk's buffer.
+ *
+ * @param arg Export chunk.
+ */
+static void export_task(void *arg) {
+	export_chunk_t *chunk = (export_chunk_t *)arg;
+	export_ctx_t *ctx = chunk->ctx;
+	const char **row = NULL;
+	size_t ncols;
+	size_t i;
+
+	// Get our buffers ready.
+	chunk->buf.data = (char *)mem_alloc(NULL, EXPORT_BUF_SIZE);
+	chunk->buf.cap = (chunk->buf.data) ? EXPORT_BUF_SIZE : 0;
+	chunk->buf.failed = (chunk->buf.data == NULL);
+	ncols = cvector_size(ctx->cols);
+	if (ncols > 0) {
+		row = (const char **)mem_alloc(NULL, ncols * sizeof(const char *));
+		if (row == NULL) {
+			chunk->buf.failed = 1;
+			return;
+		}
+	}
+
+	// Format every archive that was loaded.
+	for (i = chunk->first; (i < chunk->last) && !chunk->buf.failed; i++) {
+		pecan_catalog_entry_t *entry = ctx->cat->entries[i];
+
+		if (entry->err)
+			continue;
+
+		if (row) {
+			export_row(ctx, entry, row, &chunk->buf);
+		} else {
+			export_nested(ctx, entry, &chunk->buf);
+		}
+	}
+
+	mem_free(NULL, row);
+}
+
+/**
+ * Formats the header line of a CSV export.
+ *
+ * @param ctx Export context.
+ * @param buf Buffer to receive the header.
+ */
+static void export_header(export_ctx_t *ctx, export_buf_t *buf) {
+	export_buf_t name;
+	size_t i;
+
+	memset(&name, 0, sizeof(name));
+	for (i = 0; i < cvector_size(ctx->cols); i++) {
+		if (i > 0)
+			buf_putc(buf, ',');
+
+		name.len = 0;
+		export_col_name(&ctx->cols[i], &name);
+		buf_putc(&name, '\0');
+		put_csv(buf, (name.failed) ? "" : name.data);
+	}
+	buf_putc(buf, '\n');
+
+	buf->failed |= name.failed;
+	mem_free(NULL, name.data);
+}
+
+/**
+ * Formats an archive as a row of the projected columns.
+ *
+ * @param ctx   Export context.
+ * @param entry Catalog entry to be formatted.
+ * @param row   Scratch space for the values of each column.
+ * @param buf   Buffer to receive the row.
+ */
+static void export_row(export_ctx_t *ctx, pecan_catalog_entry_t *entry,
+					   const char **row, export_buf_t *buf) {
+	pecan_attr_t *attr;
+	size_t slot;
+	size_t i;
+
+	// Gather the values of the columns.
+	memset(row, 0, cvector_size(ctx->cols) * sizeof(const char *));
+	if (ctx->path_slot != EXPORT_NO_COLUMN)
+		row[ctx->path_slot] = export_path(ctx, entry);
+	for (attr = cvector_begin(entry->part.attribs);
+			attr != cvector_end(entry->part.attribs); ++attr) {
+		slot = map_find(&ctx->maps[PECAN_MANIFEST], attr->name);
+		if ((slot != EXPORT_NO_COLUMN) && (row[slot] == NULL))
+			row[slot] = (attr->value) ? attr->value : "";
+	}
+	for (attr = cvector_begin(entry->part.params);
+			attr != cvector_end(entry->part.params); ++attr) {
+		slot = map_find(&ctx->maps[PECAN_PARAMETERS], attr->name);
+		if ((slot != EXPORT_NO_COLUMN) && (row[slot] == NULL))
+			row[slot] = (attr->value) ? attr->value : "";
+	}
+
+	// Write them out.
+	if (ctx->fmt == PECAN_EXPORT_CSV) {
+		for (i = 0; i < cvector_size(ctx->cols); i++) {
+			if (i > 0)
+				buf_putc(buf, ',');
+			put_csv(buf, row[ctx->cols[i].slot]);
+		}
+		buf_putc(buf, '\n');
+	} else {
+		buf_putc(buf, '{');
+		for (i = 0; i < cvector_size(ctx->cols); i++) {
+			const char *value = row[ctx->cols[i].slot];
+
+			if (i > 0)
+				buf_putc(buf, ',');
+			put_json(buf, (ctx->cols[i].kind == EXPORT_COL_PARAM) ?
+				PECAN_EXPORT_PARAM_PREFIX : NULL, ctx->cols[i].name);
+			buf_putc(buf, ':');
+			if (value) {
+				put_json(buf, NULL, value);
+			} else {
+				buf_put(buf, "null", 4);
+			}
+		}
+		buf_put(buf, "}\n", 2);
+	}
+}
+
+/**
+ * Formats an archive as a JSON object with its manifest and parameters as
+ * objects of their own.
+ *
+ * @param ctx   Export context.
+ * @param entry Catalog entry to be formatted.
+ * @param buf   Buffer to receive the line.
+ */
+static void export_nested(export_ctx_t *ctx, pecan_catalog_entry_t *entry,
+						  export_buf_t *buf) {
+	buf_put(buf, "{\"path\":", 8);
+	put_json(buf, NULL, export_path(ctx, entry));
+	buf_put(buf, ",\"manifest\":", 12);
+	put_json_attrs(buf, entry->part.attribs);
+	buf_put(buf, ",\"parameters\":", 14);
+	put_json_attrs(buf, entry->part.params);
+	buf_put(buf, "}\n", 2);
+}
+
+/**
+ * Gets the path of an archive relative to the root of the parts bin.
+ *
+ * @param  ctx   Export context.
+ * @param  entry Catalog entry.
+ * @return       Relative path of the archive.
+ */
+static const char *export_path(export_ctx_t *ctx,
+							   pecan_catalog_entry_t *entry) {
+	if ((ctx->root_len > 0) &&
+			(strncmp(entry->path, ctx->cat->root, ctx->root_len) == 0) &&
+			(entry->path[ctx->root_len] == '/')) {
+		return entry->path + ctx->root_len + 1;
+	}
+
+	return entry->path;
+}
+
+/**
+ * Puts the name of a column in a buffer as it was specified by the user.
+ *
+ * @param col Column.
+ * @param buf Buffer to receive the name.
+ */
+static void export_col_name(export_col_t *col, export_buf_t *buf) {
+	if (col->kind == EXPORT_COL_PARAM) {
+		buf_put(buf, PECAN_EXPORT_PARAM_PREFIX,
+				strlen(PECAN_EXPORT_PARAM_PREFIX));
+	}
+	buf_put(buf, col->name, strlen(col->name));
+}
+
+/**
+ * Puts a CSV field in a buffer, quoting it only if needed.
+ *
+ * @param buf Buffer.
+ * @param str Value of the field or NULL for an empty one.
+ */
+static void put_csv(export_buf_t *buf, const char *str) {
+	const char *quote;
+
+	if (str == NULL)
+		return;
+
+	// Most values can go out as they are.
+	if (strpbrk(str, ",\"\r\n") == NULL) {
+		buf_put(buf, str, strlen(str));
+		return;
+	}
+
+	// Quote it and double any quotes inside of it.
+	buf_putc(buf, '"');
+	while ((quote = strchr(str, '"')) != NULL) {
+		buf_put(buf, str, quote - str + 1);
+		buf_putc(buf, '"');
+		str = quote + 1;
+	}
+	buf_put(buf, str, strlen(str));
+	buf_putc(buf, '"');
+}
+
+/**
+ * Puts a JSON string in a buffer.
+ *
+ * @param buf    Buffer.
+ * @param prefix Optional string to be put in front of the value.
+ * @param str    Value of the string.
+ */
+static void put_json(export_buf_t *buf, const char *prefix, const char *str) {
+	static const char hex[] = "0123456789abcdef";
+	const char *run;
+
+	buf_putc(buf, '"');
+	if (prefix)
+		buf_put(buf, prefix, strlen(prefix));
+
+	for (run = str; *str != '\0'; str++) {
+		unsigned char c = (unsigned char)*str;
+		char esc[6];
+
+		// Let everything that doesn't need escaping go out in bulk.
+		if ((c >= 0x20) && (c != '"') && (c != '\\'))
+			continue;
+		buf_put(buf, run, str - run);
+		run = str + 1;
+
+		// Escape the character.
+		esc[0] = '\\';
+		switch (c) {
+			case '"':
+			case '\\':
+				esc[1] = (char)c;
+				break;
+			case '\n':
+				esc[1] = 'n';
+				break;
+			case '\r':
+				esc[1] = 'r';
+				break;
+			case '\t':
+				esc[1] = 't';
+				break;
+			default:
+				esc[1] = 'u';
+				esc[2] = '0';
+				esc[3] = '0';
+				esc[4] = hex[c >> 4];
+				esc[5] = hex[c & 0xF];
+				buf_put(buf, esc, 6);
+				continue;
+		}
+		buf_put(buf, esc, 2);
+	}
+	buf_put(buf, run, str - run);
+
+	buf_putc(buf, '"');
+}
+
+/**
+ * Puts a set of attributes in a buffer as a JSON object.
+ *
+ * @param buf     Buffer.
+ * @param attribs Attributes.
+ */
+static void put_json_attrs(export_buf_t *buf, pecan_attr_arr_t attribs) {
+	pecan_attr_t *attr;
+
+	buf_putc(buf, '{');
+	for (attr = cvector_begin(attribs); attr != cvector_end(attribs); ++attr) {
+		if (attr != cvector_begin(attribs))
+			buf_putc(buf, ',');
+		put_json(buf, NULL, (attr->name) ? attr->name : "");
+		buf_putc(buf, ':');
+		put_json(buf, NULL, (attr->value) ? attr->value : "");
+	}
+	buf_putc(buf, '}');
+}
+
+/**
+ * Appends data to a buffer, growing it as needed. Once an allocation fails
+ * the buffer is flagged and everything else is ignored.
+ *
+ * @param buf  Buffer.
+ * @param data Data to be appended.
+ * @param len  Length of the data.
+ */
+static void buf_put(export_buf_t *buf, const char *data, size_t len) {
+	if (buf->failed)
+		return;
+
+	// Make some room.
+	if ((buf->len + len) > buf->cap) {
+		size_t cap = (buf->cap) ? buf->cap : 64;
+		char *data_new;
+
+		while (cap < (buf->len + len))
+			cap *= 2;
+		data_new = (char *)mem_realloc(NULL, buf->data, cap);
+		if (data_new == NULL) {
+			buf->failed = 1;
+			return;
+		}
+		buf->data = data_new;
+		buf->cap = cap;
+	}
+
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+}
+
+/**
+ * Appends a single character to a buffer.
+ *
+ * @param buf Buffer.
+ * @param c   Character to be appended.
+ */
+static void buf_putc(export_buf_t *buf, char c) {
+	if (buf->len < buf->cap) {
+		buf->data[buf->len++] = c;
+		return;
+	}
+
+	buf_put(buf, &c, 1);
+}
+
+/**
+ * Looks up the slot of an attribute name.
+ *
+ * @param  map  Name map.
+ * @param  name Name of the attribute.
+ * @return      Slot of the attribute or EXPORT_NO_COLUMN if it isn't mapped.
+ */
+static size_t map_find(export_map_t *map, const char *name) {
+	size_t i;
+
+	if ((map->cap == 0) || (name == NULL))
+		return EXPORT_NO_COLUMN;
+
+	i = (size_t)blob_hash(name, strlen(name)) & (map->cap - 1);
+	while (map->names[i] != NULL) {
+		if (strcmp(map->names[i], name) == 0)
+			return map->slots[i];
+		i = (i + 1) & (map->cap - 1);
+	}
+
+	return EXPORT_NO_COLUMN;
+}
+
+/**
+ * Maps an attribute name to a slot unless it's already mapped.
+ *
+ * @param  map  Name map.
+ * @param  name Name of the attribute. Must outlive the map.
+ * @param  slot Slot of the attribute.
+ * @return      Slot the name is mapped to or EXPORT_NO_COLUMN if we ran out
+ *              of memory.
+ */
+static size_t map_add(export_map_t *map, const char *name, size_t slot) {
+	size_t found;
+	size_t i;
+
+	// Is it already there?
+	found = map_find(map, name);
+	if (found != EXPORT_NO_COLUMN)
+		return found;
+
+	// Grow the table if it's getting crowded.
+	if (((map->count + 1) * 2) > map->cap) {
+		export_map_t grown;
+
+		grown.cap = (map->cap) ? (map->cap * 2) : 64;
+		grown.count = 0;
+		grown.names = (const char **)mem_calloc(NULL, grown.cap,
+												sizeof(const char *));
+		grown.slots = (size_t *)mem_calloc(NULL, grown.cap, sizeof(size_t));
+		if ((grown.names == NULL) || (grown.slots == NULL)) {
+			map_free(&grown);
+			return EXPORT_NO_COLUMN;
+		}
+
+		for (i = 0; i < map->cap; i++) {
+			if (map->names[i])
+				map_add(&grown, map->names[i], map->slots[i]);
+		}
+		map_free(map);
+		*map = grown;
+	}
+
+	// Put it in.
+	i = (size_t)blob_hash(name, strlen(name)) & (map->cap - 1);
+	while (map->names[i] != NULL)
+		i = (i + 1) & (map->cap - 1);
+	map->names[i] = name;
+	map->slots[i] = slot;
+	map->count++;
+
+	return slot;
+}
+
+/**
+ * Frees up a name map.
+ *
+ * @param map Name map to be free'd.
+ */
+static void map_free(export_map_t *map) {
+	mem_free(NULL, (void *)map->names);
+	mem_free(NULL, map->slots);
+	map->names = NULL;
+	map->slots = NULL;
+	map->count = 0;
+	map->cap = 0;
+}
@@ -0,0 +1,39 @@
+/**
+ * export.h
+ * Streaming exporter of the attributes of a catalog to tabular formats.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _EXPORT_H
+#define _EXPORT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "catalog.h"
+
+// Special column with the path of the archive relative to the parts bin.
+#define PECAN_EXPORT_PATH_COLUMN   "path"
+
+// Prefix of columns that refer to parameters instead of manifest attributes.
+#define PECAN_EXPORT_PARAM_PREFIX  "param:"
+
+// Supported export formats.
+typedef enum {
+	PECAN_EXPORT_CSV = 0,
+	PECAN_EXPORT_JSONL
+} pecan_export_fmt_t;
+
+// Exporting
+PECAN_EXPORTS pecan_err_t pecan_catalog_export(pecan_catalog_t *cat, int fd,
+											   pecan_export_fmt_t fmt,
+											   const char **columns,
+											   size_t ncolumns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _EXPORT_H */
@@ -5,18 +5,39 @@
  * @author Nathan Campos <nathan@innoveworkshop.com>
  */
 
+#ifdef __linux__
+#	define _GNU_SOURCE
+#endif  // __linux__
 #include "fileutils.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #ifdef _WIN32
+#	include <io.h>
 #	include <windows.h>
 #	include "win32/MsgBoxes.h"
 #else
 #	include <unistd.h>
 #endif  // _WIN32
+#ifdef __linux__
+#	include <linux/fs.h>
+#	include <sys/ioctl.h>
+#	include <sys/sendfile.h>
+#endif  // __linux__
+
+// Size of the chunks used when the kernel can't copy the data for us.
+#define FILE_SEND_CHUNK 65536
+
+// Private methods.
+static bool fd_send_copy(int in, size_t len, int out);
+#ifdef __linux__
+static size_t fd_clone(int in, size_t offset, size_t len, int out);
+#endif  // __linux__
 
 /**
  * Checks if a file exists.
@@ -119,6 +140,35 @@ size_t cleanup_path(char *path) {
 	return strlen(path);
 }
 
+/**
+ * Checks that a relative path stays inside of the folder it's relative to.
+ *
+ * @param  path Relative path to be checked.
+ * @return      TRUE if the path is safe to be appended to a folder.
+ */
+bool path_is_contained(const char *path) {
+	const char *p;
+
+	// Absolute paths are a no-no.
+	if ((*path == '/') || (*path == '\\') || (*path == '\0') ||
+			(strchr(path, ':') != NULL))
+		return false;
+
+	// Look for parent folder references.
+	for (p = path; *p != '\0'; ) {
+		size_t len = strcspn(p, "/\\");
+
+		if ((len == 2) && (p[0] == '.') && (p[1] == '.'))
+			return false;
+
+		p += len;
+		if (*p != '\0')
+			p++;
+	}
+
+	return true;
+}
+
 /**
  * Concatenates paths together safely. It is assumed that only the last string
  * is a file. Which means a directory separator will be added between all
@@ -151,7 +201,7 @@ size_t pathcat(int npaths, char **buf, ...) {
 		path = va_arg(ap, char *);
 		plen = len;
 		len += strlen(path);
-		*buf = (char *)realloc(*buf, (len + 1) * sizeof(char));
+		*buf = (char *)mem_realloc(NULL, *buf, (len + 1) * sizeof(char));
 		tmpbuf = (*buf) + plen - 1;
 
 		// Concatenate the next path.
@@ -192,8 +242,8 @@ char *extcat(const char *fpath, const char *ext) {
 	char *final_path;
 
 	// Allocate the final path string.
-	final_path = (char *)malloc((strlen(fpath) + strlen(ext) + 2) *
-								 sizeof(char));
+	final_path = (char *)mem_alloc(NULL, (strlen(fpath) + strlen(ext) + 2) *
+								   sizeof(char));
 	if (final_path == NULL)
 		return NULL;
 
@@ -203,6 +253,57 @@ char *extcat(const char *fpath, const char *ext) {
 	return final_path;
 }
 
+/**
+ * Creates a directory along with any of its parents that don't exist yet.
+ *
+ * @param  path Path of the directory to be created.
+ * @return      TRUE if the directory exists at the end of the operation.
+ */
+bool make_path(const char *path) {
+	char *buf;
+	char *p;
+	bool ok;
+
+	// Get a copy of the path that we can chop up.
+	if (*path == '\0')
+		return false;
+	buf = mem_strndup(NULL, path, strlen(path));
+	if (buf == NULL)
+		return false;
+
+	// Create each component of the path in turn.
+	for (p = buf + 1; ; p++) {
+		char sep = *p;
+
+		// Look for the end of the component.
+		if ((sep != '/') && (sep != '\\') && (sep != '\0'))
+			continue;
+
+		// Create it if needed.
+		*p = '\0';
+		if (!is_dir(buf)) {
+#ifdef _WIN32
+			LPTSTR szPath;
+
+			if (ConvertStringAToW(buf, &szPath)) {
+				CreateDirectory(szPath, NULL);
+				LocalFree(szPath);
+			}
+#else
+			mkdir(buf, 0777);
+#endif  // _WIN32
+		}
+		*p = sep;
+
+		if (sep == '\0')
+			break;
+	}
+
+	ok = is_dir(buf);
+	mem_free(NULL, buf);
+	return ok;
+}
+
 /**
  * Gets the size of a buffer to hold the whole contents of a file.
  *
@@ -248,14 +349,14 @@ char *slurp_file(const char *fname) {
 		return NULL;
 
 	// Allocate the string to hold the contents of the file.
-	contents = (char *)malloc((fsize + 1) * sizeof(char));
+	contents = (char *)mem_alloc(NULL, (fsize + 1) * sizeof(char));
 	if (contents == NULL)
 		return NULL;
 
 	// Open file to read its contents.
 	fh = fopen(fname, "r");
 	if (fh == NULL) {
-		free(contents);
+		mem_free(NULL, contents);
 		return NULL;
 	}
 
@@ -277,3 +378,309 @@ char *slurp_file(const char *fname) {
 
 	return contents;
 }
+
+/**
+ * Reads a whole file into a reusable buffer as a string, only growing the
+ * buffer when the file doesn't fit into it.
+ *
+ * @param  alloc Allocator that owns the buffer or NULL for the global one.
+ * @param  fname File path.
+ * @param  buf   Pointer to the buffer to hold the contents. It may point to a
+ *               NULL buffer, in which case it'll be allocated.
+ * @param  cap   Pointer to the capacity of the buffer. Updated if the buffer
+ *               had to be grown.
+ * @return       Number of bytes read or 0 if an error occured.
+ */
+size_t slurp_file_buf(const pecan_allocator_t *alloc, const char *fname,
+					  char **buf, size_t *cap) {
+	FILE *fh;
+	size_t fsize;
+
+	// Open file to read its contents.
+	fh = fopen(fname, "rb");
+	if (fh == NULL)
+		return 0L;
+
+	// Get file size.
+	fseek(fh, 0L, SEEK_END);
+	fsize = ftell(fh);
+	rewind(fh);
+	if (fsize == 0L) {
+		fclose(fh);
+		return 0L;
+	}
+
+	// Make sure our buffer is able to hold the contents of the file.
+	if ((*buf == NULL) || (*cap < (fsize + 1))) {
+		char *tmp = (char *)mem_realloc(alloc, *buf,
+			(fsize + 1) * sizeof(char));
+		if (tmp == NULL) {
+			fclose(fh);
+			return 0L;
+		}
+
+		*buf = tmp;
+		*cap = fsize + 1;
+	}
+
+	// Read the whole file into the buffer and terminate the string.
+	fsize = fread(*buf, sizeof(char), fsize, fh);
+	(*buf)[fsize] = '\0';
+	fclose(fh);
+
+	return fsize;
+}
+
+/**
+ * Writes a range of bytes of a file straight to a file descriptor. Whenever
+ * possible the kernel moves the data itself, without it ever being copied into
+ * our address space.
+ *
+ * @param  fpath  File path.
+ * @param  offset Offset of the first byte to be sent.
+ * @param  len    Number of bytes to be sent.
+ * @param  fd     File descriptor to write the data to.
+ * @return        TRUE if all the requested bytes were sent.
+ */
+bool file_send(const char *fpath, size_t offset, size_t len, int fd) {
+	bool ok;
+	int in;
+
+	// Open the source file.
+#ifdef _WIN32
+	in = open(fpath, O_RDONLY | O_BINARY);
+#else
+	in = open(fpath, O_RDONLY);
+#endif  // _WIN32
+	if (in == -1)
+		return false;
+
+	// Position ourselves at the start of the range and send it.
+	ok = lseek(in, (off_t)offset, SEEK_SET) != (off_t)-1;
+	if (ok)
+		ok = fd_send(in, len, fd);
+
+	close(in);
+	return ok;
+}
+
+/**
+ * Writes a whole chunk of data to a file descriptor, dealing with short writes
+ * and interruptions.
+ *
+ * @param  fd   File descriptor to write the data to.
+ * @param  data Data to be written.
+ * @param  len  Length of the data.
+ * @return      TRUE if all of the data was written.
+ */
+bool fd_write(int fd, const void *data, size_t len) {
+	const char *p = (const char *)data;
+	int n;
+
+	while (len > 0) {
+		n = write(fd, p, (len < INT_MAX) ? (unsigned)len : INT_MAX);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+
+		p += n;
+		len -= n;
+	}
+
+	return true;
+}
+
+/**
+ * Copies a range of bytes of a file into a new file. Whole blocks are shared
+ * with the source file if the filesystem supports reflinks, and the rest is
+ * copied by the kernel whenever possible.
+ *
+ * @param  fpath  Source file path.
+ * @param  offset Offset of the first byte to be copied.
+ * @param  len    Number of bytes to be copied.
+ * @param  dest   Path of the file to be created or overwritten.
+ * @return        TRUE if all the requested bytes were copied.
+ */
+bool file_extract(const char *fpath, size_t offset, size_t len,
+				  const char *dest) {
+	bool ok;
+	int in;
+	int out;
+#ifdef __linux__
+	size_t cloned;
+#endif  // __linux__
+
+	// Open both files.
+#ifdef _WIN32
+	in = open(fpath, O_RDONLY | O_BINARY);
+	out = open(dest, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+#else
+	in = open(fpath, O_RDONLY);
+	out = open(dest, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif  // _WIN32
+	ok = (in != -1) && (out != -1);
+
+#ifdef __linux__
+	// Share as many blocks as we can with the source.
+	if (ok) {
+		cloned = fd_clone(in, offset, len, out);
+		if (cloned > 0) {
+			offset += cloned;
+			len -= cloned;
+			ok = lseek(out, (off_t)cloned, SEEK_SET) != (off_t)-1;
+		}
+	}
+#endif  // __linux__
+
+	// Copy whatever is left.
+	if (ok)
+		ok = lseek(in, (off_t)offset, SEEK_SET) != (off_t)-1;
+	if (ok)
+		ok = fd_send(in, len, out);
+
+	if (in != -1)
+		close(in);
+	if ((out != -1) && (close(out) != 0))
+		ok = false;
+
+	return ok;
+}
+
+/**
+ * Moves bytes from the current position of a file descriptor to another one.
+ * Whenever possible the kernel moves the data itself, without it ever being
+ * copied into our address space.
+ *
+ * @param  in  File descriptor to read the data from.
+ * @param  len Number of bytes to be sent.
+ * @param  fd  File descriptor to write the data to.
+ * @return     TRUE if all the requested bytes were sent.
+ */
+bool fd_send(int in, size_t len, int fd) {
+#ifdef __linux__
+	ssize_t n;
+	int kernel;
+
+	// Let the kernel do the heavy lifting, copy_file_range is able to share
+	// extents between files, sendfile works with sockets and pipes as the
+	// destination and splice takes care of pipes as the source.
+	kernel = 0;
+	while ((len > 0) && (kernel < 3)) {
+		if (kernel == 0) {
+			n = copy_file_range(in, NULL, fd, NULL, len, 0);
+		} else if (kernel == 1) {
+			n = sendfile(fd, in, NULL, len);
+		} else {
+			n = splice(in, NULL, fd, NULL, len, SPLICE_F_MOVE);
+		}
+
+		if (n > 0) {
+			len -= (size_t)n;
+		} else if (n == 0) {
+			// File was truncated under us.
+			return false;
+		} else if (errno != EINTR) {
+			// Not supported between these descriptors, try something else.
+			if ((errno != EINVAL) && (errno != EXDEV) && (errno != ENOSYS) &&
+					(errno != EBADF) && (errno != EOPNOTSUPP))
+				return false;
+			kernel++;
+		}
+	}
+#endif  // __linux__
+
+	// Fall back to copying the data ourselves.
+	if (len > 0)
+		return fd_send_copy(in, len, fd);
+
+	return true;
+}
+
+/**
+ * Copies bytes from the current position of a file descriptor to another one
+ * through a buffer. Used when the kernel isn't able to do it for us.
+ *
+ * @param  in  Source file descriptor.
+ * @param  len Number of bytes to be copied.
+ * @param  out Destination file descriptor.
+ * @return     TRUE if all the requested bytes were copied.
+ */
+static bool fd_send_copy(int in, size_t len, int out) {
+	char *buf;
+	char *p;
+	int nread;
+	int nwritten;
+	bool ok;
+
+	// Allocate our bounce buffer.
+	buf = (char *)mem_alloc(NULL, FILE_SEND_CHUNK);
+	if (buf == NULL)
+		return false;
+
+	ok = true;
+	while (len > 0) {
+		// Read a chunk from the source.
+		nread = read(in, buf, (len < FILE_SEND_CHUNK) ? len : FILE_SEND_CHUNK);
+		if (nread <= 0) {
+			if ((nread < 0) && (errno == EINTR))
+				continue;
+			ok = false;
+			break;
+		}
+		len -= nread;
+
+		// Write all of it out.
+		p = buf;
+		while (nread > 0) {
+			nwritten = write(out, p, nread);
+			if (nwritten < 0) {
+				if (errno == EINTR)
+					continue;
+				ok = false;
+				len = 0;
+				break;
+			}
+			p += nwritten;
+			nread -= nwritten;
+		}
+	}
+
+	mem_free(NULL, buf);
+	return ok;
+}
+
+#ifdef __linux__
+/**
+ * Shares the whole blocks of a range of a file with the beginning of another
+ * one, without copying any data, if the filesystem supports reflinks.
+ *
+ * @param  in     Source file descriptor.
+ * @param  offset Offset of the range in the source, must be block aligned.
+ * @param  len    Length of the range.
+ * @param  out    Empty destination file descriptor.
+ * @return        Number of bytes that are now shared, 0 if none.
+ */
+static size_t fd_clone(int in, size_t offset, size_t len, int out) {
+	struct file_clone_range range;
+	struct stat st;
+	size_t blksize;
+
+	// Only whole blocks can be shared.
+	if (fstat(out, &st) == -1)
+		return 0;
+	blksize = (size_t)st.st_blksize;
+	if ((blksize == 0) || ((offset % blksize) != 0) || (len < blksize))
+		return 0;
+
+	range.src_fd = in;
+	range.src_offset = offset;
+	range.src_length = len - (len % blksize);
+	range.dest_offset = 0;
+	if (ioctl(out, FICLONERANGE, &range) == -1)
+		return 0;
+
+	return (size_t)range.src_length;
+}
+#endif  // __linux__
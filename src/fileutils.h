@@ -17,6 +17,8 @@ extern "C" {
 #include <stddef.h>
 #include <sys/types.h>
 
+#include "alloc.h"
+
 // Checking.
 bool is_dir(const char *path);
 bool file_exists(const char *fpath);
@@ -24,12 +26,23 @@ bool file_ext_match(const char *fpath, const char *ext);
 
 // Path manipulaton.
 size_t cleanup_path(char *path);
+bool path_is_contained(const char *path);
 size_t pathcat(int npaths, char **buf, ...);
 char *extcat(const char *fpath, const char *ext);
 
+// Directories.
+bool make_path(const char *path);
+
 // File content.
 size_t file_contents_size(const char *fname);
 char* slurp_file(const char *fname);
+size_t slurp_file_buf(const pecan_allocator_t *alloc, const char *fname,
+					  char **buf, size_t *cap);
+bool file_send(const char *fpath, size_t offset, size_t len, int fd);
+bool fd_send(int in, size_t len, int fd);
+bool fd_write(int fd, const void *data, size_t len);
+bool file_extract(const char *fpath, size_t offset, size_t len,
+				  const char *dest);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,483 @@
+/**
+ * fuzzy.c
+ * Approximate matching of part numbers in a catalog.
+ *
+ * Part numbers are folded to lowercase letters and digits and broken up into
+ * trigrams, each of them pointing to the part numbers that contain it. A query
+ * only compares itself against the part numbers that share enough trigrams
+ * with it to possibly be within the allowed number of typos, using a
+ * bit-parallel edit distance that works on 64 characters at a time.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "fuzzy.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "error.h"
+
+// Alphabet of the folded part numbers. Symbol 0 pads both ends.
+#define FUZZY_NSYMS  37
+#define FUZZY_NGRAMS (FUZZY_NSYMS * FUZZY_NSYMS * FUZZY_NSYMS)
+
+// Private methods.
+static unsigned int fuzzy_sym(unsigned char c);
+static size_t fuzzy_fold(const char *str, char *buf);
+static size_t fuzzy_grams(const char *str, size_t len, uint32_t *grams);
+static int fuzzy_add_key(pecan_fuzzy_t *idx, size_t *cap, size_t index,
+						 const char *str);
+static int fuzzy_key_cmp(const void *a, const void *b);
+static unsigned int fuzzy_dist(const uint64_t *peq, size_t m, const char *str,
+							   size_t len, unsigned int limit);
+static unsigned int hits_limit(pecan_fuzzy_hit_t *hits, size_t k, size_t n,
+							   unsigned int max_dist);
+static void hits_insert(pecan_fuzzy_hit_t *hits, size_t k, size_t *n,
+						size_t index, unsigned int dist);
+
+/**
+ * Initializes an empty fuzzy index.
+ *
+ * @param idx Fuzzy index to be initialized.
+ */
+void pecan_fuzzy_init(pecan_fuzzy_t *idx) {
+	memset(idx, 0, sizeof(pecan_fuzzy_t));
+}
+
+/**
+ * Builds the fuzzy index of a loaded catalog out of the name of each archive
+ * and any of its part number parameters. Hits refer back to catalog indexes.
+ *
+ * @param  idx Empty fuzzy index.
+ * @param  cat Loaded catalog to be indexed. The index doesn't reference it.
+ * @return     PECAN_OK if the operation was successful.
+ */
+pecan_err_t pecan_fuzzy_build(pecan_fuzzy_t *idx, pecan_catalog_t *cat) {
+	char param[PECAN_FUZZY_MAX_LEN + 1];
+	char mpn[PECAN_FUZZY_MAX_LEN + 1];
+	uint32_t grams[PECAN_FUZZY_MAX_LEN];
+	uint32_t *cursors;
+	size_t ngrams;
+	size_t total;
+	size_t cap;
+	size_t doc;
+	size_t i;
+	size_t j;
+
+	// Set everything up.
+	pecan_fuzzy_free(idx);
+	fuzzy_fold(PECAN_FUZZY_PARAM, mpn);
+	cursors = NULL;
+	cap = 0;
+	idx->arena = arena_new(NULL);
+	idx->offsets = (uint32_t *)mem_calloc(NULL, FUZZY_NGRAMS + 1,
+										  sizeof(uint32_t));
+	if ((idx->arena == NULL) || (idx->offsets == NULL))
+		goto nomem;
+
+	// Gather the part numbers of every archive.
+	for (doc = 0; doc < pecan_catalog_len(cat); doc++) {
+		pecan_catalog_entry_t *entry = pecan_catalog_get(cat, doc);
+		pecan_archive_t *part = &entry->part;
+		pecan_attr_t *attr;
+
+		if (entry->err)
+			continue;
+
+		attr = pecan_get_attr(part, PECAN_MANIFEST, PECAN_FUZZY_FIELD);
+		if (attr && !fuzzy_add_key(idx, &cap, doc, attr->value))
+			goto nomem;
+		for (i = 0; i < cvector_size(part->params); i++) {
+			fuzzy_fold(part->params[i].name, param);
+			if ((strcmp(param, mpn) == 0) &&
+					!fuzzy_add_key(idx, &cap, doc, part->params[i].value))
+				goto nomem;
+		}
+	}
+
+	// Group them by length so that queries can skip those that are too short
+	// or too long to ever match.
+	if (idx->nkeys > 0)
+		qsort(idx->keys, idx->nkeys, sizeof(pecan_fuzzy_key_t), fuzzy_key_cmp);
+	for (i = 0, j = 0; i <= (PECAN_FUZZY_MAX_LEN + 1); i++) {
+		while ((j < idx->nkeys) && (idx->keys[j].len < i))
+			j++;
+		idx->lengths[i] = j;
+	}
+
+	// Count the part numbers that contain each trigram.
+	for (i = 0; i < idx->nkeys; i++) {
+		ngrams = fuzzy_grams(idx->keys[i].str, idx->keys[i].len, grams);
+		for (j = 0; j < ngrams; j++)
+			idx->offsets[grams[j] + 1]++;
+	}
+	total = 0;
+	for (i = 1; i <= FUZZY_NGRAMS; i++) {
+		total += idx->offsets[i];
+		idx->offsets[i] = (uint32_t)total;
+	}
+
+	// Fill in the postings of each trigram.
+	idx->postings = (uint32_t *)mem_alloc(NULL, (total + 1) * sizeof(uint32_t));
+	cursors = (uint32_t *)mem_alloc(NULL, FUZZY_NGRAMS * sizeof(uint32_t));
+	if ((idx->postings == NULL) || (cursors == NULL))
+		goto nomem;
+	memcpy(cursors, idx->offsets, FUZZY_NGRAMS * sizeof(uint32_t));
+	for (i = 0; i < idx->nkeys; i++) {
+		ngrams = fuzzy_grams(idx->keys[i].str, idx->keys[i].len, grams);
+		for (j = 0; j < ngrams; j++)
+			idx->postings[cursors[grams[j]]++] = (uint32_t)i;
+	}
+
+	mem_free(NULL, cursors);
+	return PECAN_OK;
+
+nomem:
+	mem_free(NULL, cursors);
+	pecan_fuzzy_free(idx);
+	err_set_msg(EMSG("Couldn't allocate memory to build the fuzzy index"));
+	return PECAN_ERR_UNKNOWN;
+}
+
+/**
+ * Finds the archives whose part numbers are the closest to a query. Case and
+ * anything that isn't a letter or a digit are ignored.
+ *
+ * @param  idx      Fuzzy index.
+ * @param  query    Part number to look for.
+ * @param  max_dist Largest number of typos a match may have.
+ * @param  hits     Array to receive the best hits, closest first.
+ * @param  k        Number of hits that fit in the array.
+ * @param  nhits    Returns the number of hits in the array.
+ * @return          PECAN_OK if the operation was successful.
+ */
+pecan_err_t pecan_fuzzy_query(pecan_fuzzy_t *idx, const char *query,
+							  unsigned int max_dist, pecan_fuzzy_hit_t *hits,
+							  size_t k, size_t *nhits) {
+	char str[PECAN_FUZZY_MAX_LEN + 1];
+	uint32_t grams[PECAN_FUZZY_MAX_LEN];
+	uint64_t peq[256];
+	uint16_t *counts;
+	size_t ngrams;
+	size_t first;
+	size_t last;
+	unsigned int dist;
+	size_t m;
+	long min_shared;
+	size_t i;
+	size_t j;
+
+	*nhits = 0;
+	m = fuzzy_fold(query, str);
+	if ((k == 0) || (m == 0) || (idx->nkeys == 0))
+		return PECAN_OK;
+	if (max_dist > PECAN_FUZZY_MAX_LEN)
+		max_dist = PECAN_FUZZY_MAX_LEN;
+
+	// Prepare the bit masks of where each character shows up in the query.
+	memset(peq, 0, sizeof(peq));
+	for (i = 0; i < m; i++)
+		peq[(unsigned char)str[i]] |= (uint64_t)1 << i;
+
+	// Only part numbers of a close enough length can ever match.
+	first = idx->lengths[(m > max_dist) ? m - max_dist : 0];
+	last = idx->lengths[((m + max_dist) > PECAN_FUZZY_MAX_LEN) ?
+		PECAN_FUZZY_MAX_LEN + 1 : m + max_dist + 1];
+
+	// Each typo destroys at most three trigrams, so if there are enough of
+	// them to spare only the part numbers that share the rest are compared.
+	ngrams = fuzzy_grams(str, m, grams);
+	min_shared = (long)ngrams - (3 * (long)max_dist);
+	if (min_shared <= 0) {
+		for (i = first; i < last; i++) {
+			dist = fuzzy_dist(peq, m, idx->keys[i].str, idx->keys[i].len,
+							  hits_limit(hits, k, *nhits, max_dist));
+			if (dist <= max_dist)
+				hits_insert(hits, k, nhits, idx->keys[i].index, dist);
+		}
+	} else {
+		counts = (uint16_t *)mem_calloc(NULL, idx->nkeys, sizeof(uint16_t));
+		if (counts == NULL) {
+			err_set_msg(EMSG("Couldn't allocate memory for the fuzzy "
+							 "candidates"));
+			return PECAN_ERR_UNKNOWN;
+		}
+
+		for (i = 0; i < ngrams; i++) {
+			for (j = idx->offsets[grams[i]]; j < idx->offsets[grams[i] + 1];
+					j++) {
+				uint32_t key = idx->postings[j];
+
+				if ((key < first) || (key >= last))
+					continue;
+				if (++counts[key] != min_shared)
+					continue;
+
+				dist = fuzzy_dist(peq, m, idx->keys[key].str,
+								  idx->keys[key].len,
+								  hits_limit(hits, k, *nhits, max_dist));
+				if (dist <= max_dist)
+					hits_insert(hits, k, nhits, idx->keys[key].index, dist);
+			}
+		}
+
+		mem_free(NULL, counts);
+	}
+
+	return PECAN_OK;
+}
+
+/**
+ * Frees up everything held by a fuzzy index.
+ *
+ * @param idx Fuzzy index to be free'd.
+ */
+void pecan_fuzzy_free(pecan_fuzzy_t *idx) {
+	mem_free(NULL, idx->keys);
+	mem_free(NULL, idx->offsets);
+	mem_free(NULL, idx->postings);
+	if (idx->arena)
+		arena_release(idx->arena);
+
+	memset(idx, 0, sizeof(pecan_fuzzy_t));
+}
+
+/**
+ * Gets the symbol of a character in the alphabet of folded part numbers.
+ *
+ * @param  c Character.
+ * @return   Symbol or 0 if the character isn't a letter or a digit.
+ */
+static unsigned int fuzzy_sym(unsigned char c) {
+	if ((c >= '0') && (c <= '9'))
+		return c - '0' + 1;
+	c |= 0x20;
+	if ((c >= 'a') && (c <= 'z'))
+		return c - 'a' + 11;
+
+	return 0;
+}
+
+/**
+ * Folds a part number to lowercase letters and digits.
+ *
+ * @param  str Part number.
+ * @param  buf Buffer with room for PECAN_FUZZY_MAX_LEN characters and a
+ *             terminator.
+ * @return     Length of the folded part number.
+ */
+static size_t fuzzy_fold(const char *str, char *buf) {
+	size_t len = 0;
+
+	for (; (*str != '\0') && (len < PECAN_FUZZY_MAX_LEN); str++) {
+		if (fuzzy_sym((unsigned char)*str))
+			buf[len++] = (char)(*str | ((*str >= 'A') ? 0x20 : 0));
+	}
+	buf[len] = '\0';
+
+	return len;
+}
+
+/**
+ * Gets the distinct trigrams of a folded part number, padded at both ends so
+ * that there's one per character.
+ *
+ * @param  str   Folded part number.
+ * @param  len   Length of the part number.
+ * @param  grams Array with room for a trigram per character.
+ * @return       Number of distinct trigrams.
+ */
+static size_t fuzzy_grams(const char *str, size_t len, uint32_t *grams) {
+	unsigned int prev;
+	unsigned int cur;
+	unsigned int next;
+	size_t ngrams;
+	size_t i;
+	size_t j;
+
+	ngrams = 0;
+	prev = 0;
+	cur = fuzzy_sym((unsigned char)str[0]);
+	for (i = 0; i < len; i++) {
+		uint32_t gram;
+
+		next = ((i + 1) < len) ? fuzzy_sym((unsigned char)str[i + 1]) : 0;
+		gram = (uint32_t)((((prev * FUZZY_NSYMS) + cur) * FUZZY_NSYMS) + next);
+		prev = cur;
+		cur = next;
+
+		// Skip the repeated ones.
+		for (j = 0; j < ngrams; j++) {
+			if (grams[j] == gram)
+				break;
+		}
+		if (j == ngrams)
+			grams[ngrams++] = gram;
+	}
+
+	return ngrams;
+}
+
+/**
+ * Adds a part number to the index.
+ *
+ * @param  idx   Fuzzy index.
+ * @param  cap   Capacity of the array of part numbers.
+ * @param  index Index of the archive in the catalog.
+ * @param  str   Part number.
+ * @return       Non-zero if the operation was successful.
+ */
+static int fuzzy_add_key(pecan_fuzzy_t *idx, size_t *cap, size_t index,
+						 const char *str) {
+	char buf[PECAN_FUZZY_MAX_LEN + 1];
+	pecan_fuzzy_key_t *key;
+	size_t len;
+
+	// Empty part numbers can't be matched.
+	len = fuzzy_fold(str, buf);
+	if (len == 0)
+		return 1;
+
+	// Make room for it.
+	if (idx->nkeys == *cap) {
+		size_t ncap = (*cap) ? *cap * 2 : 1024;
+		pecan_fuzzy_key_t *keys = (pecan_fuzzy_key_t *)mem_realloc(NULL,
+			idx->keys, ncap * sizeof(pecan_fuzzy_key_t));
+		if (keys == NULL)
+			return 0;
+		idx->keys = keys;
+		*cap = ncap;
+	}
+
+	// Add it.
+	key = &idx->keys[idx->nkeys];
+	key->str = arena_strndup(idx->arena, buf, len);
+	if (key->str == NULL)
+		return 0;
+	key->len = (uint32_t)len;
+	key->index = index;
+	idx->nkeys++;
+
+	return 1;
+}
+
+/**
+ * Compares two part numbers for grouping them by length.
+ */
+static int fuzzy_key_cmp(const void *a, const void *b) {
+	const pecan_fuzzy_key_t *ka = (const pecan_fuzzy_key_t *)a;
+	const pecan_fuzzy_key_t *kb = (const pecan_fuzzy_key_t *)b;
+
+	if (ka->len != kb->len)
+		return (ka->len < kb->len) ? -1 : 1;
+	return (ka->index < kb->index) ? -1 : (ka->index > kb->index);
+}
+
+/**
+ * Calculates the edit distance between the query and a part number with
+ * Myers' bit-parallel algorithm, which tracks a whole column of the distance
+ * matrix as bit masks of where it goes up or down by one.
+ *
+ * @param  peq   Bit masks of where each character shows up in the query.
+ * @param  m     Length of the query.
+ * @param  str   Folded part number.
+ * @param  len   Length of the part number.
+ * @param  limit Distance above which the exact value doesn't matter anymore.
+ * @return       Edit distance or something above the limit.
+ */
+static unsigned int fuzzy_dist(const uint64_t *peq, size_t m, const char *str,
+							   size_t len, unsigned int limit) {
+	uint64_t high = (uint64_t)1 << (m - 1);
+	uint64_t pv = ~(uint64_t)0;
+	uint64_t mv = 0;
+	unsigned int score = (unsigned int)m;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		uint64_t eq = peq[(unsigned char)str[i]];
+		uint64_t xv = eq | mv;
+		uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+		uint64_t ph = mv | ~(xh | pv);
+		uint64_t mh = pv & xh;
+
+		// Follow the bottom row of the matrix.
+		if (ph & high) {
+			score++;
+		} else if (mh & high) {
+			score--;
+		}
+
+		// It can only go down by one per character that's left.
+		if (score > (limit + (len - i - 1)))
+			return score;
+
+		// Moving along the part number costs one at the top row.
+		ph = (ph << 1) | 1;
+		mh <<= 1;
+		pv = mh | ~(xv | ph);
+		mv = ph & xv;
+	}
+
+	return score;
+}
+
+/**
+ * Gets the largest distance that may still get a part number into the hits.
+ *
+ * @param  hits     Sorted array of hits.
+ * @param  k        Capacity of the array.
+ * @param  n        Number of hits in the array.
+ * @param  max_dist Largest number of typos a match may have.
+ * @return          Largest distance worth calculating.
+ */
+static unsigned int hits_limit(pecan_fuzzy_hit_t *hits, size_t k, size_t n,
+							   unsigned int max_dist) {
+	if ((n == k) && (hits[k - 1].dist < max_dist))
+		return hits[k - 1].dist;
+
+	return max_dist;
+}
+
+/**
+ * Offers a hit to the sorted array of the closest hits so far, keeping only
+ * the closest part number of each archive.
+ *
+ * @param hits  Sorted array of hits.
+ * @param k     Capacity of the array.
+ * @param n     Number of hits in the array.
+ * @param index Index of the archive.
+ * @param dist  Edit distance of the archive.
+ */
+static void hits_insert(pecan_fuzzy_hit_t *hits, size_t k, size_t *n,
+						size_t index, unsigned int dist) {
+	size_t i;
+
+	// Is it any better than the ones we already have?
+	if ((*n == k) && ((dist > hits[k - 1].dist) ||
+			((dist == hits[k - 1].dist) && (index > hits[k - 1].index))))
+		return;
+
+	// Replace the archive if it's already in there.
+	for (i = 0; i < *n; i++) {
+		if (hits[i].index == index) {
+			if (hits[i].dist <= dist)
+				return;
+			memmove(&hits[i], &hits[i + 1], (*n - i - 1) *
+					sizeof(pecan_fuzzy_hit_t));
+			(*n)--;
+			break;
+		}
+	}
+
+	// Slide it into place.
+	if (*n == k)
+		(*n)--;
+	for (i = *n; (i > 0) && ((hits[i - 1].dist > dist) ||
+			((hits[i - 1].dist == dist) && (hits[i - 1].index > index))); i--)
+		hits[i] = hits[i - 1];
+	hits[i].index = index;
+	hits[i].dist = dist;
+	(*n)++;
+}
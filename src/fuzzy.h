@@ -0,0 +1,73 @@
+/**
+ * fuzzy.h
+ * Approximate matching of part numbers in a catalog.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _FUZZY_H
+#define _FUZZY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "catalog.h"
+
+// Manifest attribute and parameter that hold part numbers.
+#define PECAN_FUZZY_FIELD  "name"
+#define PECAN_FUZZY_PARAM  "MPN"
+
+// Longest part number that gets compared. Longer ones are cut short.
+#define PECAN_FUZZY_MAX_LEN  64
+
+// Default number of typos that are forgiven.
+#define PECAN_FUZZY_DEFAULT_DIST  2
+
+// Part number that can be matched, folded to lowercase letters and digits.
+typedef struct {
+	const char *str;
+	uint32_t len;
+	size_t index;
+} pecan_fuzzy_key_t;
+
+// Archive that matched a query.
+typedef struct {
+	size_t index;
+	unsigned int dist;
+} pecan_fuzzy_hit_t;
+
+// Fuzzy index structure definition.
+typedef struct {
+	pecan_fuzzy_key_t *keys;
+	size_t nkeys;
+	size_t lengths[PECAN_FUZZY_MAX_LEN + 2];
+
+	uint32_t *offsets;
+	uint32_t *postings;
+
+	pecan_arena_t *arena;
+} pecan_fuzzy_t;
+
+// Initialization
+PECAN_EXPORTS void pecan_fuzzy_init(pecan_fuzzy_t *idx);
+PECAN_EXPORTS pecan_err_t pecan_fuzzy_build(pecan_fuzzy_t *idx,
+											pecan_catalog_t *cat);
+
+// Querying
+PECAN_EXPORTS pecan_err_t pecan_fuzzy_query(pecan_fuzzy_t *idx,
+											const char *query,
+											unsigned int max_dist,
+											pecan_fuzzy_hit_t *hits, size_t k,
+											size_t *nhits);
+
+// Cleanup
+PECAN_EXPORTS void pecan_fuzzy_free(pecan_fuzzy_t *idx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _FUZZY_H */
@@ -0,0 +1,623 @@
+/**
+ * import.c
+ * Bulk importer that builds component archives from inventory sheets.
+ *
+ * The sheet is read in blocks by the calling thread, which only looks for
+ * where rows end, and every block of complete rows is handed over to the
+ * thread pool as a batch. Tasks split the rows in place and point borrowed
+ * attributes straight at the cells, so building an archive doesn't allocate
+ * anything per cell. The first row of the sheet is a header that maps each
+ * column to an attribute using the same conventions as the exporter:
+ * PECAN_EXPORT_PATH_COLUMN is the path of the archive inside the parts bin,
+ * names starting with PECAN_EXPORT_PARAM_PREFIX are parameters and everything
+ * else goes into the manifest. Empty cells are skipped.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "import.h"
+
+#include <cvector_utils.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "error.h"
+#include "export.h"
+#include "fileutils.h"
+#include "thread.h"
+#include "writer.h"
+
+// Size of the blocks read from the sheet.
+#define IMPORT_BLOCK_SIZE (256 * 1024)
+
+// Number of batches allowed to be in flight for each worker thread.
+#define IMPORT_WINDOW 4
+
+// Kinds of columns.
+typedef enum {
+	IMPORT_COL_PATH = 0,
+	IMPORT_COL_MANIFEST,
+	IMPORT_COL_PARAM
+} import_col_kind_t;
+
+// Column of the sheet.
+typedef struct {
+	import_col_kind_t kind;
+	char *name;
+} import_col_t;
+
+// Everything that's shared by the import tasks.
+typedef struct {
+	const char *dir;
+	char sep;
+	int quoted;
+	import_col_t *cols;
+	size_t ncols;
+
+	pecan_mutex_t lock;
+	size_t nfailed;
+	size_t failed_row;
+	pecan_err_t err;
+	char *err_msg;
+} import_ctx_t;
+
+// Block of complete rows imported by a single task.
+typedef struct {
+	import_ctx_t *ctx;
+	char *base;
+	char *data;
+	size_t len;
+	size_t first_row;
+	size_t nimported;
+	pecan_taskgroup_t group;
+} import_batch_t;
+
+// Private methods.
+static pecan_err_t import_header(import_ctx_t *ctx, char **p, char *end);
+static void import_task(void *arg);
+static pecan_err_t import_row(import_ctx_t *ctx, char **fields, size_t n,
+							  pecan_attr_arr_t *manifest,
+							  pecan_attr_arr_t *params);
+static void import_fail(import_ctx_t *ctx, size_t row, pecan_err_t err);
+static size_t import_scan(const char *buf, size_t len, int quoted, int eof,
+						  size_t *nrows);
+static size_t import_record(char **cur, char *end, char sep, int quoted,
+							char **fields, size_t max);
+
+/**
+ * Imports an inventory sheet, writing a packed component archive for each one
+ * of its rows. The sheet is streamed, so it can be arbitrarily large.
+ *
+ * @param  pool  Thread pool to do the work or NULL to create a temporary one.
+ * @param  fd    File descriptor to read the sheet from.
+ * @param  fmt   Format of the sheet.
+ * @param  dir   Parts bin folder where the archives will be written to.
+ * @param  count Optional pointer to store the number of archives written.
+ * @return       PECAN_OK if the operation was successful.
+ *               PECAN_ERR_PATH_NOT_FOUND if the folder couldn't be created.
+ *               PECAN_ERR_PARSE if the header is missing the path column.
+ *               PECAN_ERR_FILE_IO if the sheet couldn't be read.
+ *               Error of the first row that couldn't be imported otherwise,
+ *               the other rows are still imported.
+ */
+pecan_err_t pecan_import(pecan_pool_t *pool, int fd, pecan_import_fmt_t fmt,
+						 const char *dir, size_t *count) {
+	import_ctx_t ctx;
+	import_batch_t *batches = NULL;
+	pecan_pool_t *own_pool = NULL;
+	char *buf = NULL;
+	size_t len;
+	size_t window;
+	size_t nbatches;
+	size_t imported;
+	size_t row;
+	size_t i;
+	int header;
+	int eof;
+	pecan_err_t err = PECAN_OK;
+
+	// Set up the context.
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.dir = dir;
+	ctx.sep = (fmt == PECAN_IMPORT_TSV) ? '\t' : ',';
+	ctx.quoted = (fmt == PECAN_IMPORT_CSV);
+	mutex_init(&ctx.lock);
+	imported = 0;
+
+	// Get our pool ready.
+	if (pool == NULL) {
+		own_pool = pool_new(0);
+		pool = own_pool;
+		if (pool == NULL) {
+			err_set_msg(EMSG("Couldn't create the import thread pool"));
+			err = PECAN_ERR_UNKNOWN;
+			goto cleanup;
+		}
+	}
+	window = IMPORT_WINDOW * ((pool_size(pool)) ? pool_size(pool) : 1);
+	batches = (import_batch_t *)mem_calloc(NULL, window,
+										   sizeof(import_batch_t));
+	if (batches == NULL)
+		goto nomem;
+
+	// Create the parts bin.
+	if (!make_path(dir)) {
+		err_format_msg(EMSG("Couldn't create directory '%s'"), dir);
+		err = PECAN_ERR_PATH_NOT_FOUND;
+		goto cleanup;
+	}
+
+	// Go through the sheet a block at a time.
+	len = 0;
+	row = 1;
+	nbatches = 0;
+	header = 0;
+	eof = 0;
+	while (!eof) {
+		import_batch_t *batch;
+		size_t cut;
+		size_t nrows;
+		ssize_t n;
+		char *start;
+		char *rest;
+
+		// Read the next block after whatever was left of the last one.
+		if (buf == NULL) {
+			buf = (char *)mem_alloc(NULL, len + IMPORT_BLOCK_SIZE + 1);
+			if (buf == NULL)
+				goto nomem;
+		}
+		n = read(fd, buf + len, IMPORT_BLOCK_SIZE);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			err_set_msg(EMSG("Couldn't read the inventory sheet"));
+			err = PECAN_ERR_FILE_IO;
+			goto cleanup;
+		}
+		eof = (n == 0);
+		len += (size_t)n;
+
+		// Find where the last complete row ends.
+		cut = import_scan(buf, len, ctx.quoted, eof, &nrows);
+		if (cut == 0) {
+			// A single row that doesn't fit in what we have so far.
+			if (!eof) {
+				rest = (char *)mem_realloc(NULL, buf,
+										   len + IMPORT_BLOCK_SIZE + 1);
+				if (rest == NULL)
+					goto nomem;
+				buf = rest;
+			}
+			continue;
+		}
+
+		// Keep the incomplete row for the next round.
+		rest = (char *)mem_alloc(NULL, (len - cut) + IMPORT_BLOCK_SIZE + 1);
+		if (rest == NULL)
+			goto nomem;
+		memcpy(rest, buf + cut, len - cut);
+
+		// The first row is the header.
+		start = buf;
+		if (!header) {
+			err = import_header(&ctx, &start, buf + cut);
+			if (err) {
+				mem_free(NULL, rest);
+				goto cleanup;
+			}
+			header = 1;
+			nrows--;
+			row++;
+		}
+
+		// Hand the rows over to a free batch.
+		batch = &batches[nbatches % window];
+		pool_wait(pool, &batch->group);
+		imported += batch->nimported;
+		mem_free(NULL, batch->base);
+		batch->ctx = &ctx;
+		batch->base = buf;
+		batch->data = start;
+		batch->len = cut - (start - buf);
+		batch->first_row = row;
+		batch->nimported = 0;
+		pool_group_init(&batch->group);
+		if (pool_submit(pool, &batch->group, import_task, batch) != 0)
+			import_task(batch);
+		nbatches++;
+		row += nrows;
+
+		// Start over with what was left.
+		buf = rest;
+		len = len - cut;
+	}
+
+	// An empty sheet doesn't even have a header.
+	if (!header) {
+		err_set_msg(EMSG("Inventory sheet is empty"));
+		err = PECAN_ERR_PARSE;
+	}
+
+	goto cleanup;
+
+nomem:
+	err_set_msg(EMSG("Couldn't allocate the import buffers"));
+	err = PECAN_ERR_UNKNOWN;
+
+cleanup:
+	// Wait for everything that's still in flight.
+	if (batches) {
+		for (i = 0; i < window; i++) {
+			pool_wait(pool, &batches[i].group);
+			imported += batches[i].nimported;
+			mem_free(NULL, batches[i].base);
+		}
+		mem_free(NULL, batches);
+	}
+	pool_free(own_pool);
+	mem_free(NULL, buf);
+
+	// Report back on any rows that failed.
+	if ((err == PECAN_OK) && ctx.nfailed) {
+		err_format_msg(EMSG("Failed to import %zu of %zu rows (row %zu: %s)"),
+			ctx.nfailed, ctx.nfailed + imported, ctx.failed_row,
+			(ctx.err_msg) ? ctx.err_msg : "unknown error");
+		err = ctx.err;
+	}
+	if (count)
+		*count = imported;
+
+	// Free up the context.
+	for (i = 0; i < ctx.ncols; i++)
+		mem_free(NULL, ctx.cols[i].name);
+	mem_free(NULL, ctx.cols);
+	mem_free(NULL, ctx.err_msg);
+	mutex_destroy(&ctx.lock);
+
+	return err;
+}
+
+/**
+ * Parses the header row of the sheet into its columns.
+ *
+ * @param  ctx Import context.
+ * @param  p   Pointer to the start of the header, which will be moved to the
+ *             start of the next row.
+ * @param  end End of the rows that were read.
+ * @return     PECAN_OK if the operation was successful.
+ *             PECAN_ERR_PARSE if the header is missing the path column.
+ */
+static pecan_err_t import_header(import_ctx_t *ctx, char **p, char *end) {
+	char **fields;
+	size_t plen;
+	size_t n;
+	size_t i;
+	int has_path;
+
+	// Split the header up. There can't be more columns than characters.
+	fields = (char **)mem_alloc(NULL, ((end - *p) + 1) * sizeof(char *));
+	if (fields == NULL)
+		goto nomem;
+	n = import_record(p, end, ctx->sep, ctx->quoted, fields, (end - *p) + 1);
+
+	// Figure out what each column is.
+	ctx->cols = (import_col_t *)mem_calloc(NULL, n, sizeof(import_col_t));
+	if (ctx->cols == NULL)
+		goto nomem;
+	ctx->ncols = n;
+	plen = strlen(PECAN_EXPORT_PARAM_PREFIX);
+	has_path = 0;
+	for (i = 0; i < n; i++) {
+		const char *name = fields[i];
+
+		if (strcmp(name, PECAN_EXPORT_PATH_COLUMN) == 0) {
+			ctx->cols[i].kind = IMPORT_COL_PATH;
+			has_path = 1;
+		} else if (strncmp(name, PECAN_EXPORT_PARAM_PREFIX, plen) == 0) {
+			ctx->cols[i].kind = IMPORT_COL_PARAM;
+			name += plen;
+		} else {
+			ctx->cols[i].kind = IMPORT_COL_MANIFEST;
+		}
+
+		ctx->cols[i].name = mem_strndup(NULL, name, strlen(name));
+		if (ctx->cols[i].name == NULL)
+			goto nomem;
+	}
+	mem_free(NULL, fields);
+
+	// We need to know where to put things.
+	if (!has_path) {
+		err_format_msg(EMSG("Inventory sheet has no '%s' column"),
+					   PECAN_EXPORT_PATH_COLUMN);
+		return PECAN_ERR_PARSE;
+	}
+
+	return PECAN_OK;
+
+nomem:
+	mem_free(NULL, fields);
+	err_set_msg(EMSG("Couldn't allocate the import columns"));
+	return PECAN_ERR_UNKNOWN;
+}
+
+/**
+ * Task that imports a batch of rows.
+ *
+ * @param arg Import batch.
+ */
+static void import_task(void *arg) {
+	import_batch_t *batch = (import_batch_t *)arg;
+	import_ctx_t *ctx = batch->ctx;
+	pecan_attr_arr_t manifest = NULL;
+	pecan_attr_arr_t params = NULL;
+	pecan_err_t err;
+	char **fields;
+	char *p;
+	char *end;
+	size_t row;
+	size_t n;
+
+	// Allocate the things that are reused by every row.
+	fields = (char **)mem_alloc(NULL, (ctx->ncols + 1) * sizeof(char *));
+	if (fields == NULL) {
+		err_set_msg(EMSG("Couldn't allocate the import fields"));
+		import_fail(ctx, batch->first_row, PECAN_ERR_UNKNOWN);
+		return;
+	}
+
+	// Go through the rows.
+	p = batch->data;
+	end = batch->data + batch->len;
+	for (row = batch->first_row; p < end; row++) {
+		n = import_record(&p, end, ctx->sep, ctx->quoted, fields,
+						  ctx->ncols + 1);
+
+		// Skip blank lines.
+		if ((n == 1) && (fields[0][0] == '\0'))
+			continue;
+
+		err = import_row(ctx, fields, n, &manifest, &params);
+		if (err) {
+			import_fail(ctx, row, err);
+		} else {
+			batch->nimported++;
+		}
+	}
+
+	// The attributes only borrowed their strings.
+	cvector_free(manifest);
+	cvector_free(params);
+	mem_free(NULL, fields);
+}
+
+/**
+ * Writes the archive of a single row.
+ *
+ * @param  ctx      Import context.
+ * @param  fields   Cells of the row.
+ * @param  n        Number of cells.
+ * @param  manifest Manifest attributes array to be reused.
+ * @param  params   Parameters attributes array to be reused.
+ * @return          PECAN_OK if the operation was successful.
+ */
+static pecan_err_t import_row(import_ctx_t *ctx, char **fields, size_t n,
+							  pecan_attr_arr_t *manifest,
+							  pecan_attr_arr_t *params) {
+	pecan_writer_t w;
+	pecan_attr_t attr;
+	const char *path;
+	char *fpath = NULL;
+	char *sep;
+	size_t i;
+	pecan_err_t err;
+
+	// Borrow the cells as attributes.
+	cvector_clear(*manifest);
+	cvector_clear(*params);
+	path = NULL;
+	for (i = 0; (i < n) && (i < ctx->ncols); i++) {
+		if (fields[i][0] == '\0')
+			continue;
+
+		if (ctx->cols[i].kind == IMPORT_COL_PATH) {
+			path = fields[i];
+			continue;
+		}
+
+		// Attribute files can't hold these.
+		if (strpbrk(fields[i], "\t\r\n") != NULL) {
+			err_format_msg(EMSG("Value of '%s' has a tab or a line break"),
+						   ctx->cols[i].name);
+			return PECAN_ERR_PARSE;
+		}
+
+		attr_init(&attr);
+		attr_borrow_name(&attr, ctx->cols[i].name);
+		attr_borrow_value(&attr, fields[i]);
+		if (ctx->cols[i].kind == IMPORT_COL_PARAM) {
+			cvector_push_back(*params, attr);
+		} else {
+			cvector_push_back(*manifest, attr);
+		}
+	}
+
+	// Figure out where the archive goes.
+	if ((path == NULL) || !path_is_contained(path)) {
+		err_format_msg(EMSG("Invalid archive path '%s'"),
+					   (path) ? path : "");
+		return PECAN_ERR_PARSE;
+	}
+	pathcat(2, &fpath, ctx->dir, path);
+	if (!file_ext_match(fpath, "tar")) {
+		char *tmp = extcat(fpath, "tar");
+
+		mem_free(NULL, fpath);
+		fpath = tmp;
+	}
+
+	// Create its parent directories.
+	sep = strrchr(fpath, '/');
+	if (sep && (sep != fpath)) {
+		*sep = '\0';
+		if (!make_path(fpath)) {
+			err_format_msg(EMSG("Couldn't create directory '%s'"), fpath);
+			mem_free(NULL, fpath);
+			return PECAN_ERR_PATH_NOT_FOUND;
+		}
+		*sep = '/';
+	}
+
+	// Write it.
+	err = pecan_writer_open(&w, fpath, PECAN_WRITE_DEFAULT);
+	mem_free(NULL, fpath);
+	if (err)
+		return err;
+	err = pecan_writer_add_attrs(&w, PECAN_MANIFEST_FILE, *manifest);
+	if (err == PECAN_OK)
+		err = pecan_writer_add_attrs(&w, PECAN_PARAM_FILE, *params);
+	if (err == PECAN_OK)
+		return pecan_writer_close(&w);
+
+	pecan_writer_close(&w);
+	return err;
+}
+
+/**
+ * Keeps track of a row that couldn't be imported. The error message of the
+ * calling thread is saved if it's the first failure.
+ *
+ * @param ctx Import context.
+ * @param row Number of the row in the sheet.
+ * @param err Error that happened.
+ */
+static void import_fail(import_ctx_t *ctx, size_t row, pecan_err_t err) {
+	const char *msg;
+
+	mutex_lock(&ctx->lock);
+	if (ctx->nfailed++ == 0) {
+		msg = err_get_msg();
+		ctx->failed_row = row;
+		ctx->err = err;
+		if (msg)
+			ctx->err_msg = mem_strndup(NULL, msg, strlen(msg));
+	}
+	mutex_unlock(&ctx->lock);
+}
+
+/**
+ * Finds where the last complete row in a buffer ends.
+ *
+ * @param  buf    Buffer starting at the beginning of a row.
+ * @param  len    Length of the buffer.
+ * @param  quoted Can cells be quoted (and have newlines in them)?
+ * @param  eof    Is this the end of the sheet?
+ * @param  nrows  Pointer to store the number of complete rows.
+ * @return        Offset right after the last complete row or 0 if there's
+ *                none.
+ */
+static size_t import_scan(const char *buf, size_t len, int quoted, int eof,
+						  size_t *nrows) {
+	const char *p;
+	const char *nl;
+	size_t cut;
+	int inside;
+
+	*nrows = 0;
+	cut = 0;
+	if (quoted) {
+		// Newlines inside of quotes don't count.
+		inside = 0;
+		for (p = buf; p < (buf + len); p++) {
+			if (*p == '"') {
+				inside = !inside;
+			} else if ((*p == '\n') && !inside) {
+				cut = (p - buf) + 1;
+				(*nrows)++;
+			}
+		}
+	} else {
+		for (p = buf; (nl = memchr(p, '\n', len - (p - buf))) != NULL;
+				p = nl + 1) {
+			cut = (nl - buf) + 1;
+			(*nrows)++;
+		}
+	}
+
+	// Whatever is left at the end of the sheet is the last row.
+	if (eof && (cut < len)) {
+		cut = len;
+		(*nrows)++;
+	}
+
+	return cut;
+}
+
+/**
+ * Splits a row into its cells, in place. Quotes are removed and every cell
+ * gets NULL terminated, so the buffer must have an extra byte at its end.
+ *
+ * @param  cur    Pointer to the start of the row, which will be moved to the
+ *                start of the next one.
+ * @param  end    End of the buffer.
+ * @param  sep    Cell separator.
+ * @param  quoted Can cells be quoted?
+ * @param  fields Array to receive the cells.
+ * @param  max    Maximum number of cells to store, the rest are dropped.
+ * @return        Number of cells stored.
+ */
+static size_t import_record(char **cur, char *end, char sep, int quoted,
+							char **fields, size_t max) {
+	char *p = *cur;
+	char *cell;
+	char *out;
+	size_t n = 0;
+	char c;
+
+	for (;;) {
+		// Parse the cell.
+		cell = p;
+		out = p;
+		if (n < max)
+			fields[n++] = cell;
+		if (quoted && (p < end) && (*p == '"')) {
+			for (p++; p < end; ) {
+				if (*p == '"') {
+					if (((p + 1) < end) && (p[1] == '"')) {
+						*out++ = '"';
+						p += 2;
+						continue;
+					}
+
+					p++;
+					break;
+				}
+
+				*out++ = *p++;
+			}
+
+			// Ignore anything between the closing quote and the separator.
+			while ((p < end) && (*p != sep) && (*p != '\n'))
+				p++;
+		} else {
+			while ((p < end) && (*p != sep) && (*p != '\n'))
+				*out++ = *p++;
+			if ((out > cell) && (out[-1] == '\r') &&
+					((p >= end) || (*p == '\n')))
+				out--;
+		}
+
+		// Terminate it and see what comes next.
+		c = (p < end) ? *p : '\0';
+		*out = '\0';
+		if (p < end)
+			p++;
+		if (c != sep)
+			break;
+	}
+
+	*cur = p;
+	return n;
+}
@@ -0,0 +1,33 @@
+/**
+ * import.h
+ * Bulk importer that builds component archives from inventory sheets.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _IMPORT_H
+#define _IMPORT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "pecan.h"
+#include "pool.h"
+
+// Supported sheet formats.
+typedef enum {
+	PECAN_IMPORT_CSV = 0,
+	PECAN_IMPORT_TSV
+} pecan_import_fmt_t;
+
+// Importing
+PECAN_EXPORTS pecan_err_t pecan_import(pecan_pool_t *pool, int fd,
+									   pecan_import_fmt_t fmt,
+									   const char *dir, size_t *count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _IMPORT_H */
@@ -0,0 +1,786 @@
+/**
+ * livecat.c
+ * Catalog that can be updated while other threads are reading from it.
+ *
+ * Readers never take a lock: they grab the current snapshot with an atomic
+ * load and use it for as long as they are inside a read section. Writers are
+ * serialized by a mutex, build a new snapshot that shares every untouched
+ * archive with the previous one, publish it with an atomic pointer swap and
+ * retire the old one. Retired snapshots are only free'd once every reader that
+ * could still be looking at them has left its read section (epoch-based
+ * reclamation).
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "livecat.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+
+// Atomic helpers.
+#define ATOMIC_LOAD(x)     __atomic_load_n(&(x), __ATOMIC_SEQ_CST)
+#define ATOMIC_STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_SEQ_CST)
+
+// Arguments for the attribute setting update.
+typedef struct {
+	pecan_attr_type_t type;
+	const char *name;
+	const char *value;
+} set_attr_args_t;
+
+// Private methods.
+static pecan_snapshot_t *snapshot_new(size_t len);
+static pecan_snapshot_t *snapshot_derive(pecan_snapshot_t *snap, size_t idx,
+										 size_t nremove,
+										 pecan_livecat_item_t *item);
+static size_t snapshot_index(pecan_snapshot_t *snap, const char *path,
+							 int *found);
+static void snapshot_free(pecan_snapshot_t *snap);
+static pecan_livecat_item_t *item_new(const char *path);
+static void item_release(pecan_livecat_item_t *item);
+static void livecat_publish(pecan_livecat_t *lc, pecan_snapshot_t *snap);
+static size_t livecat_reclaim(pecan_livecat_t *lc);
+static pecan_err_t livecat_swap(pecan_livecat_t *lc, const char *path,
+								pecan_livecat_item_t *item, int must_exist);
+static pecan_err_t set_attr_update(pecan_archive_t *draft, void *arg);
+
+/**
+ * Initializes an empty live catalog.
+ *
+ * @param  lc Live catalog to be initialized.
+ * @return    PECAN_OK if the operation was successful.
+ *            PECAN_ERR_UNKNOWN if we weren't able to allocate memory.
+ */
+pecan_err_t pecan_livecat_init(pecan_livecat_t *lc) {
+	lc->epoch = 1;
+	lc->readers = NULL;
+	lc->retired = NULL;
+	mutex_init(&lc->lock);
+
+	// Catalog used to load archives and hold the shared blob store.
+	pecan_catalog_init(&lc->cat);
+
+	// Start off with an empty snapshot so readers always have something.
+	lc->current = snapshot_new(0);
+	if (lc->current == NULL) {
+		err_set_msg(EMSG("Couldn't allocate the initial catalog snapshot"));
+		return PECAN_ERR_UNKNOWN;
+	}
+
+	return PECAN_OK;
+}
+
+/**
+ * Loads every archive in a parts bin and publishes them as a new snapshot that
+ * replaces everything the live catalog held.
+ *
+ * @param  lc   Live catalog structure.
+ * @param  path Path to the parts bin directory.
+ * @return      Same as pecan_catalog_load. Archives that were read successfully
+ *              are published even if some of them failed.
+ */
+pecan_err_t pecan_livecat_load(pecan_livecat_t *lc, const char *path) {
+	pecan_snapshot_t *snap;
+	pecan_err_t err;
+	size_t len;
+	size_t i;
+
+	mutex_lock(&lc->lock);
+
+	// Load up the parts bin.
+	err = pecan_catalog_load(&lc->cat, path);
+	if (err == PECAN_ERR_PATH_NOT_FOUND)
+		goto cleanup;
+
+	// Count the archives that were actually read.
+	len = 0;
+	for (i = 0; i < pecan_catalog_len(&lc->cat); i++) {
+		if (pecan_catalog_get(&lc->cat, i)->err == PECAN_OK)
+			len++;
+	}
+
+	// Build up the new snapshot with copies of the loaded archives.
+	snap = snapshot_new(len);
+	if (snap == NULL) {
+		err_set_msg(EMSG("Couldn't allocate a catalog snapshot"));
+		err = PECAN_ERR_UNKNOWN;
+		goto cleanup;
+	}
+	for (i = 0; i < pecan_catalog_len(&lc->cat); i++) {
+		pecan_catalog_entry_t *entry = pecan_catalog_get(&lc->cat, i);
+		pecan_livecat_item_t *item;
+
+		if (entry->err)
+			continue;
+
+		item = item_new(entry->path);
+		if ((item == NULL) || pecan_clone(&item->part, &entry->part)) {
+			if (item)
+				item_release(item);
+			snapshot_free(snap);
+			err_set_msg(EMSG("Couldn't allocate a catalog snapshot"));
+			err = PECAN_ERR_UNKNOWN;
+			goto cleanup;
+		}
+		snap->items[snap->len++] = item;
+	}
+
+	// Make it visible to readers.
+	livecat_publish(lc, snap);
+
+	// Bring back the loading error message since pecan_init cleared it.
+	if (err) {
+		pecan_catalog_entry_t *failed = NULL;
+
+		for (i = 0; i < pecan_catalog_len(&lc->cat); i++) {
+			failed = pecan_catalog_get(&lc->cat, i);
+			if (failed->err)
+				break;
+		}
+		if (failed && failed->err) {
+			err_format_msg(EMSG("Failed to load some archives (%s: %s)"),
+				failed->path,
+				(failed->err_msg) ? failed->err_msg : "unknown error");
+		}
+	}
+
+cleanup:
+	// The snapshots hold their own copies of the archives.
+	pecan_catalog_clear(&lc->cat);
+
+	mutex_unlock(&lc->lock);
+	return err;
+}
+
+/**
+ * Registers a new reader of the live catalog. Each reading thread must have
+ * its own reader.
+ *
+ * @param  lc Live catalog structure.
+ * @return    Reader or NULL if we weren't able to allocate memory.
+ */
+pecan_reader_t *pecan_livecat_reader_new(pecan_livecat_t *lc) {
+	pecan_reader_t *reader;
+
+	mutex_lock(&lc->lock);
+
+	// Try to reuse a reader that was given back.
+	for (reader = lc->readers; reader != NULL; reader = reader->next) {
+		if (!reader->in_use) {
+			reader->in_use = 1;
+			goto cleanup;
+		}
+	}
+
+	// Allocate a new one.
+	reader = (pecan_reader_t *)mem_alloc(NULL, sizeof(pecan_reader_t));
+	if (reader == NULL) {
+		err_set_msg(EMSG("Couldn't allocate a catalog reader"));
+		goto cleanup;
+	}
+	reader->epoch = 0;
+	reader->in_use = 1;
+	reader->lc = lc;
+	reader->next = lc->readers;
+	lc->readers = reader;
+
+cleanup:
+	mutex_unlock(&lc->lock);
+	return reader;
+}
+
+/**
+ * Gives a reader back to the live catalog. It must not be inside a read
+ * section.
+ *
+ * @param reader Reader to be released.
+ */
+void pecan_livecat_reader_free(pecan_reader_t *reader) {
+	pecan_livecat_t *lc;
+
+	if (reader == NULL)
+		return;
+	lc = reader->lc;
+
+	mutex_lock(&lc->lock);
+	ATOMIC_STORE(reader->epoch, 0);
+	reader->in_use = 0;
+	mutex_unlock(&lc->lock);
+}
+
+/**
+ * Enters a read section and gets the current snapshot. The snapshot and every
+ * archive in it will stay valid and unchanged until pecan_livecat_leave is
+ * called, no matter how many updates happen in the meantime.
+ *
+ * @param  reader Reader of the calling thread.
+ * @return        Current snapshot of the catalog.
+ */
+pecan_snapshot_t *pecan_livecat_enter(pecan_reader_t *reader) {
+	pecan_livecat_t *lc = reader->lc;
+
+	// Announce which epoch we are in before looking at the snapshot, so the
+	// writers know they can't free anything we may end up with.
+	ATOMIC_STORE(reader->epoch, ATOMIC_LOAD(lc->epoch));
+
+	return ATOMIC_LOAD(lc->current);
+}
+
+/**
+ * Leaves a read section. The snapshot returned by pecan_livecat_enter must not
+ * be used after this.
+ *
+ * @param reader Reader of the calling thread.
+ */
+void pecan_livecat_leave(pecan_reader_t *reader) {
+	ATOMIC_STORE(reader->epoch, 0);
+}
+
+/**
+ * Gets the version of a snapshot. It is incremented by every update.
+ *
+ * @param  snap Catalog snapshot.
+ * @return      Version of the snapshot.
+ */
+uint64_t pecan_snapshot_version(pecan_snapshot_t *snap) {
+	return snap->version;
+}
+
+/**
+ * Gets the number of archives in a snapshot.
+ *
+ * @param  snap Catalog snapshot.
+ * @return      Number of archives.
+ */
+size_t pecan_snapshot_len(pecan_snapshot_t *snap) {
+	return snap->len;
+}
+
+/**
+ * Gets an archive from a snapshot by its index. Archives are sorted by path.
+ * WARNING: Archives in a snapshot are shared and must be treated as read-only.
+ *
+ * @param  snap  Catalog snapshot.
+ * @param  index Index of the archive.
+ * @return       Requested item or NULL if the index is out-of-range.
+ */
+pecan_livecat_item_t *pecan_snapshot_get(pecan_snapshot_t *snap,
+										 size_t index) {
+	if (index >= snap->len)
+		return NULL;
+
+	return snap->items[index];
+}
+
+/**
+ * Finds an archive in a snapshot by its path.
+ * WARNING: Archives in a snapshot are shared and must be treated as read-only.
+ *
+ * @param  snap Catalog snapshot.
+ * @param  path Path of the archive.
+ * @return      Requested archive or NULL if it wasn't found.
+ */
+pecan_archive_t *pecan_snapshot_find(pecan_snapshot_t *snap,
+									 const char *path) {
+	size_t idx;
+	int found;
+
+	idx = snapshot_index(snap, path, &found);
+	if (!found)
+		return NULL;
+
+	return &snap->items[idx]->part;
+}
+
+/**
+ * Changes an archive and publishes the result as a new snapshot. The update
+ * function gets a copy-on-write draft of the archive, so readers will never
+ * see it half-way through the changes.
+ *
+ * @param  lc   Live catalog structure.
+ * @param  path Path of the archive to be changed.
+ * @param  fn   Function that changes the draft.
+ * @param  arg  Argument to be passed to the function.
+ * @return      PECAN_OK if the operation was successful.
+ *              PECAN_ERR_PATH_NOT_FOUND if the archive isn't in the catalog.
+ *              Error returned by the function, in which case nothing changes.
+ */
+pecan_err_t pecan_livecat_update(pecan_livecat_t *lc, const char *path,
+								 pecan_livecat_update_fn fn, void *arg) {
+	pecan_livecat_item_t *item;
+	pecan_snapshot_t *snap;
+	pecan_err_t err;
+	size_t idx;
+	int found;
+
+	mutex_lock(&lc->lock);
+
+	// Find the archive to be changed.
+	snap = lc->current;
+	idx = snapshot_index(snap, path, &found);
+	if (!found) {
+		err_format_msg(EMSG("Archive '%s' isn't in the catalog"), path);
+		err = PECAN_ERR_PATH_NOT_FOUND;
+		goto cleanup;
+	}
+
+	// Create our draft.
+	item = item_new(path);
+	if (item == NULL) {
+		err_set_msg(EMSG("Couldn't allocate memory for a catalog update"));
+		err = PECAN_ERR_UNKNOWN;
+		goto cleanup;
+	}
+	err = pecan_clone(&item->part, &snap->items[idx]->part);
+	if (err) {
+		item_release(item);
+		goto cleanup;
+	}
+
+	// Apply the changes.
+	err = fn(&item->part, arg);
+	if (err) {
+		item_release(item);
+		goto cleanup;
+	}
+
+	// Publish them.
+	err = livecat_swap(lc, path, item, 1);
+
+cleanup:
+	mutex_unlock(&lc->lock);
+	return err;
+}
+
+/**
+ * Sets an attribute of an archive and publishes the result as a new snapshot.
+ *
+ * @param  lc    Live catalog structure.
+ * @param  path  Path of the archive to be changed.
+ * @param  type  Type of attribute.
+ * @param  name  Name of the attribute.
+ * @param  value Value of the attribute.
+ * @return       Same as pecan_livecat_update.
+ */
+pecan_err_t pecan_livecat_set_attr(pecan_livecat_t *lc, const char *path,
+								   pecan_attr_type_t type, const char *name,
+								   const char *value) {
+	set_attr_args_t args;
+
+	args.type = type;
+	args.name = name;
+	args.value = value;
+
+	return pecan_livecat_update(lc, path, set_attr_update, &args);
+}
+
+/**
+ * Reads an archive from disk and publishes it as a new snapshot, replacing the
+ * one with the same path or adding it to the catalog.
+ *
+ * @param  lc   Live catalog structure.
+ * @param  path Path of the archive.
+ * @return      PECAN_OK if the operation was successful.
+ *              Same as pecan_read if the archive couldn't be read, in which
+ *              case nothing changes.
+ */
+pecan_err_t pecan_livecat_reload(pecan_livecat_t *lc, const char *path) {
+	pecan_livecat_item_t *item;
+	pecan_err_t err;
+
+	// Read the archive without holding up other writers.
+	item = item_new(path);
+	if (item == NULL) {
+		err_set_msg(EMSG("Couldn't allocate memory for a catalog update"));
+		return PECAN_ERR_UNKNOWN;
+	}
+	pecan_set_blobstore(&item->part, &lc->cat.store);
+	err = pecan_read(&item->part, path);
+	if (err) {
+		item_release(item);
+		return err;
+	}
+
+	// Publish it.
+	mutex_lock(&lc->lock);
+	err = livecat_swap(lc, path, item, 0);
+	mutex_unlock(&lc->lock);
+
+	return err;
+}
+
+/**
+ * Removes an archive from the catalog.
+ *
+ * @param  lc   Live catalog structure.
+ * @param  path Path of the archive.
+ * @return      PECAN_OK if the operation was successful.
+ *              PECAN_ERR_PATH_NOT_FOUND if the archive isn't in the catalog.
+ */
+pecan_err_t pecan_livecat_remove(pecan_livecat_t *lc, const char *path) {
+	pecan_err_t err;
+
+	mutex_lock(&lc->lock);
+	err = livecat_swap(lc, path, NULL, 1);
+	mutex_unlock(&lc->lock);
+
+	return err;
+}
+
+/**
+ * Writes the current version of an archive in the catalog to a file.
+ *
+ * @param  lc    Live catalog structure.
+ * @param  path  Path of the archive.
+ * @param  fname Path of the packed archive file to be written.
+ * @return       Same as pecan_write.
+ *               PECAN_ERR_PATH_NOT_FOUND if the archive isn't in the catalog.
+ */
+pecan_err_t pecan_livecat_write(pecan_livecat_t *lc, const char *path,
+								const char *fname) {
+	pecan_archive_t *part;
+	pecan_err_t err;
+
+	// Hold the writer lock so the archive can't be reclaimed under us.
+	mutex_lock(&lc->lock);
+	part = pecan_snapshot_find(lc->current, path);
+	if (part == NULL) {
+		err_format_msg(EMSG("Archive '%s' isn't in the catalog"), path);
+		err = PECAN_ERR_PATH_NOT_FOUND;
+	} else {
+		err = pecan_write(part, fname);
+	}
+	mutex_unlock(&lc->lock);
+
+	return err;
+}
+
+/**
+ * Frees every retired snapshot that no reader can be looking at anymore.
+ * This is done automatically after each update, but can be called to release
+ * memory sooner after long read sections are left.
+ *
+ * @param  lc Live catalog structure.
+ * @return    Number of retired snapshots that are still being held by readers.
+ */
+size_t pecan_livecat_reclaim(pecan_livecat_t *lc) {
+	size_t held;
+
+	mutex_lock(&lc->lock);
+	held = livecat_reclaim(lc);
+	mutex_unlock(&lc->lock);
+
+	return held;
+}
+
+/**
+ * Frees up any resources allocated by the live catalog. There must be no
+ * readers inside a read section.
+ *
+ * @param lc Live catalog to be free'd.
+ */
+void pecan_livecat_free(pecan_livecat_t *lc) {
+	pecan_reader_t *reader;
+
+	// Free up the snapshots.
+	while (lc->retired != NULL) {
+		pecan_snapshot_t *snap = lc->retired;
+
+		lc->retired = snap->next;
+		snapshot_free(snap);
+	}
+	snapshot_free(lc->current);
+	lc->current = NULL;
+
+	// Free up the readers.
+	reader = lc->readers;
+	while (reader != NULL) {
+		pecan_reader_t *next = reader->next;
+
+		mem_free(NULL, reader);
+		reader = next;
+	}
+	lc->readers = NULL;
+
+	// Free up the catalog last since it holds the blob store.
+	pecan_catalog_free(&lc->cat);
+	mutex_destroy(&lc->lock);
+}
+
+/**
+ * Allocates a new empty snapshot.
+ *
+ * @param  len Number of items that it must have space for.
+ * @return     Snapshot or NULL if we weren't able to allocate memory.
+ */
+static pecan_snapshot_t *snapshot_new(size_t len) {
+	pecan_snapshot_t *snap;
+
+	snap = (pecan_snapshot_t *)mem_alloc(NULL, sizeof(pecan_snapshot_t));
+	if (snap == NULL)
+		return NULL;
+
+	snap->items = (pecan_livecat_item_t **)mem_alloc(NULL,
+		((len) ? len : 1) * sizeof(pecan_livecat_item_t *));
+	if (snap->items == NULL) {
+		mem_free(NULL, snap);
+		return NULL;
+	}
+	snap->version = 0;
+	snap->len = 0;
+	snap->retired = 0;
+	snap->next = NULL;
+
+	return snap;
+}
+
+/**
+ * Creates a new snapshot from another one, sharing all of its items except for
+ * the ones that were removed or replaced.
+ *
+ * @param  snap    Snapshot to derive from.
+ * @param  idx     Index where the change happens.
+ * @param  nremove Number of items to be removed at the index.
+ * @param  item    Item to be inserted at the index or NULL. Its reference is
+ *                 taken over by the new snapshot.
+ * @return         New snapshot or NULL if we weren't able to allocate memory.
+ */
+static pecan_snapshot_t *snapshot_derive(pecan_snapshot_t *snap, size_t idx,
+										 size_t nremove,
+										 pecan_livecat_item_t *item) {
+	pecan_snapshot_t *derived;
+	size_t i;
+
+	derived = snapshot_new(snap->len - nremove + ((item) ? 1 : 0));
+	if (derived == NULL)
+		return NULL;
+
+	// Share everything that didn't change.
+	for (i = 0; i < snap->len; i++) {
+		if (i == idx) {
+			if (item)
+				derived->items[derived->len++] = item;
+			if (nremove)
+				continue;
+		}
+
+		snap->items[i]->refs++;
+		derived->items[derived->len++] = snap->items[i];
+	}
+
+	// Appending to the end.
+	if (item && (idx == snap->len))
+		derived->items[derived->len++] = item;
+
+	return derived;
+}
+
+/**
+ * Finds the position of an archive in a snapshot.
+ *
+ * @param  snap  Catalog snapshot.
+ * @param  path  Path of the archive.
+ * @param  found Set to non-zero if the archive is in the snapshot.
+ * @return       Index of the archive or where it should be inserted.
+ */
+static size_t snapshot_index(pecan_snapshot_t *snap, const char *path,
+							 int *found) {
+	size_t lo = 0;
+	size_t hi = snap->len;
+
+	// Items are always kept sorted by their paths.
+	*found = 0;
+	while (lo < hi) {
+		size_t mid = lo + ((hi - lo) / 2);
+		int cmp = strcmp(snap->items[mid]->path, path);
+
+		if (cmp == 0) {
+			*found = 1;
+			return mid;
+		} else if (cmp < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+/**
+ * Frees up a snapshot and releases its items.
+ *
+ * @param snap Snapshot to be free'd.
+ */
+static void snapshot_free(pecan_snapshot_t *snap) {
+	size_t i;
+
+	if (snap == NULL)
+		return;
+
+	for (i = 0; i < snap->len; i++)
+		item_release(snap->items[i]);
+	mem_free(NULL, snap->items);
+	mem_free(NULL, snap);
+}
+
+/**
+ * Allocates a new item with an initialized empty archive.
+ *
+ * @param  path Path of the archive.
+ * @return      Item or NULL if we weren't able to allocate memory.
+ */
+static pecan_livecat_item_t *item_new(const char *path) {
+	pecan_livecat_item_t *item;
+
+	item = (pecan_livecat_item_t *)mem_alloc(NULL,
+		sizeof(pecan_livecat_item_t));
+	if (item == NULL)
+		return NULL;
+
+	item->path = mem_strndup(NULL, path, strlen(path));
+	if (item->path == NULL) {
+		mem_free(NULL, item);
+		return NULL;
+	}
+	item->refs = 1;
+	pecan_init(&item->part);
+
+	return item;
+}
+
+/**
+ * Releases a reference to an item and frees it if nobody else is using it.
+ *
+ * @param item Item to be released.
+ */
+static void item_release(pecan_livecat_item_t *item) {
+	if (--item->refs > 0)
+		return;
+
+	pecan_release(&item->part);
+	mem_free(NULL, item->path);
+	mem_free(NULL, item);
+}
+
+/**
+ * Makes a snapshot visible to readers and retires the previous one.
+ * WARNING: Must be called with the writer lock held.
+ *
+ * @param lc   Live catalog structure.
+ * @param snap Snapshot to be published.
+ */
+static void livecat_publish(pecan_livecat_t *lc, pecan_snapshot_t *snap) {
+	pecan_snapshot_t *old;
+
+	// Swap the snapshots.
+	snap->version = lc->current->version + 1;
+	old = __atomic_exchange_n(&lc->current, snap, __ATOMIC_SEQ_CST);
+
+	// Retire the old one in the current epoch and move on to the next, so any
+	// reader that enters from now on is known to get the new snapshot.
+	old->retired = __atomic_fetch_add(&lc->epoch, 1, __ATOMIC_SEQ_CST);
+	old->next = lc->retired;
+	lc->retired = old;
+
+	// Free whatever is no longer being used.
+	livecat_reclaim(lc);
+}
+
+/**
+ * Frees every retired snapshot that no reader can be looking at anymore.
+ * WARNING: Must be called with the writer lock held.
+ *
+ * @param  lc Live catalog structure.
+ * @return    Number of retired snapshots that are still being held by readers.
+ */
+static size_t livecat_reclaim(pecan_livecat_t *lc) {
+	pecan_snapshot_t **snap;
+	pecan_reader_t *reader;
+	uint64_t oldest;
+	size_t held;
+
+	// Find the oldest epoch that a reader is still in.
+	oldest = UINT64_MAX;
+	for (reader = lc->readers; reader != NULL; reader = reader->next) {
+		uint64_t epoch = ATOMIC_LOAD(reader->epoch);
+		if ((epoch != 0) && (epoch < oldest))
+			oldest = epoch;
+	}
+
+	// Free the snapshots that were retired before that.
+	held = 0;
+	snap = &lc->retired;
+	while (*snap != NULL) {
+		if ((*snap)->retired < oldest) {
+			pecan_snapshot_t *old = *snap;
+
+			*snap = old->next;
+			snapshot_free(old);
+		} else {
+			snap = &(*snap)->next;
+			held++;
+		}
+	}
+
+	return held;
+}
+
+/**
+ * Publishes a new snapshot with an item replaced, added or removed.
+ * WARNING: Must be called with the writer lock held.
+ *
+ * @param  lc         Live catalog structure.
+ * @param  path       Path of the archive.
+ * @param  item       New item for the archive or NULL to remove it. Its
+ *                    reference is taken over.
+ * @param  must_exist Should the archive already be in the catalog?
+ * @return            PECAN_OK if the operation was successful.
+ *                    PECAN_ERR_PATH_NOT_FOUND if the archive should exist but
+ *                    doesn't.
+ *                    PECAN_ERR_UNKNOWN if we weren't able to allocate memory.
+ */
+static pecan_err_t livecat_swap(pecan_livecat_t *lc, const char *path,
+								pecan_livecat_item_t *item, int must_exist) {
+	pecan_snapshot_t *snap;
+	size_t idx;
+	int found;
+
+	// Find where the change happens.
+	idx = snapshot_index(lc->current, path, &found);
+	if (!found && (must_exist || (item == NULL))) {
+		if (item)
+			item_release(item);
+		err_format_msg(EMSG("Archive '%s' isn't in the catalog"), path);
+		return PECAN_ERR_PATH_NOT_FOUND;
+	}
+
+	// Build the new snapshot.
+	snap = snapshot_derive(lc->current, idx, (found) ? 1 : 0, item);
+	if (snap == NULL) {
+		if (item)
+			item_release(item);
+		err_set_msg(EMSG("Couldn't allocate a catalog snapshot"));
+		return PECAN_ERR_UNKNOWN;
+	}
+
+	livecat_publish(lc, snap);
+	return PECAN_OK;
+}
+
+/**
+ * Update function that sets an attribute.
+ *
+ * @param  draft Draft of the archive.
+ * @param  arg   Attribute to be set.
+ * @return       Always PECAN_OK.
+ */
+static pecan_err_t set_attr_update(pecan_archive_t *draft, void *arg) {
+	set_attr_args_t *args = (set_attr_args_t *)arg;
+
+	pecan_set_attr(draft, args->type, args->name, args->value);
+	return PECAN_OK;
+}
@@ -0,0 +1,107 @@
+/**
+ * livecat.h
+ * Catalog that can be updated while other threads are reading from it.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _LIVECAT_H
+#define _LIVECAT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "catalog.h"
+#include "thread.h"
+
+// Archive held by snapshots. Never changed once published.
+typedef struct {
+	char *path;
+	pecan_archive_t part;
+
+	size_t refs;
+} pecan_livecat_item_t;
+
+// Immutable view of the catalog at a point in time.
+typedef struct pecan_snapshot_s {
+	uint64_t version;
+	pecan_livecat_item_t **items;
+	size_t len;
+
+	uint64_t retired;
+	struct pecan_snapshot_s *next;
+} pecan_snapshot_t;
+
+// Registered reader of a live catalog.
+typedef struct pecan_reader_s {
+	uint64_t epoch;
+	int in_use;
+
+	struct pecan_livecat_s *lc;
+	struct pecan_reader_s *next;
+} pecan_reader_t;
+
+// Live catalog structure definition.
+typedef struct pecan_livecat_s {
+	pecan_snapshot_t *current;
+	uint64_t epoch;
+	pecan_reader_t *readers;
+	pecan_snapshot_t *retired;
+
+	pecan_catalog_t cat;
+	pecan_mutex_t lock;
+} pecan_livecat_t;
+
+// Update function type definition.
+typedef pecan_err_t (*pecan_livecat_update_fn)(pecan_archive_t *draft,
+											   void *arg);
+
+// Initialization
+PECAN_EXPORTS pecan_err_t pecan_livecat_init(pecan_livecat_t *lc);
+PECAN_EXPORTS pecan_err_t pecan_livecat_load(pecan_livecat_t *lc,
+											 const char *path);
+
+// Readers
+PECAN_EXPORTS pecan_reader_t *pecan_livecat_reader_new(pecan_livecat_t *lc);
+PECAN_EXPORTS void pecan_livecat_reader_free(pecan_reader_t *reader);
+PECAN_EXPORTS pecan_snapshot_t *pecan_livecat_enter(pecan_reader_t *reader);
+PECAN_EXPORTS void pecan_livecat_leave(pecan_reader_t *reader);
+
+// Snapshots
+PECAN_EXPORTS uint64_t pecan_snapshot_version(pecan_snapshot_t *snap);
+PECAN_EXPORTS size_t pecan_snapshot_len(pecan_snapshot_t *snap);
+PECAN_EXPORTS pecan_livecat_item_t *pecan_snapshot_get(pecan_snapshot_t *snap,
+													   size_t index);
+PECAN_EXPORTS pecan_archive_t *pecan_snapshot_find(pecan_snapshot_t *snap,
+												   const char *path);
+
+// Writers
+PECAN_EXPORTS pecan_err_t pecan_livecat_update(pecan_livecat_t *lc,
+											   const char *path,
+											   pecan_livecat_update_fn fn,
+											   void *arg);
+PECAN_EXPORTS pecan_err_t pecan_livecat_set_attr(pecan_livecat_t *lc,
+												 const char *path,
+												 pecan_attr_type_t type,
+												 const char *name,
+												 const char *value);
+PECAN_EXPORTS pecan_err_t pecan_livecat_reload(pecan_livecat_t *lc,
+											   const char *path);
+PECAN_EXPORTS pecan_err_t pecan_livecat_remove(pecan_livecat_t *lc,
+											   const char *path);
+PECAN_EXPORTS pecan_err_t pecan_livecat_write(pecan_livecat_t *lc,
+											  const char *path,
+											  const char *fname);
+
+// Cleanup
+PECAN_EXPORTS size_t pecan_livecat_reclaim(pecan_livecat_t *lc);
+PECAN_EXPORTS void pecan_livecat_free(pecan_livecat_t *lc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _LIVECAT_H */
@@ -6,12 +6,23 @@
  */
 
 #include <ctype.h>
+#include <fcntl.h>
+#include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "pecan.h"
+#include "error.h"
+#include "aggregate.h"
+#include "atlas.h"
+#include "complete.h"
+#include "export.h"
+#include "fuzzy.h"
+#include "import.h"
+#include "search.h"
 #ifdef USE_GTK
 #	include "gtk/app.h"
 #endif
@@ -19,6 +30,19 @@
 // Command line options structure.
 typedef struct {
 	bool dump_contents;
+	char *extract_member;
+	size_t extract_offset;
+	size_t extract_len;
+	char *unpack_dir;
+	char *export_fmt;
+	char *export_cols;
+	char *import_dir;
+	char *atlas_file;
+	char *search_query;
+	char *fuzzy_query;
+	char *complete_query;
+	char *group_query;
+	char *low_stock;
 	char *output_file;
 	char *input_file;
 #ifdef HAS_GUI
@@ -28,10 +52,32 @@ typedef struct {
 
 // Global variables.
 static char *prompt = NULL;
+static const struct option long_opts[] = {
+	{ "export",     required_argument, NULL, 'e' },
+	{ "columns",    required_argument, NULL, 'c' },
+	{ "import",     required_argument, NULL, 'i' },
+	{ "thumbnails", required_argument, NULL, 't' },
+	{ "search",     required_argument, NULL, 's' },
+	{ "fuzzy",      required_argument, NULL, 'f' },
+	{ "complete",   required_argument, NULL, 'a' },
+	{ "group",      required_argument, NULL, 'g' },
+	{ "low-stock",  required_argument, NULL, 'l' },
+	{ NULL,         0,                 NULL, 0   }
+};
 
 // Private methods.
 void usage(void);
+bool parse_range(const char *str, size_t *offset, size_t *len);
 pecan_err_t dump_archive(pecan_archive_t *part);
+pecan_err_t export_bin(const char *path, const char *fmt, char *cols,
+					   const char *fname);
+pecan_err_t import_sheet(const char *fname, const char *dir);
+pecan_err_t build_atlas(const char *path, const char *fname);
+pecan_err_t search_bin(const char *path, const char *query);
+pecan_err_t fuzzy_bin(const char *path, const char *query);
+pecan_err_t complete_bin(const char *path, char *query);
+pecan_err_t group_bin(const char *path, char *query);
+pecan_err_t low_stock_bin(const char *path, const char *limit);
 
 /**
  * Program's main entry point.
@@ -51,13 +97,27 @@ int main(int argc, char **argv) {
 	prompt = argv[0];
 	opterr = 0;
 	opts.dump_contents = false;
+	opts.extract_member = NULL;
+	opts.extract_offset = 0;
+	opts.extract_len = 0;
+	opts.unpack_dir = NULL;
+	opts.export_fmt = NULL;
+	opts.export_cols = NULL;
+	opts.import_dir = NULL;
+	opts.atlas_file = NULL;
+	opts.search_query = NULL;
+	opts.fuzzy_query = NULL;
+	opts.complete_query = NULL;
+	opts.group_query = NULL;
+	opts.low_stock = NULL;
 	opts.output_file = NULL;
 #ifdef HAS_GUI
 	opts.show_window = true;
 #endif  /* HAS_GUI */
 
 	// Go through the command line options.
-	while ((c = getopt(argc, argv, "hdwO:")) != -1) {
+	while ((c = getopt_long(argc, argv, "hdwx:r:u:e:c:i:t:s:f:a:g:l:O:", long_opts,
+			NULL)) != -1) {
 		switch (c) {
 			case 'h':
 				// Help the user with usage.
@@ -73,13 +133,70 @@ int main(int argc, char **argv) {
 				opts.show_window = false;
 				break;
 #endif  /* HAS_GUI */
+			case 'x':
+				// Extract a member of the input archive to stdout.
+				opts.extract_member = optarg;
+				break;
+			case 'r':
+				// Range of the member to be extracted.
+				if (!parse_range(optarg, &opts.extract_offset,
+						&opts.extract_len)) {
+					fprintf(stderr, "%s: invalid range '%s'\n", prompt, optarg);
+					usage();
+					return 1;
+				}
+				break;
+			case 'u':
+				// Unpack the input archive into a folder.
+				opts.unpack_dir = optarg;
+				break;
+			case 'e':
+				// Export a whole parts bin.
+				opts.export_fmt = optarg;
+				break;
+			case 'c':
+				// Columns to be exported.
+				opts.export_cols = optarg;
+				break;
+			case 'i':
+				// Import an inventory sheet into a parts bin.
+				opts.import_dir = optarg;
+				break;
+			case 't':
+				// Build the thumbnail atlas of a parts bin.
+				opts.atlas_file = optarg;
+				break;
+			case 's':
+				// Search a parts bin.
+				opts.search_query = optarg;
+				break;
+			case 'f':
+				// Look up a part number that may have typos.
+				opts.fuzzy_query = optarg;
+				break;
+			case 'a':
+				// Autocomplete the value of an attribute.
+				opts.complete_query = optarg;
+				break;
+			case 'g':
+				// Aggregate an attribute across a parts bin.
+				opts.group_query = optarg;
+				break;
+			case 'l':
+				// List the parts that are running low.
+				opts.low_stock = optarg;
+				break;
 			case 'O':
 				// Set the output file.
 				opts.output_file = optarg;
 				break;
 			case '?':
 				// Unknown option or bad argument.
-				if (optopt == 'O') {
+				if ((optopt == 'O') || (optopt == 'x') || (optopt == 'r') ||
+						(optopt == 'u') || (optopt == 'e') || (optopt == 'c') ||
+						(optopt == 'i') || (optopt == 't') || (optopt == 's') ||
+						(optopt == 'f') || (optopt == 'a') || (optopt == 'g') ||
+						(optopt == 'l')) {
 					fprintf(stderr, "Option -%c requires an argument.\n",
 						optopt);
 				} else if (isprint(optopt)) {
@@ -111,6 +228,72 @@ int main(int argc, char **argv) {
 		opts.input_file = argv[optind];
 	}
 
+	// Extract a member straight out of the archive without reading it.
+	if (opts.extract_member) {
+		fflush(stdout);
+		err = pecan_send_member(opts.input_file, opts.extract_member,
+								opts.extract_offset, opts.extract_len,
+								STDOUT_FILENO);
+		goto cleanup;
+	}
+
+	// Export a whole parts bin instead of dealing with a single archive. Its
+	// errors are reported on their own since stdout may be taken by the export.
+	if (opts.export_fmt) {
+		err = export_bin(opts.input_file, opts.export_fmt, opts.export_cols,
+						 opts.output_file);
+		pecan_free(&part);
+		return err;
+	}
+
+	// Build a whole parts bin out of an inventory sheet.
+	if (opts.import_dir) {
+		err = import_sheet(opts.input_file, opts.import_dir);
+		goto cleanup;
+	}
+
+	// Build the thumbnails of a whole parts bin.
+	if (opts.atlas_file) {
+		err = build_atlas(opts.input_file, opts.atlas_file);
+		goto cleanup;
+	}
+
+	// Search a whole parts bin.
+	if (opts.search_query) {
+		err = search_bin(opts.input_file, opts.search_query);
+		goto cleanup;
+	}
+
+	// Look up a part number in a whole parts bin.
+	if (opts.fuzzy_query) {
+		err = fuzzy_bin(opts.input_file, opts.fuzzy_query);
+		goto cleanup;
+	}
+
+	// Autocomplete an attribute across a whole parts bin.
+	if (opts.complete_query) {
+		err = complete_bin(opts.input_file, opts.complete_query);
+		goto cleanup;
+	}
+
+	// Aggregate an attribute across a whole parts bin.
+	if (opts.group_query) {
+		err = group_bin(opts.input_file, opts.group_query);
+		goto cleanup;
+	}
+
+	// List the parts of a whole parts bin that are running low.
+	if (opts.low_stock) {
+		err = low_stock_bin(opts.input_file, opts.low_stock);
+		goto cleanup;
+	}
+
+	// Unpack the archive straight from the file without reading it.
+	if (opts.unpack_dir) {
+		err = pecan_extract(opts.input_file, opts.unpack_dir);
+		goto cleanup;
+	}
+
 	// Read the input archive.
 	err = pecan_read(&part, opts.input_file);
 	if (err)
@@ -177,12 +360,471 @@ pecan_err_t dump_archive(pecan_archive_t *part) {
 	return PECAN_OK;
 }
 
+/**
+ * Exports the attributes of every archive in a parts bin to a file or stdout.
+ * Errors are reported to stderr.
+ *
+ * @param  path  Path to the parts bin.
+ * @param  fmt   Name of the export format (csv or jsonl).
+ * @param  cols  Comma-separated list of columns or NULL for everything. Will
+ *               be chopped up.
+ * @param  fname File to export to or NULL to use stdout.
+ * @return       PECAN_OK if everything went fine.
+ */
+pecan_err_t export_bin(const char *path, const char *fmt, char *cols,
+					   const char *fname) {
+	pecan_catalog_t cat;
+	pecan_export_fmt_t efmt;
+	const char **columns;
+	size_t ncolumns;
+	pecan_err_t err;
+	pecan_err_t lerr;
+	char *col;
+	int fd;
+
+	// Check the format.
+	if (strcmp(fmt, "csv") == 0) {
+		efmt = PECAN_EXPORT_CSV;
+	} else if (strcmp(fmt, "jsonl") == 0) {
+		efmt = PECAN_EXPORT_JSONL;
+	} else {
+		fprintf(stderr, "%s: invalid export format '%s'\n", prompt, fmt);
+		return PECAN_ERR_UNKNOWN;
+	}
+
+	// Split up the columns.
+	columns = NULL;
+	ncolumns = 0;
+	if (cols) {
+		columns = (const char **)malloc((strlen(cols) / 2 + 1) *
+										sizeof(const char *));
+		if (columns == NULL)
+			return PECAN_ERR_UNKNOWN;
+		for (col = strtok(cols, ","); col; col = strtok(NULL, ","))
+			columns[ncolumns++] = col;
+	}
+
+	// Load the bin, exporting whatever could be read even if some failed.
+	pecan_catalog_init(&cat);
+	lerr = pecan_catalog_load(&cat, path);
+	if (lerr) {
+		fprintf(stderr, "ERROR: %s\n", pecan_err_msg());
+		if (lerr == PECAN_ERR_PATH_NOT_FOUND) {
+			err = lerr;
+			goto cleanup;
+		}
+	}
+
+	// Get the output ready.
+	fd = STDOUT_FILENO;
+	if (fname) {
+		fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) {
+			err_format_msg(EMSG("Couldn't open '%s' for writing"), fname);
+			fprintf(stderr, "ERROR: %s\n", pecan_err_msg());
+			err = PECAN_ERR_FILE_IO;
+			goto cleanup;
+		}
+	}
+
+	// Export it.
+	fflush(stdout);
+	err = pecan_catalog_export(&cat, fd, efmt, columns, ncolumns);
+	if ((fd != STDOUT_FILENO) && (close(fd) != 0) && !err) {
+		err_format_msg(EMSG("Couldn't write the export to '%s'"), fname);
+		err = PECAN_ERR_FILE_IO;
+	}
+	if (err) {
+		fprintf(stderr, "ERROR: %s\n", pecan_err_msg());
+	} else {
+		err = lerr;
+	}
+
+cleanup:
+	pecan_catalog_free(&cat);
+	free(columns);
+	return err;
+}
+
+/**
+ * Imports an inventory sheet into a parts bin, writing an archive per row. The
+ * format of the sheet is guessed from its extension.
+ *
+ * @param  fname Path to the CSV or TSV sheet or - to read it from stdin.
+ * @param  dir   Parts bin folder to write the archives to.
+ * @return       PECAN_OK if everything went fine.
+ */
+pecan_err_t import_sheet(const char *fname, const char *dir) {
+	pecan_import_fmt_t fmt;
+	const char *ext;
+	pecan_err_t err;
+	size_t count;
+	int fd;
+
+	// Open the sheet.
+	if (strcmp(fname, "-") == 0) {
+		fd = STDIN_FILENO;
+	} else {
+		fd = open(fname, O_RDONLY);
+		if (fd == -1) {
+			err_format_msg(EMSG("Couldn't open sheet '%s'"), fname);
+			return PECAN_ERR_PATH_NOT_FOUND;
+		}
+	}
+
+	// Import it.
+	ext = strrchr(fname, '.');
+	fmt = (ext && ((strcmp(ext, ".tsv") == 0) || (strcmp(ext, ".tab") == 0))) ?
+		PECAN_IMPORT_TSV : PECAN_IMPORT_CSV;
+	count = 0;
+	err = pecan_import(NULL, fd, fmt, dir, &count);
+	printf("Imported %zu archives into '%s'\n", count, dir);
+
+	if (fd != STDIN_FILENO)
+		close(fd);
+	return err;
+}
+
+/**
+ * Builds or updates the thumbnail atlas of a parts bin.
+ *
+ * @param  path  Path to the parts bin.
+ * @param  fname Path to the atlas file.
+ * @return       PECAN_OK if the operation was successful.
+ */
+pecan_err_t build_atlas(const char *path, const char *fname) {
+	pecan_atlas_t atlas;
+	pecan_err_t err;
+	size_t decoded;
+
+	// Build it.
+	err = pecan_atlas_build(NULL, path, fname, PECAN_ATLAS_DEFAULT_SIZE,
+							PECAN_ATLAS_DEFAULT_SIZE, &decoded);
+	if (err)
+		return err;
+
+	// Let the user know how much work it took.
+	err = pecan_atlas_open(&atlas, fname);
+	if (err)
+		return err;
+	printf("Decoded %zu of %zu thumbnails into '%s'\n", decoded,
+		pecan_atlas_len(&atlas), fname);
+	pecan_atlas_close(&atlas);
+
+	return PECAN_OK;
+}
+
+/**
+ * Searches the descriptions and parameters of a parts bin and prints out the
+ * best matches.
+ *
+ * @param  path  Path to the parts bin.
+ * @param  query Free text query.
+ * @return       PECAN_OK if the operation was successful.
+ */
+pecan_err_t search_bin(const char *path, const char *query) {
+	pecan_search_hit_t hits[10];
+	pecan_catalog_t cat;
+	pecan_search_t idx;
+	pecan_err_t err;
+	size_t nhits;
+	size_t i;
+
+	// Load the bin, searching whatever could be read even if some failed.
+	pecan_catalog_init(&cat);
+	pecan_search_init(&idx);
+	err = pecan_catalog_load(&cat, path);
+	if (err == PECAN_ERR_PATH_NOT_FOUND)
+		goto cleanup;
+
+	// Index it and search.
+	err = pecan_search_build(&idx, &cat);
+	if (err)
+		goto cleanup;
+	err = pecan_search_query(&idx, query, 0, hits, 10, &nhits);
+	if (err)
+		goto cleanup;
+
+	// Show the best matches.
+	for (i = 0; i < nhits; i++) {
+		printf("%.3f\t%s\n", hits[i].score,
+			   pecan_catalog_get(&cat, hits[i].index)->path);
+	}
+
+cleanup:
+	pecan_search_free(&idx);
+	pecan_catalog_release(&cat);
+	return err;
+}
+
+/**
+ * Looks up a part number that may have typos in a parts bin and prints out the
+ * closest matches.
+ *
+ * @param  path  Path to the parts bin.
+ * @param  query Part number to look for.
+ * @return       PECAN_OK if the operation was successful.
+ */
+pecan_err_t fuzzy_bin(const char *path, const char *query) {
+	pecan_fuzzy_hit_t hits[10];
+	pecan_catalog_t cat;
+	pecan_fuzzy_t idx;
+	pecan_err_t err;
+	size_t nhits;
+	size_t i;
+
+	// Load the bin, searching whatever could be read even if some failed.
+	pecan_catalog_init(&cat);
+	pecan_fuzzy_init(&idx);
+	err = pecan_catalog_load(&cat, path);
+	if (err == PECAN_ERR_PATH_NOT_FOUND)
+		goto cleanup;
+
+	// Index it and look the part number up.
+	err = pecan_fuzzy_build(&idx, &cat);
+	if (err)
+		goto cleanup;
+	err = pecan_fuzzy_query(&idx, query, PECAN_FUZZY_DEFAULT_DIST, hits, 10,
+							&nhits);
+	if (err)
+		goto cleanup;
+
+	// Show the closest matches.
+	for (i = 0; i < nhits; i++) {
+		printf("%u\t%s\n", hits[i].dist,
+			   pecan_catalog_get(&cat, hits[i].index)->path);
+	}
+
+cleanup:
+	pecan_fuzzy_free(&idx);
+	pecan_catalog_release(&cat);
+	return err;
+}
+
+/**
+ * Autocompletes the value of a manifest attribute across a parts bin and
+ * prints out the best completions.
+ *
+ * @param  path  Path to the parts bin.
+ * @param  query Attribute name and prefix in the form of attr:pfx. Will be
+ *               chopped up.
+ * @return       PECAN_OK if the operation was successful.
+ */
+pecan_err_t complete_bin(const char *path, char *query) {
+	pecan_complete_entry_t *hits[10];
+	pecan_complete_t comp;
+	pecan_catalog_t cat;
+	pecan_err_t err;
+	char *prefix;
+	size_t nhits;
+	size_t i;
+
+	// Split the attribute name from the prefix.
+	prefix = strchr(query, ':');
+	if (prefix == NULL) {
+		err_set_msg(EMSG("Completion must be in the form attr:pfx"));
+		return PECAN_ERR_UNKNOWN;
+	}
+	*prefix++ = '\0';
+
+	// Load the bin, completing whatever could be read even if some failed.
+	pecan_catalog_init(&cat);
+	pecan_complete_init(&comp);
+	err = pecan_catalog_load(&cat, path);
+	if (err == PECAN_ERR_PATH_NOT_FOUND)
+		goto cleanup;
+
+	// Index the attribute and complete the prefix.
+	err = pecan_complete_build(&comp, &cat, PECAN_MANIFEST, query);
+	if (err)
+		goto cleanup;
+	err = pecan_complete_query(&comp, prefix, hits, 10, &nhits);
+	if (err)
+		goto cleanup;
+
+	// Show the best completions.
+	for (i = 0; i < nhits; i++)
+		printf("%llu\t%s\n", (unsigned long long)hits[i]->weight,
+			   hits[i]->value);
+
+cleanup:
+	pecan_complete_free(&comp);
+	pecan_catalog_release(&cat);
+	return err;
+}
+
+/**
+ * Aggregates a numeric manifest attribute across a parts bin, optionally
+ * grouped by another one, and prints out the count, sum, minimum and maximum
+ * of each group.
+ *
+ * @param  path  Path to the parts bin.
+ * @param  query Attribute names in the form of attr[:group]. Will be chopped
+ *               up.
+ * @return       PECAN_OK if the operation was successful.
+ */
+pecan_err_t group_bin(const char *path, char *query) {
+	pecan_column_t *group;
+	pecan_catalog_t cat;
+	pecan_table_t tbl;
+	pecan_agg_t *aggs;
+	pecan_err_t err;
+	char *name;
+	size_t i;
+
+	// Split the attribute from the one to group by.
+	name = strchr(query, ':');
+	if (name)
+		*name++ = '\0';
+
+	// Load the bin, aggregating whatever could be read even if some failed.
+	aggs = NULL;
+	pecan_catalog_init(&cat);
+	pecan_table_init(&tbl);
+	err = pecan_catalog_load(&cat, path);
+	if (err == PECAN_ERR_PATH_NOT_FOUND)
+		goto cleanup;
+
+	// Lay it out in columns and aggregate.
+	err = pecan_table_build(&tbl, &cat);
+	if (err)
+		goto cleanup;
+	group = (name) ? pecan_table_column(&tbl, PECAN_MANIFEST, name) : NULL;
+	if (name && (group == NULL)) {
+		err_format_msg(EMSG("No archive has a '%s' attribute"), name);
+		err = PECAN_ERR_UNKNOWN;
+		goto cleanup;
+	}
+	aggs = (pecan_agg_t *)malloc(PECAN_AGG_GROUPS(group) * sizeof(pecan_agg_t));
+	if (aggs == NULL) {
+		err_set_msg(EMSG("Failed to allocate the aggregates"));
+		err = PECAN_ERR_UNKNOWN;
+		goto cleanup;
+	}
+	err = pecan_aggregate(pecan_catalog_pool(&cat), &tbl,
+						  pecan_table_column(&tbl, PECAN_MANIFEST, query),
+						  group, NULL, aggs);
+	if (err)
+		goto cleanup;
+
+	// Show the groups that have anything in them.
+	for (i = 0; i < PECAN_AGG_GROUPS(group); i++) {
+		if (aggs[i].count == 0)
+			continue;
+
+		printf("%s\t%zu\t%g\t%g\t%g\n",
+			   (group && (i < group->ndict)) ? group->dict[i] : "-",
+			   aggs[i].count, aggs[i].sum, aggs[i].min, aggs[i].max);
+	}
+
+cleanup:
+	free(aggs);
+	pecan_table_free(&tbl);
+	pecan_catalog_release(&cat);
+	return err;
+}
+
+/**
+ * Lists the archives of a parts bin whose stock quantity is below a limit.
+ *
+ * @param  path  Path to the parts bin.
+ * @param  limit Quantity the stock must be below.
+ * @return       PECAN_OK if the operation was successful.
+ */
+pecan_err_t low_stock_bin(const char *path, const char *limit) {
+	pecan_column_t *quantity;
+	pecan_catalog_t cat;
+	pecan_table_t tbl;
+	uint64_t *rows;
+	pecan_err_t err;
+	size_t i;
+
+	// Load the bin, checking whatever could be read even if some failed.
+	rows = NULL;
+	pecan_catalog_init(&cat);
+	pecan_table_init(&tbl);
+	err = pecan_catalog_load(&cat, path);
+	if (err == PECAN_ERR_PATH_NOT_FOUND)
+		goto cleanup;
+
+	// Lay it out in columns and filter.
+	err = pecan_table_build(&tbl, &cat);
+	if (err)
+		goto cleanup;
+	rows = (uint64_t *)malloc(PECAN_ROWS_WORDS(&tbl) * sizeof(uint64_t));
+	if (rows == NULL) {
+		err_set_msg(EMSG("Failed to allocate the matching rows"));
+		err = PECAN_ERR_UNKNOWN;
+		goto cleanup;
+	}
+	quantity = pecan_table_column(&tbl, PECAN_MANIFEST, "quantity");
+	err = pecan_filter_below(pecan_catalog_pool(&cat), &tbl, quantity,
+							 atof(limit), NULL, rows);
+	if (err)
+		goto cleanup;
+
+	// Show the ones that are running low.
+	for (i = 0; i < tbl.nrows; i++) {
+		if ((rows[i / 64] >> (i % 64)) & 1) {
+			printf("%g\t%s\n", (quantity->type == PECAN_COLUMN_INT) ?
+				   (double)quantity->ints[i] : quantity->floats[i],
+				   pecan_catalog_get(&cat, i)->path);
+		}
+	}
+
+cleanup:
+	free(rows);
+	pecan_table_free(&tbl);
+	pecan_catalog_release(&cat);
+	return err;
+}
+
+/**
+ * Parses a byte range in the form of offset[:length].
+ *
+ * @param  str    String to be parsed.
+ * @param  offset Offset of the first byte.
+ * @param  len    Number of bytes or 0 if the range goes until the end.
+ * @return        TRUE if the range is valid.
+ */
+bool parse_range(const char *str, size_t *offset, size_t *len) {
+	char *end;
+
+	// Get the offset.
+	if (!isdigit((unsigned char)*str))
+		return false;
+	*offset = strtoul(str, &end, 10);
+	*len = 0;
+
+	// Get the optional length.
+	if (*end == ':') {
+		str = end + 1;
+		if (!isdigit((unsigned char)*str))
+			return false;
+		*len = strtoul(str, &end, 10);
+	}
+
+	return *end == '\0';
+}
+
 /**
  * Displays a helpful usage message.
  */
 void usage(void) {
-	fprintf(stderr, "usage: %s %s\n\n", prompt, "[-h] [-d] [-O outfile] infile");
+	fprintf(stderr, "usage: %s %s\n\n", prompt, "[-h] [-d] [-x member [-r range]] [-u dir] [-e fmt [-c cols]] [-i dir] [-t atlas] [-s query] [-f partno] [-a attr:pfx] [-g attr[:by]] [-l qty] [-O outfile] infile");
 	fprintf(stderr, "   -h          Prints out this very helpful message.\n");
 	fprintf(stderr, "   -d          Dumps the metadata of an archive to stdout.\n");
-	fprintf(stderr, "   -O outfile  Outputs to a new archive.\n");
+	fprintf(stderr, "   -x member   Writes the contents of a member to stdout.\n");
+	fprintf(stderr, "   -r range    Only extracts the bytes in offset[:length].\n");
+	fprintf(stderr, "   -u dir      Unpacks the archive into a folder.\n");
+	fprintf(stderr, "   -e fmt      Exports a whole parts bin as csv or jsonl (--export).\n");
+	fprintf(stderr, "   -c cols     Only exports these comma-separated columns (--columns).\n");
+	fprintf(stderr, "   -i dir      Imports a CSV or TSV sheet into a parts bin (--import).\n");
+	fprintf(stderr, "   -t atlas    Builds the thumbnail atlas of a parts bin (--thumbnails).\n");
+	fprintf(stderr, "   -s query    Searches the descriptions and parameters of a parts bin (--search).\n");
+	fprintf(stderr, "   -f partno   Looks up a part number that may have typos (--fuzzy).\n");
+	fprintf(stderr, "   -a attr:pfx Autocompletes an attribute across a parts bin (--complete).\n");
+	fprintf(stderr, "   -g attr:by  Sums up an attribute across a parts bin, grouped by another (--group).\n");
+	fprintf(stderr, "   -l qty      Lists the parts with less than this in stock (--low-stock).\n");
+	fprintf(stderr, "   -O outfile  Outputs to a new archive or export file.\n");
 }
@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena.h"
 #include "attribute.h"
 #include "error.h"
 
@@ -74,6 +75,16 @@ pecan_err_t parse_attributes(pecan_archive_t *part, pecan_attr_type_t type,
 	pecan_attr_t attr;
 	const char *start;
 	const char *end;
+	char *str;
+
+	// Make sure we have an arena to hold the strings.
+	if (part->arena == NULL) {
+		part->arena = arena_new(part->alloc);
+		if (part->arena == NULL) {
+			err_set_msg(EMSG("Couldn't allocate the attributes arena"));
+			return PECAN_ERR_UNKNOWN;
+		}
+	}
 
 	// Initialize our attribute structure.
 	attr_init(&attr);
@@ -90,7 +101,10 @@ pecan_err_t parse_attributes(pecan_archive_t *part, pecan_attr_type_t type,
 				continue;
 			}
 
-			attr_set_name_tk(&attr, start, end);
+			str = arena_strndup(part->arena, start, end - start);
+			if (str == NULL)
+				goto nomem;
+			attr_borrow_name(&attr, str);
 			break;
 		case PARSING_VALUE:
 			if (*start == '\n') {
@@ -102,10 +116,25 @@ pecan_err_t parse_attributes(pecan_archive_t *part, pecan_attr_type_t type,
 			}
 
 			// TODO: Concatenate the values until a newline.
-			attr_set_value_tk(&attr, start, end);
+			str = arena_strndup(part->arena, start, end - start);
+			if (str == NULL)
+				goto nomem;
+			attr_borrow_value(&attr, str);
 			break;
 		}
 	}
 
+	// Hand over the last attribute if the file didn't end with a newline.
+	if ((attr.name != NULL) && (attr.value != NULL)) {
+		pecan_add_attr(part, type, attr);
+	} else {
+		attr_free(attr);
+	}
+
 	return PECAN_OK;
+
+nomem:
+	attr_free(attr);
+	err_set_msg(EMSG("Couldn't allocate memory for the attribute strings"));
+	return PECAN_ERR_UNKNOWN;
 }
@@ -15,6 +15,8 @@
 #include "fileutils.h"
 #include "parser.h"
 #include "error.h"
+#include "tarindex.h"
+#include "writer.h"
 
 // Handle microtar errors.
 #define HANDLE_MTAR_ERR(mterr)                                                \
@@ -26,6 +28,18 @@
 		}                                                                     \
 	} while (0)
 
+// Private methods.
+static pecan_attr_arr_t *attr_arr_writable(pecan_archive_t *part,
+										   pecan_attr_type_t type);
+static void attr_arr_release(pecan_attr_arr_t *attribs, size_t **refs);
+static void attr_arr_clear(pecan_attr_arr_t *attribs, size_t **refs);
+static void arena_unshare(pecan_archive_t *part, pecan_attr_type_t type);
+static char *read_buf_reserve(pecan_archive_t *part, size_t size);
+static int tar_find(mtar_t *tar, pecan_tarindex_t *idx, const char *name,
+					mtar_header_t *header, uint64_t *hash);
+static void blob_intern(pecan_archive_t *part, pecan_blob_t *blob,
+						uint64_t hash);
+
 /**
  * Initializes an component structure.
  *
@@ -37,6 +51,14 @@ pecan_err_t pecan_init(pecan_archive_t *part) {
 	part->fname = NULL;
 	part->attribs = NULL;
 	part->params = NULL;
+	part->store = NULL;
+	part->attribs_refs = NULL;
+	part->params_refs = NULL;
+	part->arena = NULL;
+	part->buf = NULL;
+	part->buf_len = 0;
+	part->alloc = NULL;
+	tarindex_init(&part->index);
 
 	// Initialize what needs to be initialized.
 	err_init();
@@ -46,6 +68,141 @@ pecan_err_t pecan_init(pecan_archive_t *part) {
 	return PECAN_OK;
 }
 
+/**
+ * Makes the archive deduplicate its blobs against a shared blob store whenever
+ * they are read. Useful when loading many archives that share the same images
+ * and datasheets.
+ *
+ * @param part  Component archive structure.
+ * @param store Blob store to deduplicate against or NULL to stop doing it. It
+ *              must outlive the blobs read while it was set.
+ */
+void pecan_set_blobstore(pecan_archive_t *part, pecan_blobstore_t *store) {
+	part->store = store;
+
+	// Deduplicate anything we may have already read.
+	if (store) {
+		blobstore_intern(store, &part->image);
+		blobstore_intern(store, &part->datasheet);
+	}
+}
+
+/**
+ * Creates a copy of an archive in constant time. Both archives will share the
+ * same attributes and blobs until one of them gets changed, at which point
+ * only the changed part will be copied.
+ * WARNING: Attributes must only be changed via pecan_set_attr and friends,
+ *          changing them through pointers from pecan_get_attr would also
+ *          change every other archive sharing them.
+ *
+ * @param  dest Initialized empty archive to receive the copy.
+ * @param  src  Archive to be copied.
+ * @return      PECAN_OK if the operation was successful.
+ *              PECAN_ERR_UNKNOWN if we weren't able to allocate memory.
+ */
+pecan_err_t pecan_clone(pecan_archive_t *dest, pecan_archive_t *src) {
+	// Copy the file name over.
+	if (src->fname) {
+		dest->fname = mem_strndup(NULL, src->fname, strlen(src->fname));
+		if (dest->fname == NULL)
+			goto nomem;
+	}
+
+	// Make sure the source attributes have a reference counter to share.
+	if ((src->attribs_refs == NULL) && src->attribs) {
+		src->attribs_refs = (size_t *)mem_alloc(NULL, sizeof(size_t));
+		if (src->attribs_refs == NULL)
+			goto nomem;
+		*src->attribs_refs = 1;
+	}
+	if ((src->params_refs == NULL) && src->params) {
+		src->params_refs = (size_t *)mem_alloc(NULL, sizeof(size_t));
+		if (src->params_refs == NULL)
+			goto nomem;
+		*src->params_refs = 1;
+	}
+
+	// Share the attributes.
+	dest->attribs = src->attribs;
+	dest->attribs_refs = src->attribs_refs;
+	if (dest->attribs_refs)
+		(*dest->attribs_refs)++;
+	dest->params = src->params;
+	dest->params_refs = src->params_refs;
+	if (dest->params_refs)
+		(*dest->params_refs)++;
+
+	// Share the arena that holds the strings of the attributes.
+	if (src->arena)
+		dest->arena = arena_ref(src->arena);
+
+	// Share the blobs.
+	dest->store = src->store;
+	blob_clone(&dest->image, &src->image);
+	blob_clone(&dest->datasheet, &src->datasheet);
+
+	return PECAN_OK;
+
+nomem:
+	err_set_msg(EMSG("Couldn't allocate memory to clone the archive"));
+	return PECAN_ERR_UNKNOWN;
+}
+
+/**
+ * Sets the global allocator used for everything that isn't owned by an archive
+ * with its own allocator. This must be done before anything is allocated by
+ * the library, since memory must always be free'd by the allocator that
+ * allocated it.
+ *
+ * @param alloc Allocator to be used or NULL to go back to malloc and friends.
+ */
+void pecan_set_allocator(const pecan_allocator_t *alloc) {
+	mem_set_allocator(alloc);
+}
+
+/**
+ * Sets the allocator used for the bulk storage of an archive: its attribute
+ * strings arena, read buffer and blobs. Anything the archive currently holds
+ * will be free'd, so this is best done right after pecan_init.
+ *
+ * @param part  Component archive structure.
+ * @param alloc Allocator to be used or NULL to use the global one.
+ */
+void pecan_set_archive_allocator(pecan_archive_t *part,
+								 const pecan_allocator_t *alloc) {
+	// Get rid of everything that was allocated by the previous allocator.
+	pecan_reset(part);
+	arena_release(part->arena);
+	part->arena = NULL;
+	mem_free(part->alloc, part->buf);
+	part->buf = NULL;
+	part->buf_len = 0;
+	blob_free(&part->image);
+	blob_free(&part->datasheet);
+
+	// Switch allocators.
+	part->alloc = alloc;
+	part->image.alloc = alloc;
+	part->datasheet.alloc = alloc;
+}
+
+/**
+ * Gets the memory allocation counters of the library since the start of the
+ * program or the last call to pecan_reset_alloc_stats.
+ *
+ * @param stats Structure to be populated with the statistics.
+ */
+void pecan_get_alloc_stats(pecan_alloc_stats_t *stats) {
+	mem_get_stats(stats);
+}
+
+/**
+ * Resets the memory allocation counters of the library.
+ */
+void pecan_reset_alloc_stats(void) {
+	mem_reset_stats();
+}
+
 /**
  * Reads an component archive and populates the archive structure.
  *
@@ -72,7 +229,8 @@ pecan_err_t pecan_read(pecan_archive_t *part, const char *fpath) {
 }
 
 /**
- * Writes an component archive from an archive structure.
+ * Writes an component archive from an archive structure with the default
+ * flags (PECAN_WRITE_DEFAULT).
  *
  * @param  part  Component archive structure to be saved to disk.
  * @param  fname Path to the component archive file to write to.
@@ -81,79 +239,126 @@ pecan_err_t pecan_read(pecan_archive_t *part, const char *fpath) {
  *               PECAN_ERR_FILE_IO if there were errors while trying to write.
  */
 pecan_err_t pecan_write(pecan_archive_t *part, const char *fname) {
-	size_t clen;
-	mtar_t tar;
-	char *contents = NULL;
-	pecan_err_t err = PECAN_OK;
-	int mterr = MTAR_ESUCCESS;
-
-	// Open archive for writing.
-	mterr = mtar_open(&tar, fname, "w");
-	HANDLE_MTAR_ERR(mterr);
+	return pecan_write_flags(part, fname, PECAN_WRITE_DEFAULT);
+}
 
-	// Write manifest to the archive.
-	clen = attr_get_file(part->attribs, &contents);
-	mtar_write_file_header(&tar, PECAN_MANIFEST_FILE, clen);
-	HANDLE_MTAR_ERR(mterr);
-	mtar_write_data(&tar, contents, clen);
-	HANDLE_MTAR_ERR(mterr);
-	free(contents);
-	contents = NULL;
+/**
+ * Writes an component archive from an archive structure.
+ *
+ * @param  part  Component archive structure to be saved to disk.
+ * @param  fname Path to the component archive file to write to.
+ * @param  flags PECAN_WRITE_ALIGN_BLOBS to have the contents of the image and
+ *               datasheet start on a PECAN_BLOB_ALIGN boundary inside the
+ *               archive, so that they can be mapped straight from it.
+ * @return       PECAN_OK if the operation was successful.
+ *               PECAN_ERR_PATH_NOT_FOUND if the specified path wasn't writable.
+ *               PECAN_ERR_FILE_IO if there were errors while trying to write.
+ */
+pecan_err_t pecan_write_flags(pecan_archive_t *part, const char *fname,
+							  unsigned int flags) {
+	pecan_writer_t w;
+	char *msg;
+	pecan_err_t err;
 
-	// Write parameters to the archive.
-	clen = attr_get_file(part->params, &contents);
-	mtar_write_file_header(&tar, PECAN_PARAM_FILE, clen);
-	HANDLE_MTAR_ERR(mterr);
-	mtar_write_data(&tar, contents, clen);
-	HANDLE_MTAR_ERR(mterr);
-	free(contents);
-	contents = NULL;
+	// Open archive for writing.
+	err = pecan_writer_open(&w, fname, flags);
+	if (err)
+		return err;
 
-	// Write component image to the archive.
-	if (part->image.len > 0) {
-		mtar_write_file_header(&tar, PECAN_IMAGE_FILE, part->image.len);
-		HANDLE_MTAR_ERR(mterr);
-		mtar_write_data(&tar, part->image.data, part->image.len);
-		HANDLE_MTAR_ERR(mterr);
+	// Write the manifest, parameters, image and datasheet to the archive.
+	err = pecan_writer_add_attrs(&w, PECAN_MANIFEST_FILE, part->attribs);
+	if (err == PECAN_OK)
+		err = pecan_writer_add_attrs(&w, PECAN_PARAM_FILE, part->params);
+	if ((err == PECAN_OK) && (part->image.len > 0)) {
+		err = pecan_writer_add_data(&w, PECAN_IMAGE_FILE, part->image.data,
+									part->image.len);
 	}
-
-	// Write component datasheet to the archive.
-	if (part->datasheet.len > 0) {
-		mtar_write_file_header(&tar, PECAN_DATASHEET_FILE, part->datasheet.len);
-		HANDLE_MTAR_ERR(mterr);
-		mtar_write_data(&tar, part->datasheet.data, part->datasheet.len);
-		HANDLE_MTAR_ERR(mterr);
+	if ((err == PECAN_OK) && (part->datasheet.len > 0)) {
+		err = pecan_writer_add_data(&w, PECAN_DATASHEET_FILE,
+									part->datasheet.data, part->datasheet.len);
 	}
 
 	// Finalize and close the archive.
-	mtar_finalize(&tar);
-cleanup:
-	mtar_close(&tar);
+	if (err == PECAN_OK)
+		return pecan_writer_close(&w);
+
+	// Don't let the cleanup get in the way of the original error.
+	msg = err_save();
+	pecan_writer_close(&w);
+	err_restore(msg);
 
-	free(contents);
 	return err;
 }
 
+/**
+ * Clears an archive so that it can be reused for reading another one, while
+ * holding on to its buffers, attribute vectors and arena so that subsequent
+ * reads don't have to allocate them again.
+ *
+ * @param part Component archive to be cleared.
+ */
+void pecan_reset(pecan_archive_t *part) {
+	// Free our path name.
+	mem_free(NULL, part->fname);
+	part->fname = NULL;
+
+	// Clear our attributes but keep the vectors around.
+	attr_arr_clear(&part->attribs, &part->attribs_refs);
+	attr_arr_clear(&part->params, &part->params_refs);
+
+	// Reclaim the attribute strings unless a clone still needs them.
+	if (part->arena) {
+		if (part->arena->refs > 1) {
+			arena_release(part->arena);
+			part->arena = NULL;
+		} else {
+			arena_reset(part->arena);
+		}
+	}
+
+	// Empty our blobs while keeping their buffers.
+	blob_reset(&part->image);
+	blob_reset(&part->datasheet);
+}
+
 /**
  * Frees up any resources allocated by the archive structure.
  *
  * @param part Component archive to have its contents free'd.
  */
 void pecan_free(pecan_archive_t *part) {
+	pecan_release(part);
+
+	// Clean up our error message stuff.
+	err_free();
+}
+
+/**
+ * Frees up any resources allocated by the archive structure without touching
+ * the error message, so it can be used while cleaning up after an error.
+ *
+ * @param part Component archive to have its contents free'd.
+ */
+void pecan_release(pecan_archive_t *part) {
 	// Free our path name.
-	free(part->fname);
+	mem_free(NULL, part->fname);
 	part->fname = NULL;
 
 	// Free up all of our attributes.
-	cvector_free_each_and_free(part->attribs, attr_free);
-	cvector_free_each_and_free(part->params, attr_free);
+	attr_arr_release(&part->attribs, &part->attribs_refs);
+	attr_arr_release(&part->params, &part->params_refs);
 
 	// Free up our blobs.
 	blob_free(&part->image);
 	blob_free(&part->datasheet);
 
-	// Clean up our error message stuff.
-	err_free();
+	// Free up our arena and read buffers.
+	arena_release(part->arena);
+	part->arena = NULL;
+	mem_free(part->alloc, part->buf);
+	part->buf = NULL;
+	part->buf_len = 0;
+	tarindex_free(&part->index);
 }
 
 /**
@@ -165,15 +370,10 @@ void pecan_free(pecan_archive_t *part) {
  */
 void pecan_add_attr(pecan_archive_t *part, pecan_attr_type_t type,
 					pecan_attr_t attr) {
+	pecan_attr_arr_t *attrs = attr_arr_writable(part, type);
+
 	// Push the attribute into the vector.
-	switch (type) {
-	case PECAN_MANIFEST:
-		cvector_push_back(part->attribs, attr);
-		break;
-	case PECAN_PARAMETERS:
-		cvector_push_back(part->params, attr);
-		break;
-	}
+	cvector_push_back(*attrs, attr);
 }
 
 /**
@@ -186,12 +386,54 @@ void pecan_add_attr(pecan_archive_t *part, pecan_attr_type_t type,
  */
 void pecan_add_attr_str(pecan_archive_t *part, pecan_attr_type_t type,
 						const char *name, const char *value) {
+	pecan_add_attr_strn(part, type, name, strlen(name), value, strlen(value));
+}
+
+/**
+ * Adds an attribute to the component from strings of known lengths without
+ * checking if it already exists. The strings don't need to be NULL terminated.
+ *
+ * @param part  Component archive structure.
+ * @param type  Type of attribute.
+ * @param name  Name of the attribute.
+ * @param nlen  Length of the name of the attribute.
+ * @param value Value of the attribute.
+ * @param vlen  Length of the value of the attribute.
+ */
+void pecan_add_attr_strn(pecan_archive_t *part, pecan_attr_type_t type,
+						 const char *name, size_t nlen, const char *value,
+						 size_t vlen) {
 	pecan_attr_t attr;
 
 	// Create and populate the attribute.
 	attr_init(&attr);
-	attr_set_name(&attr, name);
-	attr_set_value(&attr, value);
+	attr_set_name_n(&attr, name, nlen);
+	attr_set_value_n(&attr, value, vlen);
+
+	// Push the attribute into the vector.
+	pecan_add_attr(part, type, attr);
+}
+
+/**
+ * Adds an attribute to the component taking ownership of the name and value
+ * strings, without checking if it already exists.
+ * WARNING: Both strings must have been allocated with mem_alloc (plain malloc
+ *          unless a global allocator was set) and will be free'd by the
+ *          archive, so they must not be used by the caller afterwards.
+ *
+ * @param part  Component archive structure.
+ * @param type  Type of attribute.
+ * @param name  Allocated name of the attribute.
+ * @param value Allocated value of the attribute.
+ */
+void pecan_add_attr_take(pecan_archive_t *part, pecan_attr_type_t type,
+						 char *name, char *value) {
+	pecan_attr_t attr;
+
+	// Create and populate the attribute without copying anything.
+	attr_init(&attr);
+	attr_take_name(&attr, name);
+	attr_take_value(&attr, value);
 
 	// Push the attribute into the vector.
 	pecan_add_attr(part, type, attr);
@@ -208,17 +450,69 @@ void pecan_add_attr_str(pecan_archive_t *part, pecan_attr_type_t type,
  */
 void pecan_set_attr(pecan_archive_t *part, pecan_attr_type_t type,
 					const char *name, const char *value) {
-	// Try to get the attribute.
-	pecan_attr_t *attr = pecan_get_attr(part, type, name);
+	pecan_set_attr_strn(part, type, name, strlen(name), value, strlen(value));
+}
+
+/**
+ * Sets an attribute from the component by its name using strings of known
+ * lengths. If it doesn't exist yet it'll be created. The strings don't need to
+ * be NULL terminated.
+ *
+ * @param part  Component archive structure.
+ * @param type  Type of attribute.
+ * @param name  Name of the attribute to be set.
+ * @param nlen  Length of the name of the attribute.
+ * @param value Value of the attribute to be set to.
+ * @param vlen  Length of the value of the attribute.
+ */
+void pecan_set_attr_strn(pecan_archive_t *part, pecan_attr_type_t type,
+						 const char *name, size_t nlen, const char *value,
+						 size_t vlen) {
+	pecan_attr_t *attr;
+
+	// Try to get the attribute from attributes that we can change.
+	attr_arr_writable(part, type);
+	attr = pecan_get_attr_n(part, type, name, nlen);
 
 	// Should we create a new attribute?
 	if (!attr) {
-		pecan_add_attr_str(part, type, name, value);
+		pecan_add_attr_strn(part, type, name, nlen, value, vlen);
 		return;
 	}
 
 	// Set the value of an existing attribute.
-	attr_set_value(attr, value);
+	attr_set_value_n(attr, value, vlen);
+}
+
+/**
+ * Sets an attribute from the component by its name taking ownership of the
+ * name and value strings. If it doesn't exist yet it'll be created.
+ * WARNING: Both strings must have been allocated with mem_alloc (plain malloc
+ *          unless a global allocator was set) and will be free'd by the
+ *          archive, so they must not be used by the caller afterwards.
+ *
+ * @param part  Component archive structure.
+ * @param type  Type of attribute.
+ * @param name  Allocated name of the attribute to be set.
+ * @param value Allocated value of the attribute to be set to.
+ */
+void pecan_set_attr_take(pecan_archive_t *part, pecan_attr_type_t type,
+						 char *name, char *value) {
+	pecan_attr_t *attr;
+
+	// Try to get the attribute from attributes that we can change.
+	attr_arr_writable(part, type);
+	attr = pecan_get_attr(part, type, name);
+
+	// Should we create a new attribute?
+	if (!attr) {
+		pecan_add_attr_take(part, type, name, value);
+		return;
+	}
+
+	// Set the value of an existing attribute and get rid of the spare name.
+	attr_take_value(attr, value);
+	mem_free(NULL, name);
 }
 
 /**
@@ -231,6 +525,21 @@ void pecan_set_attr(pecan_archive_t *part, pecan_attr_type_t type,
  */
 pecan_attr_t *pecan_get_attr(pecan_archive_t *part, pecan_attr_type_t type,
 							 const char *name) {
+	return pecan_get_attr_n(part, type, name, strlen(name));
+}
+
+/**
+ * Gets an attribute from the component by a name of known length, which
+ * doesn't need to be NULL terminated.
+ *
+ * @param  part Component archive structure.
+ * @param  type Type of attribute.
+ * @param  name Name of the attribute to be found.
+ * @param  nlen Length of the name of the attribute.
+ * @return      Attribute found in the component or NULL if one wasn't found.
+ */
+pecan_attr_t *pecan_get_attr_n(pecan_archive_t *part, pecan_attr_type_t type,
+							   const char *name, size_t nlen) {
 	pecan_attr_t *attrs;
 	switch (type) {
 		case PECAN_MANIFEST:
@@ -239,6 +548,8 @@ pecan_attr_t *pecan_get_attr(pecan_archive_t *part, pecan_attr_type_t type,
 		case PECAN_PARAMETERS:
 			attrs = part->params;
 			break;
+		default:
+			return NULL;
 	}
 
 	// Check if we have anything in the attributes vector.
@@ -248,7 +559,7 @@ pecan_attr_t *pecan_get_attr(pecan_archive_t *part, pecan_attr_type_t type,
 		// Iterate over the attributes trying to find a matching attribute name.
 		for (it = cvector_begin(attrs); it != cvector_end(attrs); ++it) {
 			// Check if the names match.
-			if (strcmp(it->name, name) == 0)
+			if ((strncmp(it->name, name, nlen) == 0) && (it->name[nlen] == '\0'))
 				return it;
 		}
 	}
@@ -275,6 +586,8 @@ pecan_attr_t *pecan_get_attr_idx(pecan_archive_t *part, pecan_attr_type_t type,
 		case PECAN_PARAMETERS:
 			attrs = part->params;
 			break;
+		default:
+			return NULL;
 	}
 
 	// Check if the index is valid.
@@ -301,6 +614,8 @@ size_t pecan_get_attr_len(pecan_archive_t *part, pecan_attr_type_t type) {
 		case PECAN_PARAMETERS:
 			attrs = part->params;
 			break;
+		default:
+			return 0;
 	}
 
 	return cvector_size(attrs);
@@ -319,17 +634,24 @@ size_t pecan_get_attr_len(pecan_archive_t *part, pecan_attr_type_t type) {
 pecan_err_t pecan_read_packed(pecan_archive_t *part, const char *fname) {
 	mtar_t tar;
 	mtar_header_t header;
-	char *contents = NULL;
+	uint64_t hash;
+	char *contents;
 	pecan_err_t err = PECAN_OK;
 	int mterr = MTAR_ESUCCESS;
 
 	// Open archive for reading.
-	mtar_open(&tar, fname, "r");
+	mterr = mtar_open(&tar, fname, "r");
+	if (mterr) {
+		err_format_msg(EMSG("microtar error: %s"), mtar_strerror(mterr));
+		return PECAN_ERR_FILE_IO;
+	}
 
-	// TODO: Use mtar_next()
+	// Use the index to go straight to the members if the archive has one,
+	// reusing the buffer from the previous reads.
+	tarindex_read(&part->index, &tar);
 
 	// Get the manifest from the archive.
-	mterr = mtar_find(&tar, PECAN_MANIFEST_FILE, &header);
+	mterr = tar_find(&tar, &part->index, PECAN_MANIFEST_FILE, &header, NULL);
 	if (mterr != MTAR_ESUCCESS) {
 		err_set_msg(EMSG("Couldn't get the manifest file from the archive"));
 		err = PECAN_ERR_FILE_IO;
@@ -337,15 +659,21 @@ pecan_err_t pecan_read_packed(pecan_archive_t *part, const char *fname) {
 	}
 
 	// Parse the manifest.
-	contents = (char *)realloc(contents, header.size + 1);
-	mtar_read_data(&tar, contents, header.size);
+	contents = read_buf_reserve(part, header.size);
+	if (contents == NULL) {
+		err_set_msg(EMSG("Couldn't allocate the archive read buffer"));
+		err = PECAN_ERR_UNKNOWN;
+		goto cleanup;
+	}
+	mterr = mtar_read_data(&tar, contents, header.size);
 	HANDLE_MTAR_ERR(mterr);
+	contents[header.size] = '\0';
 	err = parse_attributes(part, PECAN_MANIFEST, contents);
 	if (err)
 		goto cleanup;
 
 	// Get the parameters from the archive.
-	mterr = mtar_find(&tar, PECAN_PARAM_FILE, &header);
+	mterr = tar_find(&tar, &part->index, PECAN_PARAM_FILE, &header, NULL);
 	if (mterr != MTAR_ESUCCESS) {
 		err_set_msg(EMSG("Couldn't get the parameters file from the archive"));
 		err = PECAN_ERR_FILE_IO;
@@ -353,31 +681,38 @@ pecan_err_t pecan_read_packed(pecan_archive_t *part, const char *fname) {
 	}
 
 	// Parse the parameters.
-	contents = (char *)realloc(contents, header.size + 1);
-	mtar_read_data(&tar, contents, header.size);
+	contents = read_buf_reserve(part, header.size);
+	if (contents == NULL) {
+		err_set_msg(EMSG("Couldn't allocate the archive read buffer"));
+		err = PECAN_ERR_UNKNOWN;
+		goto cleanup;
+	}
+	mterr = mtar_read_data(&tar, contents, header.size);
 	HANDLE_MTAR_ERR(mterr);
+	contents[header.size] = '\0';
 	err = parse_attributes(part, PECAN_PARAMETERS, contents);
 	if (err)
 		goto cleanup;
 
 	// Get the component image from the archive.
-	mterr = mtar_find(&tar, PECAN_IMAGE_FILE, &header);
+	mterr = tar_find(&tar, &part->index, PECAN_IMAGE_FILE, &header, &hash);
 	if (mterr == MTAR_ESUCCESS) {
 		mterr = blob_tar_read(&part->image, &tar, header);
 		HANDLE_MTAR_ERR(mterr);
+		blob_intern(part, &part->image, hash);
 	}
 
 	// Get the component datasheet from the archive.
-	mterr = mtar_find(&tar, PECAN_DATASHEET_FILE, &header);
+	mterr = tar_find(&tar, &part->index, PECAN_DATASHEET_FILE, &header, &hash);
 	if (mterr == MTAR_ESUCCESS) {
 		mterr = blob_tar_read(&part->datasheet, &tar, header);
 		HANDLE_MTAR_ERR(mterr);
+		blob_intern(part, &part->datasheet, hash);
 	}
 
 cleanup:
 	// Clean up our mess.
-	free(contents);
-	contents = NULL;
+	tarindex_clear(&part->index);
 	mtar_close(&tar);
 	return err;
 }
@@ -393,40 +728,36 @@ cleanup:
  */
 pecan_err_t pecan_read_unpacked(pecan_archive_t *part, const char *path) {
 	char *fpath;
-	char *contents;
+	size_t clen;
 	pecan_err_t err = PECAN_OK;
 
 	// Grab the contents of the manifest attributes file.
 	pathcat(2, &fpath, path, PECAN_MANIFEST_FILE);
-	contents = slurp_file(fpath);
-	free(fpath);
+	clen = slurp_file_buf(part->alloc, fpath, &part->buf, &part->buf_len);
+	mem_free(NULL, fpath);
 	fpath = NULL;
-	if (contents == NULL) {
+	if (clen == 0L) {
 		err_set_msg(EMSG("Couldn't slurp the contents of the manifest file"));
 		return PECAN_ERR_PATH_NOT_FOUND;
 	}
 	
 	// Parse the manifest attributes.
-	err = parse_attributes(part, PECAN_MANIFEST, contents);
-	free(contents);
-	contents = NULL;
+	err = parse_attributes(part, PECAN_MANIFEST, part->buf);
 	if (err)
 		return err;
 
 	// Grab the contents of the attributes file.
 	pathcat(2, &fpath, path, PECAN_PARAM_FILE);
-	contents = slurp_file(fpath);
-	free(fpath);
+	clen = slurp_file_buf(part->alloc, fpath, &part->buf, &part->buf_len);
+	mem_free(NULL, fpath);
 	fpath = NULL;
-	if (contents == NULL) {
+	if (clen == 0L) {
 		err_set_msg(EMSG("Couldn't slurp the contents of the parameters file"));
 		return PECAN_ERR_PATH_NOT_FOUND;
 	}
 
 	// Parse the attributes.
-	err = parse_attributes(part, PECAN_PARAMETERS, contents);
-	free(contents);
-	contents = NULL;
+	err = parse_attributes(part, PECAN_PARAMETERS, part->buf);
 
 	// Slurp the image file.
 	pathcat(2, &fpath, path, PECAN_IMAGE_FILE);
@@ -435,8 +766,11 @@ pecan_err_t pecan_read_unpacked(pecan_archive_t *part, const char *path) {
 			err_set_msg(EMSG("Couldn't slurp the contents of the image file"));
 			return PECAN_ERR_FILE_IO;
 		}
+
+		if (part->store)
+			blobstore_intern(part->store, &part->image);
 	}
-	free(fpath);
+	mem_free(NULL, fpath);
 	fpath = NULL;
 
 	// Slurp the datasheet file.
@@ -446,13 +780,509 @@ pecan_err_t pecan_read_unpacked(pecan_archive_t *part, const char *path) {
 			err_set_msg(EMSG("Couldn't slurp the contents of the datasheet file"));
 			return PECAN_ERR_FILE_IO;
 		}
+
+		if (part->store)
+			blobstore_intern(part->store, &part->datasheet);
 	}
-	free(fpath);
+	mem_free(NULL, fpath);
 	fpath = NULL;
 
 	return err;
 }
 
+/**
+ * Re-reads a single member file of a component archive (packed or unpacked),
+ * replacing whatever the archive structure held for it. Useful for picking up
+ * an edit to one file without parsing the whole archive again. Members that
+ * are optional and no longer exist will be emptied.
+ *
+ * @param  part   Component archive to be updated.
+ * @param  fpath  Path to the component archive (file or folder).
+ * @param  member Name of the member file (PECAN_MANIFEST_FILE and friends).
+ * @return        PECAN_OK if the operation was successful.
+ *                PECAN_ERR_PATH_NOT_FOUND if a required member wasn't found.
+ *                PECAN_ERR_FILE_IO if the archive was corrupted.
+ *                PECAN_ERR_PARSE if there were parsing errors.
+ */
+pecan_err_t pecan_read_member(pecan_archive_t *part, const char *fpath,
+							  const char *member) {
+	mtar_t tar;
+	mtar_header_t header;
+	pecan_blob_t *blob = NULL;
+	pecan_attr_type_t type = PECAN_MANIFEST;
+	uint64_t hash = 0;
+	char *path = NULL;
+	char *contents;
+	int packed;
+	int found;
+	pecan_err_t err = PECAN_OK;
+	int mterr = MTAR_ESUCCESS;
+
+	// Figure out what we are dealing with.
+	if (strcmp(member, PECAN_MANIFEST_FILE) == 0) {
+		type = PECAN_MANIFEST;
+	} else if (strcmp(member, PECAN_PARAM_FILE) == 0) {
+		type = PECAN_PARAMETERS;
+	} else if (strcmp(member, PECAN_IMAGE_FILE) == 0) {
+		blob = &part->image;
+	} else if (strcmp(member, PECAN_DATASHEET_FILE) == 0) {
+		blob = &part->datasheet;
+	} else {
+		// Not something that we care about.
+		return PECAN_OK;
+	}
+
+	// Locate the member.
+	packed = !is_dir(fpath);
+	if (packed) {
+		mterr = mtar_open(&tar, fpath, "r");
+		if (mterr) {
+			err_format_msg(EMSG("microtar error: %s"), mtar_strerror(mterr));
+			return PECAN_ERR_FILE_IO;
+		}
+		tarindex_read(&part->index, &tar);
+		found = tar_find(&tar, &part->index, member, &header,
+						 &hash) == MTAR_ESUCCESS;
+	} else {
+		pathcat(2, &path, fpath, member);
+		found = file_exists(path);
+	}
+
+	// Optional blobs that went away are simply emptied.
+	if (blob) {
+		blob_reset(blob);
+		if (!found)
+			goto cleanup;
+
+		if (packed) {
+			mterr = blob_tar_read(blob, &tar, header);
+			HANDLE_MTAR_ERR(mterr);
+		} else if (blob_slurp(blob, path) == 0L) {
+			err_format_msg(EMSG("Couldn't slurp the contents of '%s'"), path);
+			err = PECAN_ERR_FILE_IO;
+			goto cleanup;
+		}
+
+		blob_intern(part, blob, hash);
+		goto cleanup;
+	}
+
+	// Attribute files are required.
+	if (!found) {
+		err_format_msg(EMSG("Couldn't find '%s' in the archive"), member);
+		err = PECAN_ERR_PATH_NOT_FOUND;
+		goto cleanup;
+	}
+
+	// Read the attribute file.
+	if (packed) {
+		contents = read_buf_reserve(part, header.size);
+		if (contents == NULL) {
+			err_set_msg(EMSG("Couldn't allocate the archive read buffer"));
+			err = PECAN_ERR_UNKNOWN;
+			goto cleanup;
+		}
+		mterr = mtar_read_data(&tar, contents, header.size);
+		HANDLE_MTAR_ERR(mterr);
+		contents[header.size] = '\0';
+	} else {
+		if (slurp_file_buf(part->alloc, path, &part->buf,
+				&part->buf_len) == 0L) {
+			err_format_msg(EMSG("Couldn't slurp the contents of '%s'"), path);
+			err = PECAN_ERR_FILE_IO;
+			goto cleanup;
+		}
+		contents = part->buf;
+	}
+
+	// Replace the attributes with the new ones, without piling them up in an
+	// arena that older versions of the archive are still holding on to.
+	if (part->arena && (part->arena->refs > 1))
+		arena_unshare(part, type);
+	if (type == PECAN_PARAMETERS) {
+		attr_arr_clear(&part->params, &part->params_refs);
+	} else {
+		attr_arr_clear(&part->attribs, &part->attribs_refs);
+	}
+	err = parse_attributes(part, type, contents);
+
+cleanup:
+	// Clean up our mess.
+	if (packed)
+		mtar_close(&tar);
+	tarindex_clear(&part->index);
+	mem_free(NULL, path);
+
+	return err;
+}
+
+/**
+ * Writes the contents of a member file of a component archive (packed or
+ * unpacked) straight to a file descriptor. The data is handed over to the
+ * kernel directly from the archive file, so it never gets copied into a blob.
+ *
+ * @param  fpath  Path to the component archive (file or folder).
+ * @param  member Name of the member file (PECAN_DATASHEET_FILE and friends).
+ * @param  offset Offset of the first byte of the member to be sent.
+ * @param  len    Number of bytes to be sent or 0 to send until the end.
+ * @param  fd     File descriptor to write the contents to.
+ * @return        PECAN_OK if the operation was successful.
+ *                PECAN_ERR_PATH_NOT_FOUND if the member wasn't found.
+ *                PECAN_ERR_FILE_IO if the archive was corrupted, the range is
+ *                outside of the member or writing failed.
+ */
+pecan_err_t pecan_send_member(const char *fpath, const char *member,
+							  size_t offset, size_t len, int fd) {
+	mtar_t tar;
+	mtar_header_t header;
+	pecan_tarindex_t idx;
+	char *path = NULL;
+	size_t start;
+	size_t size;
+	pecan_err_t err = PECAN_OK;
+	int mterr = MTAR_ESUCCESS;
+
+	// Locate the member and where its contents start.
+	if (is_dir(fpath)) {
+		pathcat(2, &path, fpath, member);
+		if (!file_exists(path)) {
+			err_format_msg(EMSG("Couldn't find '%s' in the archive"), member);
+			err = PECAN_ERR_PATH_NOT_FOUND;
+			goto cleanup;
+		}
+
+		start = 0;
+		size = file_contents_size(path);
+	} else {
+		mterr = mtar_open(&tar, fpath, "r");
+		if (mterr) {
+			err_format_msg(EMSG("microtar error: %s"), mtar_strerror(mterr));
+			return PECAN_ERR_FILE_IO;
+		}
+
+		// Finding a member leaves us right at its header.
+		tarindex_init(&idx);
+		tarindex_read(&idx, &tar);
+		mterr = tar_find(&tar, &idx, member, &header, NULL);
+		tarindex_free(&idx);
+		mtar_close(&tar);
+		if (mterr == MTAR_ENOTFOUND) {
+			err_format_msg(EMSG("Couldn't find '%s' in the archive"), member);
+			return PECAN_ERR_PATH_NOT_FOUND;
+		} else if (mterr) {
+			err_format_msg(EMSG("microtar error: %s"), mtar_strerror(mterr));
+			return PECAN_ERR_FILE_IO;
+		}
+
+		path = mem_strndup(NULL, fpath, strlen(fpath));
+		start = tar.pos + TAR_BLOCK_SIZE;
+		size = header.size;
+	}
+
+	// Check the requested range.
+	if (offset > size) {
+		err_format_msg(EMSG("Offset %zu is past the end of '%s' (%zu bytes)"),
+					   offset, member, size);
+		err = PECAN_ERR_FILE_IO;
+		goto cleanup;
+	}
+	if ((len == 0) || (len > (size - offset)))
+		len = size - offset;
+
+	// Hand the contents over.
+	if (!file_send(path, start + offset, len, fd)) {
+		err_format_msg(EMSG("Couldn't send '%s' from '%s'"), member, fpath);
+		err = PECAN_ERR_FILE_IO;
+	}
+
+cleanup:
+	mem_free(NULL, path);
+	return err;
+}
+
+/**
+ * Extracts a packed component archive into a folder that can be read as an
+ * unpacked archive. Members are copied straight from the archive file by the
+ * kernel, sharing blocks with it where the filesystem supports reflinks, so
+ * their contents never get read into memory.
+ *
+ * @param  fname Path to the packed component archive.
+ * @param  dir   Folder to extract the archive into. Created if needed.
+ * @return       PECAN_OK if the operation was successful.
+ *               PECAN_ERR_PATH_NOT_FOUND if the folder couldn't be created.
+ *               PECAN_ERR_PARSE if a member would end up outside the folder.
+ *               PECAN_ERR_FILE_IO if the archive was corrupted or writing
+ *               failed.
+ */
+pecan_err_t pecan_extract(const char *fname, const char *dir) {
+	mtar_t tar;
+	mtar_header_t header;
+	char *path = NULL;
+	char *sep;
+	pecan_err_t err = PECAN_OK;
+	int mterr = MTAR_ESUCCESS;
+
+	// Open the archive and create the folder.
+	tar.stream = NULL;
+	if (is_dir(fname)) {
+		err_format_msg(EMSG("'%s' is already unpacked"), fname);
+		return PECAN_ERR_FILE_IO;
+	}
+	mterr = mtar_open(&tar, fname, "r");
+	HANDLE_MTAR_ERR(mterr);
+	if (!make_path(dir)) {
+		err_format_msg(EMSG("Couldn't create directory '%s'"), dir);
+		err = PECAN_ERR_PATH_NOT_FOUND;
+		goto cleanup;
+	}
+
+	// Go through every member of the archive.
+	while ((mterr = mtar_read_header(&tar, &header)) == MTAR_ESUCCESS) {
+		// Only files and folders are of interest to us.
+		if (((header.type != MTAR_TREG) && (header.type != '\0') &&
+				(header.type != MTAR_TDIR)) ||
+				(strcmp(header.name, PECAN_INDEX_FILE) == 0))
+			goto next;
+
+		// Make sure we aren't tricked into writing somewhere else.
+		if (!path_is_contained(header.name)) {
+			err_format_msg(EMSG("Archive member '%s' has an unsafe name"),
+						   header.name);
+			err = PECAN_ERR_PARSE;
+			goto cleanup;
+		}
+		pathcat(2, &path, dir, header.name);
+
+		// Create the folder it lives in.
+		if (header.type == MTAR_TDIR) {
+			sep = NULL;
+		} else {
+			sep = strrchr(path, '/');
+			if (sep)
+				*sep = '\0';
+		}
+		if ((header.type == MTAR_TDIR) || sep) {
+			if (!make_path(path)) {
+				err_format_msg(EMSG("Couldn't create directory '%s'"), path);
+				err = PECAN_ERR_PATH_NOT_FOUND;
+				goto cleanup;
+			}
+			if (sep)
+				*sep = '/';
+		}
+
+		// Copy its contents out.
+		if ((header.type != MTAR_TDIR) && !file_extract(fname,
+				tar.pos + TAR_BLOCK_SIZE, header.size, path)) {
+			err_format_msg(EMSG("Couldn't extract '%s' to '%s'"), header.name,
+						   path);
+			err = PECAN_ERR_FILE_IO;
+			goto cleanup;
+		}
+
+		mem_free(NULL, path);
+		path = NULL;
+next:
+		mterr = mtar_next(&tar);
+		HANDLE_MTAR_ERR(mterr);
+	}
+
+	// Only the end of the archive should stop us.
+	if (mterr != MTAR_ENULLRECORD)
+		HANDLE_MTAR_ERR(mterr);
+
+cleanup:
+	if (tar.stream)
+		mtar_close(&tar);
+	mem_free(NULL, path);
+
+	return err;
+}
+
+/**
+ * Gets an attributes array from an archive making sure that it isn't shared
+ * with any other archive, copying it if needed, so that it can be changed.
+ *
+ * @param  part Component archive structure.
+ * @param  type Type of attribute.
+ * @return      Pointer to the archive's own attributes array.
+ */
+static pecan_attr_arr_t *attr_arr_writable(pecan_archive_t *part,
+										   pecan_attr_type_t type) {
+	pecan_attr_arr_t *attrs;
+	size_t **refs;
+
+	// Get the array we are dealing with.
+	if (type == PECAN_PARAMETERS) {
+		attrs = &part->params;
+		refs = &part->params_refs;
+	} else {
+		attrs = &part->attribs;
+		refs = &part->attribs_refs;
+	}
+
+	// Are we sharing this array?
+	if (*refs == NULL)
+		return attrs;
+
+	// Copy the array if someone else is still holding on to it.
+	if (**refs > 1) {
+		(**refs)--;
+		*attrs = attr_arr_copy(*attrs);
+	} else {
+		mem_free(NULL, *refs);
+	}
+	*refs = NULL;
+
+	return attrs;
+}
+
+/**
+ * Releases an attributes array that may be shared with other archives, only
+ * freeing it if we were the last ones holding on to it.
+ *
+ * @param attribs Attributes array to be released.
+ * @param refs    Shared reference counter of the array.
+ */
+static void attr_arr_release(pecan_attr_arr_t *attribs, size_t **refs) {
+	// Is someone else still using it?
+	if (*refs) {
+		(**refs)--;
+		if (**refs > 0) {
+			*attribs = NULL;
+			*refs = NULL;
+			return;
+		}
+
+		mem_free(NULL, *refs);
+		*refs = NULL;
+	}
+
+	// We were the last ones so free everything.
+	cvector_free_each_and_free(*attribs, attr_free);
+	*attribs = NULL;
+}
+
+/**
+ * Clears an attributes array that may be shared with other archives while
+ * keeping its storage around if we are the only ones using it.
+ *
+ * @param attribs Attributes array to be cleared.
+ * @param refs    Shared reference counter of the array.
+ */
+static void attr_arr_clear(pecan_attr_arr_t *attribs, size_t **refs) {
+	pecan_attr_t *it;
+
+	// Let go of shared arrays instead of clearing them.
+	if (*refs) {
+		attr_arr_release(attribs, refs);
+		return;
+	}
+
+	// Free the attributes but keep the vector.
+	for (it = cvector_begin(*attribs); it != cvector_end(*attribs); ++it)
+		attr_free(*it);
+	cvector_clear(*attribs);
+}
+
+/**
+ * Lets go of an arena shared with other archives before one type of attributes
+ * is parsed again, so that the new strings end up in an arena of our own. The
+ * other type of attributes gets copied out of the shared arena.
+ *
+ * @param part Component archive structure.
+ * @param type Type of attribute that's about to be replaced.
+ */
+static void arena_unshare(pecan_archive_t *part, pecan_attr_type_t type) {
+	pecan_attr_arr_t copy;
+
+	// Copy the attributes that are staying.
+	if (type == PECAN_PARAMETERS) {
+		copy = attr_arr_copy(part->attribs);
+		attr_arr_release(&part->attribs, &part->attribs_refs);
+		part->attribs = copy;
+	} else {
+		copy = attr_arr_copy(part->params);
+		attr_arr_release(&part->params, &part->params_refs);
+		part->params = copy;
+	}
+
+	// A new arena will be created when parsing.
+	arena_release(part->arena);
+	part->arena = NULL;
+}
+
+/**
+ * Makes sure the archive's read buffer is able to hold a number of bytes plus
+ * a NULL terminator, reusing it whenever it's already large enough.
+ *
+ * @param  part Component archive structure.
+ * @param  size Number of bytes that will be read into the buffer.
+ * @return      Pointer to the buffer or NULL if we couldn't allocate it.
+ */
+static char *read_buf_reserve(pecan_archive_t *part, size_t size) {
+	char *buf;
+
+	// Do we already have enough space?
+	if ((part->buf != NULL) && (part->buf_len >= (size + 1)))
+		return part->buf;
+
+	// Grow the buffer.
+	buf = (char *)mem_realloc(part->alloc, part->buf,
+		(size + 1) * sizeof(char));
+	if (buf == NULL)
+		return NULL;
+	part->buf = buf;
+	part->buf_len = size + 1;
+
+	return buf;
+}
+
+/**
+ * Positions an archive at the header of a member, going straight to it if the
+ * archive has an index and walking through the headers otherwise.
+ *
+ * @param  tar    Opened TAR file object.
+ * @param  idx    Index of the archive, may be empty.
+ * @param  name   Name of the member.
+ * @param  header Structure to receive the member's header.
+ * @param  hash   Optional pointer to receive the hash of the contents or 0 if
+ *                it isn't known.
+ * @return        MTAR_ESUCCESS if the member was found, a microtar error
+ *                otherwise.
+ */
+static int tar_find(mtar_t *tar, pecan_tarindex_t *idx, const char *name,
+					mtar_header_t *header, uint64_t *hash) {
+	// Go straight to it.
+	if (tarindex_seek(idx, tar, name, header, hash))
+		return MTAR_ESUCCESS;
+
+	// Walk through the archive like in the old days.
+	if (hash)
+		*hash = 0;
+	return mtar_find(tar, name, header);
+}
+
+/**
+ * Deduplicates a blob that was just read against the archive's blob store, if
+ * it has one.
+ *
+ * @param part Component archive structure.
+ * @param blob Blob that was just read.
+ * @param hash Hash of the blob's contents from the index or 0 if unknown.
+ */
+static void blob_intern(pecan_archive_t *part, pecan_blob_t *blob,
+						uint64_t hash) {
+	if (part->store == NULL)
+		return;
+
+	if (hash) {
+		blobstore_intern_hash(part->store, blob, hash);
+	} else {
+		blobstore_intern(part->store, blob);
+	}
+}
+
 /**
  * Gets the last error message thrown by the library.
  * 
@@ -12,11 +12,15 @@
 extern "C" {
 #endif
 
+#include "alloc.h"
 #include <cvector.h>
 #include <microtar.h>
 
+#include "arena.h"
 #include "attribute.h"
 #include "blob.h"
+#include "blobstore.h"
+#include "tarindex.h"
 
 // Library export definition.
 #define PECAN_EXPORTS extern
@@ -26,6 +30,14 @@ extern "C" {
 #define PECAN_IMAGE_FILE     "image.bmp"
 #define PECAN_MANIFEST_FILE  "manifest.tsv"
 #define PECAN_PARAM_FILE     "parameters.tsv"
+#define PECAN_INDEX_FILE     ".pecan-index"
+
+// Archive writing flags.
+#define PECAN_WRITE_ALIGN_BLOBS 0x01
+#define PECAN_WRITE_DEFAULT     PECAN_WRITE_ALIGN_BLOBS
+
+// Alignment of blobs inside archives written with PECAN_WRITE_ALIGN_BLOBS.
+#define PECAN_BLOB_ALIGN 4096
 
 // Attributes switch enumeration.
 typedef enum {
@@ -51,10 +63,32 @@ typedef struct {
 	pecan_attr_arr_t params;
 	pecan_blob_t image;
 	pecan_blob_t datasheet;
+
+	pecan_blobstore_t *store;
+	size_t *attribs_refs;
+	size_t *params_refs;
+
+	pecan_arena_t *arena;
+	char *buf;
+	size_t buf_len;
+	pecan_tarindex_t index;
+
+	const pecan_allocator_t *alloc;
 } pecan_archive_t;
 
 // Initialization
 PECAN_EXPORTS pecan_err_t pecan_init(pecan_archive_t *part);
+PECAN_EXPORTS void pecan_set_blobstore(pecan_archive_t *part,
+									   pecan_blobstore_t *store);
+PECAN_EXPORTS pecan_err_t pecan_clone(pecan_archive_t *dest,
+									  pecan_archive_t *src);
+
+// Memory Allocation
+PECAN_EXPORTS void pecan_set_allocator(const pecan_allocator_t *alloc);
+PECAN_EXPORTS void pecan_set_archive_allocator(pecan_archive_t *part,
+											   const pecan_allocator_t *alloc);
+PECAN_EXPORTS void pecan_get_alloc_stats(pecan_alloc_stats_t *stats);
+PECAN_EXPORTS void pecan_reset_alloc_stats(void);
 
 // Generic Archive Read
 PECAN_EXPORTS pecan_err_t pecan_read(pecan_archive_t *part, const char *fpath);
@@ -64,7 +98,17 @@ PECAN_EXPORTS pecan_err_t pecan_read_packed(pecan_archive_t *part,
 											const char *fname);
 PECAN_EXPORTS pecan_err_t pecan_read_unpacked(pecan_archive_t *part,
 											  const char *path);
+PECAN_EXPORTS pecan_err_t pecan_read_member(pecan_archive_t *part,
+											const char *fpath,
+											const char *member);
+PECAN_EXPORTS pecan_err_t pecan_send_member(const char *fpath,
+											const char *member, size_t offset,
+											size_t len, int fd);
+PECAN_EXPORTS pecan_err_t pecan_extract(const char *fname, const char *dir);
 PECAN_EXPORTS pecan_err_t pecan_write(pecan_archive_t *part, const char *fname);
+PECAN_EXPORTS pecan_err_t pecan_write_flags(pecan_archive_t *part,
+											const char *fname,
+											unsigned int flags);
 
 // Attributes
 PECAN_EXPORTS void pecan_add_attr(pecan_archive_t *part, pecan_attr_type_t type,
@@ -72,11 +116,28 @@ PECAN_EXPORTS void pecan_add_attr(pecan_archive_t *part, pecan_attr_type_t type,
 PECAN_EXPORTS void pecan_add_attr_str(pecan_archive_t *part,
 									  pecan_attr_type_t type, const char *name,
 									  const char *value);
+PECAN_EXPORTS void pecan_add_attr_strn(pecan_archive_t *part,
+									   pecan_attr_type_t type, const char *name,
+									   size_t nlen, const char *value,
+									   size_t vlen);
+PECAN_EXPORTS void pecan_add_attr_take(pecan_archive_t *part,
+									   pecan_attr_type_t type, char *name,
+									   char *value);
 PECAN_EXPORTS void pecan_set_attr(pecan_archive_t *part, pecan_attr_type_t type,
 								  const char *name, const char *value);
+PECAN_EXPORTS void pecan_set_attr_strn(pecan_archive_t *part,
+									   pecan_attr_type_t type, const char *name,
+									   size_t nlen, const char *value,
+									   size_t vlen);
+PECAN_EXPORTS void pecan_set_attr_take(pecan_archive_t *part,
+									   pecan_attr_type_t type, char *name,
+									   char *value);
 PECAN_EXPORTS pecan_attr_t *pecan_get_attr(pecan_archive_t *part,
 										   pecan_attr_type_t type,
 										   const char *name);
+PECAN_EXPORTS pecan_attr_t *pecan_get_attr_n(pecan_archive_t *part,
+											 pecan_attr_type_t type,
+											 const char *name, size_t nlen);
 PECAN_EXPORTS pecan_attr_t *pecan_get_attr_idx(pecan_archive_t *part,
 											   pecan_attr_type_t type,
 											   size_t index);
@@ -84,7 +145,9 @@ PECAN_EXPORTS size_t pecan_get_attr_len(pecan_archive_t *part,
 										pecan_attr_type_t type);
 
 // Clean up
+PECAN_EXPORTS void pecan_reset(pecan_archive_t *part);
 PECAN_EXPORTS void pecan_free(pecan_archive_t *part);
+void pecan_release(pecan_archive_t *part);
 
 // Error Handling
 PECAN_EXPORTS const char *pecan_err_msg(void);
@@ -0,0 +1,401 @@
+/**
+ * pool.c
+ * Work-stealing thread pool used to spread catalog operations across cores.
+ *
+ * Every worker owns a deque of tasks. Tasks submitted from inside a worker go
+ * into the bottom of its own deque and are popped from there (LIFO, which
+ * keeps subtasks hot in the cache), while idle workers steal from the top of
+ * other deques (FIFO, which grabs the oldest and usually largest pieces of
+ * work). Tasks submitted from outside the pool go into an extra shared deque.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "pool.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#include "alloc.h"
+#include "error.h"
+
+// Initial capacity of the task deques.
+#define DEQUE_INITIAL_CAP 64
+
+// Atomic counter helpers.
+#define ATOMIC_INC(x) __atomic_add_fetch(&(x), 1, __ATOMIC_ACQ_REL)
+#define ATOMIC_DEC(x) __atomic_sub_fetch(&(x), 1, __ATOMIC_ACQ_REL)
+#define ATOMIC_GET(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+
+// Worker thread context.
+typedef struct {
+	pecan_pool_t *pool;
+	size_t idx;
+} worker_ctx_t;
+
+// Private variables.
+static THREAD_LOCAL pecan_pool_t *self_pool = NULL;
+static THREAD_LOCAL size_t self_idx = 0;
+
+// Private methods.
+static void *worker_main(void *arg);
+static int pool_run_one(pecan_pool_t *pool, size_t idx);
+static int deque_push(pecan_deque_t *dq, pecan_task_t task);
+static int deque_pop(pecan_deque_t *dq, pecan_task_t *task);
+static int deque_steal(pecan_deque_t *dq, pecan_task_t *task);
+
+/**
+ * Creates a new thread pool and starts its workers.
+ * WARNING: This function allocates the pool, so you're responsible for
+ *          freeing it with pool_free.
+ *
+ * @param  nthreads Number of worker threads or 0 to use one per online CPU.
+ * @return          Newly created pool or NULL if something went wrong.
+ */
+pecan_pool_t *pool_new(size_t nthreads) {
+	pecan_pool_t *pool;
+	size_t i;
+
+	// Figure out how many workers we should have.
+	nthreads = pool_threads(nthreads);
+
+	// Allocate the pool structure.
+	pool = (pecan_pool_t *)mem_calloc(NULL, 1, sizeof(pecan_pool_t));
+	if (pool == NULL)
+		return NULL;
+	pool->nthreads = nthreads;
+	mutex_init(&pool->lock);
+	cond_init(&pool->cond);
+
+	// Create a deque for each worker plus one for outside submissions.
+	pool->deques = (pecan_deque_t *)mem_calloc(NULL, nthreads + 1,
+											   sizeof(pecan_deque_t));
+	pool->threads = (pthread_t *)mem_calloc(NULL, nthreads, sizeof(pthread_t));
+	if ((pool->deques == NULL) || (pool->threads == NULL)) {
+		mem_free(NULL, pool->deques);
+		mem_free(NULL, pool->threads);
+		mem_free(NULL, pool);
+		return NULL;
+	}
+	for (i = 0; i <= nthreads; i++)
+		mutex_init(&pool->deques[i].lock);
+
+	// Start up the workers.
+	for (i = 0; i < nthreads; i++) {
+		worker_ctx_t *ctx = (worker_ctx_t *)mem_alloc(NULL,
+													  sizeof(worker_ctx_t));
+		if (ctx == NULL) {
+			pool->nthreads = i;
+			break;
+		}
+		ctx->pool = pool;
+		ctx->idx = i;
+
+		if (pthread_create(&pool->threads[i], NULL, worker_main, ctx) != 0) {
+			mem_free(NULL, ctx);
+			pool->nthreads = i;
+			break;
+		}
+	}
+
+	// Make sure we have at least one worker.
+	if (pool->nthreads == 0) {
+		pool_free(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+/**
+ * Gets the number of worker threads a pool created with a given number of
+ * threads should have.
+ *
+ * @param  nthreads Number of worker threads or 0 to use one per online CPU.
+ * @return          Actual number of worker threads.
+ */
+size_t pool_threads(size_t nthreads) {
+	long ncpus;
+
+	if (nthreads > 0)
+		return nthreads;
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return (ncpus > 0) ? (size_t)ncpus : 1;
+}
+
+/**
+ * Gets the number of worker threads in the pool.
+ *
+ * @param  pool Thread pool.
+ * @return      Number of workers.
+ */
+size_t pool_size(pecan_pool_t *pool) {
+	return pool->nthreads;
+}
+
+/**
+ * Initializes a task group.
+ *
+ * @param group Task group to be initialized.
+ */
+void pool_group_init(pecan_taskgroup_t *group) {
+	group->pending = 0;
+}
+
+/**
+ * Submits a task to be executed by the pool. When called from inside a task
+ * it'll go to the current worker's own deque, where other workers may steal
+ * it if they run out of work.
+ *
+ * @param  pool  Thread pool.
+ * @param  group Task group that the task belongs to.
+ * @param  fn    Function to be executed.
+ * @param  arg   Argument to be passed to the function.
+ * @return       0 if the operation was successful.
+ */
+int pool_submit(pecan_pool_t *pool, pecan_taskgroup_t *group, pecan_task_fn fn,
+				void *arg) {
+	pecan_task_t task;
+	size_t idx;
+
+	// Build up the task.
+	task.fn = fn;
+	task.arg = arg;
+	task.group = group;
+
+	// Push it into the right deque and wake up anyone waiting for work.
+	idx = (self_pool == pool) ? self_idx : pool->nthreads;
+	ATOMIC_INC(group->pending);
+	mutex_lock(&pool->lock);
+	if (deque_push(&pool->deques[idx], task) != 0) {
+		mutex_unlock(&pool->lock);
+		ATOMIC_DEC(group->pending);
+		return -1;
+	}
+	pool->queued++;
+	cond_broadcast(&pool->cond);
+	mutex_unlock(&pool->lock);
+
+	return 0;
+}
+
+/**
+ * Waits for every task in a group to finish. The calling thread will help out
+ * by running queued tasks while it waits, so this can safely be called from
+ * inside a task to wait for its subtasks.
+ *
+ * @param pool  Thread pool.
+ * @param group Task group to wait for.
+ */
+void pool_wait(pecan_pool_t *pool, pecan_taskgroup_t *group) {
+	size_t idx = (self_pool == pool) ? self_idx : pool->nthreads;
+
+	while (ATOMIC_GET(group->pending) > 0) {
+		// Help out with whatever is queued.
+		if (pool_run_one(pool, idx))
+			continue;
+
+		// Sleep until there's either more work or our group is done.
+		mutex_lock(&pool->lock);
+		while ((pool->queued == 0) && (ATOMIC_GET(group->pending) > 0))
+			cond_wait(&pool->cond, &pool->lock);
+		mutex_unlock(&pool->lock);
+	}
+}
+
+/**
+ * Stops all of the workers and frees up the pool. Tasks that are still queued
+ * will be finished before it returns.
+ *
+ * @param pool Thread pool to be free'd.
+ */
+void pool_free(pecan_pool_t *pool) {
+	size_t i;
+
+	if (pool == NULL)
+		return;
+
+	// Tell the workers to stop.
+	mutex_lock(&pool->lock);
+	pool->stop = 1;
+	cond_broadcast(&pool->cond);
+	mutex_unlock(&pool->lock);
+
+	// Wait for them to finish.
+	for (i = 0; i < pool->nthreads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	// Free up the deques.
+	for (i = 0; i <= pool->nthreads; i++) {
+		mem_free(NULL, pool->deques[i].tasks);
+		mutex_destroy(&pool->deques[i].lock);
+	}
+
+	// Free up the pool.
+	cond_destroy(&pool->cond);
+	mutex_destroy(&pool->lock);
+	mem_free(NULL, pool->deques);
+	mem_free(NULL, pool->threads);
+	mem_free(NULL, pool);
+}
+
+/**
+ * Worker thread main loop.
+ *
+ * @param  arg Worker context.
+ * @return     Always NULL.
+ */
+static void *worker_main(void *arg) {
+	worker_ctx_t *ctx = (worker_ctx_t *)arg;
+	pecan_pool_t *pool = ctx->pool;
+	size_t idx = ctx->idx;
+
+	// Let the scheduling functions know who we are.
+	mem_free(NULL, ctx);
+	self_pool = pool;
+	self_idx = idx;
+
+	for (;;) {
+		// Run tasks for as long as we can find them.
+		if (pool_run_one(pool, idx))
+			continue;
+
+		// Sleep until there's more work to be done.
+		mutex_lock(&pool->lock);
+		while ((pool->queued == 0) && !pool->stop)
+			cond_wait(&pool->cond, &pool->lock);
+		if ((pool->queued == 0) && pool->stop) {
+			mutex_unlock(&pool->lock);
+			break;
+		}
+		mutex_unlock(&pool->lock);
+	}
+
+	// Release any error message that our tasks left behind.
+	err_free();
+
+	return NULL;
+}
+
+/**
+ * Runs a single task, either from our own deque or stolen from someone else.
+ *
+ * @param  pool Thread pool.
+ * @param  idx  Index of the deque owned by the calling thread.
+ * @return      Non-zero if a task was run.
+ */
+static int pool_run_one(pecan_pool_t *pool, size_t idx) {
+	pecan_task_t task;
+	size_t ndeques = pool->nthreads + 1;
+	size_t i;
+	int found;
+
+	// Try our own deque first, then steal from everyone else.
+	found = deque_pop(&pool->deques[idx], &task);
+	for (i = 1; !found && (i < ndeques); i++)
+		found = deque_steal(&pool->deques[(idx + i) % ndeques], &task);
+	if (!found)
+		return 0;
+
+	// Account for the task leaving the queues.
+	mutex_lock(&pool->lock);
+	pool->queued--;
+	mutex_unlock(&pool->lock);
+
+	// Run the task and let its group know once it's done.
+	task.fn(task.arg);
+	if (ATOMIC_DEC(task.group->pending) == 0) {
+		mutex_lock(&pool->lock);
+		cond_broadcast(&pool->cond);
+		mutex_unlock(&pool->lock);
+	}
+
+	return 1;
+}
+
+/**
+ * Pushes a task into the bottom of a deque.
+ *
+ * @param  dq   Deque to push the task into.
+ * @param  task Task to be pushed.
+ * @return      0 if the operation was successful.
+ */
+static int deque_push(pecan_deque_t *dq, pecan_task_t task) {
+	mutex_lock(&dq->lock);
+
+	// Grow the ring buffer if needed.
+	if (dq->count == dq->cap) {
+		size_t cap = (dq->cap) ? dq->cap * 2 : DEQUE_INITIAL_CAP;
+		pecan_task_t *tasks;
+		size_t i;
+
+		tasks = (pecan_task_t *)mem_alloc(NULL, cap * sizeof(pecan_task_t));
+		if (tasks == NULL) {
+			mutex_unlock(&dq->lock);
+			return -1;
+		}
+
+		// Unwrap the old ring into the new one.
+		for (i = 0; i < dq->count; i++)
+			tasks[i] = dq->tasks[(dq->head + i) % dq->cap];
+		mem_free(NULL, dq->tasks);
+		dq->tasks = tasks;
+		dq->cap = cap;
+		dq->head = 0;
+	}
+
+	// Append the task to the bottom.
+	dq->tasks[(dq->head + dq->count) % dq->cap] = task;
+	ATOMIC_INC(dq->count);
+
+	mutex_unlock(&dq->lock);
+	return 0;
+}
+
+/**
+ * Pops the most recently pushed task from the bottom of a deque.
+ *
+ * @param  dq   Deque to pop the task from.
+ * @param  task Pointer to store the task.
+ * @return      Non-zero if a task was popped.
+ */
+static int deque_pop(pecan_deque_t *dq, pecan_task_t *task) {
+	int found = 0;
+
+	mutex_lock(&dq->lock);
+	if (dq->count > 0) {
+		ATOMIC_DEC(dq->count);
+		*task = dq->tasks[(dq->head + dq->count) % dq->cap];
+		found = 1;
+	}
+	mutex_unlock(&dq->lock);
+
+	return found;
+}
+
+/**
+ * Steals the oldest task from the top of a deque.
+ *
+ * @param  dq   Deque to steal the task from.
+ * @param  task Pointer to store the task.
+ * @return      Non-zero if a task was stolen.
+ */
+static int deque_steal(pecan_deque_t *dq, pecan_task_t *task) {
+	int found = 0;
+
+	// Avoid taking the lock of deques that are obviously empty.
+	if (ATOMIC_GET(dq->count) == 0)
+		return 0;
+
+	mutex_lock(&dq->lock);
+	if (dq->count > 0) {
+		*task = dq->tasks[dq->head];
+		dq->head = (dq->head + 1) % dq->cap;
+		ATOMIC_DEC(dq->count);
+		found = 1;
+	}
+	mutex_unlock(&dq->lock);
+
+	return found;
+}
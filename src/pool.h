@@ -0,0 +1,74 @@
+/**
+ * pool.h
+ * Work-stealing thread pool used to spread catalog operations across cores.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _POOL_H
+#define _POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdlib.h>
+
+#include "thread.h"
+
+// Task function type definition.
+typedef void (*pecan_task_fn)(void *arg);
+
+// Group of tasks that can be waited upon.
+typedef struct {
+	size_t pending;
+} pecan_taskgroup_t;
+
+// Task structure definition.
+typedef struct {
+	pecan_task_fn fn;
+	void *arg;
+	pecan_taskgroup_t *group;
+} pecan_task_t;
+
+// Double-ended task queue owned by each worker.
+typedef struct {
+	pecan_task_t *tasks;
+	size_t head;
+	size_t count;
+	size_t cap;
+
+	pecan_mutex_t lock;
+} pecan_deque_t;
+
+// Thread pool structure definition.
+typedef struct pecan_pool_s {
+	pthread_t *threads;
+	size_t nthreads;
+	pecan_deque_t *deques;
+
+	pecan_mutex_t lock;
+	pecan_cond_t cond;
+	size_t queued;
+	int stop;
+} pecan_pool_t;
+
+// Initialization
+pecan_pool_t *pool_new(size_t nthreads);
+size_t pool_threads(size_t nthreads);
+size_t pool_size(pecan_pool_t *pool);
+void pool_group_init(pecan_taskgroup_t *group);
+
+// Scheduling
+int pool_submit(pecan_pool_t *pool, pecan_taskgroup_t *group, pecan_task_fn fn,
+				void *arg);
+void pool_wait(pecan_pool_t *pool, pecan_taskgroup_t *group);
+
+// Cleanup
+void pool_free(pecan_pool_t *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _POOL_H */
@@ -0,0 +1,600 @@
+/**
+ * search.c
+ * Full-text search over the descriptions and parameters of a catalog.
+ *
+ * The index is a sorted dictionary of terms, each pointing to its postings
+ * list inside a single buffer. Postings are pairs of variable length integers
+ * holding the distance to the previous archive that has the term and the
+ * number of times the term shows up in it. Queries are ranked with BM25.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "search.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "error.h"
+
+// BM25 parameters.
+#define SEARCH_K1 1.2f
+#define SEARCH_B  0.75f
+
+// Largest number of distinct terms in a query.
+#define SEARCH_MAX_QUERY_TERMS 32
+
+// Initial number of slots in the term table used while building.
+#define SEARCH_INITIAL_SLOTS 4096
+
+// Term being built.
+typedef struct {
+	const char *term;
+	uint64_t hash;
+	uint32_t df;
+	uint32_t tf;
+	size_t last_doc;
+	size_t seen;
+
+	unsigned char *buf;
+	size_t len;
+	size_t cap;
+} build_term_t;
+
+// State of the index while it's being built.
+typedef struct {
+	build_term_t *terms;
+	size_t nterms;
+	size_t cap;
+
+	uint32_t *slots;
+	size_t nslots;
+
+	cvector_vector_type(uint32_t) doc_terms;
+	pecan_arena_t *arena;
+} build_t;
+
+// Private methods.
+static size_t search_token(const char **str, char *tok);
+static int search_add_text(build_t *b, size_t doc, const char *text,
+						   uint32_t *len);
+static build_term_t *build_term(build_t *b, const char *tok, size_t len);
+static int build_rehash(build_t *b);
+static int put_varint(build_term_t *t, size_t val);
+static size_t get_varint(const unsigned char **p, const unsigned char *end);
+static int search_term_cmp(const void *a, const void *b);
+static size_t search_lower_bound(pecan_search_t *idx, const char *tok,
+								 size_t len);
+static void hits_push(pecan_search_hit_t *hits, size_t k, size_t *n,
+					  size_t index, float score);
+static int hit_cmp(const void *a, const void *b);
+
+/**
+ * Initializes an empty search index.
+ *
+ * @param idx Search index to be initialized.
+ */
+void pecan_search_init(pecan_search_t *idx) {
+	memset(idx, 0, sizeof(pecan_search_t));
+}
+
+/**
+ * Builds the search index of a loaded catalog. Each archive gets indexed with
+ * its description along with the names and values of all of its parameters.
+ * Archives that failed to load are kept around without any terms, so that hits
+ * can be mapped straight back to catalog indexes.
+ *
+ * @param  idx Empty search index.
+ * @param  cat Loaded catalog to be indexed. The index doesn't reference it.
+ * @return     PECAN_OK if the operation was successful.
+ */
+pecan_err_t pecan_search_build(pecan_search_t *idx, pecan_catalog_t *cat) {
+	pecan_search_term_t *term;
+	pecan_err_t err;
+	build_t b;
+	uint32_t *lens = NULL;
+	uint64_t total;
+	float avg;
+	size_t doc;
+	size_t i;
+	size_t j;
+
+	// Set everything up.
+	err = PECAN_OK;
+	memset(&b, 0, sizeof(build_t));
+	pecan_search_free(idx);
+	idx->ndocs = pecan_catalog_len(cat);
+	idx->arena = arena_new(NULL);
+	lens = (uint32_t *)mem_calloc(NULL, idx->ndocs + 1, sizeof(uint32_t));
+	idx->norms = (float *)mem_calloc(NULL, idx->ndocs + 1, sizeof(float));
+	if ((idx->arena == NULL) || (lens == NULL) || (idx->norms == NULL))
+		goto nomem;
+	b.arena = idx->arena;
+
+	// Tokenize every archive.
+	total = 0;
+	for (doc = 0; doc < idx->ndocs; doc++) {
+		pecan_catalog_entry_t *entry = pecan_catalog_get(cat, doc);
+		pecan_archive_t *part = &entry->part;
+		pecan_attr_t *attr;
+
+		if (entry->err)
+			continue;
+
+		// Description and parameters.
+		cvector_clear(b.doc_terms);
+		attr = pecan_get_attr(part, PECAN_MANIFEST, PECAN_SEARCH_FIELD);
+		if (attr && !search_add_text(&b, doc, attr->value, &lens[doc]))
+			goto nomem;
+		for (i = 0; i < cvector_size(part->params); i++) {
+			if (!search_add_text(&b, doc, part->params[i].name, &lens[doc]) ||
+					!search_add_text(&b, doc, part->params[i].value,
+									 &lens[doc]))
+				goto nomem;
+		}
+		total += lens[doc];
+
+		// Append the archive to the postings of each of its terms.
+		for (i = 0; i < cvector_size(b.doc_terms); i++) {
+			build_term_t *t = &b.terms[b.doc_terms[i]];
+
+			if (!put_varint(t, doc - t->last_doc) || !put_varint(t, t->tf))
+				goto nomem;
+			t->last_doc = doc;
+			t->df++;
+		}
+	}
+
+	// Precompute the length normalization of BM25.
+	avg = (idx->ndocs > 0) ? (float)total / (float)idx->ndocs : 0;
+	for (doc = 0; doc < idx->ndocs; doc++) {
+		idx->norms[doc] = SEARCH_K1 * ((1.0f - SEARCH_B) +
+			((avg > 0) ? SEARCH_B * ((float)lens[doc] / avg) : 0));
+	}
+
+	// Pack the postings into a single buffer.
+	idx->terms = (pecan_search_term_t *)mem_calloc(NULL, b.nterms + 1,
+		sizeof(pecan_search_term_t));
+	if (idx->terms == NULL)
+		goto nomem;
+	for (i = 0; i < b.nterms; i++)
+		idx->postings_len += b.terms[i].len;
+	idx->postings = (unsigned char *)mem_alloc(NULL, idx->postings_len + 1);
+	if (idx->postings == NULL)
+		goto nomem;
+	for (i = 0, j = 0; i < b.nterms; i++) {
+		term = &idx->terms[i];
+		term->term = b.terms[i].term;
+		term->df = b.terms[i].df;
+		term->len = (uint32_t)b.terms[i].len;
+		term->off = j;
+		memcpy(idx->postings + j, b.terms[i].buf, b.terms[i].len);
+		j += b.terms[i].len;
+	}
+	idx->nterms = b.nterms;
+
+	// Sort the dictionary so that it can be searched by prefix.
+	qsort(idx->terms, idx->nterms, sizeof(pecan_search_term_t),
+		  search_term_cmp);
+
+cleanup:
+	for (i = 0; i < b.nterms; i++)
+		mem_free(NULL, b.terms[i].buf);
+	mem_free(NULL, b.terms);
+	mem_free(NULL, b.slots);
+	cvector_free(b.doc_terms);
+	mem_free(NULL, lens);
+
+	return err;
+
+nomem:
+	pecan_search_free(idx);
+	err = PECAN_ERR_UNKNOWN;
+	err_set_msg(EMSG("Couldn't allocate memory to build the search index"));
+	goto cleanup;
+}
+
+/**
+ * Searches the index for the archives that best match a free text query. Any
+ * of the query terms may match and the archives are ranked with BM25.
+ *
+ * @param  idx   Search index.
+ * @param  query Free text query.
+ * @param  flags PECAN_SEARCH_PREFIX to also match terms that start with the
+ *               last word of the query, for searching as the user types.
+ * @param  hits  Array to receive the best hits, best first.
+ * @param  k     Number of hits that fit in the array.
+ * @param  nhits Returns the number of hits in the array.
+ * @return       PECAN_OK if the operation was successful.
+ */
+pecan_err_t pecan_search_query(pecan_search_t *idx, const char *query,
+							   unsigned int flags, pecan_search_hit_t *hits,
+							   size_t k, size_t *nhits) {
+	char words[SEARCH_MAX_QUERY_TERMS][PECAN_SEARCH_MAX_TOKEN + 1];
+	size_t lens[SEARCH_MAX_QUERY_TERMS];
+	size_t nwords;
+	size_t len;
+	float *scores;
+	size_t w;
+	size_t i;
+
+	*nhits = 0;
+	if ((k == 0) || (idx->nterms == 0))
+		return PECAN_OK;
+
+	// Split the query into distinct words.
+	nwords = 0;
+	while ((nwords < SEARCH_MAX_QUERY_TERMS) &&
+			((len = search_token(&query, words[nwords])) > 0)) {
+		for (w = 0; w < nwords; w++) {
+			if ((lens[w] == len) && (memcmp(words[w], words[nwords], len) == 0))
+				break;
+		}
+		if (w == nwords)
+			lens[nwords++] = len;
+	}
+	if (nwords == 0)
+		return PECAN_OK;
+
+	// Accumulate the score of every archive.
+	scores = (float *)mem_calloc(NULL, idx->ndocs + 1, sizeof(float));
+	if (scores == NULL) {
+		err_set_msg(EMSG("Couldn't allocate memory for the search scores"));
+		return PECAN_ERR_UNKNOWN;
+	}
+	for (w = 0; w < nwords; w++) {
+		int prefix = (flags & PECAN_SEARCH_PREFIX) && (w == (nwords - 1));
+
+		// Go through every term this word matches.
+		for (i = search_lower_bound(idx, words[w], lens[w]);
+				i < idx->nterms; i++) {
+			pecan_search_term_t *term = &idx->terms[i];
+			const unsigned char *p;
+			const unsigned char *end;
+			size_t doc;
+			float idf;
+
+			if (strncmp(term->term, words[w], lens[w]) != 0)
+				break;
+			if (!prefix && (term->term[lens[w]] != '\0'))
+				break;
+
+			// Score every archive in its postings.
+			idf = (float)log(1.0 + (((double)idx->ndocs - term->df + 0.5) /
+				((double)term->df + 0.5)));
+			p = idx->postings + term->off;
+			end = p + term->len;
+			doc = 0;
+			while (p < end) {
+				float tf;
+
+				doc += get_varint(&p, end);
+				tf = (float)get_varint(&p, end);
+				if (doc < idx->ndocs) {
+					scores[doc] += idf * ((tf * (SEARCH_K1 + 1.0f)) /
+						(tf + idx->norms[doc]));
+				}
+			}
+		}
+	}
+
+	// Keep the best ones.
+	for (i = 0; i < idx->ndocs; i++) {
+		if (scores[i] > 0)
+			hits_push(hits, k, nhits, i, scores[i]);
+	}
+	qsort(hits, *nhits, sizeof(pecan_search_hit_t), hit_cmp);
+
+	mem_free(NULL, scores);
+	return PECAN_OK;
+}
+
+/**
+ * Frees up everything held by a search index.
+ *
+ * @param idx Search index to be free'd.
+ */
+void pecan_search_free(pecan_search_t *idx) {
+	mem_free(NULL, idx->terms);
+	mem_free(NULL, idx->postings);
+	mem_free(NULL, idx->norms);
+	if (idx->arena)
+		arena_release(idx->arena);
+
+	memset(idx, 0, sizeof(pecan_search_t));
+}
+
+/**
+ * Gets the next token out of a string. Tokens are runs of letters and digits,
+ * which includes anything outside of ASCII, and are folded to lowercase.
+ *
+ * @param  str Pointer to the string, which is moved past the token.
+ * @param  tok Buffer with room for PECAN_SEARCH_MAX_TOKEN characters and a
+ *             terminator.
+ * @return     Length of the token or 0 if the string ended.
+ */
+static size_t search_token(const char **str, char *tok) {
+	const unsigned char *p = (const unsigned char *)*str;
+	size_t len = 0;
+
+	// Skip anything that isn't part of a token.
+	while ((*p != '\0') && !((*p >= 0x80) || ((*p >= '0') && (*p <= '9')) ||
+			((*p | 0x20) >= 'a' && (*p | 0x20) <= 'z')))
+		p++;
+
+	// Copy the token over.
+	while ((*p >= 0x80) || ((*p >= '0') && (*p <= '9')) ||
+			(((*p | 0x20) >= 'a') && ((*p | 0x20) <= 'z'))) {
+		if (len < PECAN_SEARCH_MAX_TOKEN)
+			tok[len++] = (*p < 0x80) ? (char)(*p | ((*p >= 'A') ? 0x20 : 0)) :
+				(char)*p;
+		p++;
+	}
+	tok[len] = '\0';
+
+	*str = (const char *)p;
+	return len;
+}
+
+/**
+ * Adds the tokens of a string to an archive that's being indexed.
+ *
+ * @param  b    Build state.
+ * @param  doc  Index of the archive.
+ * @param  text String to be tokenized.
+ * @param  len  Number of tokens in the archive, to be incremented.
+ * @return      Non-zero if the operation was successful.
+ */
+static int search_add_text(build_t *b, size_t doc, const char *text,
+						   uint32_t *len) {
+	char tok[PECAN_SEARCH_MAX_TOKEN + 1];
+	build_term_t *t;
+	size_t tlen;
+
+	if (text == NULL)
+		return 1;
+
+	while ((tlen = search_token(&text, tok)) > 0) {
+		t = build_term(b, tok, tlen);
+		if (t == NULL)
+			return 0;
+		(*len)++;
+
+		// Count how many times it shows up in this archive.
+		if (t->seen != (doc + 1)) {
+			t->seen = doc + 1;
+			t->tf = 0;
+			cvector_push_back(b->doc_terms, (uint32_t)(t - b->terms));
+		}
+		t->tf++;
+	}
+
+	return 1;
+}
+
+/**
+ * Gets a term from the build table, adding it if it's new.
+ *
+ * @param  b   Build state.
+ * @param  tok Term.
+ * @param  len Length of the term.
+ * @return     Term or NULL if we ran out of memory.
+ */
+static build_term_t *build_term(build_t *b, const char *tok, size_t len) {
+	build_term_t *t;
+	uint64_t hash;
+	size_t slot;
+
+	// Make sure we have room for a new term.
+	if (((b->nterms + 1) * 2) > b->nslots) {
+		if (!build_rehash(b))
+			return NULL;
+	}
+
+	// Look it up.
+	hash = blob_hash(tok, len);
+	slot = (size_t)hash & (b->nslots - 1);
+	while (b->slots[slot] != 0) {
+		t = &b->terms[b->slots[slot] - 1];
+		if ((t->hash == hash) && (strcmp(t->term, tok) == 0))
+			return t;
+		slot = (slot + 1) & (b->nslots - 1);
+	}
+
+	// Add it.
+	if (b->nterms == b->cap) {
+		size_t cap = (b->cap) ? b->cap * 2 : SEARCH_INITIAL_SLOTS;
+		build_term_t *terms = (build_term_t *)mem_realloc(NULL, b->terms,
+			cap * sizeof(build_term_t));
+		if (terms == NULL)
+			return NULL;
+		b->terms = terms;
+		b->cap = cap;
+	}
+	t = &b->terms[b->nterms];
+	memset(t, 0, sizeof(build_term_t));
+	t->term = arena_strndup(b->arena, tok, len);
+	if (t->term == NULL)
+		return NULL;
+	t->hash = hash;
+	b->slots[slot] = (uint32_t)++b->nterms;
+
+	return t;
+}
+
+/**
+ * Doubles the number of slots in the build term table.
+ *
+ * @param  b Build state.
+ * @return   Non-zero if the operation was successful.
+ */
+static int build_rehash(build_t *b) {
+	uint32_t *slots;
+	size_t nslots;
+	size_t slot;
+	size_t i;
+
+	nslots = (b->nslots) ? b->nslots * 2 : SEARCH_INITIAL_SLOTS;
+	slots = (uint32_t *)mem_calloc(NULL, nslots, sizeof(uint32_t));
+	if (slots == NULL)
+		return 0;
+
+	for (i = 0; i < b->nterms; i++) {
+		slot = (size_t)b->terms[i].hash & (nslots - 1);
+		while (slots[slot] != 0)
+			slot = (slot + 1) & (nslots - 1);
+		slots[slot] = (uint32_t)i + 1;
+	}
+
+	mem_free(NULL, b->slots);
+	b->slots = slots;
+	b->nslots = nslots;
+
+	return 1;
+}
+
+/**
+ * Appends a variable length integer to the postings of a term.
+ *
+ * @param  t   Term being built.
+ * @param  val Value to be appended.
+ * @return     Non-zero if the operation was successful.
+ */
+static int put_varint(build_term_t *t, size_t val) {
+	// Make sure we have room for the largest integer.
+	if ((t->len + 10) > t->cap) {
+		size_t cap = (t->cap) ? t->cap * 2 : 16;
+		unsigned char *buf = (unsigned char *)mem_realloc(NULL, t->buf, cap);
+		if (buf == NULL)
+			return 0;
+		t->buf = buf;
+		t->cap = cap;
+	}
+
+	// Seven bits at a time, with the high bit flagging that there's more.
+	while (val >= 0x80) {
+		t->buf[t->len++] = (unsigned char)(val | 0x80);
+		val >>= 7;
+	}
+	t->buf[t->len++] = (unsigned char)val;
+
+	return 1;
+}
+
+/**
+ * Reads a variable length integer from postings.
+ *
+ * @param  p   Pointer to the integer, which is moved past it.
+ * @param  end End of the postings.
+ * @return     Value of the integer.
+ */
+static size_t get_varint(const unsigned char **p, const unsigned char *end) {
+	size_t val = 0;
+	unsigned int shift = 0;
+
+	while (*p < end) {
+		unsigned char c = *(*p)++;
+
+		val |= (size_t)(c & 0x7F) << shift;
+		if (!(c & 0x80))
+			break;
+		shift += 7;
+	}
+
+	return val;
+}
+
+/**
+ * Compares two terms for sorting the dictionary.
+ */
+static int search_term_cmp(const void *a, const void *b) {
+	return strcmp(((const pecan_search_term_t *)a)->term,
+				  ((const pecan_search_term_t *)b)->term);
+}
+
+/**
+ * Finds the first term in the dictionary that isn't smaller than a token.
+ *
+ * @param  idx Search index.
+ * @param  tok Token to look for.
+ * @param  len Length of the token.
+ * @return     Index of the term or the number of terms if there's none.
+ */
+static size_t search_lower_bound(pecan_search_t *idx, const char *tok,
+								 size_t len) {
+	size_t lo = 0;
+	size_t hi = idx->nterms;
+
+	while (lo < hi) {
+		size_t mid = lo + ((hi - lo) / 2);
+
+		if (strncmp(idx->terms[mid].term, tok, len + 1) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+/**
+ * Offers a hit to a min-heap of the best hits so far.
+ *
+ * @param hits  Heap of hits.
+ * @param k     Capacity of the heap.
+ * @param n     Number of hits in the heap.
+ * @param index Index of the archive.
+ * @param score Score of the archive.
+ */
+static void hits_push(pecan_search_hit_t *hits, size_t k, size_t *n,
+					  size_t index, float score) {
+	pecan_search_hit_t hit;
+	size_t i;
+
+	hit.index = index;
+	hit.score = score;
+
+	// Sift it up while there's room.
+	if (*n < k) {
+		i = (*n)++;
+		while ((i > 0) && (hits[(i - 1) / 2].score > score)) {
+			hits[i] = hits[(i - 1) / 2];
+			i = (i - 1) / 2;
+		}
+		hits[i] = hit;
+		return;
+	}
+
+	// Replace the worst one and sift it down.
+	if (score <= hits[0].score)
+		return;
+	i = 0;
+	for (;;) {
+		size_t child = (i * 2) + 1;
+
+		if (child >= k)
+			break;
+		if (((child + 1) < k) && (hits[child + 1].score < hits[child].score))
+			child++;
+		if (hits[child].score >= score)
+			break;
+		hits[i] = hits[child];
+		i = child;
+	}
+	hits[i] = hit;
+}
+
+/**
+ * Compares two hits for sorting them best first.
+ */
+static int hit_cmp(const void *a, const void *b) {
+	const pecan_search_hit_t *ha = (const pecan_search_hit_t *)a;
+	const pecan_search_hit_t *hb = (const pecan_search_hit_t *)b;
+
+	if (ha->score != hb->score)
+		return (ha->score < hb->score) ? 1 : -1;
+	return (ha->index < hb->index) ? -1 : (ha->index > hb->index);
+}
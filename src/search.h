@@ -0,0 +1,74 @@
+/**
+ * search.h
+ * Full-text search over the descriptions and parameters of a catalog.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _SEARCH_H
+#define _SEARCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "catalog.h"
+
+// Manifest attribute that gets indexed along with every parameter.
+#define PECAN_SEARCH_FIELD      "description"
+
+// Longest token that gets indexed. Longer ones are cut short.
+#define PECAN_SEARCH_MAX_TOKEN  32
+
+// Query flags.
+#define PECAN_SEARCH_PREFIX     0x01
+
+// Term of the index and where its postings live.
+typedef struct {
+	const char *term;
+	uint32_t df;
+	uint32_t len;
+	size_t off;
+} pecan_search_term_t;
+
+// Archive that matched a query.
+typedef struct {
+	size_t index;
+	float score;
+} pecan_search_hit_t;
+
+// Search index structure definition.
+typedef struct {
+	pecan_search_term_t *terms;
+	size_t nterms;
+	unsigned char *postings;
+	size_t postings_len;
+
+	float *norms;
+	size_t ndocs;
+
+	pecan_arena_t *arena;
+} pecan_search_t;
+
+// Initialization
+PECAN_EXPORTS void pecan_search_init(pecan_search_t *idx);
+PECAN_EXPORTS pecan_err_t pecan_search_build(pecan_search_t *idx,
+											 pecan_catalog_t *cat);
+
+// Querying
+PECAN_EXPORTS pecan_err_t pecan_search_query(pecan_search_t *idx,
+											 const char *query,
+											 unsigned int flags,
+											 pecan_search_hit_t *hits,
+											 size_t k, size_t *nhits);
+
+// Cleanup
+PECAN_EXPORTS void pecan_search_free(pecan_search_t *idx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SEARCH_H */
@@ -0,0 +1,490 @@
+/**
+ * table.c
+ * Columnar view of the attributes of every archive in a catalog.
+ *
+ * Every attribute name becomes a column with a cell per archive. Columns whose
+ * values all parse as numbers are stored as plain arrays of integers or
+ * doubles, anything else is dictionary encoded against a sorted array of its
+ * distinct strings, and a bitmap tells which cells actually have a value.
+ * Scanning a column is then a walk through a single contiguous array instead
+ * of a string lookup in every archive.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "table.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "error.h"
+
+// Initial number of slots in the column table used while building.
+#define TABLE_INITIAL_SLOTS 64
+
+// Cell of a column being built.
+typedef struct {
+	uint32_t row;
+	const char *value;
+} table_cell_t;
+
+// Column being built.
+typedef struct {
+	const char *name;
+	pecan_attr_type_t attr;
+	uint64_t hash;
+	cvector_vector_type(table_cell_t) cells;
+} build_col_t;
+
+// State of the table while it's being built.
+typedef struct {
+	cvector_vector_type(build_col_t) cols;
+	uint32_t *slots;
+	size_t nslots;
+} build_t;
+
+// Private methods.
+static build_col_t *build_col(build_t *b, pecan_attr_type_t attr,
+							  const char *name);
+static int build_rehash(build_t *b);
+static int table_add_row(build_t *b, uint32_t row, pecan_attr_type_t attr,
+						 pecan_attr_arr_t attribs);
+static int table_fill(pecan_table_t *tbl, pecan_column_t *col,
+					  build_col_t *bcol);
+static int table_parse_int(const char *str, int64_t *val);
+static int table_parse_float(const char *str, double *val);
+static void table_clear_cell(pecan_column_t *col, uint32_t row);
+static int table_cell_cmp(const void *a, const void *b);
+
+/**
+ * Initializes an empty table.
+ *
+ * @param tbl Table to be initialized.
+ */
+void pecan_table_init(pecan_table_t *tbl) {
+	memset(tbl, 0, sizeof(pecan_table_t));
+}
+
+/**
+ * Builds the columnar view of a loaded catalog. Each row is the archive at the
+ * same index in the catalog, with the ones that failed to load left empty.
+ *
+ * @param  tbl Empty table.
+ * @param  cat Loaded catalog to be converted. The table doesn't reference it.
+ * @return     PECAN_OK if the operation was successful.
+ */
+pecan_err_t pecan_table_build(pecan_table_t *tbl, pecan_catalog_t *cat) {
+	pecan_err_t err;
+	build_t b;
+	size_t row;
+	size_t i;
+
+	// Set everything up.
+	err = PECAN_OK;
+	memset(&b, 0, sizeof(build_t));
+	pecan_table_free(tbl);
+	tbl->nrows = pecan_catalog_len(cat);
+	tbl->arena = arena_new(NULL);
+	if (tbl->arena == NULL)
+		goto nomem;
+
+	// Gather the cells of every column.
+	for (row = 0; row < tbl->nrows; row++) {
+		pecan_catalog_entry_t *entry = pecan_catalog_get(cat, row);
+
+		if (entry->err)
+			continue;
+		if (!table_add_row(&b, (uint32_t)row, PECAN_MANIFEST,
+						   entry->part.attribs) ||
+				!table_add_row(&b, (uint32_t)row, PECAN_PARAMETERS,
+							   entry->part.params))
+			goto nomem;
+	}
+
+	// Lay the columns out.
+	tbl->columns = (pecan_column_t *)mem_calloc(NULL, cvector_size(b.cols) + 1,
+												sizeof(pecan_column_t));
+	if (tbl->columns == NULL)
+		goto nomem;
+	for (i = 0; i < cvector_size(b.cols); i++) {
+		// Count it up front so whatever it got is free'd if it fails midway.
+		tbl->ncolumns++;
+		if (!table_fill(tbl, &tbl->columns[i], &b.cols[i]))
+			goto nomem;
+	}
+
+cleanup:
+	for (i = 0; i < cvector_size(b.cols); i++)
+		cvector_free(b.cols[i].cells);
+	cvector_free(b.cols);
+	mem_free(NULL, b.slots);
+
+	return err;
+
+nomem:
+	pecan_table_free(tbl);
+	err = PECAN_ERR_UNKNOWN;
+	err_set_msg(EMSG("Couldn't allocate memory to build the table"));
+	goto cleanup;
+}
+
+/**
+ * Gets a column of the table.
+ *
+ * @param  tbl  Table.
+ * @param  attr Type of the attribute.
+ * @param  name Name of the attribute.
+ * @return      Column or NULL if no archive has the attribute.
+ */
+pecan_column_t *pecan_table_column(pecan_table_t *tbl, pecan_attr_type_t attr,
+								   const char *name) {
+	size_t i;
+
+	for (i = 0; i < tbl->ncolumns; i++) {
+		if ((tbl->columns[i].attr == attr) &&
+				(strcmp(tbl->columns[i].name, name) == 0))
+			return &tbl->columns[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * Gets the dictionary code of a value in a string column, so that it can be
+ * compared against the cells without touching any strings.
+ *
+ * @param  col   String column.
+ * @param  value Value to look up.
+ * @return       Code of the value or PECAN_TABLE_NULL_CODE if no cell has it.
+ */
+uint32_t pecan_column_code(pecan_column_t *col, const char *value) {
+	size_t lo = 0;
+	size_t hi = col->ndict;
+
+	while (lo < hi) {
+		size_t mid = lo + ((hi - lo) / 2);
+		int cmp = strcmp(col->dict[mid], value);
+
+		if (cmp == 0) {
+			return (uint32_t)mid;
+		} else if (cmp < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return PECAN_TABLE_NULL_CODE;
+}
+
+/**
+ * Frees up everything held by a table.
+ *
+ * @param tbl Table to be free'd.
+ */
+void pecan_table_free(pecan_table_t *tbl) {
+	size_t i;
+
+	for (i = 0; i < tbl->ncolumns; i++) {
+		mem_free(NULL, tbl->columns[i].valid);
+		mem_free(NULL, tbl->columns[i].ints);
+		mem_free(NULL, tbl->columns[i].floats);
+		mem_free(NULL, tbl->columns[i].codes);
+		mem_free(NULL, tbl->columns[i].dict);
+	}
+	mem_free(NULL, tbl->columns);
+	if (tbl->arena)
+		arena_release(tbl->arena);
+
+	memset(tbl, 0, sizeof(pecan_table_t));
+}
+
+/**
+ * Adds the attributes of an archive to the columns being built.
+ *
+ * @param  b       Build state.
+ * @param  row     Row of the archive.
+ * @param  attr    Type of the attributes.
+ * @param  attribs Attributes of the archive.
+ * @return         Non-zero if the operation was successful.
+ */
+static int table_add_row(build_t *b, uint32_t row, pecan_attr_type_t attr,
+						 pecan_attr_arr_t attribs) {
+	build_col_t *col;
+	table_cell_t cell;
+	size_t i;
+
+	for (i = 0; i < cvector_size(attribs); i++) {
+		if ((attribs[i].name == NULL) || (attribs[i].value == NULL))
+			continue;
+
+		col = build_col(b, attr, attribs[i].name);
+		if (col == NULL)
+			return 0;
+
+		// Only the first of a repeated attribute counts, like pecan_get_attr.
+		if ((cvector_size(col->cells) > 0) &&
+				(col->cells[cvector_size(col->cells) - 1].row == row))
+			continue;
+
+		cell.row = row;
+		cell.value = attribs[i].value;
+		cvector_push_back(col->cells, cell);
+	}
+
+	return 1;
+}
+
+/**
+ * Gets a column from the build table, adding it if it's new.
+ *
+ * @param  b    Build state.
+ * @param  attr Type of the attribute.
+ * @param  name Name of the attribute.
+ * @return      Column or NULL if we ran out of memory.
+ */
+static build_col_t *build_col(build_t *b, pecan_attr_type_t attr,
+							  const char *name) {
+	build_col_t col;
+	uint64_t hash;
+	size_t slot;
+
+	// Make sure we have room for a new column.
+	if (((cvector_size(b->cols) + 1) * 2) > b->nslots) {
+		if (!build_rehash(b))
+			return NULL;
+	}
+
+	// Look it up.
+	hash = blob_hash(name, strlen(name)) ^ (uint64_t)attr;
+	slot = (size_t)hash & (b->nslots - 1);
+	while (b->slots[slot] != 0) {
+		build_col_t *c = &b->cols[b->slots[slot] - 1];
+		if ((c->hash == hash) && (c->attr == attr) &&
+				(strcmp(c->name, name) == 0))
+			return c;
+		slot = (slot + 1) & (b->nslots - 1);
+	}
+
+	// Add it.
+	col.name = name;
+	col.attr = attr;
+	col.hash = hash;
+	col.cells = NULL;
+	cvector_push_back(b->cols, col);
+	b->slots[slot] = (uint32_t)cvector_size(b->cols);
+
+	return &b->cols[cvector_size(b->cols) - 1];
+}
+
+/**
+ * Doubles the number of slots in the build column table.
+ *
+ * @param  b Build state.
+ * @return   Non-zero if the operation was successful.
+ */
+static int build_rehash(build_t *b) {
+	uint32_t *slots;
+	size_t nslots;
+	size_t slot;
+	size_t i;
+
+	nslots = (b->nslots) ? b->nslots * 2 : TABLE_INITIAL_SLOTS;
+	slots = (uint32_t *)mem_calloc(NULL, nslots, sizeof(uint32_t));
+	if (slots == NULL)
+		return 0;
+
+	for (i = 0; i < cvector_size(b->cols); i++) {
+		slot = (size_t)b->cols[i].hash & (nslots - 1);
+		while (slots[slot] != 0)
+			slot = (slot + 1) & (nslots - 1);
+		slots[slot] = (uint32_t)i + 1;
+	}
+
+	mem_free(NULL, b->slots);
+	b->slots = slots;
+	b->nslots = nslots;
+
+	return 1;
+}
+
+/**
+ * Lays out a column with the narrowest type that fits all of its values.
+ *
+ * @param  tbl  Table that owns the column.
+ * @param  col  Column to be filled.
+ * @param  bcol Column that was built.
+ * @return      Non-zero if the operation was successful.
+ */
+static int table_fill(pecan_table_t *tbl, pecan_column_t *col,
+					  build_col_t *bcol) {
+	table_cell_t *cells = bcol->cells;
+	size_t ncells = cvector_size(cells);
+	size_t nints;
+	size_t nnums;
+	int64_t ival;
+	double fval;
+	size_t i;
+
+	// Name it and mark the cells that have a value.
+	col->name = arena_strndup(tbl->arena, bcol->name, strlen(bcol->name));
+	col->attr = bcol->attr;
+	col->nvalid = ncells;
+	col->valid = (uint64_t *)mem_calloc(NULL, (tbl->nrows / 64) + 1,
+										sizeof(uint64_t));
+	if ((col->name == NULL) || (col->valid == NULL))
+		return 0;
+	for (i = 0; i < ncells; i++)
+		col->valid[cells[i].row >> 6] |= (uint64_t)1 << (cells[i].row & 63);
+
+	// Find out the type of the column.
+	// Find out the type of the column from what most of its cells hold, so
+	// that a few placeholders like "n/a" don't turn a numeric one into strings.
+	nints = 0;
+	nnums = 0;
+	for (i = 0; i < ncells; i++) {
+		if (table_parse_int(cells[i].value, &ival)) {
+			nints++;
+			nnums++;
+		} else if (table_parse_float(cells[i].value, &fval)) {
+			nnums++;
+		}
+	}
+	if ((nnums * 2) <= ncells) {
+		col->type = PECAN_COLUMN_STRING;
+	} else if (nints == nnums) {
+		col->type = PECAN_COLUMN_INT;
+	} else {
+		col->type = PECAN_COLUMN_FLOAT;
+	}
+
+	// Numbers go straight in and cells that aren't numbers are left empty.
+	if (col->type == PECAN_COLUMN_INT) {
+		col->ints = (int64_t *)mem_calloc(NULL, tbl->nrows + 1,
+										  sizeof(int64_t));
+		if (col->ints == NULL)
+			return 0;
+		for (i = 0; i < ncells; i++) {
+			if (!table_parse_int(cells[i].value, &col->ints[cells[i].row]))
+				table_clear_cell(col, cells[i].row);
+		}
+
+		return 1;
+	} else if (col->type == PECAN_COLUMN_FLOAT) {
+		col->floats = (double *)mem_calloc(NULL, tbl->nrows + 1,
+										   sizeof(double));
+		if (col->floats == NULL)
+			return 0;
+		for (i = 0; i < ncells; i++) {
+			if (!table_parse_float(cells[i].value,
+					&col->floats[cells[i].row]))
+				table_clear_cell(col, cells[i].row);
+		}
+
+		return 1;
+	}
+
+	// Strings get a code in the sorted dictionary of distinct values.
+	col->codes = (uint32_t *)mem_alloc(NULL, (tbl->nrows + 1) *
+									   sizeof(uint32_t));
+	col->dict = (const char **)mem_alloc(NULL, (ncells + 1) *
+										 sizeof(const char *));
+	if ((col->codes == NULL) || (col->dict == NULL))
+		return 0;
+	for (i = 0; i < tbl->nrows; i++)
+		col->codes[i] = PECAN_TABLE_NULL_CODE;
+	qsort(cells, ncells, sizeof(table_cell_t), table_cell_cmp);
+	for (i = 0; i < ncells; i++) {
+		if ((col->ndict == 0) ||
+				(strcmp(col->dict[col->ndict - 1], cells[i].value) != 0)) {
+			col->dict[col->ndict] = arena_strndup(tbl->arena, cells[i].value,
+												  strlen(cells[i].value));
+			if (col->dict[col->ndict] == NULL)
+				return 0;
+			col->ndict++;
+		}
+
+		col->codes[cells[i].row] = (uint32_t)(col->ndict - 1);
+	}
+
+	return 1;
+}
+
+/**
+ * Parses a whole string as a decimal integer.
+ *
+ * @param  str String to be parsed.
+ * @param  val Returns the parsed value.
+ * @return     Non-zero if the whole string is an integer within
+ *             PECAN_TABLE_MAX_INT.
+ */
+static int table_parse_int(const char *str, int64_t *val) {
+	char *end;
+
+	// Don't let strtoll skip over whitespace.
+	if (!(((*str >= '0') && (*str <= '9')) || (*str == '-') || (*str == '+')))
+		return 0;
+
+	errno = 0;
+	*val = (int64_t)strtoll(str, &end, 10);
+	return (*end == '\0') && (errno != ERANGE) &&
+		(*val <= PECAN_TABLE_MAX_INT) && (*val >= -PECAN_TABLE_MAX_INT);
+}
+
+/**
+ * Parses a whole string as a decimal floating-point number.
+ *
+ * @param  str String to be parsed.
+ * @param  val Returns the parsed value.
+ * @return     Non-zero if the whole string is a number.
+ */
+static int table_parse_float(const char *str, double *val) {
+	char *end;
+
+	// Don't let strtod take whitespace, hexadecimal, infinities or
+	// not-a-numbers.
+	if (!(((*str >= '0') && (*str <= '9')) || (*str == '-') || (*str == '+') ||
+			(*str == '.')) || strpbrk(str, "xXiInN"))
+		return 0;
+
+	*val = strtod(str, &end);
+	return (*end == '\0') && (end != str);
+}
+
+/**
+ * Marks a cell of a numeric column as not having a value.
+ *
+ * @param col Numeric column.
+ * @param row Row of the cell.
+ */
+static void table_clear_cell(pecan_column_t *col, uint32_t row) {
+	col->valid[row >> 6] &= ~((uint64_t)1 << (row & 63));
+	col->nvalid--;
+	if (col->type == PECAN_COLUMN_INT) {
+		col->ints[row] = 0;
+	} else {
+		col->floats[row] = 0;
+	}
+}
+
+/**
+ * Compares two cells for sorting them by value.
+ *
+ * @param  a First cell.
+ * @param  b Second cell.
+ * @return   Negative, zero or positive if the first cell sorts before, along
+ *           with or after the second one, like strcmp.
+ */
+static int table_cell_cmp(const void *a, const void *b) {
+	const table_cell_t *ca = (const table_cell_t *)a;
+	const table_cell_t *cb = (const table_cell_t *)b;
+	int cmp;
+
+	cmp = strcmp(ca->value, cb->value);
+	if (cmp != 0)
+		return cmp;
+
+	return (ca->row < cb->row) ? -1 : (ca->row > cb->row);
+}
@@ -0,0 +1,85 @@
+/**
+ * table.h
+ * Columnar view of the attributes of every archive in a catalog.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _TABLE_H
+#define _TABLE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "catalog.h"
+
+// Dictionary code of a string column cell without a value.
+#define PECAN_TABLE_NULL_CODE  UINT32_MAX
+
+// Largest magnitude of an integer column value, so that every one of them can
+// be represented exactly as a double.
+#define PECAN_TABLE_MAX_INT  ((int64_t)1 << 53)
+
+// Checks if a cell of a column has a value.
+#define PECAN_COLUMN_VALID(col, row) \
+	(((col)->valid[(row) >> 6] >> ((row) & 63)) & 1)
+
+// Column type enumeration.
+typedef enum {
+	PECAN_COLUMN_INT = 0,
+	PECAN_COLUMN_FLOAT,
+	PECAN_COLUMN_STRING
+} pecan_column_type_t;
+
+// Column holding an attribute of every archive. Its type is whatever most of
+// its cells hold, with the values that don't fit a numeric column left out.
+// Only the array that matches its type is allocated and cells without a value
+// are zeroed out or get PECAN_TABLE_NULL_CODE.
+typedef struct {
+	const char *name;
+	pecan_attr_type_t attr;
+	pecan_column_type_t type;
+
+	uint64_t *valid;
+	size_t nvalid;
+
+	int64_t *ints;
+	double *floats;
+	uint32_t *codes;
+
+	const char **dict;
+	size_t ndict;
+} pecan_column_t;
+
+// Table structure definition.
+typedef struct {
+	pecan_column_t *columns;
+	size_t ncolumns;
+	size_t nrows;
+
+	pecan_arena_t *arena;
+} pecan_table_t;
+
+// Initialization
+PECAN_EXPORTS void pecan_table_init(pecan_table_t *tbl);
+PECAN_EXPORTS pecan_err_t pecan_table_build(pecan_table_t *tbl,
+											pecan_catalog_t *cat);
+
+// Lookup
+PECAN_EXPORTS pecan_column_t *pecan_table_column(pecan_table_t *tbl,
+												 pecan_attr_type_t attr,
+												 const char *name);
+PECAN_EXPORTS uint32_t pecan_column_code(pecan_column_t *col,
+										 const char *value);
+
+// Cleanup
+PECAN_EXPORTS void pecan_table_free(pecan_table_t *tbl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TABLE_H */
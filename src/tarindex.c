@@ -0,0 +1,347 @@
+/**
+ * tarindex.c
+ * Index of the members of a packed archive stored as its first member.
+ *
+ * The index is a tiny binary file that lets us jump straight to any member of
+ * the archive without walking through every header before it. All integers are
+ * stored in little-endian:
+ *
+ *   Header    magic[4], version (u16), flags (u16), count (u32), buckets (u32)
+ *   Buckets   buckets * u32 entry number plus one, zero being empty
+ *   Entries   count * {offset (u32), size (u32), hash (u64), name offset (u32),
+ *             name length (u16), reserved (u16)}
+ *   Names     Member names without terminators.
+ *
+ * Offsets point to the contents of the member, right after its header, and the
+ * hash is the blob_hash of the contents.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "tarindex.h"
+
+#include <string.h>
+
+#include "byteorder.h"
+#include "pecan.h"
+
+// Largest index we are willing to read.
+#define TARINDEX_MAX_SIZE (1024 * 1024)
+
+// Private methods.
+static int tarindex_validate(pecan_tarindex_t *idx);
+static void tarindex_entry(pecan_tarindex_t *idx, uint32_t num,
+						   pecan_tarindex_entry_t *entry);
+
+/**
+ * Initializes an empty index.
+ *
+ * @param idx Index to be initialized.
+ */
+void tarindex_init(pecan_tarindex_t *idx) {
+	idx->data = NULL;
+	idx->len = 0;
+	idx->cap = 0;
+	idx->count = 0;
+	idx->nbuckets = 0;
+}
+
+/**
+ * Forgets the contents of an index while keeping its buffer around, so that it
+ * can be reused for reading the index of another archive.
+ *
+ * @param idx Index to be cleared.
+ */
+void tarindex_clear(pecan_tarindex_t *idx) {
+	idx->len = 0;
+	idx->count = 0;
+	idx->nbuckets = 0;
+}
+
+/**
+ * Reads the index of a packed archive if it has one. The archive is left
+ * rewound either way. The buffer of the index is reused whenever it's large
+ * enough.
+ *
+ * @param  idx Empty or cleared index to be populated.
+ * @param  tar Opened TAR file object.
+ * @return     Non-zero if the archive had a valid index.
+ */
+int tarindex_read(pecan_tarindex_t *idx, mtar_t *tar) {
+	mtar_header_t header;
+
+	// Start out without an index.
+	tarindex_clear(idx);
+
+	// The index must be the very first member.
+	if (mtar_rewind(tar) || mtar_read_header(tar, &header))
+		goto invalid;
+	if ((strcmp(header.name, PECAN_INDEX_FILE) != 0) ||
+			(header.size < TARINDEX_HEADER_SIZE) ||
+			(header.size > TARINDEX_MAX_SIZE))
+		goto invalid;
+
+	// Read it.
+	if (header.size > idx->cap) {
+		unsigned char *data = (unsigned char *)mem_realloc(NULL, idx->data,
+														   header.size);
+		if (data == NULL)
+			goto invalid;
+
+		idx->data = data;
+		idx->cap = header.size;
+	}
+	idx->len = header.size;
+	if (mtar_read_data(tar, idx->data, header.size))
+		goto invalid;
+
+	// Make sure it makes sense.
+	if (!tarindex_validate(idx))
+		goto invalid;
+
+	mtar_rewind(tar);
+	return 1;
+
+invalid:
+	tarindex_clear(idx);
+	mtar_rewind(tar);
+	return 0;
+}
+
+/**
+ * Looks up a member in the index.
+ *
+ * @param  idx   Index of the archive.
+ * @param  name  Name of the member.
+ * @param  entry Structure to receive the member information.
+ * @return       Non-zero if the member was found.
+ */
+int tarindex_find(pecan_tarindex_t *idx, const char *name,
+				  pecan_tarindex_entry_t *entry) {
+	const unsigned char *buckets;
+	size_t len;
+	uint32_t mask;
+	uint32_t slot;
+	uint32_t i;
+
+	// Do we even have an index?
+	if (idx->len == 0)
+		return 0;
+
+	// Probe the buckets starting from where the name hashes to.
+	len = strlen(name);
+	buckets = idx->data + TARINDEX_HEADER_SIZE;
+	mask = idx->nbuckets - 1;
+	slot = (uint32_t)(blob_hash(name, len) & mask);
+	for (i = 0; i < idx->nbuckets; i++) {
+		uint32_t num = le_read32(buckets + (((slot + i) & mask) * 4));
+		if (num == 0)
+			return 0;
+
+		tarindex_entry(idx, num - 1, entry);
+		if ((entry->name_len == len) && (memcmp(entry->name, name, len) == 0))
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Positions an archive at the header of a member using the index, just like
+ * mtar_find would, but without walking through the archive.
+ *
+ * @param  idx    Index of the archive.
+ * @param  tar    Opened TAR file object.
+ * @param  name   Name of the member.
+ * @param  header Structure to receive the member's header.
+ * @param  hash   Optional pointer to receive the hash of the contents.
+ * @return        Non-zero if the member was found and matches its header.
+ */
+int tarindex_seek(pecan_tarindex_t *idx, mtar_t *tar, const char *name,
+				  mtar_header_t *header, uint64_t *hash) {
+	pecan_tarindex_entry_t entry;
+
+	// Look it up.
+	if (!tarindex_find(idx, name, &entry))
+		return 0;
+
+	// Jump to its header and make sure the index isn't lying to us.
+	tar->remaining_data = 0;
+	if (mtar_seek(tar, entry.offset - TAR_BLOCK_SIZE) ||
+			mtar_read_header(tar, header))
+		return 0;
+	if ((strcmp(header->name, name) != 0) || (header->size != entry.size))
+		return 0;
+
+	if (hash)
+		*hash = entry.hash;
+	return 1;
+}
+
+/**
+ * Gets the size of the index of an archive, so that the offsets of its members
+ * can be figured out before the index is built.
+ *
+ * @param  entries Members of the archive.
+ * @param  count   Number of members.
+ * @return         Size of the index in bytes.
+ */
+size_t tarindex_size(const pecan_tarindex_entry_t *entries, uint32_t count) {
+	size_t names_len;
+	uint32_t nbuckets;
+	uint32_t i;
+
+	names_len = 0;
+	for (i = 0; i < count; i++)
+		names_len += entries[i].name_len;
+	nbuckets = 1;
+	while (nbuckets < (count * 2))
+		nbuckets <<= 1;
+
+	return TARINDEX_HEADER_SIZE + (nbuckets * 4) +
+		(count * TARINDEX_ENTRY_SIZE) + names_len;
+}
+
+/**
+ * Builds the index of an archive that will be written with the index as its
+ * first member.
+ *
+ * @param  idx     Empty index to be populated.
+ * @param  entries Members of the archive with the offsets of their contents.
+ * @param  count   Number of members.
+ * @return         Non-zero if the operation was successful.
+ */
+int tarindex_build(pecan_tarindex_t *idx, const pecan_tarindex_entry_t *entries,
+				   uint32_t count) {
+	unsigned char *buckets;
+	unsigned char *p;
+	uint32_t name_off;
+	uint32_t nbuckets;
+	uint32_t i;
+
+	// Figure out how big everything is going to be.
+	nbuckets = 1;
+	while (nbuckets < (count * 2))
+		nbuckets <<= 1;
+
+	// Allocate the index.
+	idx->count = count;
+	idx->nbuckets = nbuckets;
+	idx->len = tarindex_size(entries, count);
+	idx->data = (unsigned char *)mem_calloc(NULL, idx->len, 1);
+	if (idx->data == NULL)
+		return 0;
+	idx->cap = idx->len;
+
+	// Header.
+	memcpy(idx->data, TARINDEX_MAGIC, 4);
+	le_write16(idx->data + 4, TARINDEX_VERSION);
+	le_write16(idx->data + 6, 0);
+	le_write32(idx->data + 8, count);
+	le_write32(idx->data + 12, nbuckets);
+
+	// Entries and their names.
+	buckets = idx->data + TARINDEX_HEADER_SIZE;
+	p = buckets + (nbuckets * 4);
+	name_off = (uint32_t)(p - idx->data) + (count * TARINDEX_ENTRY_SIZE);
+	for (i = 0; i < count; i++) {
+		uint32_t slot;
+
+		// Entry.
+		le_write32(p, entries[i].offset);
+		le_write32(p + 4, entries[i].size);
+		le_write64(p + 8, entries[i].hash);
+		le_write32(p + 16, name_off);
+		le_write16(p + 20, (uint16_t)entries[i].name_len);
+		memcpy(idx->data + name_off, entries[i].name, entries[i].name_len);
+		p += TARINDEX_ENTRY_SIZE;
+
+		// Bucket.
+		slot = (uint32_t)(blob_hash(entries[i].name, entries[i].name_len) &
+			(nbuckets - 1));
+		while (le_read32(buckets + (slot * 4)) != 0)
+			slot = (slot + 1) & (nbuckets - 1);
+		le_write32(buckets + (slot * 4), i + 1);
+
+		name_off += (uint32_t)entries[i].name_len;
+	}
+
+	return 1;
+}
+
+/**
+ * Frees up the index.
+ *
+ * @param idx Index to be free'd.
+ */
+void tarindex_free(pecan_tarindex_t *idx) {
+	mem_free(NULL, idx->data);
+	tarindex_init(idx);
+}
+
+/**
+ * Checks that an index read from an archive is sound, so that lookups never
+ * go out of bounds.
+ *
+ * @param  idx Index with its data loaded.
+ * @return     Non-zero if the index is valid.
+ */
+static int tarindex_validate(pecan_tarindex_t *idx) {
+	pecan_tarindex_entry_t entry;
+	size_t table_len;
+	uint32_t i;
+
+	// Header.
+	if ((memcmp(idx->data, TARINDEX_MAGIC, 4) != 0) ||
+			(le_read16(idx->data + 4) != TARINDEX_VERSION))
+		return 0;
+	idx->count = le_read32(idx->data + 8);
+	idx->nbuckets = le_read32(idx->data + 12);
+	if ((idx->nbuckets == 0) || (idx->nbuckets & (idx->nbuckets - 1)) ||
+			(idx->nbuckets < idx->count))
+		return 0;
+
+	// Tables.
+	table_len = TARINDEX_HEADER_SIZE + ((size_t)idx->nbuckets * 4) +
+		((size_t)idx->count * TARINDEX_ENTRY_SIZE);
+	if (table_len > idx->len)
+		return 0;
+	for (i = 0; i < idx->nbuckets; i++) {
+		if (le_read32(idx->data + TARINDEX_HEADER_SIZE + (i * 4)) > idx->count)
+			return 0;
+	}
+
+	// Names and offsets.
+	for (i = 0; i < idx->count; i++) {
+		const unsigned char *p = idx->data + TARINDEX_HEADER_SIZE +
+			((size_t)idx->nbuckets * 4) + ((size_t)i * TARINDEX_ENTRY_SIZE);
+		size_t name_off = le_read32(p + 16);
+
+		tarindex_entry(idx, i, &entry);
+		if ((name_off < table_len) || (name_off > idx->len) ||
+				(entry.name_len > (idx->len - name_off)) ||
+				(entry.offset < (2 * TAR_BLOCK_SIZE)))
+			return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Decodes an entry of the index.
+ *
+ * @param idx   Index of the archive.
+ * @param num   Number of the entry.
+ * @param entry Structure to receive the entry.
+ */
+static void tarindex_entry(pecan_tarindex_t *idx, uint32_t num,
+						   pecan_tarindex_entry_t *entry) {
+	const unsigned char *p = idx->data + TARINDEX_HEADER_SIZE +
+		((size_t)idx->nbuckets * 4) + ((size_t)num * TARINDEX_ENTRY_SIZE);
+
+	entry->offset = le_read32(p);
+	entry->size = le_read32(p + 4);
+	entry->hash = le_read64(p + 8);
+	entry->name = (const char *)idx->data + le_read32(p + 16);
+	entry->name_len = le_read16(p + 20);
+}
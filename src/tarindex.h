@@ -0,0 +1,71 @@
+/**
+ * tarindex.h
+ * Index of the members of a packed archive stored as its first member.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _TARINDEX_H
+#define _TARINDEX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <microtar.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Index format definitions.
+#define TARINDEX_MAGIC       "PIDX"
+#define TARINDEX_VERSION     1
+#define TARINDEX_HEADER_SIZE 16
+#define TARINDEX_ENTRY_SIZE  24
+
+// Size of a TAR member header and the block size of its contents.
+#define TAR_BLOCK_SIZE 512
+#define TAR_ROUND(n)   (((n) + (TAR_BLOCK_SIZE - 1)) & ~(TAR_BLOCK_SIZE - 1))
+
+// Member of an archive as described by the index.
+typedef struct {
+	const char *name;
+	size_t name_len;
+	uint32_t offset;
+	uint32_t size;
+	uint64_t hash;
+} pecan_tarindex_entry_t;
+
+// Serialized index of an archive.
+typedef struct {
+	unsigned char *data;
+	size_t len;
+	size_t cap;
+
+	uint32_t count;
+	uint32_t nbuckets;
+} pecan_tarindex_t;
+
+// Initialization
+void tarindex_init(pecan_tarindex_t *idx);
+void tarindex_clear(pecan_tarindex_t *idx);
+
+// Reading
+int tarindex_read(pecan_tarindex_t *idx, mtar_t *tar);
+int tarindex_find(pecan_tarindex_t *idx, const char *name,
+				  pecan_tarindex_entry_t *entry);
+int tarindex_seek(pecan_tarindex_t *idx, mtar_t *tar, const char *name,
+				  mtar_header_t *header, uint64_t *hash);
+
+// Writing
+size_t tarindex_size(const pecan_tarindex_entry_t *entries, uint32_t count);
+int tarindex_build(pecan_tarindex_t *idx, const pecan_tarindex_entry_t *entries,
+				   uint32_t count);
+
+// Cleanup
+void tarindex_free(pecan_tarindex_t *idx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TARINDEX_H */
@@ -0,0 +1,115 @@
+/**
+ * thread.c
+ * Tiny portability layer for the threading primitives used by the library.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "thread.h"
+
+/**
+ * Initializes a mutex.
+ *
+ * @param mutex Mutex to be initialized.
+ */
+void mutex_init(pecan_mutex_t *mutex) {
+#ifdef _WIN32
+	InitializeCriticalSection(mutex);
+#else
+	pthread_mutex_init(mutex, NULL);
+#endif  // _WIN32
+}
+
+/**
+ * Locks a mutex, waiting for it to be available.
+ *
+ * @param mutex Mutex to be locked.
+ */
+void mutex_lock(pecan_mutex_t *mutex) {
+#ifdef _WIN32
+	EnterCriticalSection(mutex);
+#else
+	pthread_mutex_lock(mutex);
+#endif  // _WIN32
+}
+
+/**
+ * Unlocks a mutex.
+ *
+ * @param mutex Mutex to be unlocked.
+ */
+void mutex_unlock(pecan_mutex_t *mutex) {
+#ifdef _WIN32
+	LeaveCriticalSection(mutex);
+#else
+	pthread_mutex_unlock(mutex);
+#endif  // _WIN32
+}
+
+/**
+ * Cleans up the mess left behind by a mutex.
+ *
+ * @param mutex Mutex to be destroyed.
+ */
+void mutex_destroy(pecan_mutex_t *mutex) {
+#ifdef _WIN32
+	DeleteCriticalSection(mutex);
+#else
+	pthread_mutex_destroy(mutex);
+#endif  // _WIN32
+}
+
+/**
+ * Initializes a condition variable.
+ *
+ * @param cond Condition variable to be initialized.
+ */
+void cond_init(pecan_cond_t *cond) {
+#ifdef _WIN32
+	InitializeConditionVariable(cond);
+#else
+	pthread_cond_init(cond, NULL);
+#endif  // _WIN32
+}
+
+/**
+ * Waits for a condition variable to be signaled. The mutex must be locked by
+ * the caller and will be locked again when this returns.
+ *
+ * @param cond  Condition variable to wait on.
+ * @param mutex Mutex protecting the condition.
+ */
+void cond_wait(pecan_cond_t *cond, pecan_mutex_t *mutex) {
+#ifdef _WIN32
+	SleepConditionVariableCS(cond, mutex, INFINITE);
+#else
+	pthread_cond_wait(cond, mutex);
+#endif  // _WIN32
+}
+
+/**
+ * Wakes up every thread waiting on a condition variable.
+ *
+ * @param cond Condition variable to be signaled.
+ */
+void cond_broadcast(pecan_cond_t *cond) {
+#ifdef _WIN32
+	WakeAllConditionVariable(cond);
+#else
+	pthread_cond_broadcast(cond);
+#endif  // _WIN32
+}
+
+/**
+ * Cleans up the mess left behind by a condition variable.
+ *
+ * @param cond Condition variable to be destroyed.
+ */
+void cond_destroy(pecan_cond_t *cond) {
+#ifdef _WIN32
+	// Windows condition variables don't need to be destroyed.
+	(void)cond;
+#else
+	pthread_cond_destroy(cond);
+#endif  // _WIN32
+}
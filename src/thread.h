@@ -0,0 +1,58 @@
+/**
+ * thread.h
+ * Tiny portability layer for the threading primitives used by the library.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _THREAD_H
+#define _THREAD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef _WIN32
+#	include <windows.h>
+#else
+#	include <pthread.h>
+#endif  // _WIN32
+
+// Thread local storage class.
+#ifdef _MSC_VER
+#	define THREAD_LOCAL __declspec(thread)
+#else
+#	define THREAD_LOCAL __thread
+#endif  // _MSC_VER
+
+// Mutex type definition.
+#ifdef _WIN32
+typedef CRITICAL_SECTION pecan_mutex_t;
+#else
+typedef pthread_mutex_t pecan_mutex_t;
+#endif  // _WIN32
+
+// Condition variable type definition.
+#ifdef _WIN32
+typedef CONDITION_VARIABLE pecan_cond_t;
+#else
+typedef pthread_cond_t pecan_cond_t;
+#endif  // _WIN32
+
+// Mutexes
+void mutex_init(pecan_mutex_t *mutex);
+void mutex_lock(pecan_mutex_t *mutex);
+void mutex_unlock(pecan_mutex_t *mutex);
+void mutex_destroy(pecan_mutex_t *mutex);
+
+// Condition variables
+void cond_init(pecan_cond_t *cond);
+void cond_wait(pecan_cond_t *cond, pecan_mutex_t *mutex);
+void cond_broadcast(pecan_cond_t *cond);
+void cond_destroy(pecan_cond_t *cond);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _THREAD_H */
@@ -0,0 +1,982 @@
+/**
+ * watch.c
+ * Keeps a live catalog in sync with the parts bin on disk using inotify.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "watch.h"
+
+#include <cvector_utils.h>
+#include <dirent.h>
+#include <errno.h>
+#include <microtar.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "error.h"
+#include "fileutils.h"
+#include "tarindex.h"
+
+// Events that we care about in the watched directories.
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+					  IN_MOVED_TO)
+
+// Member files of an archive and their bits.
+#define MEMBER_COUNT 4
+#define MEMBER_ALL   ((1 << MEMBER_COUNT) - 1)
+static const char *member_names[MEMBER_COUNT] = {
+	PECAN_MANIFEST_FILE,
+	PECAN_PARAM_FILE,
+	PECAN_IMAGE_FILE,
+	PECAN_DATASHEET_FILE
+};
+
+// Pending change to an archive.
+typedef struct {
+	char *path;
+	int packed;
+	unsigned members;
+} watch_change_t;
+
+// Changes collected from a batch of events.
+typedef cvector_vector_type(watch_change_t) watch_changes_t;
+
+// Arguments for the member re-reading update.
+typedef struct {
+	const char *path;
+	unsigned members;
+} members_update_args_t;
+
+// Private methods.
+static pecan_err_t watch_scan(pecan_watch_t *watch, const char *dir,
+							  watch_changes_t *changes);
+static pecan_err_t watch_found_dir(pecan_watch_t *watch, const char *dir,
+								   watch_changes_t *changes);
+static pecan_err_t watch_add_dir(pecan_watch_t *watch, const char *dir);
+static void watch_drop_dirs(pecan_watch_t *watch, const char *prefix);
+static const char *watch_dir_path(pecan_watch_t *watch, int wd);
+static int watch_has(pecan_watch_t *watch, const char *path);
+static void watch_event(pecan_watch_t *watch, struct inotify_event *ev,
+						watch_changes_t *changes);
+static void watch_removed(pecan_watch_t *watch, const char *prefix,
+						  watch_changes_t *changes);
+static pecan_err_t watch_resync(pecan_watch_t *watch);
+static pecan_err_t watch_apply(pecan_watch_t *watch, watch_change_t *change,
+							   size_t *nchanged);
+static void change_queue(watch_changes_t *changes, const char *path,
+						 int packed, unsigned members);
+static void change_free(watch_change_t change);
+static pecan_watch_tar_t *tar_find(pecan_watch_t *watch, const char *path);
+static void tar_forget(pecan_watch_t *watch, const char *path);
+static pecan_err_t tar_track(pecan_watch_t *watch, const char *path,
+							 unsigned *changed);
+static void tar_free(pecan_watch_tar_t *tar);
+static pecan_err_t tar_members(const char *path,
+	cvector_vector_type(pecan_watch_member_t) old,
+	cvector_vector_type(pecan_watch_member_t) *members);
+static void members_free(cvector_vector_type(pecan_watch_member_t) members);
+static pecan_watch_member_t *member_find(
+	cvector_vector_type(pecan_watch_member_t) members, const char *name);
+static int member_same_header(pecan_watch_member_t *a,
+							  pecan_watch_member_t *b);
+static int member_index(const char *name);
+static uint64_t member_hash(mtar_t *tar, pecan_tarindex_t *idx,
+							mtar_header_t *header);
+static pecan_err_t members_update(pecan_archive_t *draft, void *arg);
+
+/**
+ * Starts watching the parts bin of a live catalog for changes. The catalog
+ * should have already been loaded from the same root directory.
+ *
+ * @param  watch Watch structure to be initialized.
+ * @param  lc    Live catalog to be kept in sync.
+ * @param  root  Path to the parts bin directory.
+ * @return       PECAN_OK if the operation was successful.
+ *               PECAN_ERR_PATH_NOT_FOUND if the directory wasn't found.
+ *               PECAN_ERR_FILE_IO if inotify couldn't be set up.
+ */
+pecan_err_t pecan_watch_init(pecan_watch_t *watch, pecan_livecat_t *lc,
+							 const char *root) {
+	watch->lc = lc;
+	watch->reader = NULL;
+	watch->root = NULL;
+	watch->fd = -1;
+	watch->dirs = NULL;
+	watch->tars = NULL;
+
+	// Check if we even have a directory there.
+	if (!is_dir(root)) {
+		err_format_msg(EMSG("Specified parts bin '%s' not found"), root);
+		return PECAN_ERR_PATH_NOT_FOUND;
+	}
+	watch->root = mem_strndup(NULL, root, strlen(root));
+
+	// Get a reader to look at the catalog.
+	watch->reader = pecan_livecat_reader_new(lc);
+	if (watch->reader == NULL)
+		return PECAN_ERR_UNKNOWN;
+
+	// Get inotify going.
+	watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watch->fd < 0) {
+		err_format_msg(EMSG("Couldn't initialize inotify: %s"),
+			strerror(errno));
+		return PECAN_ERR_FILE_IO;
+	}
+
+	// Watch every directory and remember how the packed archives look.
+	return watch_scan(watch, root, NULL);
+}
+
+/**
+ * Gets the file descriptor that becomes readable when there are changes to be
+ * processed. Useful for integrating the watch into an existing event loop.
+ *
+ * @param  watch Watch structure.
+ * @return       inotify file descriptor.
+ */
+int pecan_watch_fd(pecan_watch_t *watch) {
+	return watch->fd;
+}
+
+/**
+ * Waits for changes to the parts bin and applies them to the live catalog.
+ * Only the archives that changed are read again, and only the members that
+ * changed within them: the edited file of an unpacked archive or the members
+ * whose tar headers differ in a packed one.
+ *
+ * @param  watch    Watch structure.
+ * @param  timeout  Maximum time to wait for changes in milliseconds. 0 returns
+ *                  immediately and -1 waits forever.
+ * @param  nchanged Optional pointer to store the number of archives that were
+ *                  updated, added or removed.
+ * @return          PECAN_OK if the operation was successful.
+ *                  PECAN_ERR_FILE_IO if we couldn't read the events.
+ *                  Error of the first archive that couldn't be read otherwise,
+ *                  which keeps its previous contents in the catalog.
+ */
+pecan_err_t pecan_watch_process(pecan_watch_t *watch, int timeout,
+								size_t *nchanged) {
+	char buf[4096]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+	watch_changes_t changes = NULL;
+	watch_change_t *change;
+	struct pollfd pfd;
+	size_t count = 0;
+	pecan_err_t err = PECAN_OK;
+	int overflow = 0;
+	int ret;
+
+	if (nchanged)
+		*nchanged = 0;
+
+	// Wait for something to happen.
+	pfd.fd = watch->fd;
+	pfd.events = POLLIN;
+	ret = poll(&pfd, 1, timeout);
+	if (ret == 0 || ((ret < 0) && (errno == EINTR)))
+		return PECAN_OK;
+	if (ret < 0) {
+		err_format_msg(EMSG("Couldn't poll for changes: %s"), strerror(errno));
+		return PECAN_ERR_FILE_IO;
+	}
+
+	// Drain every event that is queued up.
+	for (;;) {
+		ssize_t len;
+		char *ptr;
+
+		len = read(watch->fd, buf, sizeof(buf));
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN)
+				break;
+
+			err_format_msg(EMSG("Couldn't read inotify events: %s"),
+				strerror(errno));
+			err = PECAN_ERR_FILE_IO;
+			goto cleanup;
+		}
+
+		for (ptr = buf; ptr < (buf + len);
+				ptr += sizeof(struct inotify_event) +
+				((struct inotify_event *)ptr)->len) {
+			struct inotify_event *ev = (struct inotify_event *)ptr;
+
+			if (ev->mask & IN_Q_OVERFLOW) {
+				overflow = 1;
+			} else {
+				watch_event(watch, ev, &changes);
+			}
+		}
+	}
+
+	// We lost track of things, so reload everything.
+	if (overflow) {
+		err = watch_resync(watch);
+		count = pecan_snapshot_len(pecan_livecat_enter(watch->reader));
+		pecan_livecat_leave(watch->reader);
+		goto cleanup;
+	}
+
+	// Apply the changes.
+	for (change = cvector_begin(changes); change != cvector_end(changes);
+			++change) {
+		pecan_err_t cerr = watch_apply(watch, change, &count);
+		if (cerr && (err == PECAN_OK))
+			err = cerr;
+	}
+
+cleanup:
+	cvector_free_each_and_free(changes, change_free);
+	if (nchanged)
+		*nchanged = count;
+
+	return err;
+}
+
+/**
+ * Stops watching the parts bin and frees up any resources allocated by the
+ * watch. The live catalog is left untouched.
+ *
+ * @param watch Watch to be free'd.
+ */
+void pecan_watch_free(pecan_watch_t *watch) {
+	pecan_watch_dir_t *dir;
+	pecan_watch_tar_t *tar;
+
+	// Stop inotify.
+	if (watch->fd >= 0)
+		close(watch->fd);
+	watch->fd = -1;
+
+	// Free up our records.
+	for (dir = cvector_begin(watch->dirs); dir != cvector_end(watch->dirs);
+			++dir) {
+		mem_free(NULL, dir->path);
+	}
+	cvector_free(watch->dirs);
+	watch->dirs = NULL;
+	for (tar = cvector_begin(watch->tars); tar != cvector_end(watch->tars);
+			++tar) {
+		tar_free(tar);
+	}
+	cvector_free(watch->tars);
+	watch->tars = NULL;
+
+	// Give back our reader.
+	pecan_livecat_reader_free(watch->reader);
+	watch->reader = NULL;
+	mem_free(NULL, watch->root);
+	watch->root = NULL;
+}
+
+/**
+ * Watches a directory and everything under it.
+ *
+ * @param  watch   Watch structure.
+ * @param  dir     Directory to be scanned.
+ * @param  changes Changes to queue the archives found into or NULL if we are
+ *                 just getting started.
+ * @return         PECAN_OK if the operation was successful.
+ */
+static pecan_err_t watch_scan(pecan_watch_t *watch, const char *dir,
+							  watch_changes_t *changes) {
+	struct dirent *ent;
+	pecan_err_t err;
+	DIR *dh;
+
+	// Watch the directory itself.
+	err = watch_add_dir(watch, dir);
+	if (err)
+		return err;
+
+	// Go through its contents.
+	dh = opendir(dir);
+	if (dh == NULL)
+		return PECAN_OK;
+	while ((err == PECAN_OK) && ((ent = readdir(dh)) != NULL)) {
+		char *path;
+
+		// Skip hidden files and the special directories.
+		if (ent->d_name[0] == '.')
+			continue;
+		pathcat(2, &path, dir, ent->d_name);
+
+		if (is_dir(path)) {
+			err = watch_found_dir(watch, path, changes);
+		} else if (file_ext_match(path, "tar")) {
+			// Remember how packed archives look so we can tell what changed.
+			if (changes) {
+				change_queue(changes, path, 1, 0);
+			} else {
+				tar_track(watch, path, NULL);
+			}
+		}
+
+		mem_free(NULL, path);
+	}
+
+	closedir(dh);
+	return err;
+}
+
+/**
+ * Handles a directory that was found in the parts bin, which is either an
+ * unpacked archive or a directory that may have more archives inside.
+ *
+ * @param  watch   Watch structure.
+ * @param  dir     Directory that was found.
+ * @param  changes Changes to queue the archives found into or NULL if we are
+ *                 just getting started.
+ * @return         PECAN_OK if the operation was successful.
+ */
+static pecan_err_t watch_found_dir(pecan_watch_t *watch, const char *dir,
+								   watch_changes_t *changes) {
+	pecan_err_t err;
+	char *manifest;
+
+	// Unpacked archives are watched for edits to their files.
+	pathcat(2, &manifest, dir, PECAN_MANIFEST_FILE);
+	if (file_exists(manifest)) {
+		err = watch_add_dir(watch, dir);
+		if (changes)
+			change_queue(changes, dir, 0, MEMBER_ALL);
+	} else {
+		err = watch_scan(watch, dir, changes);
+	}
+	mem_free(NULL, manifest);
+
+	return err;
+}
+
+/**
+ * Adds an inotify watch to a single directory.
+ *
+ * @param  watch Watch structure.
+ * @param  dir   Directory to be watched.
+ * @return       PECAN_OK if the operation was successful.
+ *               PECAN_ERR_FILE_IO if the watch couldn't be added.
+ */
+static pecan_err_t watch_add_dir(pecan_watch_t *watch, const char *dir) {
+	pecan_watch_dir_t entry;
+	pecan_watch_dir_t *it;
+
+	entry.wd = inotify_add_watch(watch->fd, dir, WATCH_EVENTS | IN_ONLYDIR);
+	if (entry.wd < 0) {
+		err_format_msg(EMSG("Couldn't watch directory '%s': %s"), dir,
+			strerror(errno));
+		return PECAN_ERR_FILE_IO;
+	}
+
+	// Directories that we already knew about keep the same descriptor.
+	for (it = cvector_begin(watch->dirs); it != cvector_end(watch->dirs);
+			++it) {
+		if (it->wd == entry.wd) {
+			mem_free(NULL, it->path);
+			it->path = mem_strndup(NULL, dir, strlen(dir));
+			return PECAN_OK;
+		}
+	}
+
+	entry.path = mem_strndup(NULL, dir, strlen(dir));
+	cvector_push_back(watch->dirs, entry);
+
+	return PECAN_OK;
+}
+
+/**
+ * Stops watching a directory and everything under it.
+ *
+ * @param watch  Watch structure.
+ * @param prefix Path of the directory.
+ */
+static void watch_drop_dirs(pecan_watch_t *watch, const char *prefix) {
+	size_t plen = strlen(prefix);
+	size_t i = 0;
+
+	while (i < cvector_size(watch->dirs)) {
+		pecan_watch_dir_t *dir = &watch->dirs[i];
+
+		if ((strncmp(dir->path, prefix, plen) == 0) &&
+				((dir->path[plen] == '\0') || (dir->path[plen] == '/'))) {
+			inotify_rm_watch(watch->fd, dir->wd);
+			mem_free(NULL, dir->path);
+			cvector_erase(watch->dirs, i);
+			continue;
+		}
+
+		i++;
+	}
+}
+
+/**
+ * Gets the path of a watched directory.
+ *
+ * @param  watch Watch structure.
+ * @param  wd    Watch descriptor.
+ * @return       Path of the directory or NULL if it isn't being watched.
+ */
+static const char *watch_dir_path(pecan_watch_t *watch, int wd) {
+	pecan_watch_dir_t *it;
+
+	for (it = cvector_begin(watch->dirs); it != cvector_end(watch->dirs);
+			++it) {
+		if (it->wd == wd)
+			return it->path;
+	}
+
+	return NULL;
+}
+
+/**
+ * Checks if an archive is currently in the live catalog.
+ *
+ * @param  watch Watch structure.
+ * @param  path  Path of the archive.
+ * @return       Non-zero if it is in the catalog.
+ */
+static int watch_has(pecan_watch_t *watch, const char *path) {
+	int found;
+
+	found = pecan_snapshot_find(pecan_livecat_enter(watch->reader),
+								path) != NULL;
+	pecan_livecat_leave(watch->reader);
+
+	return found;
+}
+
+/**
+ * Turns an inotify event into changes to be applied.
+ *
+ * @param watch   Watch structure.
+ * @param ev      Event to be handled.
+ * @param changes Changes to be applied.
+ */
+static void watch_event(pecan_watch_t *watch, struct inotify_event *ev,
+						watch_changes_t *changes) {
+	const char *dir;
+	char *manifest;
+	char *path;
+	int idx;
+
+	// The directory is gone, so is its watch.
+	if (ev->mask & IN_IGNORED) {
+		size_t i;
+
+		for (i = 0; i < cvector_size(watch->dirs); i++) {
+			if (watch->dirs[i].wd == ev->wd) {
+				mem_free(NULL, watch->dirs[i].path);
+				cvector_erase(watch->dirs, i);
+				break;
+			}
+		}
+
+		return;
+	}
+
+	// Only care about named things that aren't hidden.
+	dir = watch_dir_path(watch, ev->wd);
+	if ((dir == NULL) || (ev->len == 0) || (ev->name[0] == '.'))
+		return;
+	pathcat(2, &path, dir, ev->name);
+
+	if (ev->mask & IN_ISDIR) {
+		// Directories that came or went may have archives in them.
+		if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+			watch_found_dir(watch, path, changes);
+		} else {
+			watch_removed(watch, path, changes);
+			watch_drop_dirs(watch, path);
+		}
+	} else if (file_ext_match(path, "tar")) {
+		// Packed archive.
+		change_queue(changes, path, 1, 0);
+	} else if ((idx = member_index(ev->name)) >= 0) {
+		// A file of an unpacked archive.
+		pathcat(2, &manifest, dir, PECAN_MANIFEST_FILE);
+		if (file_exists(manifest) || watch_has(watch, dir))
+			change_queue(changes, dir, 0, 1 << idx);
+		mem_free(NULL, manifest);
+	}
+
+	mem_free(NULL, path);
+}
+
+/**
+ * Queues up the removal of every archive in the catalog under a path.
+ *
+ * @param watch   Watch structure.
+ * @param prefix  Path that went away.
+ * @param changes Changes to be applied.
+ */
+static void watch_removed(pecan_watch_t *watch, const char *prefix,
+						  watch_changes_t *changes) {
+	pecan_snapshot_t *snap;
+	size_t plen = strlen(prefix);
+	size_t i;
+
+	snap = pecan_livecat_enter(watch->reader);
+	for (i = 0; i < pecan_snapshot_len(snap); i++) {
+		pecan_livecat_item_t *item = pecan_snapshot_get(snap, i);
+
+		if ((strncmp(item->path, prefix, plen) == 0) &&
+				((item->path[plen] == '\0') || (item->path[plen] == '/'))) {
+			change_queue(changes, item->path, !is_dir(item->path),
+						 MEMBER_ALL);
+		}
+	}
+	pecan_livecat_leave(watch->reader);
+}
+
+/**
+ * Reloads the whole parts bin after we lost track of what happened.
+ *
+ * @param  watch Watch structure.
+ * @return       Same as pecan_livecat_load.
+ */
+static pecan_err_t watch_resync(pecan_watch_t *watch) {
+	pecan_watch_tar_t *tar;
+	pecan_err_t err;
+
+	// Forget what we knew about the packed archives.
+	for (tar = cvector_begin(watch->tars); tar != cvector_end(watch->tars);
+			++tar) {
+		tar_free(tar);
+	}
+	cvector_clear(watch->tars);
+
+	// Reload everything and look at the bin again.
+	err = pecan_livecat_load(watch->lc, watch->root);
+	if (err == PECAN_ERR_PATH_NOT_FOUND)
+		return err;
+	watch_scan(watch, watch->root, NULL);
+
+	return err;
+}
+
+/**
+ * Applies a change to the live catalog.
+ *
+ * @param  watch    Watch structure.
+ * @param  change   Change to be applied.
+ * @param  nchanged Counter of changed archives to be incremented.
+ * @return          PECAN_OK if the operation was successful.
+ */
+static pecan_err_t watch_apply(pecan_watch_t *watch, watch_change_t *change,
+							   size_t *nchanged) {
+	members_update_args_t args;
+	pecan_err_t err;
+	int exists;
+
+	// Check if the archive is still there.
+	if (change->packed) {
+		exists = file_exists(change->path) && !is_dir(change->path);
+	} else {
+		char *manifest;
+
+		pathcat(2, &manifest, change->path, PECAN_MANIFEST_FILE);
+		exists = file_exists(manifest);
+		mem_free(NULL, manifest);
+	}
+
+	// Archive went away.
+	if (!exists) {
+		if (change->packed)
+			tar_forget(watch, change->path);
+		if (pecan_livecat_remove(watch->lc, change->path) == PECAN_OK)
+			(*nchanged)++;
+
+		return PECAN_OK;
+	}
+
+	// New archive.
+	if (!watch_has(watch, change->path)) {
+		err = pecan_livecat_reload(watch->lc, change->path);
+		if (err)
+			return err;
+		if (change->packed)
+			tar_track(watch, change->path, NULL);
+
+		(*nchanged)++;
+		return PECAN_OK;
+	}
+
+	// Find out which members of a packed archive changed.
+	if (change->packed) {
+		err = tar_track(watch, change->path, &change->members);
+		if (err)
+			return err;
+	}
+	if (change->members == 0)
+		return PECAN_OK;
+
+	// Read only what changed.
+	args.path = change->path;
+	args.members = change->members;
+	err = pecan_livecat_update(watch->lc, change->path, members_update, &args);
+	if (err) {
+		// Make sure we look at the whole thing again next time.
+		if (change->packed)
+			tar_forget(watch, change->path);
+		return err;
+	}
+
+	(*nchanged)++;
+	return PECAN_OK;
+}
+
+/**
+ * Queues up a change to an archive, merging it with any other change that is
+ * already queued for the same archive.
+ *
+ * @param changes Changes to be applied.
+ * @param path    Path of the archive.
+ * @param packed  Is this a packed archive?
+ * @param members Bits of the members that changed. Packed archives figure
+ *                this out by themselves.
+ */
+static void change_queue(watch_changes_t *changes, const char *path,
+						 int packed, unsigned members) {
+	watch_change_t change;
+	watch_change_t *it;
+
+	// Merge with an existing change.
+	for (it = cvector_begin(*changes); it != cvector_end(*changes); ++it) {
+		if (strcmp(it->path, path) == 0) {
+			it->members |= members;
+			return;
+		}
+	}
+
+	change.path = mem_strndup(NULL, path, strlen(path));
+	change.packed = packed;
+	change.members = members;
+	cvector_push_back(*changes, change);
+}
+
+/**
+ * Frees up the contents of a change.
+ *
+ * @param change Change to be free'd.
+ */
+static void change_free(watch_change_t change) {
+	mem_free(NULL, change.path);
+}
+
+/**
+ * Finds the record of a packed archive.
+ *
+ * @param  watch Watch structure.
+ * @param  path  Path of the packed archive.
+ * @return       Record of the archive or NULL if it isn't being tracked.
+ */
+static pecan_watch_tar_t *tar_find(pecan_watch_t *watch, const char *path) {
+	pecan_watch_tar_t *it;
+
+	for (it = cvector_begin(watch->tars); it != cvector_end(watch->tars);
+			++it) {
+		if (strcmp(it->path, path) == 0)
+			return it;
+	}
+
+	return NULL;
+}
+
+/**
+ * Stops tracking a packed archive.
+ *
+ * @param watch Watch structure.
+ * @param path  Path of the packed archive.
+ */
+static void tar_forget(pecan_watch_t *watch, const char *path) {
+	pecan_watch_tar_t *tar = tar_find(watch, path);
+
+	if (tar == NULL)
+		return;
+
+	tar_free(tar);
+	cvector_erase(watch->tars, (size_t)(tar - watch->tars));
+}
+
+/**
+ * Reads the member headers of a packed archive and compares them with the
+ * ones we saw the last time. Since the headers we write ourselves always have
+ * the same modification time and mode, members whose headers didn't change
+ * are told apart by the hash of their contents, which is only known after the
+ * first time we saw them change.
+ *
+ * @param  watch   Watch structure.
+ * @param  path    Path of the packed archive.
+ * @param  changed Optional pointer to store the bits of the members that may
+ *                 have changed. Everything is flagged if it wasn't tracked.
+ * @return         PECAN_OK if the operation was successful.
+ *                 PECAN_ERR_FILE_IO if the archive couldn't be read.
+ */
+static pecan_err_t tar_track(pecan_watch_t *watch, const char *path,
+							 unsigned *changed) {
+	cvector_vector_type(pecan_watch_member_t) members = NULL;
+	pecan_watch_member_t *cur;
+	pecan_watch_member_t *old;
+	pecan_watch_tar_t entry;
+	pecan_watch_tar_t *tar;
+	pecan_err_t err;
+	unsigned bits = 0;
+	int idx;
+
+	// Get the current headers.
+	tar = tar_find(watch, path);
+	err = tar_members(path, (tar) ? tar->members : NULL, &members);
+	if (err)
+		return err;
+
+	// Start tracking new archives.
+	if (tar == NULL) {
+		entry.path = mem_strndup(NULL, path, strlen(path));
+		entry.members = members;
+		cvector_push_back(watch->tars, entry);
+		if (changed)
+			*changed = MEMBER_ALL;
+
+		return PECAN_OK;
+	}
+
+	// Flag members that changed or appeared.
+	for (cur = cvector_begin(members); cur != cvector_end(members); ++cur) {
+		int same = 0;
+
+		idx = member_index(cur->name);
+		if (idx < 0)
+			continue;
+
+		old = member_find(tar->members, cur->name);
+		if (old && member_same_header(old, cur)) {
+			same = (cur->size == 0) ||
+				((old->hash != 0) && (old->hash == cur->hash));
+		}
+
+		if (!same)
+			bits |= 1 << idx;
+	}
+
+	// Flag members that went away.
+	for (old = cvector_begin(tar->members); old != cvector_end(tar->members);
+			++old) {
+		idx = member_index(old->name);
+		if (idx < 0)
+			continue;
+
+		if (member_find(members, old->name) == NULL)
+			bits |= 1 << idx;
+	}
+
+	// Remember the new headers.
+	members_free(tar->members);
+	tar->members = members;
+	if (changed)
+		*changed = bits;
+
+	return PECAN_OK;
+}
+
+/**
+ * Frees up the contents of a packed archive record.
+ *
+ * @param tar Record to be free'd.
+ */
+static void tar_free(pecan_watch_tar_t *tar) {
+	mem_free(NULL, tar->path);
+	members_free(tar->members);
+}
+
+/**
+ * Reads the headers of every member of a packed archive. The contents of the
+ * members we care about are only hashed when their headers are the same as
+ * the last time we saw them, since that's the only way to tell if they were
+ * changed, so nothing but the headers is read when an archive is first seen.
+ *
+ * @param  path    Path of the packed archive.
+ * @param  old     Headers we saw the last time or NULL if it wasn't tracked.
+ * @param  members Vector to store the headers in.
+ * @return         PECAN_OK if the operation was successful.
+ *                 PECAN_ERR_FILE_IO if the archive couldn't be read.
+ */
+static pecan_err_t tar_members(const char *path,
+	cvector_vector_type(pecan_watch_member_t) old,
+	cvector_vector_type(pecan_watch_member_t) *members) {
+	pecan_watch_member_t member;
+	pecan_watch_member_t *prev;
+	pecan_tarindex_t idx;
+	mtar_header_t header;
+	mtar_t tar;
+	int mterr;
+
+	// Open archive for reading.
+	mterr = mtar_open(&tar, path, "r");
+	if (mterr) {
+		err_format_msg(EMSG("microtar error: %s"), mtar_strerror(mterr));
+		return PECAN_ERR_FILE_IO;
+	}
+	tarindex_init(&idx);
+	if (old)
+		tarindex_read(&idx, &tar);
+
+	// Go through the headers, only hashing the ones that didn't change.
+	while ((mterr = mtar_read_header(&tar, &header)) == MTAR_ESUCCESS) {
+		member.name = mem_strndup(NULL, header.name, strlen(header.name));
+		member.size = header.size;
+		member.mtime = header.mtime;
+		member.mode = header.mode;
+		member.offset = tar.pos + TAR_BLOCK_SIZE;
+		member.hash = 0;
+		prev = member_find(old, header.name);
+		if (prev && member_same_header(prev, &member))
+			member.hash = member_hash(&tar, &idx, &header);
+		cvector_push_back(*members, member);
+
+		mtar_next(&tar);
+	}
+	tarindex_free(&idx);
+	mtar_close(&tar);
+
+	// Running into the end of the archive is the only way out.
+	if (mterr != MTAR_ENULLRECORD) {
+		members_free(*members);
+		*members = NULL;
+		err_format_msg(EMSG("microtar error: %s"), mtar_strerror(mterr));
+		return PECAN_ERR_FILE_IO;
+	}
+
+	return PECAN_OK;
+}
+
+/**
+ * Frees up a vector of member headers.
+ *
+ * @param members Vector to be free'd.
+ */
+static void members_free(cvector_vector_type(pecan_watch_member_t) members) {
+	pecan_watch_member_t *it;
+
+	for (it = cvector_begin(members); it != cvector_end(members); ++it)
+		mem_free(NULL, it->name);
+	cvector_free(members);
+}
+
+/**
+ * Finds a member in a vector of member headers.
+ *
+ * @param  members Vector of member headers.
+ * @param  name    Name of the member.
+ * @return         Header of the member or NULL if it wasn't found.
+ */
+static pecan_watch_member_t *member_find(
+	cvector_vector_type(pecan_watch_member_t) members, const char *name) {
+	pecan_watch_member_t *it;
+
+	for (it = cvector_begin(members); it != cvector_end(members); ++it) {
+		if (strcmp(it->name, name) == 0)
+			return it;
+	}
+
+	return NULL;
+}
+
+/**
+ * Checks if two headers of the same member are the same.
+ *
+ * @param  a First header.
+ * @param  b Second header.
+ * @return   Non-zero if they are the same.
+ */
+static int member_same_header(pecan_watch_member_t *a,
+							  pecan_watch_member_t *b) {
+	return (a->size == b->size) && (a->mtime == b->mtime) &&
+		(a->mode == b->mode) && (a->offset == b->offset);
+}
+
+/**
+ * Gets the index of an archive member file from its name.
+ *
+ * @param  name Name of the file.
+ * @return      Index of the member or -1 if it isn't one.
+ */
+static int member_index(const char *name) {
+	int i;
+
+	for (i = 0; i < MEMBER_COUNT; i++) {
+		if (strcmp(name, member_names[i]) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+/**
+ * Gets the hash of the contents of an archive member file. The hash stored in
+ * the index is used whenever it can be trusted, otherwise the contents are
+ * read and hashed. The archive is left at the member's header.
+ *
+ * @param  tar    Opened TAR file object positioned at the member's header.
+ * @param  idx    Index of the archive.
+ * @param  header Header of the member.
+ * @return        Hash of the contents or 0 if it isn't a member file, is
+ *                empty or couldn't be read.
+ */
+static uint64_t member_hash(mtar_t *tar, pecan_tarindex_t *idx,
+							mtar_header_t *header) {
+	pecan_tarindex_entry_t entry;
+	uint64_t hash;
+	void *data;
+
+	// We only care about the member files that have something in them.
+	if ((member_index(header->name) < 0) || (header->size == 0))
+		return 0;
+
+	// Trust the index as long as it agrees with where the contents are.
+	if (tarindex_find(idx, header->name, &entry) && (entry.hash != 0) &&
+			(entry.offset == (tar->pos + TAR_BLOCK_SIZE)) &&
+			(entry.size == header->size))
+		return entry.hash;
+
+	// Hash the contents ourselves.
+	data = mem_alloc(NULL, header->size);
+	if (data == NULL)
+		return 0;
+	tar->remaining_data = 0;
+	hash = (mtar_read_data(tar, data, header->size) == MTAR_ESUCCESS) ?
+		blob_hash(data, header->size) : 0;
+	mem_free(NULL, data);
+	mtar_seek(tar, tar->last_header);
+
+	return hash;
+}
+
+/**
+ * Update function that re-reads some members of an archive.
+ *
+ * @param  draft Draft of the archive.
+ * @param  arg   Path and members to be read.
+ * @return       Same as pecan_read_member.
+ */
+static pecan_err_t members_update(pecan_archive_t *draft, void *arg) {
+	members_update_args_t *args = (members_update_args_t *)arg;
+	pecan_err_t err;
+	int i;
+
+	for (i = 0; i < MEMBER_COUNT; i++) {
+		if (!(args->members & (1 << i)))
+			continue;
+
+		err = pecan_read_member(draft, args->path, member_names[i]);
+		if (err)
+			return err;
+	}
+
+	return PECAN_OK;
+}
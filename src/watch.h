@@ -0,0 +1,72 @@
+/**
+ * watch.h
+ * Keeps a live catalog in sync with the parts bin on disk using inotify.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _WATCH_H
+#define _WATCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "livecat.h"
+
+// Header of a member of a packed archive as it was last seen, along with where
+// its contents were and their hash, since the headers we write ourselves
+// always have the same modification time and mode. The hash is 0 until the
+// member is seen again with the same header.
+typedef struct {
+	char *name;
+	unsigned size;
+	unsigned mtime;
+	unsigned mode;
+	size_t offset;
+	uint64_t hash;
+} pecan_watch_member_t;
+
+// Packed archive being tracked.
+typedef struct {
+	char *path;
+	cvector_vector_type(pecan_watch_member_t) members;
+} pecan_watch_tar_t;
+
+// Directory being watched.
+typedef struct {
+	int wd;
+	char *path;
+} pecan_watch_dir_t;
+
+// Watch structure definition.
+typedef struct {
+	pecan_livecat_t *lc;
+	pecan_reader_t *reader;
+	char *root;
+	int fd;
+
+	cvector_vector_type(pecan_watch_dir_t) dirs;
+	cvector_vector_type(pecan_watch_tar_t) tars;
+} pecan_watch_t;
+
+// Initialization
+PECAN_EXPORTS pecan_err_t pecan_watch_init(pecan_watch_t *watch,
+										   pecan_livecat_t *lc,
+										   const char *root);
+PECAN_EXPORTS int pecan_watch_fd(pecan_watch_t *watch);
+
+// Operations
+PECAN_EXPORTS pecan_err_t pecan_watch_process(pecan_watch_t *watch,
+											  int timeout, size_t *nchanged);
+
+// Cleanup
+PECAN_EXPORTS void pecan_watch_free(pecan_watch_t *watch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WATCH_H */
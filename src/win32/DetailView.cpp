@@ -109,15 +109,14 @@ void DetailViewSetImage(Pecan* pecan) {
 	// Clear the current image.
 	DetailViewClearImage();
 
-	// Grab the component image from the archive.
+	// Grab the component image from the archive already scaled down.
 	PECAN_BLOB blob = pecan->GetImage();
-	if (!image.LoadBitmap(blob.data, blob.len)) {
-		MsgBoxLastError(NULL);
+	if (!image.LoadThumbnail(blob.data, blob.len, nImageWidth, nImageHeight)) {
+		pecan->ShowLastErrorMessage();
 		return;
 	}
 
-	// Resize and display it.
-	image.Resize(nImageWidth, nImageHeight);
+	// Display it.
 	SendDlgItemMessage(hwndDetail, IDC_IMAGE, STM_SETIMAGE, IMAGE_BITMAP,
 		(LPARAM)*image.GetBitmapHandle());
 }
@@ -7,6 +7,8 @@
 
 #include "Image.h"
 
+#include "../bmp.h"
+
 /**
  * Constructs an empty image object.
  */
@@ -46,18 +48,51 @@ BOOL Image::LoadBitmap(LPCTSTR szPath) {
  * @return          TRUE if the operation was successful.
  */
 BOOL Image::LoadBitmap(LPCVOID lpBuffer, SIZE_T nLen) {
-	TCHAR szTempFile[MAX_PATH];
+	pecan_bmp_t bmp;
+	LPVOID lpBits;
 
-	// Create a temporary file.
-	if (!CreateTempFileContent(szTempFile, lpBuffer, nLen))
+	// Parse the bitmap straight from memory.
+	if (pecan_bmp_open(&bmp, lpBuffer, nLen) != PECAN_OK)
 		return FALSE;
 
-	// Load the temporary bitmap file.
-	if (!LoadBitmap(szTempFile))
+	// Decode it into a bitmap of the same size.
+	if (!CreateSection(bmp.width, bmp.height, &lpBits))
+		return FALSE;
+	if (pecan_bmp_decode(&bmp, lpBits, bmp.width * PECAN_BMP_PIXEL_SIZE) !=
+			PECAN_OK) {
+		DestroyBitmapHandle();
 		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Loads a bitmap from a buffer scaled down to a thumbnail.
+ * 
+ * @param  lpBuffer Bitmap file buffer.
+ * @param  nLen     Length of the buffer.
+ * @param  cx       Width of the thumbnail.
+ * @param  cy       Height of the thumbnail.
+ * 
+ * @return          TRUE if the operation was successful.
+ */
+BOOL Image::LoadThumbnail(LPCVOID lpBuffer, SIZE_T nLen, int cx, int cy) {
+	pecan_bmp_t bmp;
+	LPVOID lpBits;
 
-	// Delete the temporary file.
-	DeleteFile(szTempFile);
+	// Parse the bitmap straight from memory.
+	if (pecan_bmp_open(&bmp, lpBuffer, nLen) != PECAN_OK)
+		return FALSE;
+
+	// Scale it down without going through GDI.
+	if (!CreateSection(cx, cy, &lpBits))
+		return FALSE;
+	if (pecan_bmp_thumbnail(&bmp, lpBits, cx, cy, cx * PECAN_BMP_PIXEL_SIZE,
+			PECAN_BMP_BOX) != PECAN_OK) {
+		DestroyBitmapHandle();
+		return FALSE;
+	}
 
 	return TRUE;
 }
@@ -121,3 +156,35 @@ void Image::DestroyBitmapHandle() {
 	DeleteObject(this->hBitmap);
 	this->hBitmap = NULL;
 }
+
+/**
+ * Replaces the internal bitmap handle with a top-down 32-bit DIB section that
+ * our decoder can write into.
+ * 
+ * @param  cx       Width of the bitmap.
+ * @param  cy       Height of the bitmap.
+ * @param  lppvBits Returns a pointer to the pixels of the bitmap.
+ * 
+ * @return          TRUE if the operation was successful.
+ */
+BOOL Image::CreateSection(int cx, int cy, LPVOID *lppvBits) {
+	BITMAPINFO bmi = { 0 };
+	HDC hdcScreen;
+
+	// Describe the pixel layout of the decoder.
+	bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+	bmi.bmiHeader.biWidth = cx;
+	bmi.bmiHeader.biHeight = -cy;
+	bmi.bmiHeader.biPlanes = 1;
+	bmi.bmiHeader.biBitCount = 32;
+	bmi.bmiHeader.biCompression = BI_RGB;
+
+	// Create the section.
+	DestroyBitmapHandle();
+	hdcScreen = GetDC(NULL);
+	this->hBitmap = CreateDIBSection(hdcScreen, &bmi, DIB_RGB_COLORS, lppvBits,
+		NULL, 0);
+	ReleaseDC(NULL, hdcScreen);
+
+	return this->hBitmap != NULL;
+}
@@ -16,6 +16,8 @@ class Image {
 protected:
 	HBITMAP hBitmap;
 
+	BOOL CreateSection(int cx, int cy, LPVOID *lppvBits);
+
 public:
 	// Constructors and Destructors
 	Image();
@@ -24,6 +26,7 @@ public:
 	// Getters and Setters
 	BOOL LoadBitmap(LPCTSTR szPath);
 	BOOL LoadBitmap(LPCVOID lpBuffer, SIZE_T nLen);
+	BOOL LoadThumbnail(LPCVOID lpBuffer, SIZE_T nLen, int cx, int cy);
 	HBITMAP* GetBitmapHandle();
 	void DestroyBitmapHandle();
 
@@ -0,0 +1,539 @@
+/**
+ * writer.c
+ * Incremental writer of component archives, one member at a time.
+ *
+ * Members are streamed straight into the archive as they are added, so their
+ * contents never have to be held in memory all at once. Since we only know
+ * what went into the archive once it's closed, a slot of
+ * PECAN_WRITER_INDEX_RESERVE bytes is set aside for the index as the first
+ * member and filled in at the very end. Archives with more members than the
+ * slot is able to describe get the slot turned into padding and are simply
+ * left without an index.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#include "writer.h"
+
+#include <cvector_utils.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#	include <io.h>
+#else
+#	include <unistd.h>
+#endif  // _WIN32
+
+#include "error.h"
+#include "fileutils.h"
+
+// Padding members of packed archives.
+#define TAR_PAD_NAME  "././@PaxHeader"
+#define TAR_TYPE_PAX  'x'
+
+// Longest member name that fits in a TAR header.
+#define TAR_NAME_MAX  99
+
+// Handle microtar errors.
+#define HANDLE_MTAR_ERR(mterr)                                                \
+	do {                                                                      \
+		if (mterr) {                                                          \
+			err_format_msg(EMSG("microtar error: %s"), mtar_strerror(mterr)); \
+			err = PECAN_ERR_FILE_IO;                                          \
+			goto cleanup;                                                     \
+		}                                                                     \
+	} while (0)
+
+// Private methods.
+static int writer_write(mtar_t *tar, const void *data, unsigned size);
+static int writer_seek(mtar_t *tar, unsigned pos);
+static int writer_flush(pecan_writer_t *w);
+static pecan_err_t writer_begin(pecan_writer_t *w, const char *name,
+								size_t len, int align);
+static pecan_err_t writer_index(pecan_writer_t *w);
+static int tar_write_pad(mtar_t *tar, unsigned len);
+
+/**
+ * Creates an archive and gets it ready to have members added to it.
+ *
+ * @param  w     Archive writer to be initialized.
+ * @param  fname Path to the component archive file to write to.
+ * @param  flags PECAN_WRITE_ALIGN_BLOBS to have the contents of every member
+ *               that isn't an attribute file start on a PECAN_BLOB_ALIGN
+ *               boundary inside the archive.
+ * @return       PECAN_OK if the operation was successful.
+ *               PECAN_ERR_PATH_NOT_FOUND if the specified path wasn't writable.
+ *               PECAN_ERR_FILE_IO if there were errors while trying to write.
+ */
+pecan_err_t pecan_writer_open(pecan_writer_t *w, const char *fname,
+							  unsigned int flags) {
+	static const char zeros[TAR_BLOCK_SIZE] = { 0 };
+	pecan_err_t err = PECAN_OK;
+	int mterr = MTAR_ESUCCESS;
+	int i;
+
+	// Set everything up.
+	w->flags = flags;
+	w->buf = NULL;
+	w->buf_len = 0;
+	w->members = NULL;
+	memset(&w->tar, 0, sizeof(mtar_t));
+	w->tar.write = writer_write;
+	w->tar.seek = writer_seek;
+	w->tar.stream = w;
+
+	// Create the archive.
+#ifdef _WIN32
+	w->fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+#else
+	w->fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif  // _WIN32
+	if (w->fd == -1) {
+		err_format_msg(EMSG("Couldn't open '%s' for writing"), fname);
+		return PECAN_ERR_PATH_NOT_FOUND;
+	}
+
+	// Allocate the write buffer.
+	w->buf = (char *)mem_alloc(NULL, PECAN_WRITER_BUF_SIZE);
+	if (w->buf == NULL) {
+		err_set_msg(EMSG("Couldn't allocate the archive write buffer"));
+		err = PECAN_ERR_UNKNOWN;
+		goto cleanup;
+	}
+
+	// Set aside the slot for the index.
+	mterr = mtar_write_file_header(&w->tar, PECAN_INDEX_FILE,
+								   PECAN_WRITER_INDEX_RESERVE);
+	HANDLE_MTAR_ERR(mterr);
+	for (i = 0; i < (PECAN_WRITER_INDEX_RESERVE / TAR_BLOCK_SIZE); i++) {
+		mterr = mtar_write_data(&w->tar, zeros, TAR_BLOCK_SIZE);
+		HANDLE_MTAR_ERR(mterr);
+	}
+
+	return PECAN_OK;
+
+cleanup:
+	close(w->fd);
+	w->fd = -1;
+	mem_free(NULL, w->buf);
+	w->buf = NULL;
+	return err;
+}
+
+/**
+ * Adds a set of attributes to the archive as a TSV file. The attributes are
+ * formatted straight into the archive, without any intermediate allocations.
+ *
+ * @param  w       Archive writer.
+ * @param  name    Name of the member, usually PECAN_MANIFEST_FILE or
+ *                 PECAN_PARAM_FILE.
+ * @param  attribs Attributes to be written.
+ * @return         PECAN_OK if the operation was successful.
+ *                 PECAN_ERR_FILE_IO if there were errors while trying to write.
+ */
+pecan_err_t pecan_writer_add_attrs(pecan_writer_t *w, const char *name,
+								   pecan_attr_arr_t attribs) {
+	pecan_attr_t *attr;
+	size_t len;
+	pecan_err_t err;
+	int mterr = MTAR_ESUCCESS;
+
+	// Figure out how big the file is going to be.
+	len = 0;
+	for (attr = cvector_begin(attribs); attr != cvector_end(attribs); ++attr) {
+		len += ((attr->name) ? strlen(attr->name) : 0) +
+			((attr->value) ? strlen(attr->value) : 0) + 2;
+	}
+
+	// Attribute files are tiny and never mapped, so there's no need to align.
+	err = writer_begin(w, name, len, 0);
+	if (err)
+		return err;
+
+	// Write each attribute as a line of the file.
+	for (attr = cvector_begin(attribs); attr != cvector_end(attribs); ++attr) {
+		if (attr->name) {
+			mterr = mtar_write_data(&w->tar, attr->name,
+									(unsigned)strlen(attr->name));
+			HANDLE_MTAR_ERR(mterr);
+		}
+		mterr = mtar_write_data(&w->tar, "\t", 1);
+		HANDLE_MTAR_ERR(mterr);
+		if (attr->value) {
+			mterr = mtar_write_data(&w->tar, attr->value,
+									(unsigned)strlen(attr->value));
+			HANDLE_MTAR_ERR(mterr);
+		}
+		mterr = mtar_write_data(&w->tar, "\n", 1);
+		HANDLE_MTAR_ERR(mterr);
+	}
+
+cleanup:
+	return err;
+}
+
+/**
+ * Adds a member to the archive from memory.
+ *
+ * @param  w    Archive writer.
+ * @param  name Name of the member.
+ * @param  data Contents of the member.
+ * @param  len  Length of the contents.
+ * @return      PECAN_OK if the operation was successful.
+ *              PECAN_ERR_FILE_IO if there were errors while trying to write.
+ */
+pecan_err_t pecan_writer_add_data(pecan_writer_t *w, const char *name,
+								  const void *data, size_t len) {
+	pecan_err_t err;
+	int mterr = MTAR_ESUCCESS;
+
+	err = writer_begin(w, name, len, 1);
+	if (err)
+		return err;
+
+	mterr = mtar_write_data(&w->tar, data, (unsigned)len);
+	HANDLE_MTAR_ERR(mterr);
+	w->members[cvector_size(w->members) - 1].hash = blob_hash(data, len);
+
+cleanup:
+	return err;
+}
+
+/**
+ * Adds a member to the archive with the contents of a file. The file is
+ * copied by the kernel whenever possible instead of being read into memory.
+ *
+ * @param  w     Archive writer.
+ * @param  name  Name of the member.
+ * @param  fpath Path to the file with the contents of the member.
+ * @return       PECAN_OK if the operation was successful.
+ *               PECAN_ERR_PATH_NOT_FOUND if the file couldn't be opened.
+ *               PECAN_ERR_FILE_IO if there were errors while trying to write.
+ */
+pecan_err_t pecan_writer_add_file(pecan_writer_t *w, const char *name,
+								  const char *fpath) {
+	struct stat st;
+	pecan_err_t err;
+	int fd;
+
+	// Open the file.
+#ifdef _WIN32
+	fd = open(fpath, O_RDONLY | O_BINARY);
+#else
+	fd = open(fpath, O_RDONLY);
+#endif  // _WIN32
+	if (fd == -1) {
+		err_format_msg(EMSG("Couldn't open '%s' for reading"), fpath);
+		return PECAN_ERR_PATH_NOT_FOUND;
+	}
+
+	// Copy the whole thing.
+	if (fstat(fd, &st) == -1) {
+		err_format_msg(EMSG("Couldn't get the size of '%s'"), fpath);
+		err = PECAN_ERR_FILE_IO;
+	} else {
+		err = pecan_writer_add_fd(w, name, fd, (size_t)st.st_size);
+	}
+
+	close(fd);
+	return err;
+}
+
+/**
+ * Adds a member to the archive with bytes read from a file descriptor, starting
+ * at its current position. The data is moved by the kernel whenever possible,
+ * which also works for pipes.
+ *
+ * @param  w    Archive writer.
+ * @param  name Name of the member.
+ * @param  fd   File descriptor to read the contents from.
+ * @param  len  Number of bytes to read, since the size has to be known upfront.
+ * @return      PECAN_OK if the operation was successful.
+ *              PECAN_ERR_FILE_IO if there were errors while trying to read or
+ *              write.
+ */
+pecan_err_t pecan_writer_add_fd(pecan_writer_t *w, const char *name, int fd,
+								size_t len) {
+	pecan_err_t err;
+	int mterr = MTAR_ESUCCESS;
+
+	err = writer_begin(w, name, len, 1);
+	if (err)
+		return err;
+
+	// Get what's buffered out of the way and let the kernel do the copying.
+	if (writer_flush(w) != MTAR_ESUCCESS) {
+		err_set_msg(EMSG("Couldn't write to the archive"));
+		return PECAN_ERR_FILE_IO;
+	}
+	if (!fd_send(fd, len, w->fd)) {
+		err_format_msg(EMSG("Couldn't copy the contents of '%s'"), name);
+		return PECAN_ERR_FILE_IO;
+	}
+
+	// Let microtar know the data went through and pad it to a full block. The
+	// hash is left unknown, since we never got to see the contents.
+	w->tar.pos += (unsigned)len;
+	w->tar.remaining_data = 0;
+	mterr = mtar_write_data(&w->tar, NULL, 0);
+	HANDLE_MTAR_ERR(mterr);
+
+cleanup:
+	return err;
+}
+
+/**
+ * Finishes writing the archive, fills in its index and closes it. Everything
+ * is free'd even if the operation fails.
+ *
+ * @param  w Archive writer.
+ * @return   PECAN_OK if the operation was successful.
+ *           PECAN_ERR_FILE_IO if there were errors while trying to write.
+ */
+pecan_err_t pecan_writer_close(pecan_writer_t *w) {
+	pecan_tarindex_entry_t *entry;
+	pecan_err_t err = PECAN_OK;
+	int mterr = MTAR_ESUCCESS;
+
+	// Has it been opened at all?
+	if (w->fd == -1)
+		return PECAN_OK;
+
+	// Finalize the archive and go back to fill in the index.
+	mterr = mtar_finalize(&w->tar);
+	HANDLE_MTAR_ERR(mterr);
+	err = writer_index(w);
+	if (err)
+		goto cleanup;
+	mterr = writer_flush(w);
+	HANDLE_MTAR_ERR(mterr);
+
+cleanup:
+	if ((close(w->fd) != 0) && (err == PECAN_OK)) {
+		err_set_msg(EMSG("Couldn't close the archive"));
+		err = PECAN_ERR_FILE_IO;
+	}
+	w->fd = -1;
+
+	// Free up everything.
+	for (entry = cvector_begin(w->members); entry != cvector_end(w->members);
+			entry++) {
+		mem_free(NULL, (char *)entry->name);
+	}
+	cvector_free(w->members);
+	w->members = NULL;
+	mem_free(NULL, w->buf);
+	w->buf = NULL;
+
+	return err;
+}
+
+/**
+ * Writes the header of a new member, preceded by padding if it has to be
+ * aligned, and records it for the index.
+ *
+ * @param  w     Archive writer.
+ * @param  name  Name of the member.
+ * @param  len   Length of its contents.
+ * @param  align Should the contents be aligned if the archive asks for it?
+ * @return       PECAN_OK if the operation was successful.
+ *               PECAN_ERR_FILE_IO if there were errors while trying to write.
+ */
+static pecan_err_t writer_begin(pecan_writer_t *w, const char *name,
+								size_t len, int align) {
+	pecan_tarindex_entry_t entry;
+	unsigned pad;
+	pecan_err_t err = PECAN_OK;
+	int mterr = MTAR_ESUCCESS;
+
+	// Check if the member is something that we are able to write.
+	if (w->fd == -1) {
+		err_set_msg(EMSG("Archive isn't opened for writing"));
+		return PECAN_ERR_FILE_IO;
+	}
+	entry.name_len = strlen(name);
+	if ((entry.name_len == 0) || (entry.name_len > TAR_NAME_MAX)) {
+		err_format_msg(EMSG("Invalid archive member name '%s'"), name);
+		return PECAN_ERR_FILE_IO;
+	}
+	if ((len > (UINT_MAX - (2 * PECAN_BLOB_ALIGN))) ||
+			(w->tar.pos > (UINT_MAX - (2 * PECAN_BLOB_ALIGN) - len))) {
+		err_format_msg(EMSG("Member '%s' is too big for the archive"), name);
+		return PECAN_ERR_FILE_IO;
+	}
+
+	// Pad the archive until the contents land on an aligned offset.
+	if (align && (w->flags & PECAN_WRITE_ALIGN_BLOBS)) {
+		pad = (2 * PECAN_BLOB_ALIGN - TAR_BLOCK_SIZE -
+			(w->tar.pos % PECAN_BLOB_ALIGN)) % PECAN_BLOB_ALIGN;
+		if (pad) {
+			mterr = tar_write_pad(&w->tar, pad);
+			HANDLE_MTAR_ERR(mterr);
+		}
+	}
+
+	// Write the header.
+	mterr = mtar_write_file_header(&w->tar, name, (unsigned)len);
+	HANDLE_MTAR_ERR(mterr);
+
+	// Keep track of it for the index.
+	entry.name = mem_strndup(NULL, name, entry.name_len);
+	if (entry.name == NULL) {
+		err_set_msg(EMSG("Couldn't allocate the archive member name"));
+		return PECAN_ERR_UNKNOWN;
+	}
+	entry.offset = w->tar.pos;
+	entry.size = (uint32_t)len;
+	entry.hash = 0;
+	cvector_push_back(w->members, entry);
+
+cleanup:
+	return err;
+}
+
+/**
+ * Fills in the slot at the front of the archive with its index or with padding
+ * if the index doesn't fit in it.
+ *
+ * @param  w Archive writer with every member already written.
+ * @return   PECAN_OK if the operation was successful.
+ *           PECAN_ERR_FILE_IO if there were errors while trying to write.
+ */
+static pecan_err_t writer_index(pecan_writer_t *w) {
+	pecan_tarindex_t idx;
+	uint32_t count;
+	pecan_err_t err = PECAN_OK;
+	int mterr = MTAR_ESUCCESS;
+
+	tarindex_init(&idx);
+	count = (uint32_t)cvector_size(w->members);
+
+	// Too many members to be described in the space we've got.
+	if (tarindex_size(w->members, count) > PECAN_WRITER_INDEX_RESERVE) {
+		mterr = mtar_seek(&w->tar, 0);
+		HANDLE_MTAR_ERR(mterr);
+		mterr = tar_write_pad(&w->tar,
+							  TAR_BLOCK_SIZE + PECAN_WRITER_INDEX_RESERVE);
+		HANDLE_MTAR_ERR(mterr);
+
+		return PECAN_OK;
+	}
+
+	// Build the index and drop it right after its header.
+	if (!tarindex_build(&idx, w->members, count)) {
+		err_set_msg(EMSG("Couldn't allocate the archive index"));
+		return PECAN_ERR_UNKNOWN;
+	}
+	mterr = mtar_seek(&w->tar, TAR_BLOCK_SIZE);
+	HANDLE_MTAR_ERR(mterr);
+	mterr = w->tar.write(&w->tar, idx.data, (unsigned)idx.len);
+	HANDLE_MTAR_ERR(mterr);
+
+cleanup:
+	tarindex_free(&idx);
+	return err;
+}
+
+/**
+ * Writes a member that does nothing but take up space in the archive. It's a
+ * pax extended header with only a comment in it, which standard TAR
+ * implementations skip over.
+ *
+ * @param  tar TAR file object being written.
+ * @param  len Number of bytes to take up, including the header. Must be a
+ *             multiple of TAR_BLOCK_SIZE and no bigger than PECAN_BLOB_ALIGN.
+ * @return     MicroTAR error code.
+ */
+static int tar_write_pad(mtar_t *tar, unsigned len) {
+	char rec[PECAN_BLOB_ALIGN];
+	mtar_header_t header;
+	int mterr;
+	int n;
+
+	// Write the header.
+	memset(&header, 0, sizeof(header));
+	strcpy(header.name, TAR_PAD_NAME);
+	header.type = TAR_TYPE_PAX;
+	header.mode = 0644;
+	header.size = len - TAR_BLOCK_SIZE;
+	mterr = mtar_write_header(tar, &header);
+	if (mterr || (header.size == 0))
+		return mterr;
+
+	// Fill it up with a single comment record of the right length.
+	n = sprintf(rec, "%u comment=", header.size);
+	memset(rec + n, ' ', header.size - n - 1);
+	rec[header.size - 1] = '\n';
+
+	return mtar_write_data(tar, rec, header.size);
+}
+
+/**
+ * MicroTAR write callback that gathers everything in our buffer.
+ *
+ * @param  tar  TAR file object being written.
+ * @param  data Data to be written.
+ * @param  size Length of the data.
+ * @return      MicroTAR error code.
+ */
+static int writer_write(mtar_t *tar, const void *data, unsigned size) {
+	pecan_writer_t *w = (pecan_writer_t *)tar->stream;
+
+	if (size == 0)
+		return MTAR_ESUCCESS;
+
+	// Make room for it.
+	if ((w->buf_len + size) > PECAN_WRITER_BUF_SIZE) {
+		if (writer_flush(w) != MTAR_ESUCCESS)
+			return MTAR_EWRITEFAIL;
+	}
+
+	// Big chunks go straight to the file.
+	if (size >= PECAN_WRITER_BUF_SIZE)
+		return fd_write(w->fd, data, size) ? MTAR_ESUCCESS : MTAR_EWRITEFAIL;
+
+	memcpy(w->buf + w->buf_len, data, size);
+	w->buf_len += size;
+
+	return MTAR_ESUCCESS;
+}
+
+/**
+ * MicroTAR seek callback.
+ *
+ * @param  tar TAR file object being written.
+ * @param  pos Absolute position to seek to.
+ * @return     MicroTAR error code.
+ */
+static int writer_seek(mtar_t *tar, unsigned pos) {
+	pecan_writer_t *w = (pecan_writer_t *)tar->stream;
+
+	if (writer_flush(w) != MTAR_ESUCCESS)
+		return MTAR_EWRITEFAIL;
+	if (lseek(w->fd, (off_t)pos, SEEK_SET) == (off_t)-1)
+		return MTAR_ESEEKFAIL;
+
+	return MTAR_ESUCCESS;
+}
+
+/**
+ * Writes everything that's in the buffer to the archive.
+ *
+ * @param  w Archive writer.
+ * @return   MicroTAR error code.
+ */
+static int writer_flush(pecan_writer_t *w) {
+	bool ok;
+
+	if (w->buf_len == 0)
+		return MTAR_ESUCCESS;
+
+	ok = fd_write(w->fd, w->buf, w->buf_len);
+	w->buf_len = 0;
+
+	return (ok) ? MTAR_ESUCCESS : MTAR_EWRITEFAIL;
+}
@@ -0,0 +1,66 @@
+/**
+ * writer.h
+ * Incremental writer of component archives, one member at a time.
+ *
+ * @author Nathan Campos <nathan@innoveworkshop.com>
+ */
+
+#ifndef _WRITER_H
+#define _WRITER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <microtar.h>
+#include <stdint.h>
+
+#include "pecan.h"
+#include "tarindex.h"
+
+// Space set aside for the index at the front of the archive. Enough for a few
+// dozen members with reasonable names.
+#define PECAN_WRITER_INDEX_RESERVE (3 * TAR_BLOCK_SIZE)
+
+// Size of the buffer that headers and small members are gathered in.
+#define PECAN_WRITER_BUF_SIZE 65536
+
+// Archive writer structure definition.
+typedef struct {
+	int fd;
+	mtar_t tar;
+	unsigned int flags;
+
+	char *buf;
+	size_t buf_len;
+
+	cvector_vector_type(pecan_tarindex_entry_t) members;
+} pecan_writer_t;
+
+// Initialization
+PECAN_EXPORTS pecan_err_t pecan_writer_open(pecan_writer_t *w,
+											const char *fname,
+											unsigned int flags);
+
+// Members
+PECAN_EXPORTS pecan_err_t pecan_writer_add_attrs(pecan_writer_t *w,
+												 const char *name,
+												 pecan_attr_arr_t attribs);
+PECAN_EXPORTS pecan_err_t pecan_writer_add_data(pecan_writer_t *w,
+												const char *name,
+												const void *data, size_t len);
+PECAN_EXPORTS pecan_err_t pecan_writer_add_file(pecan_writer_t *w,
+												const char *name,
+												const char *fpath);
+PECAN_EXPORTS pecan_err_t pecan_writer_add_fd(pecan_writer_t *w,
+											  const char *name, int fd,
+											  size_t len);
+
+// Cleanup
+PECAN_EXPORTS pecan_err_t pecan_writer_close(pecan_writer_t *w);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WRITER_H */
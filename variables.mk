@@ -22,8 +22,9 @@ ifeq ($(PLATFORM), Darwin)
 endif
 
 # Flags
-CFLAGS  = -Wall -Wextra -pedantic
-LDFLAGS =
+CFLAGS  = -Wall -Wextra -pedantic -pthread
+LDFLAGS = -pthread
+LDLIBS  = -lm
 
 # Default toolkit for Linux.
 ifeq ($(PLATFORM), Linux)